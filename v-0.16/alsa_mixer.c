@@ -0,0 +1,490 @@
+/**
+ * @file alsa_mixer.c
+ * @brief Implementation of the direct ALSA mixer control path.
+ *
+ * The volume element is looked up by the names PulseAudio uses for its hardware
+ * volume (the first paths of its analog-output and analog-input mappings), then any
+ * active element with a volume in the right direction is taken. The mute switch is
+ * the switch of the volume element, or the first element of the same list having one.
+ */
+
+#include "alsa_mixer.h"
+#include "easypulse_log.h"
+#include "easypulse_metrics.h"
+#include <alsa/asoundlib.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ALSA_MIXER_MAX_POLL 16      // Poll descriptors handled by alsa_mixer_wait().
+
+struct alsa_mixer {
+    snd_mixer_t *handle;
+    bool output;                    // Playback elements (true) or capture elements (false).
+    snd_mixer_elem_t *volume;       // Element of the volume (NULL once removed).
+    snd_mixer_elem_t *mute;         // Element of the switch (NULL if there is none, or once removed).
+    long min;                       // Raw range of the volume element.
+    long max;
+    bool changed;                   // Set by the element callbacks during snd_mixer_handle_events().
+    alsa_mixer_callback callback;
+    void *userdata;
+};
+
+static const char *const output_elements[] = {"Master", "Speaker", "PCM", "Headphone", "Front", "Line Out", NULL};
+static const char *const input_elements[] = {"Capture", "Mic", "Internal Mic", "Front Mic", "Rear Mic", "Line", NULL};
+
+static bool has_volume(alsa_mixer *mixer, snd_mixer_elem_t *elem) {
+    return mixer->output ? snd_mixer_selem_has_playback_volume(elem) : snd_mixer_selem_has_capture_volume(elem);
+}
+
+static bool has_switch(alsa_mixer *mixer, snd_mixer_elem_t *elem) {
+    return mixer->output ? snd_mixer_selem_has_playback_switch(elem) : snd_mixer_selem_has_capture_switch(elem);
+}
+
+static bool has_channel(alsa_mixer *mixer, snd_mixer_elem_t *elem, snd_mixer_selem_channel_id_t channel) {
+    return mixer->output ? snd_mixer_selem_has_playback_channel(elem, channel)
+                         : snd_mixer_selem_has_capture_channel(elem, channel);
+}
+
+static snd_mixer_elem_t *find_element(alsa_mixer *mixer, const char *name) {
+    snd_mixer_selem_id_t *id;
+    snd_mixer_selem_id_alloca(&id);
+    snd_mixer_selem_id_set_index(id, 0);
+    snd_mixer_selem_id_set_name(id, name);
+
+    snd_mixer_elem_t *elem = snd_mixer_find_selem(mixer->handle, id);
+    return elem && snd_mixer_selem_is_active(elem) ? elem : NULL;
+}
+
+/**
+ * @brief Element callback: notes value changes and removals of the elements in use.
+ */
+static int element_event(snd_mixer_elem_t *elem, unsigned int mask) {
+    alsa_mixer *mixer = (alsa_mixer *) snd_mixer_elem_get_callback_private(elem);
+
+    if (mask == SND_CTL_EVENT_MASK_REMOVE) {
+        EASYPULSE_WARN("Mixer element %s was removed.", snd_mixer_selem_get_name(elem));
+        if (mixer->volume == elem) {
+            mixer->volume = NULL;
+        }
+        if (mixer->mute == elem) {
+            mixer->mute = NULL;
+        }
+        mixer->changed = true;
+        return 0;
+    }
+
+    if (mask & SND_CTL_EVENT_MASK_VALUE) {
+        mixer->changed = true;
+    }
+    return 0;
+}
+
+static void watch_element(alsa_mixer *mixer, snd_mixer_elem_t *elem) {
+    snd_mixer_elem_set_callback_private(elem, mixer);
+    snd_mixer_elem_set_callback(elem, element_event);
+}
+
+/**
+ * @brief Picks the volume and switch elements of the mixer.
+ *
+ * @return true if a volume element was found, false otherwise.
+ */
+static bool select_elements(alsa_mixer *mixer) {
+    const char *const *names = mixer->output ? output_elements : input_elements;
+
+    for (const char *const *name = names; *name && !mixer->volume; ++name) {
+        snd_mixer_elem_t *elem = find_element(mixer, *name);
+        if (elem && has_volume(mixer, elem)) {
+            mixer->volume = elem;
+        }
+    }
+    for (snd_mixer_elem_t *elem = snd_mixer_first_elem(mixer->handle); elem && !mixer->volume;
+         elem = snd_mixer_elem_next(elem)) {
+        if (snd_mixer_selem_is_active(elem) && has_volume(mixer, elem)) {
+            mixer->volume = elem;
+        }
+    }
+    if (!mixer->volume) {
+        return false;
+    }
+
+    if (has_switch(mixer, mixer->volume)) {
+        mixer->mute = mixer->volume;
+    }
+    for (const char *const *name = names; *name && !mixer->mute; ++name) {
+        snd_mixer_elem_t *elem = find_element(mixer, *name);
+        if (elem && has_switch(mixer, elem)) {
+            mixer->mute = elem;
+        }
+    }
+
+    if (mixer->output) {
+        snd_mixer_selem_get_playback_volume_range(mixer->volume, &mixer->min, &mixer->max);
+    } else {
+        snd_mixer_selem_get_capture_volume_range(mixer->volume, &mixer->min, &mixer->max);
+    }
+
+    watch_element(mixer, mixer->volume);
+    if (mixer->mute && mixer->mute != mixer->volume) {
+        watch_element(mixer, mixer->mute);
+    }
+    return true;
+}
+
+/**
+ * @brief Opens the mixer of the sound card of an ALSA device.
+ *
+ * @param alsa_id The ALSA device, as in pulseaudio_device.alsa_id ("hw:1,0"). The
+ * mixer is the one of its card ("hw:1").
+ * @param output true for the playback elements, false for the capture elements.
+ * @return The mixer, or NULL if the card has no suitable element or cannot be opened.
+ */
+alsa_mixer *alsa_mixer_open(const char *alsa_id, bool output) {
+    if (!alsa_id) {
+        EASYPULSE_ERROR("The device has no ALSA id.");
+        return NULL;
+    }
+
+    char card[64];
+    size_t length = strcspn(alsa_id, ",");
+    if (length >= sizeof(card)) {
+        EASYPULSE_ERROR("Invalid ALSA id %s.", alsa_id);
+        return NULL;
+    }
+    memcpy(card, alsa_id, length);
+    card[length] = '\0';
+
+    alsa_mixer *mixer = calloc(1, sizeof(alsa_mixer));
+    if (!mixer) {
+        EASYPULSE_ERROR("Failed to allocate memory for the mixer.");
+        return NULL;
+    }
+    mixer->output = output;
+
+    int err = snd_mixer_open(&mixer->handle, 0);
+    if (err < 0) {
+        EASYPULSE_ERROR("Unable to open a mixer: %s", snd_strerror(err));
+        free(mixer);
+        return NULL;
+    }
+
+    if ((err = snd_mixer_attach(mixer->handle, card)) < 0 ||
+        (err = snd_mixer_selem_register(mixer->handle, NULL, NULL)) < 0 ||
+        (err = snd_mixer_load(mixer->handle)) < 0) {
+        EASYPULSE_ERROR("Unable to load the mixer of %s: %s", card, snd_strerror(err));
+        alsa_mixer_close(mixer);
+        return NULL;
+    }
+
+    if (!select_elements(mixer)) {
+        EASYPULSE_ERROR("The mixer of %s has no %s volume.", card, output ? "playback" : "capture");
+        alsa_mixer_close(mixer);
+        return NULL;
+    }
+
+    EASYPULSE_DEBUG("Mixer of %s: volume %s, switch %s.", card, snd_mixer_selem_get_name(mixer->volume),
+                    mixer->mute ? snd_mixer_selem_get_name(mixer->mute) : "none");
+    return mixer;
+}
+
+/**
+ * @brief Opens the mixer of a device of the manager.
+ *
+ * @param device An output or input device of the manager.
+ * @param output true if the device is an output, false if it is an input.
+ * @return The mixer, or NULL if the device has no hardware mixer.
+ */
+alsa_mixer *alsa_mixer_open_device(const pulseaudio_device *device, bool output) {
+    if (!device) {
+        EASYPULSE_ERROR("Invalid arguments provided.");
+        return NULL;
+    }
+    return alsa_mixer_open(device->alsa_id, output);
+}
+
+/**
+ * @brief Closes a mixer.
+ *
+ * @param mixer The mixer (NULL is ignored).
+ */
+void alsa_mixer_close(alsa_mixer *mixer) {
+    if (!mixer) {
+        return;
+    }
+    snd_mixer_close(mixer->handle);
+    free(mixer);
+}
+
+/**
+ * @brief Returns the name of the volume element, or NULL once it was removed.
+ *
+ * @param mixer The mixer.
+ */
+const char *alsa_mixer_element_name(const alsa_mixer *mixer) {
+    return mixer && mixer->volume ? snd_mixer_selem_get_name(mixer->volume) : NULL;
+}
+
+static int read_volume(alsa_mixer *mixer, int *volume) {
+    long sum = 0;
+    int count = 0;
+
+    for (int channel = SND_MIXER_SCHN_FRONT_LEFT; channel <= SND_MIXER_SCHN_LAST; ++channel) {
+        snd_mixer_selem_channel_id_t id = (snd_mixer_selem_channel_id_t) channel;
+        if (!has_channel(mixer, mixer->volume, id)) {
+            continue;
+        }
+        long value;
+        int err = mixer->output ? snd_mixer_selem_get_playback_volume(mixer->volume, id, &value)
+                                : snd_mixer_selem_get_capture_volume(mixer->volume, id, &value);
+        if (err < 0) {
+            return err;
+        }
+        sum += value;
+        ++count;
+    }
+
+    if (count == 0 || mixer->max <= mixer->min) {
+        *volume = 0;
+        return 0;
+    }
+    long average = sum / count;
+    *volume = (int) (((average - mixer->min) * 100 + (mixer->max - mixer->min) / 2) / (mixer->max - mixer->min));
+    return 0;
+}
+
+static int read_mute(alsa_mixer *mixer, bool *mute) {
+    // A channel with its switch on is enough for the device to be heard
+    for (int channel = SND_MIXER_SCHN_FRONT_LEFT; channel <= SND_MIXER_SCHN_LAST; ++channel) {
+        snd_mixer_selem_channel_id_t id = (snd_mixer_selem_channel_id_t) channel;
+        if (!has_channel(mixer, mixer->mute, id)) {
+            continue;
+        }
+        int on;
+        int err = mixer->output ? snd_mixer_selem_get_playback_switch(mixer->mute, id, &on)
+                                : snd_mixer_selem_get_capture_switch(mixer->mute, id, &on);
+        if (err < 0) {
+            return err;
+        }
+        if (on) {
+            *mute = false;
+            return 0;
+        }
+    }
+    *mute = true;
+    return 0;
+}
+
+/**
+ * @brief Reads the volume of the device.
+ *
+ * @param mixer The mixer.
+ * @param volume Where to store the average volume of the channels (0-100).
+ * @return 0 on success, -1 on failure.
+ */
+int alsa_mixer_get_volume(alsa_mixer *mixer, int *volume) {
+    if (!mixer || !volume || !mixer->volume) {
+        EASYPULSE_ERROR("Invalid mixer or arguments.");
+        return -1;
+    }
+
+    int err = read_volume(mixer, volume);
+    if (err < 0) {
+        EASYPULSE_ERROR("Failed to read the volume: %s", snd_strerror(err));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Sets the volume of all the channels of the device.
+ *
+ * @param mixer The mixer.
+ * @param volume The volume (0-100).
+ * @return 0 on success, -1 on failure.
+ */
+int alsa_mixer_set_volume(alsa_mixer *mixer, int volume) {
+    metrics_call call = metrics_api_begin();
+
+    if (!mixer || !mixer->volume) {
+        EASYPULSE_ERROR("Invalid mixer.");
+        metrics_api_end(METRIC_API_ALSA_SET_VOLUME, call, false);
+        return -1;
+    }
+    if (volume < 0 || volume > 100) {
+        EASYPULSE_ERROR("The volume specified is out of range (0-100).");
+        metrics_api_end(METRIC_API_ALSA_SET_VOLUME, call, false);
+        return -1;
+    }
+
+    long value = mixer->min + ((mixer->max - mixer->min) * volume + 50) / 100;
+    int err = mixer->output ? snd_mixer_selem_set_playback_volume_all(mixer->volume, value)
+                            : snd_mixer_selem_set_capture_volume_all(mixer->volume, value);
+    if (err < 0) {
+        EASYPULSE_ERROR("Failed to set the volume: %s", snd_strerror(err));
+    }
+
+    metrics_api_end(METRIC_API_ALSA_SET_VOLUME, call, err >= 0);
+    return err < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Reads the mute state of the device.
+ *
+ * @param mixer The mixer.
+ * @param mute Where to store the state (true if every channel is switched off).
+ * @return 0 on success, -1 on failure or if the device has no switch.
+ */
+int alsa_mixer_get_mute(alsa_mixer *mixer, bool *mute) {
+    if (!mixer || !mute || !mixer->mute) {
+        EASYPULSE_ERROR("Invalid mixer or arguments, or the device has no switch.");
+        return -1;
+    }
+
+    int err = read_mute(mixer, mute);
+    if (err < 0) {
+        EASYPULSE_ERROR("Failed to read the switch: %s", snd_strerror(err));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Mutes or unmutes all the channels of the device.
+ *
+ * @param mixer The mixer.
+ * @param mute true to mute, false to unmute.
+ * @return 0 on success, -1 on failure or if the device has no switch.
+ */
+int alsa_mixer_set_mute(alsa_mixer *mixer, bool mute) {
+    metrics_call call = metrics_api_begin();
+
+    if (!mixer || !mixer->mute) {
+        EASYPULSE_ERROR("Invalid mixer, or the device has no switch.");
+        metrics_api_end(METRIC_API_ALSA_SET_MUTE, call, false);
+        return -1;
+    }
+
+    // The switch of an element is on when the sound goes through
+    int err = mixer->output ? snd_mixer_selem_set_playback_switch_all(mixer->mute, !mute)
+                            : snd_mixer_selem_set_capture_switch_all(mixer->mute, !mute);
+    if (err < 0) {
+        EASYPULSE_ERROR("Failed to set the switch: %s", snd_strerror(err));
+    }
+
+    metrics_api_end(METRIC_API_ALSA_SET_MUTE, call, err >= 0);
+    return err < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Sets the callback called by alsa_mixer_handle_events() on a change.
+ *
+ * @param mixer The mixer.
+ * @param callback The callback, NULL to remove it.
+ * @param userdata Passed to the callback.
+ */
+void alsa_mixer_set_callback(alsa_mixer *mixer, alsa_mixer_callback callback, void *userdata) {
+    if (!mixer) {
+        return;
+    }
+    mixer->callback = callback;
+    mixer->userdata = userdata;
+}
+
+/**
+ * @brief Fills poll descriptors that become readable when the mixer has events.
+ *
+ * @param mixer The mixer.
+ * @param pfds The descriptors to fill (NULL to only get the count).
+ * @param space Number of entries of pfds.
+ * @return The number of descriptors, or -1 on failure.
+ */
+int alsa_mixer_poll_descriptors(alsa_mixer *mixer, struct pollfd *pfds, unsigned int space) {
+    if (!mixer) {
+        return -1;
+    }
+
+    int count = snd_mixer_poll_descriptors_count(mixer->handle);
+    if (count < 0 || !pfds) {
+        return count < 0 ? -1 : count;
+    }
+    if ((unsigned int) count > space) {
+        EASYPULSE_ERROR("The mixer needs %d poll descriptors, %u given.", count, space);
+        return -1;
+    }
+
+    count = snd_mixer_poll_descriptors(mixer->handle, pfds, space);
+    return count < 0 ? -1 : count;
+}
+
+/**
+ * @brief Processes the events of the mixer after poll() returned.
+ *
+ * The callback is called once if the volume or the switch changed (or an element
+ * was removed, in which case the volume is reported as -1).
+ *
+ * @param mixer The mixer.
+ * @param pfds The descriptors given to poll().
+ * @param count Number of descriptors.
+ * @return 1 if something changed, 0 if not, -1 on failure.
+ */
+int alsa_mixer_handle_events(alsa_mixer *mixer, struct pollfd *pfds, unsigned int count) {
+    if (!mixer || !pfds) {
+        return -1;
+    }
+
+    unsigned short revents = 0;
+    if (snd_mixer_poll_descriptors_revents(mixer->handle, pfds, count, &revents) < 0) {
+        return -1;
+    }
+    if (revents & (POLLERR | POLLNVAL)) {
+        EASYPULSE_ERROR("The mixer was closed (device unplugged?).");
+        return -1;
+    }
+    if (!(revents & POLLIN)) {
+        return 0;
+    }
+
+    mixer->changed = false;
+    if (snd_mixer_handle_events(mixer->handle) < 0) {
+        return -1;
+    }
+    if (!mixer->changed) {
+        return 0;
+    }
+
+    if (mixer->callback) {
+        int volume = -1;
+        bool mute = false;
+        if (mixer->volume) {
+            read_volume(mixer, &volume);
+        }
+        if (mixer->mute) {
+            read_mute(mixer, &mute);
+        }
+        mixer->callback(mixer, volume, mute, mixer->userdata);
+    }
+    return 1;
+}
+
+/**
+ * @brief Waits for events of the mixer and processes them.
+ *
+ * @param mixer The mixer.
+ * @param timeout_ms The longest wait in milliseconds (-1 to wait forever).
+ * @return 1 if something changed, 0 if not (timeout), -1 on failure.
+ */
+int alsa_mixer_wait(alsa_mixer *mixer, int timeout_ms) {
+    struct pollfd pfds[ALSA_MIXER_MAX_POLL];
+
+    int count = alsa_mixer_poll_descriptors(mixer, pfds, ALSA_MIXER_MAX_POLL);
+    if (count < 0) {
+        return -1;
+    }
+
+    int ready = poll(pfds, (nfds_t) count, timeout_ms);
+    if (ready <= 0) {
+        return ready == 0 || errno == EINTR ? 0 : -1;
+    }
+    return alsa_mixer_handle_events(mixer, pfds, (unsigned int) count);
+}
@@ -0,0 +1,71 @@
+/**
+ * @file alsa_mixer.h
+ * @brief Direct control of the hardware mixer of a device, through the ALSA simple mixer.
+ *
+ * An alsa_mixer maps a device to the simple mixer elements of its sound card (the
+ * ones PulseAudio drives for its hardware volume, such as "Master" or "Capture") and
+ * reads and writes their volume and switch without going through the sound server.
+ * This is a fast path for appliances with hardware mixers: a call is a few ioctls on
+ * the control device, with no server round trip, and it keeps working when the server
+ * is busy or not running at all.
+ *
+ * The server is not told about the changes: PulseAudio notices them on its own mixer
+ * events and updates the sink or source, so the two stay in sync, but a change made
+ * here goes around the flat volume and the software volume of the server.
+ *
+ * Changes made by other programs (alsamixer, the server, hardware buttons) are
+ * reported through the poll descriptors of the mixer:
+ * @code
+ * alsa_mixer *mixer = alsa_mixer_open_device(&manager->outputs[0], true);
+ * alsa_mixer_set_callback(mixer, on_change, NULL);
+ * struct pollfd pfds[8];
+ * int count = alsa_mixer_poll_descriptors(mixer, pfds, 8);
+ * while (poll(pfds, count, -1) > 0) {
+ *     alsa_mixer_handle_events(mixer, pfds, count);
+ * }
+ * @endcode
+ *
+ * Volumes are percentages of the raw range of the element, like the "%" values of
+ * amixer. An alsa_mixer must only be used by one thread at a time.
+ */
+
+#ifndef ALSA_MIXER_H
+#define ALSA_MIXER_H
+
+#include "easypulse_core.h"
+#include <poll.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct alsa_mixer alsa_mixer;
+
+//Called by alsa_mixer_handle_events() when the volume or the switch changed.
+typedef void (*alsa_mixer_callback)(alsa_mixer *mixer, int volume, bool mute, void *userdata);
+
+alsa_mixer *alsa_mixer_open(const char *alsa_id, bool output);          //Opens the mixer of an ALSA device ("hw:1,0"). Returns NULL on failure.
+alsa_mixer *alsa_mixer_open_device(const pulseaudio_device *device,
+bool output);                                                           //Opens the mixer of a device through its alsa_id.
+void alsa_mixer_close(alsa_mixer *mixer);                               //Closes the mixer.
+
+const char *alsa_mixer_element_name(const alsa_mixer *mixer);           //Name of the volume element (e.g. "Master").
+int alsa_mixer_get_volume(alsa_mixer *mixer, int *volume);              //Reads the volume (0-100). Returns 0 or -1.
+int alsa_mixer_set_volume(alsa_mixer *mixer, int volume);               //Sets the volume of all channels (0-100). Returns 0 or -1.
+int alsa_mixer_get_mute(alsa_mixer *mixer, bool *mute);                 //Reads the mute state. Returns 0 or -1.
+int alsa_mixer_set_mute(alsa_mixer *mixer, bool mute);                  //Sets the mute state. Returns 0 or -1.
+
+void alsa_mixer_set_callback(alsa_mixer *mixer,
+alsa_mixer_callback callback, void *userdata);                          //Sets the change callback (NULL to remove it).
+int alsa_mixer_poll_descriptors(alsa_mixer *mixer,
+struct pollfd *pfds, unsigned int space);                               //Fills the poll descriptors. Returns their count, or -1.
+int alsa_mixer_handle_events(alsa_mixer *mixer,
+struct pollfd *pfds, unsigned int count);                               //Processes pending events after poll(). Returns 1 on a change, 0, or -1.
+int alsa_mixer_wait(alsa_mixer *mixer, int timeout_ms);                 //Waits for events and processes them. Returns 1 on a change, 0, or -1.
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,598 @@
+/**
+ * @file audio_stream.c
+ * @brief Playback and capture streams owned by the library, sized by named buffer profiles.
+ *
+ * See audio_stream.h. The streams live on the mainloop of the manager: every call locks
+ * it, and the blocking calls wait on it for the stream callbacks.
+ */
+
+#include "audio_stream.h"
+#include "easypulse_internal.h"
+#include "easypulse_log.h"
+#include "easypulse_metrics.h"
+#include <stdlib.h>
+#include <string.h>
+
+//Values of a profile, before the checks against the device.
+typedef struct stream_profile_spec {
+    const char *name;
+    pa_usec_t latency_usec;             // tlength for playback, fragsize for capture.
+    pa_usec_t request_usec;             // minreq for playback.
+    pa_stream_flags_t flags;
+} stream_profile_spec;
+
+static const stream_profile_spec stream_profiles[STREAM_PROFILE_COUNT] = {
+    [STREAM_PROFILE_ULTRA_LOW] = { "ultra-low", 5000, 1000, PA_STREAM_ADJUST_LATENCY },
+    [STREAM_PROFILE_INTERACTIVE] = { "interactive", 20000, 5000, PA_STREAM_ADJUST_LATENCY },
+    [STREAM_PROFILE_BULK] = { "bulk", 2000000, 500000, PA_STREAM_NOFLAGS },
+};
+
+struct audio_stream {
+    pulseaudio_manager *manager;
+    pa_stream *stream;
+    bool playback;
+    bool has_range;                     // The ranges of the device were probed.
+    pcm_buffer_range range;
+    pa_sample_spec spec;
+    stream_buffer_profile profile;
+    pa_stream_flags_t flags;            // Flags the stream was connected with.
+    pa_buffer_attr attr;                // Attributes granted by the server.
+    size_t fragment_offset;             // Bytes of the current capture fragment already read.
+    int operation;                      // Outcome of the operation waited for (-1 while in flight).
+};
+
+const char *stream_profile_name(stream_buffer_profile profile) {
+    return (unsigned) profile < STREAM_PROFILE_COUNT ? stream_profiles[profile].name : NULL;
+}
+
+int stream_profile_from_name(const char *name) {
+    if (!name) {
+        return -1;
+    }
+    for (int i = 0; i < STREAM_PROFILE_COUNT; ++i) {
+        if (strcmp(stream_profiles[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static pa_usec_t stream_clamp(pa_usec_t value, pa_usec_t min, pa_usec_t max) {
+    if (value < min) {
+        return min;
+    }
+    return max > 0 && value > max ? max : value;
+}
+
+/**
+ * @brief Computes the buffer attributes of a profile for a stream.
+ *
+ * The request is kept within the period range of the device, and the latency within
+ * its buffer range and at two requests at least, so that the server can refill a
+ * request while the other plays. Fields left to the server are (uint32_t) -1.
+ *
+ * @param profile The profile.
+ * @param playback Whether the stream is a playback stream.
+ * @param spec Sample format of the stream, to convert times to bytes.
+ * @param range Period and buffer ranges of the device, or NULL if unknown.
+ * @param result Where to store the attributes.
+ * @return true on success, false if the arguments are invalid.
+ */
+bool stream_profile_compute(stream_buffer_profile profile, bool playback, const pa_sample_spec *spec,
+                            const pcm_buffer_range *range, stream_profile_attr *result) {
+    if ((unsigned) profile >= STREAM_PROFILE_COUNT || !spec || !pa_sample_spec_valid(spec) || !result) {
+        return false;
+    }
+
+    const stream_profile_spec *values = &stream_profiles[profile];
+    pa_usec_t latency = values->latency_usec;
+    pa_usec_t request = values->request_usec;
+
+    if (range) {
+        request = stream_clamp(request, range->min_period_usec, range->max_period_usec);
+        latency = stream_clamp(latency, range->min_buffer_usec, range->max_buffer_usec);
+    }
+    if (latency < 2 * request) {
+        latency = 2 * request;
+    }
+
+    memset(result, 0, sizeof(stream_profile_attr));
+    memset(&result->attr, 0xff, sizeof(pa_buffer_attr));
+    if (playback) {
+        result->attr.tlength = (uint32_t) pa_usec_to_bytes(latency, spec);
+        result->attr.minreq = (uint32_t) pa_usec_to_bytes(request, spec);
+    } else {
+        result->attr.fragsize = (uint32_t) pa_usec_to_bytes(latency, spec);
+    }
+    result->flags = values->flags;
+    result->latency_usec = latency;
+    result->request_usec = request;
+    result->adjusted = latency != values->latency_usec || request != values->request_usec;
+    return true;
+}
+
+/**
+ * @brief Wakes up the callers waiting for the state, room or data of a stream.
+ */
+static void audio_stream_notify_cb(pa_stream *s, void *userdata) {
+    (void) s;
+
+    audio_stream *stream = (audio_stream *) userdata;
+    pa_threaded_mainloop_signal(stream->manager->mainloop, 0);
+}
+
+static void audio_stream_request_cb(pa_stream *s, size_t nbytes, void *userdata) {
+    (void) nbytes;
+
+    audio_stream_notify_cb(s, userdata);
+}
+
+/**
+ * @brief Keeps the granted attributes up to date when the server changes them (for
+ * instance when the stream is moved to another device).
+ */
+static void audio_stream_buffer_attr_cb(pa_stream *s, void *userdata) {
+    audio_stream *stream = (audio_stream *) userdata;
+    const pa_buffer_attr *attr = pa_stream_get_buffer_attr(s);
+    if (attr) {
+        stream->attr = *attr;
+    }
+}
+
+static void audio_stream_success_cb(pa_stream *s, int success, void *userdata) {
+    (void) s;
+
+    audio_stream *stream = (audio_stream *) userdata;
+    stream->operation = success ? 1 : 0;
+    pa_threaded_mainloop_signal(stream->manager->mainloop, 0);
+}
+
+/**
+ * @brief Waits for an operation of a stream. Mainloop locked.
+ *
+ * @return true if it succeeded.
+ */
+static bool audio_stream_wait_operation(audio_stream *stream, pa_operation *op, metric_id kind, uint64_t start) {
+    if (!op) {
+        metrics_op_end(kind, start, false);
+        return false;
+    }
+
+    while (stream->operation < 0 && pa_operation_get_state(op) == PA_OPERATION_RUNNING) {
+        manager_wait(stream->manager);
+    }
+    pa_operation_unref(op);
+
+    metrics_op_end(kind, start, stream->operation == 1);
+    metrics_round_trip();
+    return stream->operation == 1;
+}
+
+/**
+ * @brief Reads a size of the device.buffering properties of a device, in microseconds.
+ *
+ * @return true if the property is a size in bytes.
+ */
+static bool audio_stream_buffering_usec(const pa_proplist *proplist, const char *key, const pa_sample_spec *spec,
+                                        unsigned int *usec) {
+    const char *value = proplist ? pa_proplist_gets(proplist, key) : NULL;
+    if (!value || !pa_sample_spec_valid(spec)) {
+        return false;
+    }
+
+    char *end;
+    unsigned long long bytes = strtoull(value, &end, 10);
+    if (end == value || *end != '\0' || bytes == 0) {
+        return false;
+    }
+    *usec = (unsigned int) pa_bytes_to_usec(bytes, spec);
+    return *usec > 0;
+}
+
+/**
+ * @brief Takes the ranges of a stream from the buffer the server set up on its device.
+ *
+ * The server gives the buffer and fragment sizes it configured, not the limits of the
+ * hardware, so they only bound the profiles from above.
+ */
+static void audio_stream_range_from_device(audio_stream *stream, const pa_proplist *proplist,
+                                           const pa_sample_spec *spec) {
+    unsigned int buffer_usec, fragment_usec;
+    if (audio_stream_buffering_usec(proplist, PA_PROP_DEVICE_BUFFERING_BUFFER_SIZE, spec, &buffer_usec) &&
+        audio_stream_buffering_usec(proplist, PA_PROP_DEVICE_BUFFERING_FRAGMENT_SIZE, spec, &fragment_usec)) {
+        memset(&stream->range, 0, sizeof(pcm_buffer_range));
+        stream->range.max_period_usec = fragment_usec;
+        stream->range.max_buffer_usec = buffer_usec;
+        stream->has_range = true;
+    }
+}
+
+static void audio_stream_sink_info_cb(pa_context *c, const pa_sink_info *info, int eol, void *userdata) {
+    (void) c;
+
+    audio_stream *stream = (audio_stream *) userdata;
+    if (eol != 0) {
+        stream->operation = eol > 0 ? 1 : 0;
+        pa_threaded_mainloop_signal(stream->manager->mainloop, 0);
+        return;
+    }
+    audio_stream_range_from_device(stream, info->proplist, &info->sample_spec);
+}
+
+static void audio_stream_source_info_cb(pa_context *c, const pa_source_info *info, int eol, void *userdata) {
+    (void) c;
+
+    audio_stream *stream = (audio_stream *) userdata;
+    if (eol != 0) {
+        stream->operation = eol > 0 ? 1 : 0;
+        pa_threaded_mainloop_signal(stream->manager->mainloop, 0);
+        return;
+    }
+    audio_stream_range_from_device(stream, info->proplist, &info->sample_spec);
+}
+
+/**
+ * @brief Reads the ranges of a stream from the properties of its device. Mainloop locked.
+ */
+static void audio_stream_query_range(audio_stream *stream, const char *code) {
+    pa_context *context = stream->manager->context;
+    uint64_t start = metrics_op_begin();
+
+    stream->operation = -1;
+    if (stream->playback) {
+        audio_stream_wait_operation(stream, pa_context_get_sink_info_by_name(context, code, audio_stream_sink_info_cb,
+                                                                             stream),
+                                    METRIC_OP_GET_SINK_INFO, start);
+    } else {
+        audio_stream_wait_operation(stream, pa_context_get_source_info_by_name(context, code,
+                                                                               audio_stream_source_info_cb, stream),
+                                    METRIC_OP_GET_SOURCE_INFO, start);
+    }
+}
+
+/**
+ * @brief Whether the stream can still carry audio. Mainloop locked.
+ */
+static bool audio_stream_alive(const audio_stream *stream) {
+    return pa_stream_get_state(stream->stream) == PA_STREAM_READY;
+}
+
+static void audio_stream_free(audio_stream *stream) {
+    if (stream->stream) {
+        pa_stream_set_state_callback(stream->stream, NULL, NULL);
+        pa_stream_set_write_callback(stream->stream, NULL, NULL);
+        pa_stream_set_read_callback(stream->stream, NULL, NULL);
+        pa_stream_set_buffer_attr_callback(stream->stream, NULL, NULL);
+        if (pa_stream_get_state(stream->stream) == PA_STREAM_READY ||
+            pa_stream_get_state(stream->stream) == PA_STREAM_CREATING) {
+            pa_stream_disconnect(stream->stream);
+        }
+        pa_stream_unref(stream->stream);
+    }
+    free(stream);
+}
+
+static audio_stream *audio_stream_open_impl(pulseaudio_manager *manager, bool playback,
+                                            const pulseaudio_device *device, const char *name,
+                                            const pa_sample_spec *spec, stream_buffer_profile profile) {
+    if (!manager || !manager->context || !spec) {
+        EASYPULSE_ERROR("Invalid PulseAudio manager or sample format.");
+        return NULL;
+    }
+
+    audio_stream *stream = calloc(1, sizeof(audio_stream));
+    if (!stream) {
+        EASYPULSE_ERROR("Failed to allocate memory for the stream.");
+        return NULL;
+    }
+    stream->manager = manager;
+    stream->playback = playback;
+    stream->spec = *spec;
+    stream->profile = profile;
+
+    if (device && device->code) {
+        manager_lock(manager);
+        audio_stream_query_range(stream, device->code);
+        manager_unlock(manager);
+    }
+
+    // ALSA can only probe the device while the server does not hold it, so it is the
+    // fallback for the devices without buffering properties. Probed without the lock:
+    // opening the ALSA device may take a while
+    if (!stream->has_range && device && device->alsa_id) {
+        stream->has_range = playback ? get_output_buffer_range(device->alsa_id, &stream->range)
+                                     : get_input_buffer_range(device->alsa_id, &stream->range);
+    }
+
+    stream_profile_attr computed;
+    if (!stream_profile_compute(profile, playback, spec, stream->has_range ? &stream->range : NULL, &computed)) {
+        EASYPULSE_ERROR("Invalid buffer profile or sample format.");
+        free(stream);
+        return NULL;
+    }
+    if (computed.adjusted) {
+        EASYPULSE_WARN("Buffer profile %s adjusted to the device: latency %llu us, request %llu us.",
+                       stream_profile_name(profile), (unsigned long long) computed.latency_usec,
+                       (unsigned long long) computed.request_usec);
+    }
+    stream->flags = computed.flags;
+
+    manager_lock(manager);
+
+    stream->stream = pa_stream_new(manager->context, name ? name : "easypulse stream", spec, NULL);
+    if (!stream->stream) {
+        manager_unlock(manager);
+        EASYPULSE_ERROR("Failed to create the stream.");
+        free(stream);
+        return NULL;
+    }
+    pa_stream_set_state_callback(stream->stream, audio_stream_notify_cb, stream);
+    pa_stream_set_buffer_attr_callback(stream->stream, audio_stream_buffer_attr_cb, stream);
+    if (playback) {
+        pa_stream_set_write_callback(stream->stream, audio_stream_request_cb, stream);
+    } else {
+        pa_stream_set_read_callback(stream->stream, audio_stream_request_cb, stream);
+    }
+
+    const char *target = device ? device->code : NULL;
+    int connected = playback ? pa_stream_connect_playback(stream->stream, target, &computed.attr, computed.flags, NULL, NULL)
+                             : pa_stream_connect_record(stream->stream, target, &computed.attr, computed.flags);
+
+    pa_stream_state_t state = PA_STREAM_FAILED;
+    if (connected == 0) {
+        while ((state = pa_stream_get_state(stream->stream)) == PA_STREAM_CREATING ||
+               state == PA_STREAM_UNCONNECTED) {
+            manager_wait(manager);
+        }
+        metrics_round_trip();
+    }
+
+    if (state != PA_STREAM_READY) {
+        EASYPULSE_ERROR("Failed to connect the stream: %s", pa_strerror(pa_context_errno(manager->context)));
+        audio_stream_free(stream);
+        manager_unlock(manager);
+        return NULL;
+    }
+
+    audio_stream_buffer_attr_cb(stream->stream, stream);
+    manager_unlock(manager);
+    return stream;
+}
+
+/**
+ * @brief Opens a playback or capture stream with a buffer profile.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param playback true for a playback stream, false for a capture stream.
+ * @param device The device to connect to, NULL for the default one. Its buffering
+ *        properties, or else its ALSA device, give the period and buffer ranges.
+ * @param name Name of the stream, NULL for a default one.
+ * @param spec Sample format of the stream.
+ * @param profile The buffer profile.
+ * @return The stream, to be closed with audio_stream_close(), or NULL on failure.
+ */
+audio_stream *audio_stream_open(pulseaudio_manager *manager, bool playback, const pulseaudio_device *device,
+                                const char *name, const pa_sample_spec *spec, stream_buffer_profile profile) {
+    metrics_call call = metrics_api_begin();
+    audio_stream *stream = audio_stream_open_impl(manager, playback, device, name, spec, profile);
+    metrics_api_end(METRIC_API_STREAM_OPEN, call, stream != NULL);
+    return stream;
+}
+
+static bool audio_stream_set_profile_impl(audio_stream *stream, stream_buffer_profile profile) {
+    if (!stream) {
+        return false;
+    }
+
+    stream_profile_attr computed;
+    if (!stream_profile_compute(profile, stream->playback, &stream->spec,
+                                stream->has_range ? &stream->range : NULL, &computed)) {
+        EASYPULSE_ERROR("Invalid buffer profile.");
+        return false;
+    }
+
+    manager_lock(stream->manager);
+
+    bool ok = false;
+    if (audio_stream_alive(stream)) {
+        uint64_t start = metrics_op_begin();
+        stream->operation = -1;
+        ok = audio_stream_wait_operation(stream, pa_stream_set_buffer_attr(stream->stream, &computed.attr,
+                                                                           audio_stream_success_cb, stream),
+                                         METRIC_OP_SET_BUFFER_ATTR, start);
+    }
+    if (ok) {
+        stream->profile = profile;
+        audio_stream_buffer_attr_cb(stream->stream, stream);
+    }
+
+    manager_unlock(stream->manager);
+
+    if (!ok) {
+        EASYPULSE_ERROR("Failed to switch the stream to the %s buffer profile.", stream_profile_name(profile));
+    }
+    return ok;
+}
+
+/**
+ * @brief Switches a connected stream to another buffer profile.
+ *
+ * The stream stays connected and keeps playing; the server applies the new attributes
+ * from the next request on.
+ *
+ * @param stream The stream.
+ * @param profile The new profile.
+ * @return true if the server accepted the new attributes, false otherwise.
+ */
+bool audio_stream_set_profile(audio_stream *stream, stream_buffer_profile profile) {
+    metrics_call call = metrics_api_begin();
+    bool result = audio_stream_set_profile_impl(stream, profile);
+    metrics_api_end(METRIC_API_STREAM_SET_PROFILE, call, result);
+    return result;
+}
+
+/**
+ * @brief Writes playback data, waiting for room in the buffer as needed.
+ *
+ * @param stream A playback stream.
+ * @param data The data, in the sample format of the stream.
+ * @param length Number of bytes (a multiple of the frame size).
+ * @return true if all the data was written, false if the stream failed.
+ */
+bool audio_stream_write(audio_stream *stream, const void *data, size_t length) {
+    if (!stream || !stream->playback || (length > 0 && !data)) {
+        return false;
+    }
+
+    const uint8_t *bytes = (const uint8_t *) data;
+    bool ok = true;
+
+    manager_lock(stream->manager);
+
+    while (length > 0) {
+        if (!audio_stream_alive(stream)) {
+            ok = false;
+            break;
+        }
+
+        size_t room = pa_stream_writable_size(stream->stream);
+        if (room == 0 || room == (size_t) -1) {
+            manager_wait(stream->manager);
+            continue;
+        }
+
+        size_t chunk = length < room ? length : room;
+        if (pa_stream_write(stream->stream, bytes, chunk, NULL, 0, PA_SEEK_RELATIVE) < 0) {
+            ok = false;
+            break;
+        }
+        bytes += chunk;
+        length -= chunk;
+    }
+
+    manager_unlock(stream->manager);
+    return ok;
+}
+
+/**
+ * @brief Reads capture data, waiting for it as needed.
+ *
+ * Holes in the capture (data dropped by the server) are skipped.
+ *
+ * @param stream A capture stream.
+ * @param data Where to store the data.
+ * @param length Number of bytes to read.
+ * @return The number of bytes read (length, or less if the stream ended), or -1 if
+ *         the stream failed before anything was read.
+ */
+ssize_t audio_stream_read(audio_stream *stream, void *data, size_t length) {
+    if (!stream || stream->playback || (length > 0 && !data)) {
+        return -1;
+    }
+
+    uint8_t *bytes = (uint8_t *) data;
+    size_t done = 0;
+    bool failed = false;
+
+    manager_lock(stream->manager);
+
+    while (done < length) {
+        if (!audio_stream_alive(stream)) {
+            failed = true;
+            break;
+        }
+        if (pa_stream_readable_size(stream->stream) == 0) {
+            manager_wait(stream->manager);
+            continue;
+        }
+
+        const void *fragment;
+        size_t size;
+        if (pa_stream_peek(stream->stream, &fragment, &size) < 0) {
+            failed = true;
+            break;
+        }
+        if (size == 0) {
+            continue;
+        }
+
+        // A fragment is dropped once it was read completely
+        size_t chunk = 0;
+        if (fragment) {
+            chunk = size - stream->fragment_offset;
+            if (chunk > length - done) {
+                chunk = length - done;
+            }
+            memcpy(bytes + done, (const uint8_t *) fragment + stream->fragment_offset, chunk);
+            done += chunk;
+        }
+        stream->fragment_offset += fragment ? chunk : size;
+        if (stream->fragment_offset >= size) {
+            pa_stream_drop(stream->stream);
+            stream->fragment_offset = 0;
+        }
+    }
+
+    manager_unlock(stream->manager);
+    return failed && done == 0 ? -1 : (ssize_t) done;
+}
+
+/**
+ * @brief Waits until the playback data written so far was played.
+ *
+ * @param stream A playback stream.
+ * @return true on success, false otherwise.
+ */
+bool audio_stream_drain(audio_stream *stream) {
+    if (!stream || !stream->playback) {
+        return false;
+    }
+
+    manager_lock(stream->manager);
+
+    bool ok = false;
+    if (audio_stream_alive(stream)) {
+        stream->operation = -1;
+        ok = audio_stream_wait_operation(stream, pa_stream_drain(stream->stream, audio_stream_success_cb, stream),
+                                         METRIC_OP_DRAIN, metrics_op_begin());
+    }
+
+    manager_unlock(stream->manager);
+    return ok;
+}
+
+const pa_buffer_attr *audio_stream_buffer_attr(const audio_stream *stream) {
+    return stream ? &stream->attr : NULL;
+}
+
+stream_buffer_profile audio_stream_profile(const audio_stream *stream) {
+    return stream ? stream->profile : STREAM_PROFILE_COUNT;
+}
+
+uint32_t audio_stream_index(const audio_stream *stream) {
+    if (!stream) {
+        return PA_INVALID_INDEX;
+    }
+
+    manager_lock(stream->manager);
+    uint32_t index = pa_stream_get_index(stream->stream);
+    manager_unlock(stream->manager);
+    return index;
+}
+
+/**
+ * @brief Disconnects a stream and frees it. Playback data not yet played is dropped,
+ * call audio_stream_drain() first to play it.
+ *
+ * @param stream The stream (NULL is ignored).
+ */
+void audio_stream_close(audio_stream *stream) {
+    if (!stream) {
+        return;
+    }
+
+    pulseaudio_manager *manager = stream->manager;
+    manager_lock(manager);
+    audio_stream_free(stream);
+    manager_unlock(manager);
+}
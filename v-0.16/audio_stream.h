@@ -0,0 +1,91 @@
+/**
+ * @file audio_stream.h
+ * @brief Playback and capture streams owned by the library, sized by named buffer profiles.
+ *
+ * A buffer profile trades CPU wakeups for latency:
+ *
+ *     profile       latency   request   flags
+ *     ultra-low       5 ms      1 ms    PA_STREAM_ADJUST_LATENCY
+ *     interactive    20 ms      5 ms    PA_STREAM_ADJUST_LATENCY
+ *     bulk            2 s     500 ms    none (the device keeps its own latency)
+ *
+ * For playback the latency is the target buffer length (tlength) and the request the
+ * size the server asks for at a time (minreq); for capture the latency is the fragment
+ * size (fragsize). With PA_STREAM_ADJUST_LATENCY the server also sets the latency of the
+ * device so that the whole path meets the target.
+ *
+ * The values are checked against the period and buffer ranges of the device: the
+ * request is kept within the period range, and the latency within the buffer range and
+ * above two requests, so a profile stays within what the device can do. The
+ * ranges come from the device.buffering.buffer_size and device.buffering.fragment_size
+ * properties of the sink or source, which bound them from above. For a device without
+ * them, ALSA probes the hardware limits (see get_output_buffer_range()), which only
+ * works while the server does not hold the device. The server may still round the
+ * values: audio_stream_buffer_attr() gives what it granted.
+ *
+ * audio_stream_set_profile() renegotiates a connected stream with
+ * pa_stream_set_buffer_attr(), without reconnecting it. The flags stay those of the
+ * profile the stream was opened with.
+ *
+ * audio_stream_write() and audio_stream_read() block until the whole buffer is written
+ * or read, so they must not be called from the mainloop thread (event callbacks).
+ */
+
+#ifndef AUDIO_STREAM_H
+#define AUDIO_STREAM_H
+
+#include "easypulse_core.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//Named buffer profiles.
+typedef enum stream_buffer_profile {
+    STREAM_PROFILE_ULTRA_LOW,           // Lowest latency, most wakeups (live monitoring, instruments).
+    STREAM_PROFILE_INTERACTIVE,         // Latency below a video frame (games, calls, UI sounds).
+    STREAM_PROFILE_BULK,                // Few wakeups, high latency (music, recordings).
+    STREAM_PROFILE_COUNT
+} stream_buffer_profile;
+
+//Buffer attributes computed for a profile.
+typedef struct stream_profile_attr {
+    pa_buffer_attr attr;                // Attributes to ask the server for.
+    pa_stream_flags_t flags;            // Connection flags.
+    pa_usec_t latency_usec;             // Latency asked for, after the checks.
+    pa_usec_t request_usec;             // Request size, after the checks.
+    bool adjusted;                      // The device ranges changed the values of the profile.
+} stream_profile_attr;
+
+typedef struct audio_stream audio_stream;
+
+const char *stream_profile_name(stream_buffer_profile profile);      //Name of a profile ("ultra-low", "interactive", "bulk").
+int stream_profile_from_name(const char *name);                      //Profile of a name, or -1 if unknown.
+bool stream_profile_compute(stream_buffer_profile profile,
+bool playback, const pa_sample_spec *spec,
+const pcm_buffer_range *range, stream_profile_attr *result);         //Buffer attributes of a profile (range may be NULL).
+
+audio_stream *audio_stream_open(pulseaudio_manager *manager,
+bool playback, const pulseaudio_device *device, const char *name,
+const pa_sample_spec *spec, stream_buffer_profile profile);          //Connects a stream (device NULL for the default). Returns NULL on failure.
+bool audio_stream_set_profile(audio_stream *stream,
+stream_buffer_profile profile);                                      //Renegotiates the buffer attributes of a connected stream.
+bool audio_stream_write(audio_stream *stream,
+const void *data, size_t length);                                    //Writes playback data, waiting for room.
+ssize_t audio_stream_read(audio_stream *stream,
+void *data, size_t length);                                          //Reads capture data, waiting for it. Returns the bytes read or -1.
+bool audio_stream_drain(audio_stream *stream);                       //Waits until the playback data was played.
+const pa_buffer_attr *audio_stream_buffer_attr(
+const audio_stream *stream);                                         //Buffer attributes granted by the server.
+stream_buffer_profile audio_stream_profile(const audio_stream *stream);  //Current profile of a stream.
+uint32_t audio_stream_index(const audio_stream *stream);             //Index of the sink input or source output.
+void audio_stream_close(audio_stream *stream);                       //Disconnects and frees a stream.
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,482 @@
+/**
+ * @file batch_script.c
+ * @brief Implementation of the scripts of mixer operations.
+ *
+ * A script is run in three steps: every line is parsed and its devices resolved
+ * against the devices of the manager, the volumes of the devices whose volume changes
+ * are read in one batch, then every operation is sent in a second batch. Volume
+ * changes and channel mutes of a device are computed from the volume left by the
+ * previous operations of the script, so that the server, executing them in order,
+ * ends in the same state as if they had been run one at a time.
+ */
+
+#include "batch_script.h"
+#include "control.h"
+#include "easypulse_internal.h"
+#include "easypulse_log.h"
+#include "easypulse_metrics.h"
+#include "op_batch.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum script_op_kind {
+    SCRIPT_OP_VOLUME,
+    SCRIPT_OP_MUTE,
+    SCRIPT_OP_CHANNEL_MUTE,
+    SCRIPT_OP_DEFAULT,
+    SCRIPT_OP_MOVE,
+    SCRIPT_OP_PORT
+} script_op_kind;
+
+//Volume of a device changed by the script.
+typedef struct script_volume {
+    bool output;
+    uint32_t index;             // Index of the device.
+    bool known;                 // The volume was read from the server.
+    pa_cvolume volume;          // Volume after the operations sent so far.
+    op_batch *batch;            // Batch of the read.
+} script_volume;
+
+//An operation of a script.
+typedef struct script_op {
+    bool valid;                 // The line was parsed and its devices found.
+    script_op_kind kind;
+    bool output;                // Outputs (sink, sink input) or inputs (source, source output).
+    const pulseaudio_device *device;
+    uint32_t stream;            // Stream moved by SCRIPT_OP_MOVE.
+    int value;                  // Volume percentage, or mute state.
+    uint32_t channel;           // Channel of SCRIPT_OP_CHANNEL_MUTE.
+    const char *port;           // Port of SCRIPT_OP_PORT (points into the copy of the line).
+    char *line;                 // Copy of the line the words point into.
+    script_volume *volume;      // Volume of the device for SCRIPT_OP_VOLUME and SCRIPT_OP_CHANNEL_MUTE.
+    script_result *result;
+    op_batch *batch;            // Batch the operation was sent in.
+} script_op;
+
+/**
+ * @brief Splits a line into words, in place.
+ *
+ * @return The number of words, -1 if there are too many, -2 if a quote is not closed.
+ */
+static int script_split(char *line, char **words) {
+    int count = 0;
+    char *p = line;
+
+    while (true) {
+        while (isspace((unsigned char) *p)) {
+            ++p;
+        }
+        if (*p == '\0') {
+            return count;
+        }
+        if (count == SCRIPT_MAX_WORDS) {
+            return -1;
+        }
+
+        if (*p == '"') {
+            words[count++] = ++p;
+            char *quote = strchr(p, '"');
+            if (!quote) {
+                return -2;
+            }
+            *quote = '\0';
+            p = quote + 1;
+        } else {
+            words[count++] = p;
+            while (*p && !isspace((unsigned char) *p)) {
+                ++p;
+            }
+            if (*p) {
+                *p++ = '\0';
+            }
+        }
+    }
+}
+
+static bool script_number(const char *text, uint32_t max, uint32_t *value) {
+    if (!*text || strlen(text) > 10) {
+        return false;
+    }
+    for (const char *c = text; *c; ++c) {
+        if (!isdigit((unsigned char) *c)) {
+            return false;
+        }
+    }
+    unsigned long long number = strtoull(text, NULL, 10);
+    if (number > max) {
+        return false;
+    }
+    *value = (uint32_t) number;
+    return true;
+}
+
+/**
+ * @brief Finds the device of an operation.
+ *
+ * @return true if found, false otherwise (with the message set).
+ */
+static bool script_device(pulseaudio_manager *manager, script_op *op, const char *reference, char *message) {
+    const pulseaudio_device *devices = op->output ? manager->outputs : manager->inputs;
+    uint32_t count = op->output ? manager->output_count : manager->input_count;
+
+    int position = control_find_device(devices, count, reference);
+    if (position < 0) {
+        snprintf(message, SCRIPT_MESSAGE_SIZE, "no %s %s", op->output ? "output" : "input", reference);
+        return false;
+    }
+    op->device = &devices[position];
+    return true;
+}
+
+static bool script_direction(const char *word, script_op *op, char *message) {
+    if (strcmp(word, "output") == 0 || strcmp(word, "input") == 0) {
+        op->output = word[0] == 'o';
+        return true;
+    }
+    snprintf(message, SCRIPT_MESSAGE_SIZE, "expected output or input, got %s", word);
+    return false;
+}
+
+static bool script_state(const char *word, int *state, char *message) {
+    if (strcmp(word, "on") == 0 || strcmp(word, "off") == 0) {
+        *state = strcmp(word, "on") == 0;
+        return true;
+    }
+    snprintf(message, SCRIPT_MESSAGE_SIZE, "expected on or off, got %s", word);
+    return false;
+}
+
+/**
+ * @brief Parses the words of an operation and resolves its devices.
+ *
+ * @return true if the operation can be sent, false otherwise (with the message set).
+ */
+static bool script_parse(pulseaudio_manager *manager, char **words, int count, script_op *op, char *message) {
+    const char *command = words[0];
+    uint32_t value;
+
+    if (strcmp(command, "volume") == 0 && count == 4) {
+        op->kind = SCRIPT_OP_VOLUME;
+        if (!script_direction(words[1], op, message) || !script_device(manager, op, words[2], message)) {
+            return false;
+        }
+        if (!script_number(words[3], 100, &value)) {
+            snprintf(message, SCRIPT_MESSAGE_SIZE, "invalid volume %s", words[3]);
+            return false;
+        }
+        op->value = (int) value;
+        return true;
+    }
+
+    if (strcmp(command, "mute") == 0 && (count == 4 || (count == 6 && strcmp(words[3], "channel") == 0))) {
+        op->kind = count == 4 ? SCRIPT_OP_MUTE : SCRIPT_OP_CHANNEL_MUTE;
+        if (!script_direction(words[1], op, message) || !script_device(manager, op, words[2], message) ||
+            !script_state(words[count - 1], &op->value, message)) {
+            return false;
+        }
+        if (count == 6 && !script_number(words[4], PA_CHANNELS_MAX - 1, &op->channel)) {
+            snprintf(message, SCRIPT_MESSAGE_SIZE, "invalid channel %s", words[4]);
+            return false;
+        }
+        return true;
+    }
+
+    if (strcmp(command, "default") == 0 && count == 3) {
+        op->kind = SCRIPT_OP_DEFAULT;
+        return script_direction(words[1], op, message) && script_device(manager, op, words[2], message);
+    }
+
+    if (strcmp(command, "move") == 0 && count == 4 &&
+        (strcmp(words[1], "sink-input") == 0 || strcmp(words[1], "source-output") == 0)) {
+        op->kind = SCRIPT_OP_MOVE;
+        op->output = strcmp(words[1], "sink-input") == 0;
+        if (!script_number(words[2], UINT32_MAX - 1, &op->stream)) {
+            snprintf(message, SCRIPT_MESSAGE_SIZE, "invalid stream index %s", words[2]);
+            return false;
+        }
+        return script_device(manager, op, words[3], message);
+    }
+
+    if (strcmp(command, "port") == 0 && count == 4) {
+        op->kind = SCRIPT_OP_PORT;
+        op->port = words[3];
+        return script_direction(words[1], op, message) && script_device(manager, op, words[2], message);
+    }
+
+    snprintf(message, SCRIPT_MESSAGE_SIZE, "unknown operation or wrong arguments: %s", command);
+    return false;
+}
+
+/**
+ * @brief Returns the volume record of a device, adding it if needed.
+ */
+static script_volume *script_volume_of(script_volume *volumes, uint32_t *count, bool output, uint32_t index) {
+    for (uint32_t i = 0; i < *count; ++i) {
+        if (volumes[i].output == output && volumes[i].index == index) {
+            return &volumes[i];
+        }
+    }
+    script_volume *volume = &volumes[(*count)++];
+    *volume = (script_volume) { .output = output, .index = index };
+    return volume;
+}
+
+static void script_sink_volume_cb(pa_context *c, const pa_sink_info *info, int eol, void *userdata) {
+    (void) c;
+    script_volume *volume = (script_volume *) userdata;
+
+    if (info) {
+        volume->volume = info->volume;
+        volume->known = true;
+    }
+    if (eol != 0) {
+        op_batch_complete(volume->batch, eol > 0 && volume->known);
+    }
+}
+
+static void script_source_volume_cb(pa_context *c, const pa_source_info *info, int eol, void *userdata) {
+    (void) c;
+    script_volume *volume = (script_volume *) userdata;
+
+    if (info) {
+        volume->volume = info->volume;
+        volume->known = true;
+    }
+    if (eol != 0) {
+        op_batch_complete(volume->batch, eol > 0 && volume->known);
+    }
+}
+
+static void script_op_cb(pa_context *c, int success, void *userdata) {
+    script_op *op = (script_op *) userdata;
+
+    op->result->success = success != 0;
+    if (!success) {
+        snprintf(op->result->message, SCRIPT_MESSAGE_SIZE, "%s", pa_strerror(pa_context_errno(c)));
+    }
+    op_batch_complete(op->batch, success != 0);
+}
+
+/**
+ * @brief Sends an operation of the script. Mainloop locked.
+ */
+static void script_send(pulseaudio_manager *manager, script_op *op) {
+    pa_context *c = manager->context;
+    uint32_t index = op->device->index;
+    pa_operation *o = NULL;
+
+    switch (op->kind) {
+        case SCRIPT_OP_VOLUME:
+        case SCRIPT_OP_CHANNEL_MUTE: {
+            pa_cvolume *volume = &op->volume->volume;
+            if (!op->volume->known) {
+                snprintf(op->result->message, SCRIPT_MESSAGE_SIZE, "cannot read the volume of the device");
+                return;
+            }
+            if (op->kind == SCRIPT_OP_VOLUME) {
+                pa_cvolume_set(volume, volume->channels, (pa_volume_t) ((double) op->value / 100.0 * PA_VOLUME_NORM));
+            } else if (op->channel < volume->channels) {
+                // As manager_set_output_mute_state(): a muted channel has no volume
+                volume->values[op->channel] = op->value ? PA_VOLUME_MUTED : pa_cvolume_max(volume);
+            } else {
+                snprintf(op->result->message, SCRIPT_MESSAGE_SIZE, "the device has no channel %u", op->channel);
+                return;
+            }
+            o = op->output ? pa_context_set_sink_volume_by_index(c, index, volume, script_op_cb, op)
+                           : pa_context_set_source_volume_by_index(c, index, volume, script_op_cb, op);
+            break;
+        }
+        case SCRIPT_OP_MUTE:
+            o = op->output ? pa_context_set_sink_mute_by_index(c, index, op->value, script_op_cb, op)
+                           : pa_context_set_source_mute_by_index(c, index, op->value, script_op_cb, op);
+            break;
+        case SCRIPT_OP_DEFAULT:
+            o = op->output ? pa_context_set_default_sink(c, op->device->code, script_op_cb, op)
+                           : pa_context_set_default_source(c, op->device->code, script_op_cb, op);
+            break;
+        case SCRIPT_OP_MOVE:
+            o = op->output ? pa_context_move_sink_input_by_index(c, op->stream, index, script_op_cb, op)
+                           : pa_context_move_source_output_by_index(c, op->stream, index, script_op_cb, op);
+            break;
+        case SCRIPT_OP_PORT:
+            o = op->output ? pa_context_set_sink_port_by_index(c, index, op->port, script_op_cb, op)
+                           : pa_context_set_source_port_by_index(c, index, op->port, script_op_cb, op);
+            break;
+    }
+
+    if (!op_batch_add(op->batch, o)) {
+        snprintf(op->result->message, SCRIPT_MESSAGE_SIZE, "cannot send the operation: %s",
+                 pa_strerror(pa_context_errno(c)));
+    }
+}
+
+/**
+ * @brief Reads the volumes, then sends the operations, in two batches.
+ */
+static void script_execute(pulseaudio_manager *manager, script_op *ops, uint32_t count, script_volume *volumes,
+                           uint32_t volume_count) {
+    manager_lock(manager);
+
+    if (volume_count > 0) {
+        op_batch reads;
+        op_batch_init(&reads, manager->mainloop, METRIC_OP_BATCH);
+        for (uint32_t i = 0; i < volume_count; ++i) {
+            volumes[i].batch = &reads;
+            op_batch_add(&reads, volumes[i].output
+                ? pa_context_get_sink_info_by_index(manager->context, volumes[i].index, script_sink_volume_cb, &volumes[i])
+                : pa_context_get_source_info_by_index(manager->context, volumes[i].index, script_source_volume_cb,
+                                                      &volumes[i]));
+        }
+        op_batch_wait(&reads);
+    }
+
+    op_batch writes;
+    op_batch_init(&writes, manager->mainloop, METRIC_OP_BATCH);
+    for (uint32_t i = 0; i < count; ++i) {
+        if (ops[i].valid) {
+            ops[i].batch = &writes;
+            script_send(manager, &ops[i]);
+        }
+    }
+    op_batch_wait(&writes);
+
+    manager_unlock(manager);
+}
+
+/**
+ * @brief Frees a report.
+ *
+ * @param report The report (NULL is ignored).
+ */
+void script_report_free(script_report *report) {
+    if (!report) {
+        return;
+    }
+    free(report->results);
+    free(report);
+}
+
+static script_report *script_run_impl(pulseaudio_manager *manager, const char *script, size_t length) {
+    if (!manager || !manager->context || !script) {
+        EASYPULSE_ERROR("Invalid PulseAudio manager or script.");
+        return NULL;
+    }
+
+    // Every line may be an operation
+    uint32_t lines = 1;
+    for (size_t i = 0; i < length; ++i) {
+        lines += script[i] == '\n';
+    }
+
+    script_report *report = calloc(1, sizeof(script_report));
+    script_op *ops = calloc(lines, sizeof(script_op));
+    script_volume *volumes = calloc(lines, sizeof(script_volume));
+    if (report) {
+        report->results = calloc(lines, sizeof(script_result));
+    }
+    if (!report || !report->results || !ops || !volumes) {
+        EASYPULSE_ERROR("Failed to allocate memory for the script.");
+        script_report_free(report);
+        free(ops);
+        free(volumes);
+        return NULL;
+    }
+
+    uint32_t volume_count = 0;
+    const char *start = script;
+    const char *end = script + length;
+    for (uint32_t line = 1; start < end; ++line) {
+        const char *newline = memchr(start, '\n', (size_t) (end - start));
+        size_t size = (size_t) ((newline ? newline : end) - start);
+
+        char *text = strndup(start, size);
+        start += size + 1;
+        if (!text) {
+            EASYPULSE_ERROR("Failed to allocate memory for the script.");
+            break;
+        }
+
+        char *words[SCRIPT_MAX_WORDS];
+        int count = script_split(text, words);
+        if (count == 0 || (count > 0 && words[0][0] == '#')) {
+            free(text);
+            continue;
+        }
+
+        script_op *op = &ops[report->count];
+        op->line = text;
+        op->result = &report->results[report->count++];
+        op->result->line = line;
+
+        if (count < 0) {
+            snprintf(op->result->message, SCRIPT_MESSAGE_SIZE, count == -1 ? "too many words" : "unclosed quote");
+            continue;
+        }
+        op->valid = script_parse(manager, words, count, op, op->result->message);
+        if (op->valid && (op->kind == SCRIPT_OP_VOLUME || op->kind == SCRIPT_OP_CHANNEL_MUTE)) {
+            op->volume = script_volume_of(volumes, &volume_count, op->output, op->device->index);
+        }
+    }
+
+    script_execute(manager, ops, report->count, volumes, volume_count);
+
+    for (uint32_t i = 0; i < report->count; ++i) {
+        report->failed += !report->results[i].success;
+        free(ops[i].line);
+    }
+    free(ops);
+    free(volumes);
+    return report;
+}
+
+/**
+ * @brief Executes a script (see batch_script.h).
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param script The text of the script.
+ * @param length Length of the text.
+ * @return The outcome of every operation, to be freed with script_report_free(), or
+ *         NULL if the script could not run at all.
+ */
+script_report *script_run(pulseaudio_manager *manager, const char *script, size_t length) {
+    metrics_call call = metrics_api_begin();
+    script_report *report = script_run_impl(manager, script, length);
+    metrics_api_end(METRIC_API_RUN_SCRIPT, call, report && report->failed == 0);
+    return report;
+}
+
+/**
+ * @brief Executes a script read from a file.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param file The file, read until its end.
+ * @return As script_run().
+ */
+script_report *script_run_file(pulseaudio_manager *manager, FILE *file) {
+    size_t length = 0;
+    size_t capacity = 65536;
+    char *script = malloc(capacity);
+
+    while (script) {
+        length += fread(script + length, 1, capacity - length, file);
+        if (length < capacity) {
+            break;
+        }
+        capacity *= 2;
+        char *larger = realloc(script, capacity);
+        if (!larger) {
+            free(script);
+        }
+        script = larger;
+    }
+    if (!script || ferror(file)) {
+        EASYPULSE_ERROR("Failed to read the script.");
+        free(script);
+        return NULL;
+    }
+
+    script_report *report = script_run(manager, script, length);
+    free(script);
+    return report;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file batch_script.h
+ * @brief Scripts of mixer operations executed as one pipelined batch.
+ *
+ * A script is a text with one operation per line. Words are separated by spaces, a
+ * word containing spaces is written between double quotes. Blank lines and lines
+ * starting with '#' are ignored.
+ *
+ *     volume output|input <device> <0-100>
+ *     mute output|input <device> on|off
+ *     mute output|input <device> channel <n> on|off
+ *     default output|input <device>
+ *     move sink-input <stream index> <output>
+ *     move source-output <stream index> <input>
+ *     port output|input <device> <port name>
+ *
+ * Devices are referenced as in control.h: index, stable id ("@" and 16 hexadecimal
+ * digits, see manager_device_stable_id()), code or name.
+ *
+ * Every operation of the script is sent to the server before any reply is waited
+ * for, so a script costs two round trips (one reading the volumes that channel mutes
+ * and volume changes start from, one for the changes) whatever its length. The
+ * server executes the operations in the order of the script. A line that cannot be
+ * parsed or refers to an unknown device fails without stopping the others.
+ */
+
+#ifndef BATCH_SCRIPT_H
+#define BATCH_SCRIPT_H
+
+#include "easypulse_core.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SCRIPT_MAX_WORDS 8              // Words of an operation.
+#define SCRIPT_MESSAGE_SIZE 128         // Size of the error message of a line.
+
+//Outcome of one operation of a script.
+typedef struct script_result {
+    uint32_t line;                      // Line of the operation in the script (from 1).
+    bool success;                       // Whether the server executed the operation.
+    char message[SCRIPT_MESSAGE_SIZE];  // Why the operation failed (empty on success).
+} script_result;
+
+//Outcome of a script.
+typedef struct script_report {
+    script_result *results;             // One per operation, in the order of the script.
+    uint32_t count;                     // Number of operations.
+    uint32_t failed;                    // Operations that failed.
+} script_report;
+
+script_report *script_run(pulseaudio_manager *manager,
+const char *script, size_t length);                                 //Executes a script. Returns NULL if it could not run at all.
+
+script_report *script_run_file(pulseaudio_manager *manager,
+FILE *file);                                                        //Executes a script read from a file.
+
+void script_report_free(script_report *report);                     //Frees a report.
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,270 @@
+/**
+ * @file event_replay.c
+ * @brief Replay driver for event logs recorded by manager_start_recording().
+ *
+ * This program creates a manager, loads the given routing rules and feeds an event
+ * log through its event handling several times at full speed, with
+ * manager_replay_events(). The duration of every pass is measured and the results
+ * (records per second, duration percentiles, streams routed) are written as JSON, so
+ * that the processing of an event storm can be compared across commits.
+ *
+ * A log is recorded on a live system by setting EASYPULSE_RECORD=<path> for any
+ * program using the library. Built with EASYPULSE_BENCH_MOCK defined, the program runs
+ * against the mock server of mock/pulse_mock.c and -g records a synthetic storm first:
+ * a USB hub reset, where every device behind the hub disappears with its streams and
+ * comes back, and the applications reopen their streams.
+ *
+ * Usage: event_replay [-n passes] [-r key=value:sink ...] [-c] [-o file.json]
+ *                     [-l label] [-g streams per device] log
+ */
+
+#include "../easypulse_core.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef EASYPULSE_BENCH_MOCK
+#include "../mock/pulse_mock.h"
+#define BENCH_BACKEND "mock"
+#else
+#define BENCH_BACKEND "pulseaudio"
+#endif
+
+#define REPLAY_MAX_RULES 16         // Routing rules accepted on the command line.
+#define REPLAY_HUB_DEVICES 4        // Devices behind the hub of the synthetic storm.
+
+static void count_event(pulseaudio_manager *manager, pa_subscription_event_type_t event, uint32_t index,
+                        void *userdata) {
+    (void) manager;
+    (void) event;
+    (void) index;
+
+    ++*(uint64_t *) userdata;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Parses a routing rule given as key=value:sink.
+ *
+ * @param text The rule, modified in place.
+ * @param condition Where to store the condition (pointing into text).
+ * @param target Where to store the code of the target sink (pointing into text).
+ * @return true if the rule is well formed, false otherwise.
+ */
+static bool parse_rule(char *text, route_condition *condition, const char **target) {
+    char *equal = strchr(text, '=');
+    char *colon = strrchr(text, ':');
+    if (!equal || !colon || colon < equal) {
+        return false;
+    }
+
+    *equal = '\0';
+    *colon = '\0';
+    condition->key = text;
+    condition->type = ROUTE_MATCH_EXACT;
+    condition->pattern = equal + 1;
+    *target = colon + 1;
+    return true;
+}
+
+#ifdef EASYPULSE_BENCH_MOCK
+/**
+ * @brief Records a USB hub reset on the mock server.
+ *
+ * The devices behind the hub are created with their streams, then the recording
+ * starts: the devices are unplugged (their streams fall back to the default sink and
+ * are closed by their applications), plugged back in, and the streams are reopened.
+ *
+ * @param manager The manager recording the events.
+ * @param path Path of the log.
+ * @param streams Streams playing on every device.
+ * @return true if the log was written, false otherwise.
+ */
+static bool record_hub_reset(pulseaudio_manager *manager, const char *path, uint32_t streams) {
+    static const char *const roles[] = {"music", "phone", "video", "game"};
+    uint32_t sinks[REPLAY_HUB_DEVICES];
+    uint32_t *inputs = malloc((size_t) REPLAY_HUB_DEVICES * streams * sizeof(uint32_t));
+    char name[64];
+    char application[64];
+
+    if (!inputs) {
+        return false;
+    }
+
+    for (uint32_t d = 0; d < REPLAY_HUB_DEVICES; ++d) {
+        snprintf(name, sizeof(name), "usb_hub_device_%u", d);
+        sinks[d] = mock_add_sink(name, name, PA_INVALID_INDEX, 2, 48000);
+        for (uint32_t s = 0; s < streams; ++s) {
+            snprintf(application, sizeof(application), "Application %u", s);
+            inputs[d * streams + s] = mock_add_sink_input(application, roles[s % 4], sinks[d], false);
+        }
+    }
+
+    if (!manager_start_recording(manager, path)) {
+        free(inputs);
+        return false;
+    }
+
+    for (uint32_t d = 0; d < REPLAY_HUB_DEVICES; ++d) {
+        mock_remove_sink(sinks[d]);
+    }
+    for (uint32_t i = 0; i < REPLAY_HUB_DEVICES * streams; ++i) {
+        mock_remove_sink_input(inputs[i]);
+    }
+    for (uint32_t d = 0; d < REPLAY_HUB_DEVICES; ++d) {
+        snprintf(name, sizeof(name), "usb_hub_device_%u", d);
+        sinks[d] = mock_add_sink(name, name, PA_INVALID_INDEX, 2, 48000);
+        for (uint32_t s = 0; s < streams; ++s) {
+            snprintf(application, sizeof(application), "Application %u", s);
+            mock_add_sink_input(application, roles[s % 4], sinks[d], false);
+        }
+    }
+
+    // Events and the replies to the stream queries are delivered by the mainloop thread
+    usleep(200000);
+    free(inputs);
+    return manager_stop_recording(manager);
+}
+#endif
+
+int main(int argc, char *argv[]) {
+    uint32_t passes = 100;
+    route_condition conditions[REPLAY_MAX_RULES];
+    const char *targets[REPLAY_MAX_RULES];
+    uint32_t rule_count = 0;
+    bool callback = false;
+    const char *output = "event_replay.json";
+    const char *label = "";
+    uint32_t generate = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:co:l:g:")) != -1) {
+        switch (opt) {
+            case 'n':
+                passes = (uint32_t) strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                if (rule_count == REPLAY_MAX_RULES || !parse_rule(optarg, &conditions[rule_count], &targets[rule_count])) {
+                    fprintf(stderr, "Invalid routing rule (expected key=value:sink, at most %d).\n", REPLAY_MAX_RULES);
+                    return 1;
+                }
+                ++rule_count;
+                break;
+            case 'c':
+                callback = true;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'l':
+                label = optarg;
+                break;
+            case 'g':
+                generate = (uint32_t) strtoul(optarg, NULL, 10);
+                break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    }
+    if (optind != argc - 1 || passes == 0) {
+        fprintf(stderr, "Usage: %s [-n passes] [-r key=value:sink ...] [-c] [-o file.json] [-l label] "
+                "[-g streams per device] log\n", argv[0]);
+        return 1;
+    }
+    const char *log_path = argv[optind];
+
+#ifdef EASYPULSE_BENCH_MOCK
+    mock_add_default_devices();
+#endif
+
+    pulseaudio_manager *manager = manager_create();
+    uint64_t *samples = malloc(passes * sizeof(uint64_t));
+    if (!manager || !samples) {
+        fprintf(stderr, "Failed to initialize the replay.\n");
+        if (manager) {
+            manager_cleanup(manager);
+        }
+        free(samples);
+        return 1;
+    }
+
+    if (generate > 0) {
+#ifdef EASYPULSE_BENCH_MOCK
+        if (!record_hub_reset(manager, log_path, generate)) {
+            fprintf(stderr, "Failed to record the synthetic storm.\n");
+            manager_cleanup(manager);
+            free(samples);
+            return 1;
+        }
+#else
+        fprintf(stderr, "-g needs the mock server, ignored.\n");
+#endif
+    }
+
+    for (uint32_t i = 0; i < rule_count; ++i) {
+        manager_add_routing_rule(manager, &conditions[i], 1, targets[i]);
+    }
+
+    uint64_t callbacks = 0;
+    if (callback) {
+        manager_set_event_callback(manager, count_event, &callbacks);
+    }
+
+    event_replay_stats stats = {0};
+    uint64_t total_ns = 0;
+    bool ok = true;
+    for (uint32_t i = 0; i < passes && ok; ++i) {
+        ok = manager_replay_events(manager, log_path, &stats);
+        samples[i] = stats.elapsed_ns;
+        total_ns += stats.elapsed_ns;
+    }
+    manager_cleanup(manager);
+
+    if (!ok) {
+        fprintf(stderr, "Failed to replay %s.\n", log_path);
+        free(samples);
+        return 1;
+    }
+
+    FILE *out = fopen(output, "w");
+    if (!out) {
+        fprintf(stderr, "Cannot open %s for writing.\n", output);
+        free(samples);
+        return 1;
+    }
+
+    qsort(samples, passes, sizeof(uint64_t), compare_u64);
+    uint64_t records = stats.events + stats.sink_inputs;
+    double mean_ns = (double) total_ns / passes;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"benchmark\": \"event_replay\",\n");
+    fprintf(out, "  \"backend\": \"%s\",\n", BENCH_BACKEND);
+    fprintf(out, "  \"label\": \"%s\",\n", label);
+    fprintf(out, "  \"passes\": %u,\n", passes);
+    fprintf(out, "  \"rules\": %u,\n", rule_count);
+    fprintf(out, "  \"event_callback\": %s,\n", callback ? "true" : "false");
+    fprintf(out, "  \"events\": %llu,\n", (unsigned long long) stats.events);
+    fprintf(out, "  \"sink_inputs\": %llu,\n", (unsigned long long) stats.sink_inputs);
+    fprintf(out, "  \"routed\": %llu,\n", (unsigned long long) stats.routed);
+    fprintf(out, "  \"callbacks\": %llu,\n", (unsigned long long) callbacks);
+    fprintf(out, "  \"recorded_ms\": %.3f,\n", (double) stats.recorded_usec / 1e3);
+    fprintf(out, "  \"records_per_sec\": %.1f,\n", mean_ns > 0 ? (double) records * 1e9 / mean_ns : 0.0);
+    fprintf(out, "  \"mean_us\": %.3f,\n", mean_ns / 1e3);
+    fprintf(out, "  \"min_us\": %.3f,\n", (double) samples[0] / 1e3);
+    fprintf(out, "  \"p50_us\": %.3f,\n", (double) samples[passes / 2] / 1e3);
+    fprintf(out, "  \"p99_us\": %.3f,\n", (double) samples[(passes - 1) * 99 / 100] / 1e3);
+    fprintf(out, "  \"max_us\": %.3f\n", (double) samples[passes - 1] / 1e3);
+    fprintf(out, "}\n");
+    fclose(out);
+
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,501 @@
+/**
+ * @file json_bench.c
+ * @brief Benchmark of the JSON serialization of the mixer state.
+ *
+ * For every stream count, this program builds a synthetic state in memory (the
+ * devices of a few sound cards with their channels and profiles, and that many
+ * playback streams with a typical proplist) and serializes it a fixed number of times:
+ *
+ * - "json_writer_buffer": json_writer_manager() into a buffer;
+ * - "json_writer_fd": json_writer_manager() to /dev/null through a 4 KiB buffer;
+ * - "printf": the hand-written approach json_writer replaces, fprintf() on an
+ *   open_memstream() with an allocated copy of every escaped string.
+ *
+ * No server is needed. The results (time per serialization, throughput, bytes, and
+ * allocations per serialization for the printf baseline) are written as JSON.
+ *
+ * Usage: json_bench [-n iterations] [-s streams,...] [-o file.json] [-l label]
+ */
+
+#include "../easypulse_core.h"
+#include "../json_writer.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MAX_COUNTS 8          // Stream counts accepted on the command line.
+#define BENCH_DEVICES 8             // Outputs and inputs of the synthetic state.
+#define BENCH_CHANNELS 8            // Channels of every device.
+#define BENCH_PROFILES 4            // Profiles of every device.
+#define BENCH_FD_BUFFER 4096
+
+//Serializations measured.
+typedef enum bench_method {
+    BENCH_JSON_BUFFER,
+    BENCH_JSON_FD,
+    BENCH_PRINTF,
+    BENCH_METHOD_COUNT
+} bench_method;
+
+static const char *const bench_method_names[BENCH_METHOD_COUNT] = {
+    "json_writer_buffer", "json_writer_fd", "printf",
+};
+
+//Proplist keys exported for the streams.
+static const char *const bench_keys[] = {
+    PA_PROP_APPLICATION_NAME, PA_PROP_APPLICATION_PROCESS_BINARY, PA_PROP_MEDIA_NAME, PA_PROP_MEDIA_ROLE,
+};
+#define BENCH_KEY_COUNT (sizeof(bench_keys) / sizeof(bench_keys[0]))
+
+//Measurements of one method for one stream count.
+typedef struct bench_result {
+    bench_method method;
+    uint32_t streams;
+    uint32_t iterations;
+    uint64_t bytes;                 // Size of one serialization.
+    uint64_t allocations;           // Allocations of one serialization (printf baseline).
+    uint64_t total_ns;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+} bench_result;
+
+static uint64_t allocation_count;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void fill_device(pulseaudio_device *device, uint32_t index, const char *kind) {
+    char text[128];
+    memset(device, 0, sizeof(pulseaudio_device));
+    device->index = index;
+    snprintf(text, sizeof(text), "alsa_%s.pci-0000_00_1f.%u.analog-surround-71", kind, index);
+    device->code = strdup(text);
+    snprintf(text, sizeof(text), "Built-in Audio \"Analog\" Surround 7.1 (%u)", index);
+    device->name = strdup(text);
+    snprintf(text, sizeof(text), "hw:%u,0", index);
+    device->alsa_id = strdup(text);
+    device->sample_rate = 48000;
+    device->master_volume = 65;
+    device->min_channels = 2;
+    device->max_channels = BENCH_CHANNELS;
+    device->owner_module = PA_INVALID_INDEX;
+    device->channel_volume = calloc(BENCH_CHANNELS, sizeof(int));
+    for (int i = 0; i < BENCH_CHANNELS; ++i) {
+        pa_channel_position_t position = (pa_channel_position_t) (PA_CHANNEL_POSITION_FRONT_LEFT + i);
+        device->channel_names[i] = channel_position_name(position);
+        device->channel_volume[i] = 60 + i;
+    }
+    device->profiles = calloc(BENCH_PROFILES, sizeof(pa_card_profile_info));
+    device->profile_count = BENCH_PROFILES;
+    for (uint32_t i = 0; i < BENCH_PROFILES; ++i) {
+        snprintf(text, sizeof(text), "output:analog-surround-%u+input:analog-stereo", 21 + i * 10);
+        device->profiles[i].name = strdup(text);
+        snprintf(text, sizeof(text), "Analog Surround %u.1 Output + Analog Stereo Input", 2 + i * 2);
+        device->profiles[i].description = strdup(text);
+        device->profiles[i].n_sinks = 1;
+        device->profiles[i].n_sources = 1;
+        device->profiles[i].priority = 100 * i;
+    }
+    device->active_profile = &device->profiles[BENCH_PROFILES - 1];
+}
+
+static void free_device(pulseaudio_device *device) {
+    for (uint32_t i = 0; i < BENCH_PROFILES; ++i) {
+        free((char *) device->profiles[i].name);
+        free((char *) device->profiles[i].description);
+    }
+    free(device->channel_volume);
+    free(device->profiles);
+    free(device->code);
+    free(device->name);
+    free(device->alsa_id);
+}
+
+static void fill_stream(output_stream_info *stream, uint32_t index) {
+    char text[128];
+    memset(stream, 0, sizeof(output_stream_info));
+    stream->index = index;
+    stream->owner_module = PA_INVALID_INDEX;
+    stream->parent_index = index % BENCH_DEVICES;
+    stream->sample_spec = (pa_sample_spec) { .format = PA_SAMPLE_FLOAT32LE, .rate = 48000, .channels = 2 };
+    pa_cvolume_set(&stream->volume, 2, PA_VOLUME_NORM / 2);
+    stream->name = strdup("Playback Stream");
+    stream->driver = strdup("protocol-native.c");
+
+    stream->proplist = pa_proplist_new();
+    snprintf(text, sizeof(text), "Player %u", index);
+    pa_proplist_sets(stream->proplist, PA_PROP_APPLICATION_NAME, text);
+    pa_proplist_sets(stream->proplist, PA_PROP_APPLICATION_PROCESS_BINARY, "player");
+    snprintf(text, sizeof(text), "Track %u - \"Live\"\tRemastered", index);
+    pa_proplist_sets(stream->proplist, PA_PROP_MEDIA_NAME, text);
+    pa_proplist_sets(stream->proplist, PA_PROP_MEDIA_ROLE, index % 4 ? "music" : "phone");
+    pa_proplist_sets(stream->proplist, PA_PROP_APPLICATION_PROCESS_ID, "4242");
+    pa_proplist_sets(stream->proplist, PA_PROP_WINDOW_X11_DISPLAY, ":0");
+}
+
+/**
+ * @brief Escapes a string into a new allocation, as exporters usually do.
+ */
+static char *printf_escape(const char *text) {
+    char *escaped = malloc(strlen(text) * 6 + 1);
+    allocation_count++;
+    char *p = escaped;
+    for (; *text; ++text) {
+        unsigned char c = (unsigned char) *text;
+        if (c == '"' || c == '\\') {
+            *p++ = '\\';
+            *p++ = (char) c;
+        } else if (c < 0x20) {
+            p += sprintf(p, "\\u%04x", c);
+        } else {
+            *p++ = (char) c;
+        }
+    }
+    *p = '\0';
+    return escaped;
+}
+
+static void printf_string(FILE *out, const char *key, const char *value, const char *separator) {
+    if (!value) {
+        fprintf(out, "\"%s\":null%s", key, separator);
+        return;
+    }
+    char *escaped = printf_escape(value);
+    fprintf(out, "\"%s\":\"%s\"%s", key, escaped, separator);
+    free(escaped);
+}
+
+static void printf_device(FILE *out, const pulseaudio_device *device) {
+    fputc('{', out);
+    fprintf(out, "\"index\":%u,", device->index);
+    printf_string(out, "code", device->code, ",");
+    printf_string(out, "name", device->name, ",");
+    printf_string(out, "alsa_id", device->alsa_id, ",");
+    fprintf(out, "\"sample_rate\":%d,\"volume\":%d,\"mute\":%s,\"min_channels\":%d,\"max_channels\":%d,"
+            "\"owner_module\":null,\"channels\":[", device->sample_rate, device->master_volume,
+            device->mute ? "true" : "false", device->min_channels, device->max_channels);
+    for (int i = 0; i < device->max_channels; ++i) {
+        fprintf(out, "%s{", i ? "," : "");
+        printf_string(out, "name", device->channel_names[i], ",");
+        fprintf(out, "\"volume\":%d}", device->channel_volume[i]);
+    }
+    fputs("],", out);
+    printf_string(out, "active_profile", device->active_profile->name, ",\"profiles\":[");
+    for (uint32_t i = 0; i < device->profile_count; ++i) {
+        fprintf(out, "%s{", i ? "," : "");
+        printf_string(out, "name", device->profiles[i].name, ",");
+        printf_string(out, "description", device->profiles[i].description, ",");
+        fprintf(out, "\"sinks\":%u,\"sources\":%u,\"priority\":%u}", device->profiles[i].n_sinks,
+                device->profiles[i].n_sources, device->profiles[i].priority);
+    }
+    fputs("]}", out);
+}
+
+/**
+ * @brief The hand-written serialization json_writer replaces.
+ *
+ * @return The size of the JSON.
+ */
+static size_t serialize_printf(const pulseaudio_manager *manager, const output_stream_list *streams) {
+    char *text = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&text, &size);
+    allocation_count++;
+
+    fputc('{', out);
+    printf_string(out, "default_output", manager->active_output_device, ",");
+    printf_string(out, "default_input", manager->active_input_device, ",\"outputs\":[");
+    for (uint32_t i = 0; i < manager->output_count; ++i) {
+        fputs(i ? "," : "", out);
+        printf_device(out, &manager->outputs[i]);
+    }
+    fputs("],\"inputs\":[", out);
+    for (uint32_t i = 0; i < manager->input_count; ++i) {
+        fputs(i ? "," : "", out);
+        printf_device(out, &manager->inputs[i]);
+    }
+    fputs("],\"sink_inputs\":[", out);
+    for (uint32_t i = 0; i < streams->num_inputs; ++i) {
+        const output_stream_info *stream = &streams->inputs[i];
+        fprintf(out, "%s{\"index\":%u,\"sink\":%u,\"owner_module\":null,", i ? "," : "", stream->index,
+                stream->parent_index);
+        printf_string(out, "name", stream->name, ",");
+        printf_string(out, "driver", stream->driver, ",");
+        fprintf(out, "\"sample_rate\":%u,\"channels\":%u,\"volume\":[", stream->sample_spec.rate,
+                stream->sample_spec.channels);
+        for (uint8_t c = 0; c < stream->volume.channels; ++c) {
+            fprintf(out, "%s%llu", c ? "," : "", (unsigned long long)
+                    (((uint64_t) stream->volume.values[c] * 100 + PA_VOLUME_NORM / 2) / PA_VOLUME_NORM));
+        }
+        fputs("],\"properties\":{", out);
+        bool first = true;
+        for (size_t k = 0; k < BENCH_KEY_COUNT; ++k) {
+            const char *value = pa_proplist_gets(stream->proplist, bench_keys[k]);
+            if (value) {
+                fputs(first ? "" : ",", out);
+                printf_string(out, bench_keys[k], value, "");
+                first = false;
+            }
+        }
+        fputs("}}", out);
+    }
+    fputs("]}", out);
+    fclose(out);
+
+    free(text);
+    return size;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Returns a percentile of sorted samples (nearest rank).
+ */
+static uint64_t percentile(const uint64_t *sorted, uint32_t count, double p) {
+    uint32_t rank = (uint32_t) (p / 100.0 * count + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    return sorted[(rank > count ? count : rank) - 1];
+}
+
+/**
+ * @brief Serializes the state once with a method.
+ *
+ * @return The size of the JSON, 0 on failure.
+ */
+static size_t serialize(bench_method method, const pulseaudio_manager *manager, const output_stream_list *streams,
+                        char *buffer, size_t capacity, int null_fd) {
+    json_writer writer;
+    switch (method) {
+        case BENCH_JSON_BUFFER:
+            json_writer_init_buffer(&writer, buffer, capacity);
+            break;
+        case BENCH_JSON_FD:
+            json_writer_init_fd(&writer, null_fd, buffer, BENCH_FD_BUFFER);
+            break;
+        default:
+            return serialize_printf(manager, streams);
+    }
+    json_writer_manager(&writer, manager, streams, NULL, bench_keys, BENCH_KEY_COUNT);
+    return json_writer_finish(&writer) ? writer.total : 0;
+}
+
+static bool measure(bench_method method, const pulseaudio_manager *manager, const output_stream_list *streams,
+                    uint32_t iterations, uint64_t *samples, bench_result *result) {
+    // A writer on a buffer too small still counts the bytes: it sizes the real buffer
+    char probe[1];
+    json_writer writer;
+    json_writer_init_buffer(&writer, probe, sizeof(probe));
+    json_writer_manager(&writer, manager, streams, NULL, bench_keys, BENCH_KEY_COUNT);
+    json_writer_finish(&writer);
+
+    size_t capacity = writer.total + 1 > BENCH_FD_BUFFER ? writer.total + 1 : BENCH_FD_BUFFER;
+    char *buffer = malloc(capacity);
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (!buffer || null_fd < 0) {
+        free(buffer);
+        if (null_fd >= 0) {
+            close(null_fd);
+        }
+        return false;
+    }
+
+    memset(result, 0, sizeof(bench_result));
+    result->method = method;
+    result->streams = streams->num_inputs;
+    result->iterations = iterations;
+
+    bool ok = true;
+    for (uint32_t i = 0; i < iterations && ok; ++i) {
+        allocation_count = 0;
+        uint64_t start = now_ns();
+        size_t bytes = serialize(method, manager, streams, buffer, capacity, null_fd);
+        samples[i] = now_ns() - start;
+        result->total_ns += samples[i];
+        result->bytes = bytes;
+        result->allocations = allocation_count;
+        ok = bytes > 0;
+    }
+    free(buffer);
+    close(null_fd);
+
+    qsort(samples, iterations, sizeof(uint64_t), compare_u64);
+    result->p50_ns = percentile(samples, iterations, 50);
+    result->p99_ns = percentile(samples, iterations, 99);
+    return ok;
+}
+
+/**
+ * @brief Writes the results as JSON, with the writer being measured.
+ */
+static bool write_results(int fd, const char *label, const bench_result *results, uint32_t count) {
+    char buffer[BENCH_FD_BUFFER];
+    json_writer writer;
+    json_writer_init_fd(&writer, fd, buffer, sizeof(buffer));
+
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "benchmark");
+    json_writer_string(&writer, "json");
+    json_writer_key(&writer, "label");
+    json_writer_string(&writer, label);
+    json_writer_key(&writer, "results");
+    json_writer_begin_array(&writer);
+    for (uint32_t i = 0; i < count; ++i) {
+        const bench_result *r = &results[i];
+        double mean_ns = (double) r->total_ns / r->iterations;
+        json_writer_begin_object(&writer);
+        json_writer_key(&writer, "method");
+        json_writer_string(&writer, bench_method_names[r->method]);
+        json_writer_key(&writer, "streams");
+        json_writer_uint(&writer, r->streams);
+        json_writer_key(&writer, "iterations");
+        json_writer_uint(&writer, r->iterations);
+        json_writer_key(&writer, "bytes");
+        json_writer_uint(&writer, r->bytes);
+        json_writer_key(&writer, "allocations");
+        json_writer_uint(&writer, r->allocations);
+        json_writer_key(&writer, "mean_us");
+        json_writer_double(&writer, mean_ns / 1000.0);
+        json_writer_key(&writer, "p50_us");
+        json_writer_double(&writer, (double) r->p50_ns / 1000.0);
+        json_writer_key(&writer, "p99_us");
+        json_writer_double(&writer, (double) r->p99_ns / 1000.0);
+        json_writer_key(&writer, "mb_per_sec");
+        json_writer_double(&writer, mean_ns > 0.0 ? (double) r->bytes / mean_ns * 1000.0 : 0.0);
+        json_writer_end_object(&writer);
+    }
+    json_writer_end_array(&writer);
+    json_writer_end_object(&writer);
+    return json_writer_finish(&writer) && write(fd, "\n", 1) == 1;
+}
+
+/**
+ * @brief Parses a comma separated list of counts.
+ *
+ * @return The number of counts, or 0 if the list is invalid.
+ */
+static uint32_t parse_counts(const char *list, uint32_t *counts) {
+    uint32_t n = 0;
+    const char *p = list;
+    while (*p && n < BENCH_MAX_COUNTS) {
+        char *end;
+        unsigned long value = strtoul(p, &end, 10);
+        if (end == p || value == 0 || value > 100000) {
+            return 0;
+        }
+        counts[n++] = (uint32_t) value;
+        p = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',') {
+            return 0;
+        }
+    }
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t iterations = 200;
+    uint32_t streams[BENCH_MAX_COUNTS] = {1, 100, 1000};
+    uint32_t stream_counts = 3;
+    const char *output = "json_bench.json";
+    const char *label = "";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:o:l:")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = (uint32_t) strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                stream_counts = parse_counts(optarg, streams);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'l':
+                label = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n iterations] [-s streams,...] [-o file.json] [-l label]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (iterations == 0 || stream_counts == 0) {
+        fprintf(stderr, "Invalid iteration or stream count.\n");
+        return 1;
+    }
+
+    // The manager only holds the devices here: no server connection
+    pulseaudio_device outputs[BENCH_DEVICES];
+    pulseaudio_device inputs[BENCH_DEVICES];
+    pulseaudio_manager manager;
+    memset(&manager, 0, sizeof(manager));
+    for (uint32_t i = 0; i < BENCH_DEVICES; ++i) {
+        fill_device(&outputs[i], i, "output");
+        fill_device(&inputs[i], i, "input");
+    }
+    manager.outputs = outputs;
+    manager.inputs = inputs;
+    manager.output_count = BENCH_DEVICES;
+    manager.input_count = BENCH_DEVICES;
+    manager.active_output_device = outputs[0].code;
+    manager.active_input_device = inputs[0].code;
+
+    bench_result *results = calloc((size_t) stream_counts * BENCH_METHOD_COUNT, sizeof(bench_result));
+    uint64_t *samples = malloc(iterations * sizeof(uint64_t));
+    uint32_t count = 0;
+    for (uint32_t s = 0; results && samples && s < stream_counts; ++s) {
+        output_stream_list list = { calloc(streams[s], sizeof(output_stream_info)), streams[s] };
+        if (!list.inputs) {
+            break;
+        }
+        for (uint32_t i = 0; i < streams[s]; ++i) {
+            fill_stream(&list.inputs[i], i);
+        }
+        for (int method = 0; method < BENCH_METHOD_COUNT; ++method) {
+            if (measure((bench_method) method, &manager, &list, iterations, samples, &results[count])) {
+                count++;
+            } else {
+                fprintf(stderr, "%s failed with %u streams.\n", bench_method_names[method], streams[s]);
+            }
+        }
+        for (uint32_t i = 0; i < streams[s]; ++i) {
+            free(list.inputs[i].name);
+            free(list.inputs[i].driver);
+            pa_proplist_free(list.inputs[i].proplist);
+        }
+        free(list.inputs);
+    }
+    for (uint32_t i = 0; i < BENCH_DEVICES; ++i) {
+        free_device(&outputs[i]);
+        free_device(&inputs[i]);
+    }
+
+    int fd = open(output, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool written = fd >= 0 && write_results(fd, label, results, count);
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (!written) {
+        fprintf(stderr, "Cannot write %s.\n", output);
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        printf("%-20s %6u streams: %9.1f us, %8llu bytes, %5llu allocations\n", bench_method_names[results[i].method],
+               results[i].streams, (double) results[i].total_ns / results[i].iterations / 1000.0,
+               (unsigned long long) results[i].bytes, (unsigned long long) results[i].allocations);
+    }
+    free(results);
+    free(samples);
+    return written && count > 0 ? 0 : 1;
+}
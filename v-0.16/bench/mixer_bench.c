@@ -0,0 +1,567 @@
+/**
+ * @file mixer_bench.c
+ * @brief Throughput and latency benchmark of the mixer control entry points.
+ *
+ * For every combination of device and stream counts, this program loads that many
+ * module-null-sink instances, opens that many corked playback streams on the first
+ * of them, creates a manager and calls each benchmarked setter a fixed number of
+ * times, cycling through the devices and streams. The wall time of every call is
+ * recorded and the results (operations per second, latency percentiles, server round
+ * trips per call) are written as JSON, so runs on different commits can be compared.
+ * The library prints progress messages on stdout, so the results go to a file
+ * (mixer_bench.json unless -o is given).
+ *
+ * Built with EASYPULSE_BENCH_MOCK defined, the program runs against the mock server
+ * of mock/pulse_mock.c instead of a PulseAudio daemon; see bench/Makefile. The real
+ * backend is meant to run on a private daemon, see bench/run_private_pulseaudio.sh.
+ *
+ * Usage: mixer_bench [-n iterations] [-d devices,...] [-s streams,...] [-o file.json]
+ *                    [-l label] [-m mock latency in us]
+ */
+
+#include "../easypulse_core.h"
+#include "../easypulse_metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef EASYPULSE_BENCH_MOCK
+#include "../mock/pulse_mock.h"
+#define BENCH_BACKEND "mock"
+#else
+#define BENCH_BACKEND "pulseaudio"
+#endif
+
+#define BENCH_SINK_PREFIX "easypulse_bench_"
+#define BENCH_MAX_COUNTS 8          // Device or stream counts accepted on the command line.
+
+//Benchmarked entry points.
+typedef enum bench_op {
+    BENCH_SET_MASTER_VOLUME,
+    BENCH_TOGGLE_OUTPUT_MUTE,
+    BENCH_SET_OUTPUT_MUTE_STATE,
+    BENCH_MOVE_SINK_INPUT,
+    BENCH_SWITCH_DEFAULT_OUTPUT,
+    BENCH_OP_COUNT
+} bench_op;
+
+static const struct {
+    const char *name;
+    metric_id metric;
+} bench_ops[BENCH_OP_COUNT] = {
+    {"manager_set_master_volume", METRIC_API_SET_MASTER_VOLUME},
+    {"manager_toggle_output_mute", METRIC_API_TOGGLE_OUTPUT_MUTE},
+    {"manager_set_output_mute_state", METRIC_API_SET_OUTPUT_MUTE_STATE},
+    {"manager_move_sink_input", METRIC_API_MOVE_SINK_INPUT},
+    {"manager_switch_default_output", METRIC_API_SWITCH_DEFAULT_OUTPUT},
+};
+
+//Devices and streams of a scenario.
+typedef struct bench_scenario {
+    pulseaudio_manager *manager;
+    uint32_t *outputs;              // Positions of the benchmark sinks in manager->outputs.
+    uint32_t device_count;
+    uint32_t *streams;              // Sink input indexes of the benchmark streams.
+    uint32_t stream_count;
+} bench_scenario;
+
+//Measurements of one entry point in one scenario.
+typedef struct bench_result {
+    bench_op op;
+    uint32_t devices;
+    uint32_t streams;
+    uint32_t calls;
+    uint32_t errors;
+    uint64_t total_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+    double round_trips;             // Server round trips per call.
+} bench_result;
+
+#ifndef EASYPULSE_BENCH_MOCK
+//Corked playback streams, kept on a connection of their own.
+typedef struct bench_streams {
+    pa_threaded_mainloop *mainloop;
+    pa_context *context;
+    pa_stream **streams;
+    uint32_t count;
+} bench_streams;
+
+static bench_streams stream_set;
+
+static void bench_context_state_cb(pa_context *c, void *userdata) {
+    (void) c;
+    pa_threaded_mainloop_signal((pa_threaded_mainloop *) userdata, 0);
+}
+
+static void bench_stream_state_cb(pa_stream *s, void *userdata) {
+    (void) s;
+    pa_threaded_mainloop_signal((pa_threaded_mainloop *) userdata, 0);
+}
+
+/**
+ * @brief Closes the benchmark streams and their connection.
+ */
+static void close_streams(bench_scenario *scenario) {
+    (void) scenario;
+
+    if (!stream_set.mainloop) {
+        return;
+    }
+
+    pa_threaded_mainloop_lock(stream_set.mainloop);
+    for (uint32_t i = 0; i < stream_set.count; ++i) {
+        pa_stream_disconnect(stream_set.streams[i]);
+        pa_stream_unref(stream_set.streams[i]);
+    }
+    if (stream_set.context) {
+        pa_context_disconnect(stream_set.context);
+        pa_context_unref(stream_set.context);
+    }
+    pa_threaded_mainloop_unlock(stream_set.mainloop);
+
+    pa_threaded_mainloop_stop(stream_set.mainloop);
+    pa_threaded_mainloop_free(stream_set.mainloop);
+    free(stream_set.streams);
+    memset(&stream_set, 0, sizeof(stream_set));
+}
+
+/**
+ * @brief Opens corked playback streams on a sink.
+ *
+ * The streams use a connection of their own, as the streams of separate applications would.
+ *
+ * @param scenario The scenario; its streams array receives the sink input indexes.
+ * @param sink_name Name of the sink to play to.
+ * @return true if every stream is ready, false otherwise.
+ */
+static bool open_streams(bench_scenario *scenario, const char *sink_name) {
+    stream_set.mainloop = pa_threaded_mainloop_new();
+    stream_set.streams = calloc(scenario->stream_count, sizeof(pa_stream *));
+    if (!stream_set.mainloop || !stream_set.streams) {
+        fprintf(stderr, "Failed to allocate the benchmark streams.\n");
+        close_streams(scenario);
+        return false;
+    }
+
+    pa_mainloop_api *api = pa_threaded_mainloop_get_api(stream_set.mainloop);
+    stream_set.context = pa_context_new(api, "easypulse bench streams");
+    if (!stream_set.context) {
+        close_streams(scenario);
+        return false;
+    }
+    pa_context_set_state_callback(stream_set.context, bench_context_state_cb, stream_set.mainloop);
+
+    pa_threaded_mainloop_lock(stream_set.mainloop);
+    bool ok = pa_context_connect(stream_set.context, NULL, PA_CONTEXT_NOFLAGS, NULL) >= 0 &&
+              pa_threaded_mainloop_start(stream_set.mainloop) >= 0;
+
+    while (ok) {
+        pa_context_state_t state = pa_context_get_state(stream_set.context);
+        if (state == PA_CONTEXT_READY) {
+            break;
+        }
+        if (state == PA_CONTEXT_FAILED || state == PA_CONTEXT_TERMINATED) {
+            ok = false;
+            break;
+        }
+        pa_threaded_mainloop_wait(stream_set.mainloop);
+    }
+
+    pa_sample_spec spec = {.format = PA_SAMPLE_S16LE, .rate = 44100, .channels = 2};
+
+    // Connect every stream first, then wait for all of them
+    for (uint32_t i = 0; ok && i < scenario->stream_count; ++i) {
+        pa_stream *stream = pa_stream_new(stream_set.context, "easypulse bench", &spec, NULL);
+        if (!stream) {
+            ok = false;
+            break;
+        }
+        stream_set.streams[stream_set.count++] = stream;
+        pa_stream_set_state_callback(stream, bench_stream_state_cb, stream_set.mainloop);
+        ok = pa_stream_connect_playback(stream, sink_name, NULL, PA_STREAM_START_CORKED, NULL, NULL) >= 0;
+    }
+
+    for (uint32_t i = 0; ok && i < stream_set.count; ++i) {
+        pa_stream_state_t state;
+        while ((state = pa_stream_get_state(stream_set.streams[i])) == PA_STREAM_CREATING) {
+            pa_threaded_mainloop_wait(stream_set.mainloop);
+        }
+        ok = state == PA_STREAM_READY;
+        scenario->streams[i] = pa_stream_get_index(stream_set.streams[i]);
+    }
+    pa_threaded_mainloop_unlock(stream_set.mainloop);
+
+    if (!ok) {
+        fprintf(stderr, "Failed to open %u playback streams.\n", scenario->stream_count);
+        close_streams(scenario);
+    }
+    return ok;
+}
+#else
+static bool open_streams(bench_scenario *scenario, const char *sink_name) {
+    pulseaudio_manager *manager = scenario->manager;
+    uint32_t sink = PA_INVALID_INDEX;
+    for (uint32_t i = 0; i < manager->output_count; ++i) {
+        if (strcmp(manager->outputs[i].code, sink_name) == 0) {
+            sink = manager->outputs[i].index;
+        }
+    }
+
+    for (uint32_t i = 0; i < scenario->stream_count; ++i) {
+        scenario->streams[i] = mock_add_sink_input("easypulse bench", "music", sink, true);
+        if (scenario->streams[i] == PA_INVALID_INDEX) {
+            fprintf(stderr, "Failed to open %u playback streams.\n", scenario->stream_count);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void close_streams(bench_scenario *scenario) {
+    for (uint32_t i = 0; i < scenario->stream_count; ++i) {
+        mock_remove_sink_input(scenario->streams[i]);
+    }
+}
+#endif
+
+/**
+ * @brief Loads the null sinks of a scenario.
+ *
+ * @param manager The manager used to load the modules.
+ * @param count Number of sinks.
+ * @return The module requests (their index fields hold the loaded modules), or NULL on error.
+ */
+static module_request *load_sinks(pulseaudio_manager *manager, uint32_t count) {
+    module_request *requests = calloc(count, sizeof(module_request));
+    char (*arguments)[96] = calloc(count, sizeof(*arguments));
+    if (!requests || !arguments) {
+        free(requests);
+        free(arguments);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        snprintf(arguments[i], sizeof(arguments[i]),
+                 "sink_name=" BENCH_SINK_PREFIX "%u sink_properties=device.description=Bench_%u", i, i);
+        requests[i].name = "module-null-sink";
+        requests[i].arguments = arguments[i];
+    }
+
+    int loaded = manager_load_modules(manager, requests, count);
+    free(arguments);
+
+    if (loaded != (int) count) {
+        fprintf(stderr, "Loaded %d of %u null sinks.\n", loaded, count);
+        for (uint32_t i = 0; i < count; ++i) {
+            if (requests[i].index != PA_INVALID_INDEX) {
+                manager_unload_module(manager, requests[i].index);
+            }
+        }
+        free(requests);
+        return NULL;
+    }
+    return requests;
+}
+
+static void unload_sinks(pulseaudio_manager *manager, module_request *requests, uint32_t count) {
+    uint32_t *indices = malloc(count * sizeof(uint32_t));
+    if (indices) {
+        for (uint32_t i = 0; i < count; ++i) {
+            indices[i] = requests[i].index;
+        }
+        manager_unload_modules(manager, indices, count);
+        free(indices);
+    }
+    free(requests);
+}
+
+/**
+ * @brief Calls a benchmarked entry point once.
+ *
+ * @param scenario The scenario.
+ * @param op The entry point.
+ * @param i Number of the call, used to cycle through devices, streams and values.
+ * @return true if the call reported success.
+ */
+static bool run_op(bench_scenario *scenario, bench_op op, uint32_t i) {
+    pulseaudio_manager *manager = scenario->manager;
+    uint32_t position = scenario->outputs[i % scenario->device_count];
+    uint32_t device = manager->outputs[position].index;
+
+    switch (op) {
+        case BENCH_SET_MASTER_VOLUME:
+            return manager_set_master_volume(manager, device, 40 + (int) (i % 20)) == 0;
+        case BENCH_TOGGLE_OUTPUT_MUTE:
+            return manager_toggle_output_mute(manager, position, (int) (i & 1)) == 0;
+        case BENCH_SET_OUTPUT_MUTE_STATE:
+            return manager_set_output_mute_state(manager, device, 0, (i & 1) != 0) == 0;
+        case BENCH_MOVE_SINK_INPUT: {
+            uint32_t target = manager->outputs[scenario->outputs[(i + 1) % scenario->device_count]].index;
+            return manager_move_sink_input(manager, scenario->streams[i % scenario->stream_count], target);
+        }
+        case BENCH_SWITCH_DEFAULT_OUTPUT:
+            return manager_switch_default_output(manager, position);
+        default:
+            return false;
+    }
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Returns a percentile of sorted samples (nearest rank).
+ */
+static uint64_t percentile(const uint64_t *sorted, uint32_t count, double p) {
+    uint32_t rank = (uint32_t) (p / 100.0 * count + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    return sorted[(rank > count ? count : rank) - 1];
+}
+
+/**
+ * @brief Measures an entry point in a scenario.
+ *
+ * @param scenario The scenario.
+ * @param op The entry point.
+ * @param iterations Number of calls.
+ * @param samples Buffer for the call times (at least iterations entries).
+ * @param result Receives the measurements.
+ */
+static void measure(bench_scenario *scenario, bench_op op, uint32_t iterations, uint64_t *samples,
+                    bench_result *result) {
+    memset(result, 0, sizeof(bench_result));
+    result->op = op;
+    result->devices = scenario->device_count;
+    result->streams = scenario->stream_count;
+    result->calls = iterations;
+
+    // Warm up caches and connections before measuring
+    for (uint32_t i = 0; i < iterations / 10; ++i) {
+        run_op(scenario, op, i);
+    }
+
+    metrics_reset();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        uint64_t start = metrics_now_ns();
+        bool ok = run_op(scenario, op, i);
+        samples[i] = metrics_now_ns() - start;
+        result->total_ns += samples[i];
+        if (!ok) {
+            ++result->errors;
+        }
+    }
+
+    metrics_snapshot snapshot;
+    metrics_snapshot_take(&snapshot);
+    const metrics_stat *stat = &snapshot.stats[bench_ops[op].metric];
+    result->round_trips = stat->count ? (double) stat->round_trips / (double) stat->count : 0.0;
+
+    qsort(samples, iterations, sizeof(uint64_t), compare_u64);
+    result->p50_ns = percentile(samples, iterations, 50.0);
+    result->p90_ns = percentile(samples, iterations, 90.0);
+    result->p99_ns = percentile(samples, iterations, 99.0);
+    result->max_ns = samples[iterations - 1];
+}
+
+/**
+ * @brief Runs every entry point for one device count and one stream count.
+ *
+ * @return The number of results added, or -1 if the scenario could not be set up.
+ */
+static int run_scenario(pulseaudio_manager *setup, uint32_t device_count, uint32_t stream_count,
+                        uint32_t iterations, uint64_t *samples, bench_result *results) {
+    module_request *sinks = load_sinks(setup, device_count);
+    if (!sinks) {
+        return -1;
+    }
+
+    bench_scenario scenario = {0};
+    scenario.device_count = device_count;
+    scenario.stream_count = stream_count;
+    scenario.outputs = calloc(device_count, sizeof(uint32_t));
+    scenario.streams = calloc(stream_count, sizeof(uint32_t));
+    scenario.manager = manager_create();
+
+    int added = -1;
+    if (scenario.outputs && scenario.streams && scenario.manager) {
+        uint32_t found = 0;
+        for (uint32_t i = 0; i < scenario.manager->output_count && found < device_count; ++i) {
+            const char *code = scenario.manager->outputs[i].code;
+            if (code && strncmp(code, BENCH_SINK_PREFIX, strlen(BENCH_SINK_PREFIX)) == 0) {
+                scenario.outputs[found++] = i;
+            }
+        }
+
+        if (found == device_count && open_streams(&scenario, BENCH_SINK_PREFIX "0")) {
+            for (int op = 0; op < BENCH_OP_COUNT; ++op) {
+                fprintf(stderr, "%s: %u devices, %u streams...\n", bench_ops[op].name, device_count, stream_count);
+                measure(&scenario, (bench_op) op, iterations, samples, &results[op]);
+            }
+            close_streams(&scenario);
+            added = BENCH_OP_COUNT;
+        } else if (found != device_count) {
+            fprintf(stderr, "The manager sees %u of the %u null sinks.\n", found, device_count);
+        }
+    }
+
+    if (scenario.manager) {
+        manager_cleanup(scenario.manager);
+    }
+    free(scenario.outputs);
+    free(scenario.streams);
+    unload_sinks(setup, sinks, device_count);
+    return added;
+}
+
+static double to_us(uint64_t ns) {
+    return (double) ns / 1000.0;
+}
+
+/**
+ * @brief Writes the results as JSON.
+ */
+static void write_results(FILE *out, const char *label, uint32_t iterations, const bench_result *results,
+                          uint32_t count) {
+    fprintf(out, "{\n  \"benchmark\": \"mixer\",\n  \"backend\": \"%s\",\n", BENCH_BACKEND);
+    fprintf(out, "  \"label\": \"%s\",\n  \"iterations\": %u,\n  \"results\": [", label, iterations);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        const bench_result *r = &results[i];
+        double seconds = (double) r->total_ns / 1e9;
+        fprintf(out, "%s\n    {\"operation\": \"%s\", \"devices\": %u, \"streams\": %u, \"calls\": %u, \"errors\": %u, "
+                "\"ops_per_sec\": %.1f, \"mean_us\": %.2f, \"p50_us\": %.2f, \"p90_us\": %.2f, \"p99_us\": %.2f, "
+                "\"max_us\": %.2f, \"round_trips_per_call\": %.2f}",
+                i ? "," : "", bench_ops[r->op].name, r->devices, r->streams, r->calls, r->errors,
+                seconds > 0.0 ? (double) r->calls / seconds : 0.0, to_us(r->total_ns) / r->calls,
+                to_us(r->p50_ns), to_us(r->p90_ns), to_us(r->p99_ns), to_us(r->max_ns), r->round_trips);
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
+
+/**
+ * @brief Parses a comma separated list of counts.
+ *
+ * @return The number of counts, or 0 if the list is invalid.
+ */
+static uint32_t parse_counts(const char *list, uint32_t *counts) {
+    uint32_t n = 0;
+    const char *p = list;
+    while (*p && n < BENCH_MAX_COUNTS) {
+        char *end;
+        unsigned long value = strtoul(p, &end, 10);
+        if (end == p || value == 0 || value > 100000) {
+            return 0;
+        }
+        counts[n++] = (uint32_t) value;
+        p = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',') {
+            return 0;
+        }
+    }
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t iterations = 200;
+    uint32_t devices[BENCH_MAX_COUNTS] = {1, 10, 100};
+    uint32_t streams[BENCH_MAX_COUNTS] = {1, 100, 1000};
+    uint32_t device_counts = 3;
+    uint32_t stream_counts = 3;
+    const char *output = "mixer_bench.json";
+    const char *label = "";
+    uint32_t mock_latency = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:s:o:l:m:")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = (uint32_t) strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                device_counts = parse_counts(optarg, devices);
+                break;
+            case 's':
+                stream_counts = parse_counts(optarg, streams);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'l':
+                label = optarg;
+                break;
+            case 'm':
+                mock_latency = (uint32_t) strtoul(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n iterations] [-d devices,...] [-s streams,...] [-o file.json] "
+                        "[-l label] [-m mock latency in us]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (iterations == 0 || device_counts == 0 || stream_counts == 0) {
+        fprintf(stderr, "Invalid iteration, device or stream count.\n");
+        return 1;
+    }
+
+#ifdef EASYPULSE_BENCH_MOCK
+    // A machine with one sound card, every request answered after the same delay
+    mock_add_default_devices();
+    for (int kind = 0; kind < MOCK_OP_KIND_COUNT; ++kind) {
+        mock_set_latency((mock_op_kind) kind, mock_latency);
+    }
+#else
+    (void) mock_latency;
+#endif
+
+    metrics_enable(true);
+
+    pulseaudio_manager *setup = manager_create();
+    bench_result *results = calloc((size_t) device_counts * stream_counts * BENCH_OP_COUNT, sizeof(bench_result));
+    uint64_t *samples = malloc(iterations * sizeof(uint64_t));
+    if (!setup || !results || !samples) {
+        fprintf(stderr, "Failed to initialize the benchmark.\n");
+        if (setup) {
+            manager_cleanup(setup);
+        }
+        free(results);
+        free(samples);
+        return 1;
+    }
+
+    uint32_t count = 0;
+    for (uint32_t d = 0; d < device_counts; ++d) {
+        for (uint32_t s = 0; s < stream_counts; ++s) {
+            int added = run_scenario(setup, devices[d], streams[s], iterations, samples, &results[count]);
+            if (added < 0) {
+                fprintf(stderr, "Skipping %u devices, %u streams.\n", devices[d], streams[s]);
+                continue;
+            }
+            count += (uint32_t) added;
+        }
+    }
+    manager_cleanup(setup);
+
+    FILE *out = fopen(output, "w");
+    if (!out) {
+        fprintf(stderr, "Cannot open %s for writing.\n", output);
+        free(results);
+        free(samples);
+        return 1;
+    }
+    write_results(out, label, iterations, results, count);
+    fclose(out);
+    fprintf(stderr, "Wrote %u results to %s\n", count, output);
+
+    free(results);
+    free(samples);
+    return count > 0 ? 0 : 1;
+}
@@ -0,0 +1,49 @@
+#!/bin/sh
+# Runs a command against a private PulseAudio daemon.
+#
+# The daemon has no hardware modules, only a null sink, and its own runtime directory,
+# so the desktop session is neither used nor disturbed. The label of the results is the
+# current commit.
+#
+# Usage: run_private_pulseaudio.sh <command> [arguments...]
+
+set -e
+
+if [ $# -eq 0 ]; then
+    echo "Usage: $0 <command> [arguments...]" >&2
+    exit 1
+fi
+
+RUNTIME_DIR=$(mktemp -d)
+export XDG_RUNTIME_DIR="$RUNTIME_DIR"
+export PULSE_RUNTIME_PATH="$RUNTIME_DIR/pulse"
+export PULSE_STATE_PATH="$RUNTIME_DIR/state"
+export PULSE_SERVER="unix:$RUNTIME_DIR/pulse/native"
+mkdir -p "$PULSE_RUNTIME_PATH" "$PULSE_STATE_PATH"
+
+pulseaudio -n --daemonize=no --exit-idle-time=-1 --disallow-exit --log-target=stderr --log-level=error \
+    -L "module-native-protocol-unix socket=$RUNTIME_DIR/pulse/native auth-anonymous=1" \
+    -L "module-null-sink sink_name=bench_default" \
+    -L "module-null-source source_name=bench_default_input" &
+DAEMON=$!
+
+cleanup() {
+    kill "$DAEMON" 2>/dev/null || true
+    wait "$DAEMON" 2>/dev/null || true
+    rm -rf "$RUNTIME_DIR"
+}
+trap cleanup EXIT INT TERM
+
+# Wait for the socket
+i=0
+while [ ! -S "$RUNTIME_DIR/pulse/native" ]; do
+    i=$((i + 1))
+    if [ $i -gt 50 ] || ! kill -0 "$DAEMON" 2>/dev/null; then
+        echo "The private PulseAudio daemon did not start." >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+
+LABEL=$(git rev-parse --short HEAD 2>/dev/null || echo "")
+"$@" -l "$LABEL"
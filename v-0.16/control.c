@@ -0,0 +1,462 @@
+/**
+ * @file control.c
+ * @brief Implementation of the line-based control protocol.
+ *
+ * Commands are executed one after the other with the manager_* functions; the time
+ * saved by the daemon comes from the connection, the enumeration and the ALSA probing
+ * being done once, not from the commands themselves.
+ */
+
+#include "control.h"
+#include "peak_meter.h"
+#include "easypulse_log.h"
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CONTROL_BUFFER_MIN 4096     // First allocation of a buffer.
+
+/**
+ * @brief Initializes an empty buffer.
+ *
+ * @param buffer The buffer.
+ */
+void control_buffer_init(control_buffer *buffer) {
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
+
+/**
+ * @brief Makes room for bytes after the end of a buffer.
+ *
+ * @return true on success, false on allocation failure.
+ */
+bool control_buffer_reserve(control_buffer *buffer, size_t extra) {
+    if (buffer->length + extra <= buffer->capacity) {
+        return true;
+    }
+
+    size_t capacity = buffer->capacity ? buffer->capacity : CONTROL_BUFFER_MIN;
+    while (capacity < buffer->length + extra) {
+        capacity *= 2;
+    }
+    char *data = realloc(buffer->data, capacity);
+    if (!data) {
+        EASYPULSE_ERROR("Failed to allocate memory for a control buffer.");
+        return false;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+/**
+ * @brief Appends bytes to a buffer.
+ *
+ * @return true on success, false on allocation failure.
+ */
+bool control_buffer_append(control_buffer *buffer, const char *data, size_t length) {
+    if (!control_buffer_reserve(buffer, length)) {
+        return false;
+    }
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+    return true;
+}
+
+/**
+ * @brief Appends formatted text to a buffer.
+ *
+ * @return true on success, false on allocation failure.
+ */
+bool control_buffer_printf(control_buffer *buffer, const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (length < 0 || !control_buffer_reserve(buffer, (size_t) length + 1)) {
+        return false;
+    }
+
+    va_start(args, format);
+    vsnprintf(buffer->data + buffer->length, (size_t) length + 1, format, args);
+    va_end(args);
+    buffer->length += (size_t) length;
+    return true;
+}
+
+/**
+ * @brief Removes bytes from the start of a buffer.
+ */
+void control_buffer_consume(control_buffer *buffer, size_t length) {
+    if (length >= buffer->length) {
+        buffer->length = 0;
+        return;
+    }
+    memmove(buffer->data, buffer->data + length, buffer->length - length);
+    buffer->length -= length;
+}
+
+/**
+ * @brief Frees a buffer.
+ */
+void control_buffer_free(control_buffer *buffer) {
+    free(buffer->data);
+    control_buffer_init(buffer);
+}
+
+static bool is_number(const char *text) {
+    if (!*text) {
+        return false;
+    }
+    for (; *text; ++text) {
+        if (!isdigit((unsigned char) *text)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Finds a device by reference.
+ *
+ * @param devices The devices (outputs or inputs of a manager).
+ * @param count Number of devices.
+ * @param reference A PulseAudio index, a stable id ("@" and 16 hexadecimal digits), a code
+ *                  or a name.
+ * @return The position of the device in the array, or -1 if none matches.
+ */
+int control_find_device(const pulseaudio_device *devices, uint32_t count, const char *reference) {
+    if (!reference) {
+        return -1;
+    }
+
+    if (is_number(reference)) {
+        uint32_t index = (uint32_t) strtoul(reference, NULL, 10);
+        for (uint32_t i = 0; i < count; ++i) {
+            if (devices[i].index == index) {
+                return (int) i;
+            }
+        }
+        return -1;
+    }
+
+    char *end;
+    if (reference[0] == '@' && isxdigit((unsigned char) reference[1])) {
+        uint64_t id = strtoull(reference + 1, &end, 16);
+        for (uint32_t i = 0; i < count && *end == '\0'; ++i) {
+            if (devices[i].code && manager_device_stable_id(devices[i].code) == id) {
+                return (int) i;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if (devices[i].code && strcmp(devices[i].code, reference) == 0) {
+            return (int) i;
+        }
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        if (devices[i].name && strcmp(devices[i].name, reference) == 0) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Finds a device of the manager, outputs or inputs depending on the word given.
+ *
+ * @return The position of the device, or -1 (with an error appended to the reply).
+ */
+static int find(control_session *session, const char *kind, const char *reference, bool *output,
+                control_buffer *reply) {
+    pulseaudio_manager *manager = session->manager;
+
+    if (strcmp(kind, "output") == 0) {
+        *output = true;
+    } else if (strcmp(kind, "input") == 0) {
+        *output = false;
+    } else {
+        control_buffer_printf(reply, "ERR expected output or input, got %s\n", kind);
+        return -1;
+    }
+
+    int position = *output ? control_find_device(manager->outputs, manager->output_count, reference)
+                           : control_find_device(manager->inputs, manager->input_count, reference);
+    if (position < 0) {
+        control_buffer_printf(reply, "ERR no %s %s\n", kind, reference);
+    }
+    return position;
+}
+
+static bool parse_percent(const char *text, int *value) {
+    if (!is_number(text) || strlen(text) > 3) {
+        return false;
+    }
+    *value = atoi(text);
+    return *value <= 100;
+}
+
+/**
+ * @brief Returns the change a connection made to a device, or NULL.
+ */
+static control_change *find_change(control_session *session, bool output, uint32_t index) {
+    for (uint32_t i = 0; i < session->change_count; ++i) {
+        if (session->changes[i].output == output && session->changes[i].index == index) {
+            return &session->changes[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Remembers a volume (or mute if volume is -1) set by a connection.
+ */
+static void remember_change(control_session *session, bool output, uint32_t index, int volume, int mute) {
+    control_change *change = find_change(session, output, index);
+    if (!change) {
+        if (session->change_count == CONTROL_MAX_CHANGES) {
+            // The oldest change has most likely been published by now
+            memmove(session->changes, session->changes + 1, (CONTROL_MAX_CHANGES - 1) * sizeof(control_change));
+            --session->change_count;
+        }
+        change = &session->changes[session->change_count++];
+        *change = (control_change) { .output = output, .index = index, .volume = -1, .mute = -1 };
+    }
+    if (volume >= 0) {
+        change->volume = volume;
+    } else {
+        change->mute = mute;
+    }
+}
+
+/**
+ * @brief Appends the data lines of "list".
+ */
+static void list_devices(control_session *session, bool output, control_buffer *reply) {
+    pulseaudio_manager *manager = session->manager;
+    const pulseaudio_device *devices = output ? manager->outputs : manager->inputs;
+    uint32_t count = output ? manager->output_count : manager->input_count;
+    const char *active = output ? manager->active_output_device : manager->active_input_device;
+
+    // The published state follows the volume changes, the device arrays do not. It is
+    // updated a little after a change, so the changes of this connection are applied on it.
+    shm_state_snapshot *snapshot = NULL;
+    shm_state_snapshot state;
+    if (session->state && shm_state_read(session->state, &state)) {
+        snapshot = &state;
+        uint32_t position = output ? state.default_output : state.default_input;
+        const shm_state_device *published = output ? state.outputs : state.inputs;
+        if (position != SHM_STATE_NONE && !session->default_changed[output ? 0 : 1]) {
+            active = published[position].code;
+        }
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        int volume = devices[i].master_volume;
+        bool mute = devices[i].mute;
+
+        if (snapshot) {
+            const shm_state_device *published = output ? snapshot->outputs : snapshot->inputs;
+            uint32_t published_count = output ? snapshot->output_count : snapshot->input_count;
+            for (uint32_t j = 0; j < published_count && j < SHM_STATE_MAX_DEVICES; ++j) {
+                if (published[j].index == devices[i].index) {
+                    volume = published[j].volume;
+                    mute = published[j].mute;
+                    break;
+                }
+            }
+        }
+
+        const control_change *change = find_change(session, output, devices[i].index);
+        if (change && change->volume >= 0) {
+            volume = change->volume;
+        }
+        if (change && change->mute >= 0) {
+            mute = change->mute;
+        }
+
+        bool is_default = active && devices[i].code && strcmp(active, devices[i].code) == 0;
+        control_buffer_printf(reply, "= %u %d %d %d %s %s\n", devices[i].index, volume, mute ? 1 : 0,
+                              is_default ? 1 : 0, devices[i].code ? devices[i].code : "-",
+                              devices[i].name ? devices[i].name : "");
+    }
+}
+
+/**
+ * @brief Executes one command line and appends its reply.
+ *
+ * @param session The session (manager and state) the command runs in.
+ * @param line The command, without its line terminator. Modified in place.
+ * @param reply The buffer the reply is appended to.
+ * @return true if the command succeeded (or the line was blank), false otherwise.
+ */
+bool control_execute(control_session *session, char *line, control_buffer *reply) {
+    char *argv[CONTROL_MAX_ARGS];
+    int argc = 0;
+    char *state = NULL;
+
+    for (char *word = strtok_r(line, " \t\r", &state); word; word = strtok_r(NULL, " \t\r", &state)) {
+        if (argc == 0 && word[0] == '#') {
+            break;
+        }
+        if (argc == CONTROL_MAX_ARGS) {
+            control_buffer_printf(reply, "ERR too many words\n");
+            return false;
+        }
+        argv[argc++] = word;
+    }
+    if (argc == 0) {
+        return true;
+    }
+
+    pulseaudio_manager *manager = session->manager;
+    const char *command = argv[0];
+
+    if (strcmp(command, "ping") == 0 && argc == 1) {
+        return control_buffer_printf(reply, "OK pong\n");
+    }
+    if (strcmp(command, "quit") == 0 && argc == 1) {
+        session->quit = true;
+        return control_buffer_printf(reply, "OK\n");
+    }
+
+    // Devices are enumerated again only when a command needs them
+    bool stale = session->devices_stale && atomic_exchange(session->devices_stale, false);
+    if (stale || strcmp(command, "refresh") == 0) {
+        if (!manager_refresh_devices(manager)) {
+            control_buffer_printf(reply, "ERR failed to enumerate the devices\n");
+            return false;
+        }
+        if (strcmp(command, "refresh") == 0) {
+            return control_buffer_printf(reply, "OK\n");
+        }
+    }
+
+    bool output = true;
+    int position;
+    int value;
+    bool ok;
+
+    if (strcmp(command, "list") == 0 && argc == 2 &&
+        (strcmp(argv[1], "outputs") == 0 || strcmp(argv[1], "inputs") == 0)) {
+        list_devices(session, argv[1][0] == 'o', reply);
+        ok = true;
+    } else if (strcmp(command, "volume") == 0 && argc == 3) {
+        if ((position = find(session, "output", argv[1], &output, reply)) < 0) {
+            return false;
+        }
+        if (!parse_percent(argv[2], &value)) {
+            control_buffer_printf(reply, "ERR invalid volume %s\n", argv[2]);
+            return false;
+        }
+        ok = manager_set_master_volume(manager, manager->outputs[position].index, value) == 0;
+        if (ok) {
+            remember_change(session, true, manager->outputs[position].index, value, -1);
+        }
+    } else if (strcmp(command, "mute") == 0 && argc == 4) {
+        if ((position = find(session, argv[1], argv[2], &output, reply)) < 0) {
+            return false;
+        }
+        if (strcmp(argv[3], "on") != 0 && strcmp(argv[3], "off") != 0) {
+            control_buffer_printf(reply, "ERR expected on or off, got %s\n", argv[3]);
+            return false;
+        }
+        int mute = strcmp(argv[3], "on") == 0;
+        ok = (output ? manager_toggle_output_mute(manager, (uint32_t) position, mute)
+                     : manager_toggle_input_mute(manager, (uint32_t) position, mute)) == 0;
+        if (ok) {
+            remember_change(session, output, (output ? manager->outputs : manager->inputs)[position].index, -1, mute);
+        }
+    } else if (strcmp(command, "default") == 0 && argc == 3) {
+        if ((position = find(session, argv[1], argv[2], &output, reply)) < 0) {
+            return false;
+        }
+        ok = output ? manager_switch_default_output(manager, (uint32_t) position)
+                    : manager_switch_default_input(manager, (uint32_t) position);
+        if (ok && session->devices_stale) {
+            // The active device names are only set by the enumeration
+            atomic_store(session->devices_stale, true);
+            session->default_changed[output ? 0 : 1] = true;
+        }
+    } else if (strcmp(command, "move") == 0 && argc == 4 &&
+               (strcmp(argv[1], "sink-input") == 0 || strcmp(argv[1], "source-output") == 0)) {
+        bool sink_input = strcmp(argv[1], "sink-input") == 0;
+        if (!is_number(argv[2])) {
+            control_buffer_printf(reply, "ERR invalid stream index %s\n", argv[2]);
+            return false;
+        }
+        if ((position = find(session, sink_input ? "output" : "input", argv[3], &output, reply)) < 0) {
+            return false;
+        }
+        uint32_t stream = (uint32_t) strtoul(argv[2], NULL, 10);
+        ok = sink_input ? manager_move_sink_input(manager, stream, manager->outputs[position].index)
+                        : manager_move_source_output(manager, stream, manager->inputs[position].index);
+    } else if (strcmp(command, "peak") == 0 && argc == 3) {
+        if ((position = find(session, argv[1], argv[2], &output, reply)) < 0) {
+            return false;
+        }
+        float peak = 0.0f;
+        ok = (output ? manager_get_output_peak(manager, (uint32_t) position, &peak)
+                     : manager_get_input_peak(manager, (uint32_t) position, &peak)) == 0;
+        if (ok) {
+            return control_buffer_printf(reply, "OK %.3f\n", peak);
+        }
+    } else {
+        control_buffer_printf(reply, "ERR unknown command or wrong arguments: %s\n", command);
+        return false;
+    }
+
+    control_buffer_printf(reply, ok ? "OK\n" : "ERR %s failed\n", command);
+    return ok;
+}
+
+/**
+ * @brief Executes every complete line of the input.
+ *
+ * Stops after a "quit" command.
+ *
+ * @param session The session the commands run in.
+ * @param input The bytes received. Lines are modified in place.
+ * @param length Number of bytes.
+ * @param reply The buffer the replies are appended to.
+ * @return The number of bytes consumed (up to the end of the last complete line).
+ */
+size_t control_process(control_session *session, char *input, size_t length, control_buffer *reply) {
+    size_t consumed = 0;
+
+    while (consumed < length && !session->quit) {
+        char *line = input + consumed;
+        char *end = memchr(line, '\n', length - consumed);
+        if (!end) {
+            // A line that cannot end within the limit is skipped up to its end, which may
+            // come with later input, and gets one error
+            if (length - consumed >= CONTROL_MAX_LINE) {
+                if (!session->discarding) {
+                    control_buffer_printf(reply, "ERR line too long\n");
+                }
+                session->discarding = true;
+                consumed = length;
+            }
+            break;
+        }
+
+        *end = '\0';
+        consumed += (size_t) (end - line) + 1;
+        if (session->discarding) {
+            session->discarding = false;
+            continue;
+        }
+        if ((size_t) (end - line) >= CONTROL_MAX_LINE) {
+            control_buffer_printf(reply, "ERR line too long\n");
+            continue;
+        }
+        control_execute(session, line, reply);
+    }
+    return consumed;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file control.h
+ * @brief Line-based control protocol, executed against a long-lived manager.
+ *
+ * A command is a line of words separated by spaces. Its reply is zero or more data
+ * lines starting with "= ", followed by one status line, "OK" (possibly followed by a
+ * value) or "ERR <message>". Blank lines and lines starting with '#' have no reply, so
+ * a client sending N commands reads exactly N status lines, in order, and can send all
+ * its commands before reading anything.
+ *
+ * Devices are referenced by index, stable id (see manager_device_stable_id()), code
+ * (PulseAudio name) or name (description):
+ *
+ *     ping                                      OK pong
+ *     list outputs|inputs                       = <index> <volume> <mute> <default> <code> <name>
+ *     volume <output> <0-100>
+ *     mute output|input <device> on|off
+ *     default output|input <device>
+ *     move sink-input <stream index> <output>
+ *     move source-output <stream index> <input>
+ *     peak output|input <device>                OK <0.000-1.000>
+ *     refresh                                   Enumerates the devices again.
+ *     quit                                      The daemon closes the connection.
+ *
+ * The daemon (daemon/easypulsed.c) feeds everything it reads from a connection to
+ * control_process() and writes all the replies at once, so a pipelined batch of
+ * commands costs one read and one write on the socket.
+ */
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "easypulse_core.h"
+#include "shm_state.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+#include <atomic>
+using std::atomic_bool;
+#else
+#include <stdatomic.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CONTROL_MAX_LINE 1024       // Longer lines are rejected.
+#define CONTROL_MAX_ARGS 8          // Words of a command.
+#define CONTROL_MAX_CHANGES 16      // Devices whose changes a connection remembers.
+
+//Growable byte buffer holding replies or unprocessed input.
+typedef struct control_buffer {
+    char *data;
+    size_t length;
+    size_t capacity;
+} control_buffer;
+
+//Volume or mute set by a connection. The published state shows it only a little later, so
+//"list" shows these values until the connection ends.
+typedef struct control_change {
+    bool output;
+    uint32_t index;                     // Index of the device.
+    int volume;                         // -1 if unchanged.
+    int mute;                           // -1 if unchanged.
+} control_change;
+
+//State of a connection. The manager and the stale flag are shared by the connections.
+typedef struct control_session {
+    pulseaudio_manager *manager;
+    const shm_state_reader *state;      // Published state used by "list" (NULL to use the manager).
+    atomic_bool *devices_stale;         // Set when devices changed, they are enumerated again before the next command.
+    control_change changes[CONTROL_MAX_CHANGES];    // Changes made by the connection (see below).
+    uint32_t change_count;
+    bool default_changed[2];            // The default output [0] or input [1] was switched by the connection.
+    bool quit;                          // Set by the "quit" command.
+    bool discarding;                    // Skipping the rest of a line that was too long.
+} control_session;
+
+void control_buffer_init(control_buffer *buffer);                       //Initializes an empty buffer.
+bool control_buffer_reserve(control_buffer *buffer, size_t extra);      //Makes room for bytes. Returns false on allocation failure.
+bool control_buffer_append(control_buffer *buffer,
+const char *data, size_t length);                                       //Appends bytes. Returns false on allocation failure.
+bool control_buffer_printf(control_buffer *buffer,
+const char *format, ...);                                               //Appends formatted text.
+void control_buffer_consume(control_buffer *buffer, size_t length);     //Removes bytes from the start.
+void control_buffer_free(control_buffer *buffer);                       //Frees the buffer.
+
+int control_find_device(const pulseaudio_device *devices,
+uint32_t count, const char *reference);                                 //Position of a device by index, stable id, code or name, or -1.
+
+bool control_execute(control_session *session, char *line,
+control_buffer *reply);                                                 //Executes one command line. Returns false if it failed.
+size_t control_process(control_session *session, char *input,
+size_t length, control_buffer *reply);                                  //Executes every complete line. Returns the bytes consumed.
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
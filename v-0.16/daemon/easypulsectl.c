@@ -0,0 +1,123 @@
+/**
+ * @file easypulsectl.c
+ * @brief Command-line client of easypulsed.
+ *
+ * Sends one command given as arguments, or every line of its standard input, and prints
+ * the replies. All the commands are sent before any reply is read, so a script of any
+ * length costs one round trip to the daemon.
+ *
+ * Usage: easypulsectl [-s socket] [command words...]
+ *
+ * Exits with 1 if a command failed, 2 if the daemon could not be reached.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int connect_daemon(const char *path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        perror(path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+static bool send_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = send(fd, data, length, MSG_NOSIGNAL);
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        length -= (size_t) written;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    char default_path[108];
+    const char *socket_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "+s:")) != -1) {
+        if (opt != 's') {
+            fprintf(stderr, "Usage: %s [-s socket] [command words...]\n", argv[0]);
+            return 2;
+        }
+        socket_path = optarg;
+    }
+    if (!socket_path) {
+        // Same default as easypulsed, which has no /tmp fallback either
+        const char *runtime = getenv("XDG_RUNTIME_DIR");
+        if (!runtime) {
+            fprintf(stderr, "XDG_RUNTIME_DIR is not set, give the socket path with -s\n");
+            return 2;
+        }
+        snprintf(default_path, sizeof(default_path), "%s/easypulse.sock", runtime);
+        socket_path = default_path;
+    }
+
+    int fd = connect_daemon(socket_path);
+    if (fd < 0) {
+        return 2;
+    }
+
+    // Send every command first, then read: the daemon answers them in one batch
+    bool sent = true;
+    if (optind < argc) {
+        for (int i = optind; i < argc && sent; ++i) {
+            sent = send_all(fd, argv[i], strlen(argv[i])) && send_all(fd, i + 1 < argc ? " " : "\n", 1);
+        }
+    } else {
+        char chunk[65536];
+        size_t length;
+        while (sent && (length = fread(chunk, 1, sizeof(chunk), stdin)) > 0) {
+            sent = send_all(fd, chunk, length);
+        }
+        // A last line without a newline is still a command
+        sent = sent && send_all(fd, "\n", 1);
+    }
+    if (!sent) {
+        perror("send");
+        close(fd);
+        return 2;
+    }
+    shutdown(fd, SHUT_WR);
+
+    // The daemon closes the connection once it has answered everything
+    FILE *replies = fdopen(fd, "r");
+    if (!replies) {
+        close(fd);
+        return 2;
+    }
+
+    bool failed = false;
+    char line[4096];
+    while (fgets(line, sizeof(line), replies)) {
+        if (strncmp(line, "ERR", 3) == 0) {
+            failed = true;
+            fputs(line, stderr);
+        } else {
+            fputs(line, stdout);
+        }
+    }
+    fclose(replies);
+
+    return failed ? 1 : 0;
+}
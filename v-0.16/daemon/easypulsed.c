@@ -0,0 +1,294 @@
+/**
+ * @file easypulsed.c
+ * @brief Control daemon holding a warm manager, driven over a Unix socket.
+ *
+ * A program built on the library pays the server connection, the enumeration of the
+ * devices and the probing of their ALSA devices before its first call, which is
+ * hundreds of milliseconds for a command-line tool changing one volume. This daemon
+ * pays it once and accepts the commands of control.h over a Unix socket: a one-shot
+ * script connects, writes its commands and reads the replies, in well under a
+ * millisecond plus the commands themselves.
+ *
+ * Connections are pipelined: everything received is executed in order and all the
+ * replies produced by one read are written at once. Devices are enumerated again
+ * lazily, when a command arrives after a device was added or removed. The daemon also
+ * publishes the device state in shared memory (shm_state.h), which "list" replies from.
+ *
+ * Usage: easypulsed [-s socket] [-p state name]
+ *
+ * The socket defaults to $XDG_RUNTIME_DIR/easypulse.sock and the state to
+ * SHM_STATE_DEFAULT_NAME. The socket is only accessible to the user running the daemon,
+ * since every command it accepts changes the mixer; without XDG_RUNTIME_DIR, the path
+ * must be given with -s.
+ */
+
+#define _GNU_SOURCE // For accept4().
+#include "../control.h"
+#include "../easypulse_core.h"
+#include "../easypulse_log.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define DAEMON_MAX_CLIENTS 64           // Connections served at once.
+#define DAEMON_READ_SIZE 65536          // Bytes read from a connection at a time.
+#define DAEMON_MAX_PENDING (1 << 20)    // Unsent replies above which a connection stops being read.
+
+//A connection.
+typedef struct daemon_client {
+    int fd;
+    control_session session;
+    control_buffer input;               // Bytes received and not processed yet (an incomplete line).
+    control_buffer output;              // Replies not written yet.
+} daemon_client;
+
+static volatile sig_atomic_t running = 1;
+static atomic_bool devices_stale;
+
+static void stop(int signal) {
+    (void) signal;
+    running = 0;
+}
+
+/**
+ * @brief Event callback: notes that devices were added or removed. Mainloop thread.
+ */
+static void on_event(pulseaudio_manager *manager, pa_subscription_event_type_t event, uint32_t index,
+                     void *userdata) {
+    (void) manager;
+    (void) index;
+    (void) userdata;
+
+    pa_subscription_event_type_t facility = event & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+    pa_subscription_event_type_t type = event & PA_SUBSCRIPTION_EVENT_TYPE_MASK;
+    if ((facility == PA_SUBSCRIPTION_EVENT_SINK || facility == PA_SUBSCRIPTION_EVENT_SOURCE) &&
+        type != PA_SUBSCRIPTION_EVENT_CHANGE) {
+        atomic_store(&devices_stale, true);
+    } else if (facility == PA_SUBSCRIPTION_EVENT_SERVER) {
+        // Default device changes
+        atomic_store(&devices_stale, true);
+    }
+}
+
+static int open_socket(const char *path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    // The socket file is created by bind() with the umask: no one else may connect to it
+    unlink(path);
+    mode_t previous = umask(077);
+    int bound = bind(fd, (struct sockaddr *) &address, sizeof(address));
+    umask(previous);
+    if (bound != 0 || listen(fd, 16) != 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void close_client(daemon_client *client) {
+    close(client->fd);
+    control_buffer_free(&client->input);
+    control_buffer_free(&client->output);
+    *client = (daemon_client) { .fd = -1 };
+}
+
+/**
+ * @brief Writes as much of the pending replies as the socket takes.
+ *
+ * @return false if the connection failed.
+ */
+static bool flush_client(daemon_client *client) {
+    while (client->output.length > 0) {
+        ssize_t written = send(client->fd, client->output.data, client->output.length, MSG_NOSIGNAL);
+        if (written < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        control_buffer_consume(&client->output, (size_t) written);
+    }
+    return true;
+}
+
+/**
+ * @brief Reads from a connection and executes the complete lines received.
+ *
+ * @return false if the connection is over.
+ */
+static bool serve_client(daemon_client *client) {
+    if (!control_buffer_reserve(&client->input, DAEMON_READ_SIZE)) {
+        return false;
+    }
+
+    ssize_t received = recv(client->fd, client->input.data + client->input.length, DAEMON_READ_SIZE, 0);
+    if (received < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    if (received == 0) {
+        // The client sent everything, it still reads the replies not written yet
+        client->session.quit = true;
+    } else {
+        client->input.length += (size_t) received;
+        size_t consumed = control_process(&client->session, client->input.data, client->input.length, &client->output);
+        control_buffer_consume(&client->input, consumed);
+    }
+
+    return flush_client(client) && !(client->session.quit && client->output.length == 0);
+}
+
+int main(int argc, char *argv[]) {
+    char default_path[108];
+    const char *socket_path = NULL;
+    const char *state_name = SHM_STATE_DEFAULT_NAME;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:p:")) != -1) {
+        switch (opt) {
+            case 's':
+                socket_path = optarg;
+                break;
+            case 'p':
+                state_name = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-s socket] [-p state name]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (!socket_path) {
+        // No shared fallback: a socket in /tmp could be taken over by another user
+        const char *runtime = getenv("XDG_RUNTIME_DIR");
+        if (!runtime) {
+            fprintf(stderr, "XDG_RUNTIME_DIR is not set, give the socket path with -s\n");
+            return 1;
+        }
+        snprintf(default_path, sizeof(default_path), "%s/easypulse.sock", runtime);
+        socket_path = default_path;
+    }
+
+    pulseaudio_manager *manager = manager_create();
+    if (!manager) {
+        fprintf(stderr, "Failed to initialize PulseAudio manager\n");
+        return 1;
+    }
+
+    shm_state_reader *state = NULL;
+    if (manager_start_publishing(manager, state_name)) {
+        state = shm_state_open(state_name);
+    }
+    manager_set_event_callback(manager, on_event, NULL);
+
+    int listener = open_socket(socket_path);
+    if (listener < 0) {
+        shm_state_close(state);
+        manager_cleanup(manager);
+        return 1;
+    }
+
+    struct sigaction action = { .sa_handler = stop };
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    daemon_client clients[DAEMON_MAX_CLIENTS] = { 0 };
+    struct pollfd pfds[DAEMON_MAX_CLIENTS + 1];
+    for (int i = 0; i < DAEMON_MAX_CLIENTS; ++i) {
+        clients[i].fd = -1;
+    }
+
+    printf("Listening on %s\n", socket_path);
+    fflush(stdout);
+
+    while (running) {
+        pfds[0].fd = listener;
+        pfds[0].events = POLLIN;
+        for (int i = 0; i < DAEMON_MAX_CLIENTS; ++i) {
+            pfds[i + 1].fd = clients[i].fd;
+            // A client that does not read its replies is not read either
+            bool readable = clients[i].output.length < DAEMON_MAX_PENDING && !clients[i].session.quit;
+            pfds[i + 1].events = readable ? POLLIN : 0;
+            if (clients[i].fd >= 0 && clients[i].output.length > 0) {
+                pfds[i + 1].events |= POLLOUT;
+            }
+        }
+
+        if (poll(pfds, DAEMON_MAX_CLIENTS + 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            int fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            int slot = -1;
+            for (int i = 0; i < DAEMON_MAX_CLIENTS && fd >= 0 && slot < 0; ++i) {
+                if (clients[i].fd < 0) {
+                    slot = i;
+                }
+            }
+            if (slot >= 0) {
+                daemon_client *client = &clients[slot];
+                client->fd = fd;
+                client->session = (control_session) {
+                    .manager = manager,
+                    .state = state,
+                    .devices_stale = &devices_stale,
+                };
+                control_buffer_init(&client->input);
+                control_buffer_init(&client->output);
+            } else if (fd >= 0) {
+                EASYPULSE_WARN("Too many connections, one was refused.");
+                close(fd);
+            }
+        }
+
+        for (int i = 0; i < DAEMON_MAX_CLIENTS; ++i) {
+            daemon_client *client = &clients[i];
+            short revents = pfds[i + 1].revents;
+            if (client->fd < 0 || pfds[i + 1].fd != client->fd || !revents) {
+                continue;
+            }
+
+            bool alive = true;
+            if (revents & POLLOUT) {
+                alive = flush_client(client) && !(client->session.quit && client->output.length == 0);
+            }
+            if (alive && (revents & (POLLIN | POLLHUP | POLLERR))) {
+                alive = serve_client(client);
+            }
+            if (!alive) {
+                close_client(client);
+            }
+        }
+    }
+
+    for (int i = 0; i < DAEMON_MAX_CLIENTS; ++i) {
+        if (clients[i].fd >= 0) {
+            close_client(&clients[i]);
+        }
+    }
+    close(listener);
+    unlink(socket_path);
+
+    shm_state_close(state);
+    manager_cleanup(manager);
+    return 0;
+}
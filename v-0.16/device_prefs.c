@@ -0,0 +1,475 @@
+/**
+ * @file device_prefs.c
+ * @brief Implementation of the per-device preference store.
+ *
+ * A store is always kept in its file format. An edit collects the entries to keep and
+ * the new one, in order, and writes them into a new buffer, which replaces the old one
+ * (allocated or mapped).
+ */
+
+#include "device_prefs.h"
+#include "easypulse_log.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DEVICE_PREFS_ALIGN(size) (((size) + 7) & ~(size_t) 7)
+
+struct device_prefs {
+    const uint8_t *data;                // The store in its file format.
+    size_t size;
+    bool mapped;                        // Mapped from a file (otherwise allocated).
+};
+
+//An entry to write, with its volumes and strings (offsets are set when written).
+typedef struct device_prefs_item {
+    device_prefs_entry entry;
+    const uint32_t *volumes;
+    const char *port;
+    const char *profile;
+} device_prefs_item;
+
+//Positions of the tables of a store.
+typedef struct device_prefs_layout {
+    size_t entries;
+    size_t volumes;
+    size_t strings;
+    size_t size;
+} device_prefs_layout;
+
+static device_prefs_layout device_prefs_layout_of(const device_prefs_header *header) {
+    device_prefs_layout layout;
+    layout.entries = DEVICE_PREFS_ALIGN(sizeof(device_prefs_header));
+    layout.volumes = layout.entries + DEVICE_PREFS_ALIGN((size_t) header->entry_count * sizeof(device_prefs_entry));
+    layout.strings = layout.volumes + DEVICE_PREFS_ALIGN((size_t) header->volume_count * sizeof(uint32_t));
+    layout.size = layout.strings + header->strings_size;
+    return layout;
+}
+
+/**
+ * @brief Order of the entries: by id, then by kind.
+ *
+ * @return A negative number, zero or a positive number if the entry comes before, is
+ *         or comes after the key.
+ */
+static int device_prefs_compare(const device_prefs_entry *entry, device_prefs_kind kind, uint64_t id) {
+    if (entry->id != id) {
+        return entry->id < id ? -1 : 1;
+    }
+    return (int) entry->kind - (int) kind;
+}
+
+/**
+ * @brief Appends a string to the strings of a store being built.
+ *
+ * @return Its offset, or DEVICE_PREFS_NONE for NULL.
+ */
+static uint32_t device_prefs_put_string(uint8_t *strings, uint32_t *used, const char *text) {
+    if (!text) {
+        return DEVICE_PREFS_NONE;
+    }
+    uint32_t offset = *used;
+    size_t length = strlen(text) + 1;
+    memcpy(strings + offset, text, length);
+    *used += (uint32_t) length;
+    return offset;
+}
+
+/**
+ * @brief Replaces the content of a store by a list of items.
+ *
+ * The items may point into the current content, which is only released once the new
+ * one is written.
+ *
+ * @param prefs The store.
+ * @param items The items, sorted and without duplicates.
+ * @param count Number of items.
+ * @return true on success, false on allocation failure (the store is then unchanged).
+ */
+static bool device_prefs_build(device_prefs *prefs, const device_prefs_item *items, uint32_t count) {
+    device_prefs_header header = {
+        .magic = DEVICE_PREFS_MAGIC,
+        .version = DEVICE_PREFS_VERSION,
+        .header_size = sizeof(device_prefs_header),
+        .entry_count = count,
+    };
+
+    size_t strings_size = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        header.volume_count += items[i].entry.channels;
+        strings_size += items[i].port ? strlen(items[i].port) + 1 : 0;
+        strings_size += items[i].profile ? strlen(items[i].profile) + 1 : 0;
+    }
+    header.strings_size = (uint32_t) strings_size;
+
+    device_prefs_layout layout = device_prefs_layout_of(&header);
+    header.size = (uint32_t) layout.size;
+
+    uint8_t *data = calloc(1, layout.size);
+    if (!data) {
+        EASYPULSE_ERROR("Failed to allocate memory for the device preferences.");
+        return false;
+    }
+
+    memcpy(data, &header, sizeof(device_prefs_header));
+    device_prefs_entry *entries = (device_prefs_entry *) (data + layout.entries);
+    uint32_t *volumes = (uint32_t *) (data + layout.volumes);
+    uint8_t *strings = data + layout.strings;
+    uint32_t volume_count = 0;
+    uint32_t strings_used = 0;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        entries[i] = items[i].entry;
+        entries[i].volumes = volume_count;
+        entries[i].port = device_prefs_put_string(strings, &strings_used, items[i].port);
+        entries[i].profile = device_prefs_put_string(strings, &strings_used, items[i].profile);
+        entries[i].reserved = 0;
+        if (items[i].entry.channels > 0) {
+            memcpy(volumes + volume_count, items[i].volumes, items[i].entry.channels * sizeof(uint32_t));
+            volume_count += items[i].entry.channels;
+        }
+    }
+
+    if (prefs->mapped) {
+        munmap((void *) prefs->data, prefs->size);
+    } else {
+        free((void *) prefs->data);
+    }
+    prefs->data = data;
+    prefs->size = layout.size;
+    prefs->mapped = false;
+    return true;
+}
+
+/**
+ * @brief Rebuilds a store with an entry replaced, added or removed.
+ *
+ * A new default device clears the default flag of the other devices of its direction.
+ *
+ * @param prefs The store.
+ * @param kind Kind of the entry.
+ * @param id Id of the entry.
+ * @param item The new entry, or NULL to remove it.
+ * @return true on success, false on allocation failure.
+ */
+static bool device_prefs_replace(device_prefs *prefs, device_prefs_kind kind, uint64_t id,
+                                 const device_prefs_item *item) {
+    const device_prefs_header *header = device_prefs_get_header(prefs);
+    const device_prefs_entry *entries = device_prefs_get_entries(prefs);
+    const uint32_t *volumes = (const uint32_t *) (prefs->data + device_prefs_layout_of(header).volumes);
+
+    device_prefs_item *items = malloc(((size_t) header->entry_count + 1) * sizeof(device_prefs_item));
+    if (!items) {
+        EASYPULSE_ERROR("Failed to allocate memory for the device preferences.");
+        return false;
+    }
+
+    bool new_default = item && (item->entry.flags & DEVICE_PREFS_DEFAULT);
+    bool inserted = item == NULL;
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < header->entry_count; ++i) {
+        int order = device_prefs_compare(&entries[i], kind, id);
+        if (!inserted && order > 0) {
+            items[count++] = *item;
+            inserted = true;
+        }
+        if (order == 0) {
+            continue;
+        }
+
+        items[count] = (device_prefs_item) {
+            .entry = entries[i],
+            .volumes = volumes + entries[i].volumes,
+            .port = device_prefs_get_string(prefs, entries[i].port),
+            .profile = device_prefs_get_string(prefs, entries[i].profile),
+        };
+        if (new_default && entries[i].kind == kind) {
+            items[count].entry.flags &= (uint8_t) ~DEVICE_PREFS_DEFAULT;
+        }
+        count++;
+    }
+    if (!inserted) {
+        items[count++] = *item;
+    }
+
+    bool built = device_prefs_build(prefs, items, count);
+    free(items);
+    return built;
+}
+
+/**
+ * @brief Creates an empty store.
+ *
+ * @return The store, to be freed with device_prefs_free(), or NULL on failure.
+ */
+device_prefs *device_prefs_create(void) {
+    device_prefs *prefs = calloc(1, sizeof(device_prefs));
+    if (!prefs || !device_prefs_build(prefs, NULL, 0)) {
+        EASYPULSE_ERROR("Failed to allocate memory for the device preferences.");
+        free(prefs);
+        return NULL;
+    }
+    return prefs;
+}
+
+/**
+ * @brief Saves the settings of a device, replacing those saved before.
+ *
+ * @param prefs The store.
+ * @param output true for a sink, false for a source.
+ * @param id Stable id of the device (manager_device_stable_id() of its name).
+ * @param volume Volume of the channels, or NULL not to save the volume.
+ * @param mute Mute state (0 or 1), or -1 not to save it.
+ * @param port Active port, or NULL not to save it.
+ * @param is_default Whether the device is made the default one when it appears. The
+ *        other devices of the same direction are then no longer the default one.
+ * @return true on success, false otherwise.
+ */
+bool device_prefs_set_device(device_prefs *prefs, bool output, uint64_t id, const pa_cvolume *volume, int mute,
+                             const char *port, bool is_default) {
+    if (!prefs || (volume && (!pa_cvolume_valid(volume) || volume->channels == 0))) {
+        EASYPULSE_ERROR("Invalid device preferences or volume.");
+        return false;
+    }
+
+    device_prefs_kind kind = output ? DEVICE_PREFS_OUTPUT : DEVICE_PREFS_INPUT;
+    uint32_t volumes[PA_CHANNELS_MAX];
+    device_prefs_item item = {
+        .entry = {
+            .id = id,
+            .kind = (uint8_t) kind,
+            .flags = (uint8_t) ((mute >= 0 ? DEVICE_PREFS_MUTE_SAVED : 0) | (mute > 0 ? DEVICE_PREFS_MUTED : 0) |
+                                (is_default ? DEVICE_PREFS_DEFAULT : 0)),
+            .channels = volume ? volume->channels : 0,
+        },
+        .volumes = volumes,
+        .port = port,
+    };
+    for (uint8_t channel = 0; volume && channel < volume->channels; ++channel) {
+        volumes[channel] = volume->values[channel];
+    }
+
+    return device_prefs_replace(prefs, kind, id, &item);
+}
+
+/**
+ * @brief Saves the profile of a card, replacing the one saved before.
+ *
+ * @param prefs The store.
+ * @param id Stable id of the card (manager_device_stable_id() of its name).
+ * @param profile Name of the profile.
+ * @return true on success, false otherwise.
+ */
+bool device_prefs_set_card(device_prefs *prefs, uint64_t id, const char *profile) {
+    if (!prefs || !profile) {
+        EASYPULSE_ERROR("Invalid device preferences or profile.");
+        return false;
+    }
+
+    device_prefs_item item = {
+        .entry = { .id = id, .kind = DEVICE_PREFS_CARD },
+        .profile = profile,
+    };
+    return device_prefs_replace(prefs, DEVICE_PREFS_CARD, id, &item);
+}
+
+/**
+ * @brief Forgets the settings of a device or a card.
+ *
+ * @param prefs The store.
+ * @param kind What the entry is the preferences of.
+ * @param id Stable id of the device or the card.
+ * @return true if the entry was removed, false if it was unknown or on failure.
+ */
+bool device_prefs_remove(device_prefs *prefs, device_prefs_kind kind, uint64_t id) {
+    if (!device_prefs_find(prefs, kind, id)) {
+        return false;
+    }
+    return device_prefs_replace(prefs, kind, id, NULL);
+}
+
+/**
+ * @brief Writes a store to a file, replacing it atomically.
+ *
+ * @param prefs The store.
+ * @param path Path of the file.
+ * @return true on success, false otherwise.
+ */
+bool device_prefs_save(const device_prefs *prefs, const char *path) {
+    if (!prefs || !path) {
+        return false;
+    }
+
+    // Written next to the file and renamed, so that a mapped store never changes
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+
+    FILE *file = fopen(temporary, "wb");
+    if (!file) {
+        EASYPULSE_ERROR("Cannot create the device preferences file %s.", temporary);
+        return false;
+    }
+    bool written = fwrite(prefs->data, 1, prefs->size, file) == prefs->size;
+    written = fclose(file) == 0 && written;
+    if (!written || rename(temporary, path) != 0) {
+        EASYPULSE_ERROR("Cannot write the device preferences file %s.", path);
+        unlink(temporary);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Checks that everything a store refers to lies within it, and that its entries
+ * are sorted.
+ */
+static bool device_prefs_valid(const uint8_t *data, size_t size) {
+    const device_prefs_header *header = (const device_prefs_header *) data;
+    if (size < sizeof(device_prefs_header) || header->magic != DEVICE_PREFS_MAGIC ||
+        header->version != DEVICE_PREFS_VERSION || header->header_size != sizeof(device_prefs_header) ||
+        header->size != size) {
+        return false;
+    }
+
+    device_prefs_layout layout = device_prefs_layout_of(header);
+    if (layout.size != size || (header->strings_size > 0 && data[size - 1] != '\0')) {
+        return false;
+    }
+
+    const device_prefs_entry *entries = (const device_prefs_entry *) (data + layout.entries);
+    for (uint32_t i = 0; i < header->entry_count; ++i) {
+        const device_prefs_entry *entry = &entries[i];
+        if (entry->kind > DEVICE_PREFS_CARD || entry->channels > PA_CHANNELS_MAX ||
+            (uint64_t) entry->volumes + entry->channels > header->volume_count ||
+            (entry->port != DEVICE_PREFS_NONE && entry->port >= header->strings_size) ||
+            (entry->profile != DEVICE_PREFS_NONE && entry->profile >= header->strings_size) ||
+            (i > 0 && device_prefs_compare(&entries[i - 1], (device_prefs_kind) entry->kind, entry->id) >= 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Maps a store file.
+ *
+ * @param path Path of the file.
+ * @return The store, to be freed with device_prefs_free(), or NULL if the file is
+ *         missing or is not a valid store of this version.
+ */
+device_prefs *device_prefs_load(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        EASYPULSE_ERROR("Cannot open the device preferences file %s.", path);
+        return NULL;
+    }
+
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(device_prefs_header) && st.st_size <= UINT32_MAX) {
+        data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        EASYPULSE_ERROR("Cannot map the device preferences file %s.", path);
+        return NULL;
+    }
+    if (!device_prefs_valid(data, (size_t) st.st_size)) {
+        EASYPULSE_ERROR("The device preferences file %s is invalid or has another version.", path);
+        munmap(data, (size_t) st.st_size);
+        return NULL;
+    }
+
+    device_prefs *prefs = malloc(sizeof(device_prefs));
+    if (!prefs) {
+        EASYPULSE_ERROR("Failed to allocate memory for the device preferences.");
+        munmap(data, (size_t) st.st_size);
+        return NULL;
+    }
+    prefs->data = data;
+    prefs->size = (size_t) st.st_size;
+    prefs->mapped = true;
+    return prefs;
+}
+
+/**
+ * @brief Frees or unmaps a store.
+ *
+ * @param prefs The store (NULL is ignored).
+ */
+void device_prefs_free(device_prefs *prefs) {
+    if (!prefs) {
+        return;
+    }
+    if (prefs->mapped) {
+        munmap((void *) prefs->data, prefs->size);
+    } else {
+        free((void *) prefs->data);
+    }
+    free(prefs);
+}
+
+const device_prefs_header *device_prefs_get_header(const device_prefs *prefs) {
+    return (const device_prefs_header *) prefs->data;
+}
+
+const device_prefs_entry *device_prefs_get_entries(const device_prefs *prefs) {
+    return (const device_prefs_entry *) (prefs->data + device_prefs_layout_of(device_prefs_get_header(prefs)).entries);
+}
+
+/**
+ * @brief Looks up the entry of a device or a card.
+ *
+ * @param prefs The store (NULL finds nothing).
+ * @param kind What the entry is the preferences of.
+ * @param id Stable id of the device or the card.
+ * @return The entry, or NULL if the store does not know it.
+ */
+const device_prefs_entry *device_prefs_find(const device_prefs *prefs, device_prefs_kind kind, uint64_t id) {
+    if (!prefs) {
+        return NULL;
+    }
+
+    const device_prefs_entry *entries = device_prefs_get_entries(prefs);
+    uint32_t low = 0;
+    uint32_t high = device_prefs_get_header(prefs)->entry_count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        int order = device_prefs_compare(&entries[middle], kind, id);
+        if (order == 0) {
+            return &entries[middle];
+        }
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return NULL;
+}
+
+bool device_prefs_get_volume(const device_prefs *prefs, const device_prefs_entry *entry, pa_cvolume *volume) {
+    if (!prefs || !entry || entry->channels == 0) {
+        return false;
+    }
+
+    const uint32_t *volumes = (const uint32_t *) (prefs->data + device_prefs_layout_of(device_prefs_get_header(prefs)).volumes);
+    volume->channels = entry->channels;
+    for (uint8_t channel = 0; channel < entry->channels; ++channel) {
+        volume->values[channel] = volumes[entry->volumes + channel];
+    }
+    return true;
+}
+
+const char *device_prefs_get_string(const device_prefs *prefs, uint32_t offset) {
+    if (offset == DEVICE_PREFS_NONE) {
+        return NULL;
+    }
+    return (const char *) prefs->data + device_prefs_layout_of(device_prefs_get_header(prefs)).strings + offset;
+}
@@ -0,0 +1,106 @@
+/**
+ * @file device_prefs.h
+ * @brief Per-device preference store, applied by the manager when a device appears.
+ *
+ * A store holds, for each device it knows, the settings to give it back when it
+ * reappears (a USB interface plugged in again, a card switched back to a profile): the
+ * volume of each channel, the mute state, the active port and whether it is the
+ * default device, and for each card its active profile. Devices and cards are keyed by
+ * their stable id (manager_device_stable_id() of their name), so an entry outlives the
+ * index the server gave the device.
+ *
+ * The store does not talk to PulseAudio. Once given to the manager with
+ * manager_set_device_prefs(), the manager looks up every sink, source and card reported
+ * new by the server and sends the saved settings that differ, without waiting, from the
+ * mainloop thread: the settings of a device reach the server as one pipelined batch,
+ * right behind the device itself.
+ *
+ * A store is kept in memory in its file format, so device_prefs_save() writes it as is
+ * and device_prefs_load() maps the file: header, entries, channel volumes and strings
+ * follow each other, each table aligned on 8 bytes, in the byte order of the machine.
+ * Entries are sorted by id, so a lookup is a binary search in the mapping. Editing a
+ * store rebuilds it, which is meant for the rare changes of the saved settings, not for
+ * the hot path.
+ */
+
+#ifndef DEVICE_PREFS_H
+#define DEVICE_PREFS_H
+
+#include <pulse/pulseaudio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DEVICE_PREFS_MAGIC 0x46525045u  // "EPRF" in little endian.
+#define DEVICE_PREFS_VERSION 1
+#define DEVICE_PREFS_NONE UINT32_MAX    // No string (offsets into the strings).
+
+//What an entry of a store is the preferences of.
+typedef enum device_prefs_kind {
+    DEVICE_PREFS_OUTPUT,                // A sink.
+    DEVICE_PREFS_INPUT,                 // A source.
+    DEVICE_PREFS_CARD                   // A card (only the profile is saved).
+} device_prefs_kind;
+
+//Flags of an entry.
+#define DEVICE_PREFS_MUTE_SAVED 0x01    // The mute state is saved.
+#define DEVICE_PREFS_MUTED 0x02         // Saved mute state.
+#define DEVICE_PREFS_DEFAULT 0x04       // The device is made the default one.
+
+//Start of a store file.
+typedef struct device_prefs_header {
+    uint32_t magic;                     // DEVICE_PREFS_MAGIC.
+    uint16_t version;                   // DEVICE_PREFS_VERSION.
+    uint16_t header_size;               // sizeof(device_prefs_header).
+    uint32_t size;                      // Size of the whole store.
+    uint32_t entry_count;
+    uint32_t volume_count;              // Channel volumes of all the entries.
+    uint32_t strings_size;              // Size of the strings, which end the store.
+} device_prefs_header;
+
+//Saved settings of a device or a card.
+typedef struct device_prefs_entry {
+    uint64_t id;                        // Stable id of the sink, source or card.
+    uint32_t volumes;                   // Position of its first channel volume in the volumes.
+    uint32_t port;                      // Port of a device (offset in the strings, DEVICE_PREFS_NONE if not saved).
+    uint32_t profile;                   // Profile of a card (offset in the strings, DEVICE_PREFS_NONE if not saved).
+    uint8_t kind;                       // device_prefs_kind.
+    uint8_t flags;                      // DEVICE_PREFS_* flags.
+    uint8_t channels;                   // Number of channel volumes (0 if the volume is not saved).
+    uint8_t reserved;
+} device_prefs_entry;
+
+typedef struct device_prefs device_prefs;
+
+device_prefs *device_prefs_create(void);                            //Creates an empty store. Returns NULL on failure.
+device_prefs *device_prefs_load(const char *path);                  //Maps a store file. Returns NULL if missing or invalid.
+bool device_prefs_save(const device_prefs *prefs, const char *path);  //Writes a store to a file.
+void device_prefs_free(device_prefs *prefs);                        //Frees or unmaps a store.
+
+bool device_prefs_set_device(device_prefs *prefs, bool output,
+uint64_t id, const pa_cvolume *volume, int mute, const char *port,
+bool is_default);                                                   //Saves the settings of a device (NULL or -1 for the unsaved ones).
+bool device_prefs_set_card(device_prefs *prefs, uint64_t id,
+const char *profile);                                               //Saves the profile of a card.
+bool device_prefs_remove(device_prefs *prefs,
+device_prefs_kind kind, uint64_t id);                               //Forgets a device or a card.
+
+const device_prefs_header *device_prefs_get_header(
+const device_prefs *prefs);                                         //Header of a store, with the counts.
+const device_prefs_entry *device_prefs_get_entries(
+const device_prefs *prefs);                                         //Entries of a store, sorted by id.
+const device_prefs_entry *device_prefs_find(const device_prefs *prefs,
+device_prefs_kind kind, uint64_t id);                               //Entry of a device or a card, NULL if unknown.
+bool device_prefs_get_volume(const device_prefs *prefs,
+const device_prefs_entry *entry, pa_cvolume *volume);               //Saved volume of an entry, false if not saved.
+const char *device_prefs_get_string(const device_prefs *prefs,
+uint32_t offset);                                                   //String of a store, NULL for DEVICE_PREFS_NONE.
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
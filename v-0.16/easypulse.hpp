@@ -0,0 +1,414 @@
+/**
+ * @file easypulse.hpp
+ * @brief C++17 layer over the C API: move-only owners and views over library memory.
+ *
+ * Everything the C API hands out as an owning pointer (the manager, stream lists,
+ * device info arrays, channel names, module lists) is held here by a move-only owner
+ * that calls the matching cleanup function once, so it can neither leak nor be freed
+ * twice. Nothing is copied: the owners and the manager give views (span, string_view
+ * and the *_view classes below) that point into the memory of the library.
+ *
+ * A view is valid as long as the object it was taken from, and the views of the devices
+ * until manager::refresh_devices(). To keep them from outliving a temporary, the
+ * functions returning views cannot be called on rvalues: write
+ *
+ *     auto streams = easypulse::output_streams::query(manager);
+ *     for (const auto &stream : streams) { ... stream.property(PA_PROP_APPLICATION_NAME) ... }
+ *
+ * rather than taking a view from output_streams::query(manager) directly.
+ *
+ * std::span is C++20, so easypulse::span provides the part of it used here. Channel
+ * layouts and volume math for fixed layouts are in easypulse_layout.hpp.
+ */
+
+#ifndef EASYPULSE_HPP
+#define EASYPULSE_HPP
+
+#include "easypulse_core.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <string_view>
+#include <utility>
+
+namespace easypulse {
+
+//Contiguous read-only view of an array (the subset of std::span used by this layer).
+template <typename T>
+class span {
+public:
+    using element_type = T;
+    using iterator = T *;
+
+    constexpr span() noexcept = default;
+    constexpr span(T *data, std::size_t size) noexcept : data_(data), size_(data ? size : 0) {}
+
+    constexpr T *data() const noexcept { return data_; }
+    constexpr std::size_t size() const noexcept { return size_; }
+    constexpr bool empty() const noexcept { return size_ == 0; }
+    constexpr T &operator[](std::size_t i) const noexcept { return data_[i]; }
+    constexpr iterator begin() const noexcept { return data_; }
+    constexpr iterator end() const noexcept { return data_ + size_; }
+
+private:
+    T *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+//View of a C string of the library, empty for NULL.
+inline std::string_view view(const char *text) noexcept {
+    return text ? std::string_view(text) : std::string_view();
+}
+
+//Random access range presenting the elements of a C array through a view class. View
+//is constructed from a pointer to one element.
+template <typename Raw, typename View>
+class view_range {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = View;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = View;
+
+        constexpr iterator() noexcept = default;
+        constexpr explicit iterator(const Raw *position) noexcept : position_(position) {}
+
+        constexpr View operator*() const noexcept { return View(position_); }
+        constexpr View operator[](difference_type n) const noexcept { return View(position_ + n); }
+        constexpr iterator &operator++() noexcept { ++position_; return *this; }
+        constexpr iterator operator++(int) noexcept { return iterator(position_++); }
+        constexpr iterator &operator--() noexcept { --position_; return *this; }
+        constexpr iterator operator--(int) noexcept { return iterator(position_--); }
+        constexpr iterator &operator+=(difference_type n) noexcept { position_ += n; return *this; }
+        constexpr iterator &operator-=(difference_type n) noexcept { position_ -= n; return *this; }
+        constexpr iterator operator+(difference_type n) const noexcept { return iterator(position_ + n); }
+        constexpr iterator operator-(difference_type n) const noexcept { return iterator(position_ - n); }
+        constexpr difference_type operator-(iterator other) const noexcept { return position_ - other.position_; }
+        constexpr bool operator==(iterator other) const noexcept { return position_ == other.position_; }
+        constexpr bool operator!=(iterator other) const noexcept { return position_ != other.position_; }
+        constexpr bool operator<(iterator other) const noexcept { return position_ < other.position_; }
+
+    private:
+        const Raw *position_ = nullptr;
+    };
+
+    constexpr view_range() noexcept = default;
+    constexpr view_range(const Raw *data, std::size_t size) noexcept : data_(data), size_(data ? size : 0) {}
+
+    constexpr std::size_t size() const noexcept { return size_; }
+    constexpr bool empty() const noexcept { return size_ == 0; }
+    constexpr View operator[](std::size_t i) const noexcept { return View(data_ + i); }
+    constexpr iterator begin() const noexcept { return iterator(data_); }
+    constexpr iterator end() const noexcept { return iterator(data_ + size_); }
+
+private:
+    const Raw *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+//A card profile of a device.
+class profile_view {
+public:
+    constexpr explicit profile_view(const pa_card_profile_info *profile) noexcept : profile_(profile) {}
+
+    explicit operator bool() const noexcept { return profile_ != nullptr; }
+    std::string_view name() const noexcept { return view(profile_->name); }
+    std::string_view description() const noexcept { return view(profile_->description); }
+    std::uint32_t sinks() const noexcept { return profile_->n_sinks; }
+    std::uint32_t sources() const noexcept { return profile_->n_sources; }
+    std::uint32_t priority() const noexcept { return profile_->priority; }
+    const pa_card_profile_info &raw() const noexcept { return *profile_; }
+
+private:
+    const pa_card_profile_info *profile_;
+};
+
+//An output or input device held by the manager.
+class device_view {
+public:
+    constexpr explicit device_view(const pulseaudio_device *device) noexcept : device_(device) {}
+
+    std::uint32_t index() const noexcept { return device_->index; }
+    std::string_view code() const noexcept { return view(device_->code); }
+    std::string_view name() const noexcept { return view(device_->name); }
+    std::string_view alsa_id() const noexcept { return view(device_->alsa_id); }
+    std::uint64_t stable_id() const noexcept { return manager_device_stable_id(device_->code); }
+    int sample_rate() const noexcept { return device_->sample_rate; }
+    int volume() const noexcept { return device_->master_volume; }
+    bool mute() const noexcept { return device_->mute; }
+    int min_channels() const noexcept { return device_->min_channels; }
+    int max_channels() const noexcept { return device_->max_channels; }
+    std::uint32_t owner_module() const noexcept { return device_->owner_module; }
+
+    //Channels whose names (and volumes, when known) the device holds. The names are
+    //static strings, so their views stay valid after refresh_devices().
+    std::size_t channel_count() const noexcept {
+        return device_->max_channels > 0 ? std::min<std::size_t>(device_->max_channels, PA_CHANNELS_MAX) : 0;
+    }
+    std::string_view channel_name(std::size_t channel) const noexcept {
+        return channel < channel_count() ? view(device_->channel_names[channel]) : std::string_view();
+    }
+    span<const int> channel_volumes() const noexcept {
+        return span<const int>(device_->channel_volume, device_->max_channels > 0 ? device_->max_channels : 0);
+    }
+
+    view_range<pa_card_profile_info, profile_view> profiles() const noexcept {
+        return view_range<pa_card_profile_info, profile_view>(device_->profiles, device_->profile_count);
+    }
+    profile_view active_profile() const noexcept { return profile_view(device_->active_profile); }
+
+    const pulseaudio_device &raw() const noexcept { return *device_; }
+
+private:
+    const pulseaudio_device *device_;
+};
+
+using device_range = view_range<pulseaudio_device, device_view>;
+
+//A playback (output_stream_info) or recording (input_stream_info) stream.
+template <typename Info>
+class stream_view {
+public:
+    constexpr explicit stream_view(const Info *stream) noexcept : stream_(stream) {}
+
+    std::uint32_t index() const noexcept { return stream_->index; }
+    std::uint32_t device() const noexcept { return stream_->parent_index; }
+    std::uint32_t owner_module() const noexcept { return stream_->owner_module; }
+    std::string_view name() const noexcept { return view(stream_->name); }
+    std::string_view driver() const noexcept { return view(stream_->driver); }
+    const pa_sample_spec &sample_spec() const noexcept { return stream_->sample_spec; }
+    const pa_channel_map &channel_map() const noexcept { return stream_->channel_map; }
+    const pa_cvolume &volume() const noexcept { return stream_->volume; }
+
+    //Value of a proplist key, empty if the stream does not have it.
+    std::string_view property(const char *key) const noexcept {
+        return stream_->proplist ? view(pa_proplist_gets(stream_->proplist, key)) : std::string_view();
+    }
+
+    const Info &raw() const noexcept { return *stream_; }
+
+private:
+    const Info *stream_;
+};
+
+using output_stream_view = stream_view<output_stream_info>;
+using input_stream_view = stream_view<input_stream_info>;
+
+//Move-only owner of a pointer freed by a cleanup function of the library.
+template <typename T, void (*Free)(T *)>
+class owner {
+public:
+    constexpr owner() noexcept = default;
+    constexpr explicit owner(T *pointer) noexcept : pointer_(pointer) {}
+    owner(const owner &) = delete;
+    owner &operator=(const owner &) = delete;
+    owner(owner &&other) noexcept : pointer_(std::exchange(other.pointer_, nullptr)) {}
+    owner &operator=(owner &&other) noexcept {
+        if (this != &other) {
+            reset(std::exchange(other.pointer_, nullptr));
+        }
+        return *this;
+    }
+    ~owner() { reset(); }
+
+    explicit operator bool() const noexcept { return pointer_ != nullptr; }
+    T *get() const noexcept { return pointer_; }
+    T *release() noexcept { return std::exchange(pointer_, nullptr); }
+    void reset(T *pointer = nullptr) noexcept {
+        T *old = std::exchange(pointer_, pointer);
+        if (old) {
+            Free(old);
+        }
+    }
+
+private:
+    T *pointer_ = nullptr;
+};
+
+//Sink inputs, from get_output_streams().
+class output_streams : public owner<output_stream_list, output_streams_cleanup> {
+public:
+    using owner::owner;
+
+    static output_streams query(pa_context *context) noexcept { return output_streams(get_output_streams(context)); }
+    static output_streams query(const pulseaudio_manager *manager) noexcept { return query(manager->context); }
+
+    std::size_t size() const noexcept { return get() ? get()->num_inputs : 0; }
+    bool empty() const noexcept { return size() == 0; }
+    view_range<output_stream_info, output_stream_view> streams() const & noexcept {
+        return view_range<output_stream_info, output_stream_view>(get() ? get()->inputs : nullptr, size());
+    }
+    void streams() const && = delete;
+    auto begin() const & noexcept { return streams().begin(); }
+    auto end() const & noexcept { return streams().end(); }
+    output_stream_view operator[](std::size_t i) const & noexcept { return streams()[i]; }
+    void operator[](std::size_t i) const && = delete;
+};
+
+//Source outputs, from get_input_streams().
+class input_streams : public owner<input_stream_list, input_streams_cleanup> {
+public:
+    using owner::owner;
+
+    static input_streams query(pa_context *context) noexcept { return input_streams(get_input_streams(context)); }
+    static input_streams query(const pulseaudio_manager *manager) noexcept { return query(manager->context); }
+
+    std::size_t size() const noexcept { return get() ? get()->num_inputs : 0; }
+    bool empty() const noexcept { return size() == 0; }
+    view_range<input_stream_info, input_stream_view> streams() const & noexcept {
+        return view_range<input_stream_info, input_stream_view>(get() ? get()->outputs : nullptr, size());
+    }
+    void streams() const && = delete;
+    auto begin() const & noexcept { return streams().begin(); }
+    auto end() const & noexcept { return streams().end(); }
+    input_stream_view operator[](std::size_t i) const & noexcept { return streams()[i]; }
+    void operator[](std::size_t i) const && = delete;
+};
+
+//NULL-terminated array of device informations, from get_available_output_devices() or
+//get_available_input_devices().
+template <typename Info, void (*Free)(Info **)>
+class device_infos : public owner<Info *, Free> {
+public:
+    using owner<Info *, Free>::owner;
+    using owner<Info *, Free>::get;
+
+    //The array as a span of non-null pointers (counted on every call).
+    span<Info *const> pointers() const & noexcept {
+        std::size_t count = 0;
+        while (get() && get()[count]) {
+            ++count;
+        }
+        return span<Info *const>(get(), count);
+    }
+    void pointers() const && = delete;
+};
+
+using output_device_infos = device_infos<pa_sink_info, delete_output_devices>;
+using input_device_infos = device_infos<pa_source_info, delete_input_devices>;
+
+inline output_device_infos available_output_devices() noexcept {
+    return output_device_infos(get_available_output_devices());
+}
+
+inline input_device_infos available_input_devices() noexcept {
+    return input_device_infos(get_available_input_devices());
+}
+
+//Channel names, from get_output_channel_names() or get_input_channel_names(). The names
+//are static strings: only the array is owned.
+class channel_names {
+public:
+    constexpr channel_names() noexcept = default;
+    channel_names(const char **names, int count) noexcept : names_(names), count_(names && count > 0 ? count : 0) {}
+    channel_names(const channel_names &) = delete;
+    channel_names &operator=(const channel_names &) = delete;
+    channel_names(channel_names &&other) noexcept
+        : names_(std::exchange(other.names_, nullptr)), count_(std::exchange(other.count_, 0)) {}
+    channel_names &operator=(channel_names &&other) noexcept {
+        if (this != &other) {
+            clear();
+            names_ = std::exchange(other.names_, nullptr);
+            count_ = std::exchange(other.count_, 0);
+        }
+        return *this;
+    }
+    ~channel_names() { clear(); }
+
+    static channel_names output(const char *code, int count) noexcept {
+        return channel_names(get_output_channel_names(code, count), count);
+    }
+    static channel_names input(const char *code, int count) noexcept {
+        return channel_names(get_input_channel_names(code, count), count);
+    }
+
+    explicit operator bool() const noexcept { return names_ != nullptr; }
+    std::size_t size() const noexcept { return count_; }
+    std::string_view operator[](std::size_t i) const noexcept { return view(names_[i]); }
+
+private:
+    void clear() noexcept {
+        free(names_);
+        names_ = nullptr;
+        count_ = 0;
+    }
+
+    const char **names_ = nullptr;
+    std::size_t count_ = 0;
+};
+
+//Loaded modules, from manager_list_modules().
+class modules : public owner<module_list, module_list_cleanup> {
+public:
+    using owner::owner;
+
+    span<const module_info> list() const & noexcept {
+        return get() ? span<const module_info>(get()->modules, get()->count) : span<const module_info>();
+    }
+    void list() const && = delete;
+    auto begin() const & noexcept { return list().begin(); }
+    auto end() const & noexcept { return list().end(); }
+};
+
+//Move-only owner of a pulseaudio_manager.
+class manager : public owner<pulseaudio_manager, manager_cleanup> {
+public:
+    using owner::owner;
+
+    //Connects to the sound server. Test the result with operator bool.
+    static manager create() noexcept { return manager(manager_create()); }
+
+    device_range outputs() const & noexcept { return device_range(get()->outputs, get()->output_count); }
+    device_range inputs() const & noexcept { return device_range(get()->inputs, get()->input_count); }
+    void outputs() const && = delete;
+    void inputs() const && = delete;
+    std::string_view default_output() const & noexcept { return view(get()->active_output_device); }
+    std::string_view default_input() const & noexcept { return view(get()->active_input_device); }
+    void default_output() const && = delete;
+    void default_input() const && = delete;
+
+    //Enumerates the devices again. The device views taken before become invalid.
+    bool refresh_devices() noexcept { return manager_refresh_devices(get()); }
+
+    output_streams sink_inputs() const noexcept { return output_streams::query(get()); }
+    input_streams source_outputs() const noexcept { return input_streams::query(get()); }
+    modules list_modules() const noexcept { return modules(manager_list_modules(get())); }
+
+    int set_volume(std::uint32_t device_index, int volume) noexcept {
+        return manager_set_master_volume(get(), device_index, volume);
+    }
+    //position is the position of the device in outputs() / inputs(), as in the C API.
+    int set_output_mute(std::uint32_t position, bool mute) noexcept {
+        return manager_toggle_output_mute(get(), position, mute);
+    }
+    int set_input_mute(std::uint32_t position, bool mute) noexcept {
+        return manager_toggle_input_mute(get(), position, mute);
+    }
+    int set_output_channel_mute(std::uint32_t device_index, std::uint32_t channel, bool mute) noexcept {
+        return manager_set_output_mute_state(get(), device_index, channel, mute);
+    }
+    int set_input_channel_mute(std::uint32_t device_index, std::uint32_t channel, bool mute) noexcept {
+        return manager_set_input_mute_state(get(), device_index, channel, mute);
+    }
+    bool switch_default_output(std::uint32_t position) noexcept {
+        return manager_switch_default_output(get(), position);
+    }
+    bool switch_default_input(std::uint32_t position) noexcept {
+        return manager_switch_default_input(get(), position);
+    }
+    bool move_sink_input(std::uint32_t stream_index, std::uint32_t device_index) noexcept {
+        return manager_move_sink_input(get(), stream_index, device_index);
+    }
+    bool move_source_output(std::uint32_t stream_index, std::uint32_t device_index) noexcept {
+        return manager_move_source_output(get(), stream_index, device_index);
+    }
+};
+
+} // namespace easypulse
+
+#endif
@@ -4,10 +4,19 @@
  *
  * This file provides the core functionality to interact with PulseAudio,
  * allowing operations like setting the default device and adjusting volume.
+ *
+ * Public entry points are thin wrappers around static *_impl functions that record
+ * their call count, errors, round trips and wall time (see easypulse_metrics.h).
  */
 
 #include "easypulse_core.h"
+#include "easypulse_internal.h"
 #include "system_query.h"
+#include "op_batch.h"
+#include "easypulse_metrics.h"
+#include "easypulse_trace.h"
+#include "easypulse_log.h"
+#include "event_log.h"
 #include <pulse/introspect.h>
 #include <pulse/thread-mainloop.h>
 #include <stdint.h>
@@ -22,7 +31,17 @@
 
 
 static bool manager_initialize(pulseaudio_manager *self);
-static void iterate(pulseaudio_manager *manager, pa_operation *op);
+static void iterate(pulseaudio_manager *manager, pa_operation *op, metric_id kind);
+static void wait_operation_locked(pulseaudio_manager *manager, pa_operation *op, metric_id kind);
+static void manager_subscribe_cb(pa_context *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata);
+static void manager_start_heartbeat(pulseaudio_manager *self);
+static void manager_table_event(pulseaudio_manager *manager, pa_context *c, pa_subscription_event_type_t facility,
+                                pa_subscription_event_type_t type, uint32_t idx);
+static void manager_idle_reset(pulseaudio_manager *manager);
+static void manager_fallback_event(pulseaudio_manager *manager, pa_context *c, pa_subscription_event_type_t facility);
+static void manager_fallback_free(manager_fallback *fallback);
+static void manager_prefs_event(pulseaudio_manager *manager, pa_context *c, pa_subscription_event_type_t facility,
+                                uint32_t idx);
 
 static void manager_set_output_channel_mute_state_cb(pa_context *c, const pa_sink_info *info,
 int eol, void *userdata);
@@ -44,37 +63,216 @@ typedef struct _shared_data_2 {
         pa_cvolume new_volume;
 } _shared_data_2;
 
+//Shared data between manager_apply_routing_rules and its callbacks
+typedef struct _shared_data_3 {
+    pulseaudio_manager *manager;
+    uint32_t pending;   //Move operations still in flight.
+    int moved;          //Streams successfully moved.
+} _shared_data_3;
+
+//Shared data between manager_switch_default_input and its callbacks
+typedef struct _shared_data_4 {
+    op_batch *batch;            //Batch the list operations belong to.
+    uint32_t *streams;          //Indexes of the recording streams (source outputs).
+    uint32_t *stream_sources;   //Source each recording stream is attached to.
+    uint32_t stream_count;
+    uint32_t *monitors;         //Indexes of the monitor sources.
+    uint32_t monitor_count;
+} _shared_data_4;
+
+//Shared data between manager_load_modules and its callback, one per request
+typedef struct _shared_data_5 {
+    op_batch *batch;
+    module_request *request;    //Request receiving the index of the loaded module.
+} _shared_data_5;
+
+//Shared data between manager_get_output_latency and its callback
+typedef struct _shared_data_6 {
+    pulseaudio_manager *manager;
+    bool found;
+    pa_usec_t latency;
+    pa_usec_t configured_latency;
+} _shared_data_6;
+
+//Shared data between manager_list_modules and its callback
+typedef struct _shared_data_7 {
+    pulseaudio_manager *manager;
+    module_list *list;
+    bool failed;
+} _shared_data_7;
+
+//Publisher of the device state, refreshed from the mainloop thread on device events
+struct manager_publisher {
+    shm_state_writer *writer;               //Segment the state is published to (NULL once stopped).
+    shm_state_snapshot staging;             //State collected by the refresh in progress.
+    char default_sink[SHM_STATE_NAME_SIZE];
+    char default_source[SHM_STATE_NAME_SIZE];
+    uint32_t pending;                       //Queries of the refresh still in flight.
+    bool dirty;                             //A device event arrived during the refresh.
+};
+
+//Device of the device table
+typedef struct manager_table_device {
+    bool output;
+    bool monitor;                           //Monitor source, left alone by the idle policy.
+    uint32_t index;                         //Index of the sink or source.
+    uint64_t id;                            //Stable id of its name.
+    uint32_t streams;                       //Streams attached to it in the stream table.
+    bool watched;                           //Watched by the idle policy, which owns the fields below.
+    bool suspended;                         //Suspended by the idle policy.
+    bool pinned;                            //Suspended with manager_suspend_*(), left alone by the policy.
+    pa_usec_t awake_until;                  //Kept awake until then by manager_resume_and_hold_*() (0 if not).
+    pa_time_event *timer;                   //Suspends the device when due (NULL if not armed).
+} manager_table_device;
+
+//Stream of the device table
+typedef struct manager_table_stream {
+    bool output;                            //Sink input (true) or source output.
+    uint32_t index;                         //Index of the stream.
+    uint32_t device;                        //Index of its sink or source.
+} manager_table_stream;
+
+//Devices and streams of the server, kept up to date from the events by the mainloop
+//thread while the idle policy or a fallback chain needs them
+struct manager_device_table {
+    bool running;
+    manager_table_device *devices;
+    uint32_t device_count;
+    uint32_t device_capacity;
+    manager_table_stream *streams;
+    uint32_t stream_count;
+    uint32_t stream_capacity;
+};
+
+//Idle suspend policy, driven by the device table
+struct manager_idle {
+    bool running;
+    pa_usec_t timeout;                      //Time a device may stay without streams.
+};
+
+//Fallback chain of one direction
+typedef struct manager_fallback_chain {
+    char **codes;                           //Codes of the devices, by priority.
+    uint64_t *ids;                          //Stable ids of the codes.
+    uint32_t length;
+    uint64_t default_id;                    //Stable id of the current default device (0 if unknown).
+} manager_fallback_chain;
+
+//Fallback chains, recovering from the device table when a default device goes
+struct manager_fallback {
+    bool running;
+    manager_fallback_chain chains[2];       //Input (0) and output (1) chains.
+    uint32_t pending;                       //Operations of the recoveries in flight.
+    uint32_t failed;                        //Operations of the recoveries in flight that failed.
+    uint64_t recovery_start;                //Time the recoveries in flight started (ns).
+};
+
+//Shared data between manager_table_list and its callbacks
+typedef struct _shared_data_8 {
+    op_batch *batch;
+    pulseaudio_manager *manager;
+} _shared_data_8;
+
 /**
- * @brief Creates a new pulseaudio_manager instance.
+ * @brief Fills a pulseaudio_device from the information of a sink.
  *
- * This function allocates memory for a new pulseaudio_manager instance and initializes it.
- * It allocates memory for the output and input devices based on the current system state,
- * and initializes the PulseAudio context and mainloop. It also sets the active output and
- * input devices.
+ * Duplicates the names of the sink and probes its ALSA device (if any) for the sample
+ * rate and the channel range.
  *
- * If any memory allocation or initialization operation fails, the function cleans up any
- * resources that were successfully allocated or initialized, and returns NULL.
+ * @param device The device to fill. Its previous content is overwritten.
+ * @param info The sink information.
+ */
+static void manager_fill_output_device(pulseaudio_device *device, const pa_sink_info *info) {
+    device->index = info->index;
+    device->name = strdup(info->description);
+    device->code = strdup(info->name);
+    device->owner_module = info->owner_module;
+
+    char *alsa_id = get_alsa_output_id(info->name);
+
+    //Do NOT attempt to duplicate the string if alsa_id is null, as the program can crash!
+    if (alsa_id) {
+        device->alsa_id = strdup(alsa_id);
+    } else {
+        device->alsa_id = NULL;
+    }
+    device->sample_rate = get_output_sample_rate(device->alsa_id, info);
+    device->max_channels = get_max_output_channels(device->alsa_id, info);
+    device->min_channels = get_min_output_channels(device->alsa_id, info);
+    channel_names_from_map(&info->channel_map, device->channel_names, PA_CHANNELS_MAX);
+
+    free(alsa_id);
+}
+
+/**
+ * @brief Frees the memory owned by a pulseaudio_device.
  *
- * @return A pointer to the newly created pulseaudio_manager instance, or NULL if the
- *         creation failed.
+ * Frees all associated strings and profile data (the channel names are static). The device structure
+ * itself is not freed, since devices live in the arrays of the manager.
+ *
+ * @param device The device whose fields are to be freed.
  */
-pulseaudio_manager *manager_create(void) {
-    pulseaudio_manager *self = malloc(sizeof(pulseaudio_manager));
-    if (!self) {
-        fprintf(stderr, "Failed to allocate memory for pulseaudio_manager.\n");
-        return NULL;
+static void manager_free_device(pulseaudio_device *device) {
+    free(device->code);
+    free(device->name);
+    free(device->alsa_id);
+    if (device->profiles) {
+        for (uint32_t j = 0; j < device->profile_count; ++j) {
+            free((char*)device->profiles[j].name);
+            free((char*)device->profiles[j].description);
+        }
+        free(device->profiles);
+    }
+}
+
+/**
+ * @brief Frees the devices of the manager and the names of its active devices.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ */
+static void manager_free_devices(pulseaudio_manager *manager) {
+    for (uint32_t i = 0; i < manager->output_count && manager->outputs; ++i) {
+        manager_free_device(&manager->outputs[i]);
     }
+    free(manager->outputs);
+    manager->outputs = NULL;
+    manager->output_count = 0;
 
-    // Zero-initialize the structure to set sensible defaults
-    memset(self, 0, sizeof(pulseaudio_manager));
+    for (uint32_t i = 0; i < manager->input_count && manager->inputs; ++i) {
+        manager_free_device(&manager->inputs[i]);
+    }
+    free(manager->inputs);
+    manager->inputs = NULL;
+    manager->input_count = 0;
+
+    free(manager->active_output_device);
+    free(manager->active_input_device);
+    manager->active_output_device = NULL;
+    manager->active_input_device = NULL;
+}
 
-    // Initialize manager's PulseAudio main loop and context
-    if (!manager_initialize(self)) {
-        fprintf(stderr, "Failed to initialize pulseaudio_manager.\n");
-        free(self);
-        return NULL;
+/**
+ * @brief Frees the memory owned by a combined output record.
+ *
+ * @param combined The record whose fields are to be freed.
+ */
+static void free_combined_output(combined_output *combined) {
+    free(combined->code);
+    for (uint32_t i = 0; i < combined->slave_count; ++i) {
+        free(combined->slaves[i]);
     }
+    free(combined->slaves);
+    free(combined->resample_method);
+}
 
+/**
+ * @brief Fills the output and input devices of the manager, and its active devices,
+ * through libpulse.
+ *
+ * @param self Pointer to the pulseaudio_manager instance.
+ * @return true on success, false otherwise.
+ */
+static bool manager_list_devices_impl(pulseaudio_manager *self) {
     // Get the count of output and input devices
     self->output_count = get_output_device_count();
     self->input_count = get_input_device_count();
@@ -83,33 +281,14 @@ pulseaudio_manager *manager_create(void) {
     if (self->output_count > 0) {
         self->outputs = calloc(self->output_count, sizeof(pulseaudio_device));
         if (!self->outputs) {
-            fprintf(stderr, "Failed to allocate memory for outputs.\n");
-            manager_cleanup(self);
-            return NULL;
+            EASYPULSE_ERROR("Failed to allocate memory for outputs.");
+            return false;
         }
         // Retrieve and populate output devices
         pa_sink_info **output_devices = get_available_output_devices();
 
         for (uint32_t i = 0; i < self->output_count; ++i) {
-            self->outputs[i].index = output_devices[i]->index;
-            self->outputs[i].name = strdup(output_devices[i]->description);
-            self->outputs[i].code = strdup(output_devices[i]->name);
-
-
-            char *alsa_id = get_alsa_output_id(output_devices[i]->name);
-
-            //Do NOT attempt to duplicate the string if alsa_id is null, as the program can crash!
-            if (alsa_id) {
-                self->outputs[i].alsa_id = strdup(alsa_id);
-            } else {
-                self->outputs[i].alsa_id = NULL;
-            }
-            self->outputs[i].sample_rate = get_output_sample_rate(self->outputs[i].alsa_id, output_devices[i]);
-            self->outputs[i].max_channels = get_max_output_channels(self->outputs[i].alsa_id, output_devices[i]);
-            self->outputs[i].min_channels = get_min_output_channels(self->outputs[i].alsa_id, output_devices[i]);
-            self->outputs[i].channel_names = get_output_channel_names(output_devices[i]->name, self->outputs[i].max_channels);
-
-            free(alsa_id);
+            manager_fill_output_device(&self->outputs[i], output_devices[i]);
         }
         for (uint32_t i = 0; i < self->output_count; ++i) {
             if (output_devices[i]) {
@@ -124,9 +303,8 @@ pulseaudio_manager *manager_create(void) {
     if (self->input_count > 0) {
         self->inputs = calloc(self->input_count, sizeof(pulseaudio_device));
         if (!self->inputs) {
-            fprintf(stderr, "Failed to allocate memory for inputs.\n");
-            manager_cleanup(self);
-            return NULL;
+            EASYPULSE_ERROR("Failed to allocate memory for inputs.");
+            return false;
         }
         // Retrieve and populate input devices
         pa_source_info **input_devices = get_available_input_devices();
@@ -135,6 +313,7 @@ pulseaudio_manager *manager_create(void) {
             self->inputs[i].index = input_devices[i]->index;
             self->inputs[i].name = strdup(input_devices[i]->description);
             self->inputs[i].code = strdup(input_devices[i]->name);
+            self->inputs[i].owner_module = input_devices[i]->owner_module;
 
             char *alsa_id = get_alsa_input_id(input_devices[i]->name);
 
@@ -147,7 +326,7 @@ pulseaudio_manager *manager_create(void) {
             self->inputs[i].sample_rate = get_input_sample_rate(self->inputs[i].alsa_id, input_devices[i]);
             self->inputs[i].max_channels = get_max_input_channels(self->inputs[i].alsa_id, input_devices[i]);
             self->inputs[i].min_channels = get_min_input_channels(self->inputs[i].alsa_id, input_devices[i]);
-            self->inputs[i].channel_names = get_input_channel_names(input_devices[i]->name, self->inputs[i].max_channels);
+            channel_names_from_map(&input_devices[i]->channel_map, self->inputs[i].channel_names, PA_CHANNELS_MAX);
 
             free(alsa_id);
         }
@@ -161,12 +340,51 @@ pulseaudio_manager *manager_create(void) {
     }
 
     // Set the default output and input devices
-    self->active_output_device = strdup(get_default_output(self->context));
-    self->active_input_device = strdup(get_default_input(self->context));
+    self->active_output_device = get_default_output(self->context);
+    self->active_input_device = get_default_input(self->context);
 
     // Check that the active devices were set
     if (!self->active_output_device || !self->active_input_device) {
-        fprintf(stderr, "Failed to set the active output or input device.\n");
+        EASYPULSE_ERROR("Failed to set the active output or input device.");
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Creates a new pulseaudio_manager instance.
+ *
+ * This function allocates memory for a new pulseaudio_manager instance and initializes it.
+ * It allocates memory for the output and input devices based on the current system state,
+ * and initializes the PulseAudio context and mainloop. It also sets the active output and
+ * input devices.
+ *
+ * If any memory allocation or initialization operation fails, the function cleans up any
+ * resources that were successfully allocated or initialized, and returns NULL.
+ *
+ * @return A pointer to the newly created pulseaudio_manager instance, or NULL if the
+ *         creation failed.
+ */
+static pulseaudio_manager *manager_create_impl(void) {
+    pulseaudio_manager *self = malloc(sizeof(pulseaudio_manager));
+    if (!self) {
+        EASYPULSE_ERROR("Failed to allocate memory for pulseaudio_manager.");
+        return NULL;
+    }
+
+    // Zero-initialize the structure to set sensible defaults
+    memset(self, 0, sizeof(pulseaudio_manager));
+    self->slow_callback_usec = MANAGER_SLOW_CALLBACK_USEC;
+
+    // Initialize manager's PulseAudio main loop and context
+    if (!manager_initialize(self)) {
+        EASYPULSE_ERROR("Failed to initialize pulseaudio_manager.");
+        free(self);
+        return NULL;
+    }
+
+    if (!manager_list_devices_impl(self)) {
         manager_cleanup(self);
         return NULL;
     }
@@ -174,6 +392,81 @@ pulseaudio_manager *manager_create(void) {
     return self;
 }
 
+pulseaudio_manager *manager_create(void) {
+    const char *trace_path = getenv("EASYPULSE_TRACE");
+    if (trace_path && *trace_path) {
+        trace_enable(true);
+    }
+
+    log_level level;
+    if (log_level_from_name(getenv("EASYPULSE_LOG_LEVEL"), &level)) {
+        log_set_level(level);
+    }
+
+    metrics_call call = metrics_api_begin();
+    pulseaudio_manager *result = manager_create_impl();
+    metrics_api_end(METRIC_API_CREATE, call, result != NULL);
+
+    const char *record_path = getenv("EASYPULSE_RECORD");
+    if (result && record_path && *record_path) {
+        manager_start_recording(result, record_path);
+    }
+
+    const char *publish_name = getenv("EASYPULSE_PUBLISH");
+    if (result && publish_name && *publish_name) {
+        manager_start_publishing(result, publish_name);
+    }
+    return result;
+}
+
+
+/**
+ * @brief Enumerates the devices again.
+ *
+ * The device arrays and the active devices of the manager are a picture taken when it
+ * was created. A long-lived manager calls this when devices were added or removed
+ * (see manager_set_event_callback()) or the default devices changed. Positions in the
+ * arrays may change, pointers into them become invalid.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @return true on success, false otherwise (the manager then has no devices).
+ */
+bool manager_refresh_devices(pulseaudio_manager *manager) {
+    if (!manager || !manager->context) {
+        EASYPULSE_ERROR("Invalid PulseAudio manager or context.");
+        return false;
+    }
+
+    metrics_call call = metrics_api_begin();
+    manager_free_devices(manager);
+    bool result = manager_list_devices_impl(manager);
+    metrics_api_end(METRIC_API_REFRESH_DEVICES, call, result);
+    return result;
+}
+
+/**
+ * @brief Returns the stable id of a device.
+ *
+ * The index of a device changes every time it reappears (unplugged, server restarted),
+ * its code does not. The stable id is the 64-bit FNV-1a hash of the code: a fixed-size
+ * key for files and scripts, written "@" followed by 16 hexadecimal digits
+ * (MANAGER_STABLE_ID_FORMAT).
+ *
+ * @param code Code (PulseAudio name) of the device.
+ * @return The stable id, 0 if code is NULL.
+ */
+uint64_t manager_device_stable_id(const char *code) {
+    if (!code) {
+        return 0;
+    }
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const unsigned char *c = (const unsigned char *) code; *c; ++c) {
+        hash ^= *c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
 
 /**
  * @brief Callback function for handling PulseAudio context state changes.
@@ -249,11 +542,14 @@ static bool manager_initialize(pulseaudio_manager *self) {
     // Set the state callback
     pa_context_set_state_callback(self->context, manager_initialize_cb, self);
 
+    // Server events are only delivered once manager_enable_events() subscribes to them
+    pa_context_set_subscribe_callback(self->context, manager_subscribe_cb, self);
+
     // Lock the mainloop and connect the context
-    pa_threaded_mainloop_lock(self->mainloop);
+    manager_lock(self);
 
     if (pa_context_connect(self->context, NULL, PA_CONTEXT_NOFLAGS, NULL) < 0) {
-        pa_threaded_mainloop_unlock(self->mainloop);
+        manager_unlock(self);
         pa_threaded_mainloop_free(self->mainloop);
         return false;
     }
@@ -263,10 +559,15 @@ static bool manager_initialize(pulseaudio_manager *self) {
 
     // 4. Wait for the context to be ready
     while (self->pa_ready == 0) {
-        pa_threaded_mainloop_wait(self->mainloop);
+        manager_wait(self);
+    }
+
+    // Mainloop stalls are only measured when metrics are being recorded
+    if (self->pa_ready == 1 && metrics_enabled()) {
+        manager_start_heartbeat(self);
     }
 
-    pa_threaded_mainloop_unlock(self->mainloop);
+    manager_unlock(self);
 
     if (self->pa_ready == 2) {
         return false;
@@ -285,57 +586,29 @@ static bool manager_initialize(pulseaudio_manager *self) {
  * @param manager A pointer to the pulseaudio_manager object to be cleaned up.
  *                If the pointer is NULL, the function does nothing.
  */
-void manager_cleanup(pulseaudio_manager *manager) {
+static void manager_cleanup_impl(pulseaudio_manager *manager) {
     if (manager) {
-        // Free output devices
-        if (manager->outputs) {
-            for (uint32_t i = 0; i < manager->output_count; ++i) {
-                free(manager->outputs[i].code);
-                free(manager->outputs[i].name);
-                free(manager->outputs[i].alsa_id);
-                if (manager->outputs[i].channel_names) {
-                    for (int j = 0; j < manager->outputs[i].max_channels; ++j) {
-                        free(manager->outputs[i].channel_names[j]);
-                    }
-                    free(manager->outputs[i].channel_names);
-                }
-                if (manager->outputs[i].profiles) {
-                    for (uint32_t j = 0; j < manager->outputs[i].profile_count; ++j) {
-                        free((char*)manager->outputs[i].profiles[j].name);
-                        free((char*)manager->outputs[i].profiles[j].description);
-                    }
-                    free(manager->outputs[i].profiles);
-                }
-            }
-            free(manager->outputs); // Finally free the array itself
-        }
+        manager_free_devices(manager);
 
-        // Free input devices
-        if (manager->inputs) {
-            for (uint32_t i = 0; i < manager->input_count; ++i) {
-                free(manager->inputs[i].code);
-                free(manager->inputs[i].name);
-                free(manager->inputs[i].alsa_id);
-                if (manager->inputs[i].channel_names) {
-                    for (int j = 0; j < manager->inputs[i].max_channels; ++j) {
-                        free(manager->inputs[i].channel_names[j]);
-                    }
-                    free(manager->inputs[i].channel_names);
-                }
-                if (manager->inputs[i].profiles) {
-                    for (uint32_t j = 0; j < manager->inputs[i].profile_count; ++j) {
-                        free((char*)manager->inputs[i].profiles[j].name);
-                        free((char*)manager->inputs[i].profiles[j].description);
-                    }
-                    free(manager->inputs[i].profiles);
-                }
-            }
-            free(manager->inputs); // Finally free the array itself
+        // Free the combined outputs bookkeeping
+        for (uint32_t i = 0; i < manager->combined_count; ++i) {
+            free_combined_output(&manager->combined[i]);
         }
+        free(manager->combined);
 
-        // Free the names of active output and input devices
-        free(manager->active_output_device);
-        free(manager->active_input_device);
+        // The peak meters are streams of the context
+        manager_close_meters(manager);
+
+        // The heartbeat and the idle timers must go while the mainloop still runs them
+        if (manager->heartbeat) {
+            manager_lock(manager);
+            pa_threaded_mainloop_get_api(manager->mainloop)->time_free(manager->heartbeat);
+            manager->heartbeat = NULL;
+            manager_unlock(manager);
+        }
+        // The server never resumes a device a client suspended, so the devices the idle
+        // policy suspended are resumed before the process can exit
+        manager_stop_idle_suspend(manager);
 
         // Disconnect and unreference the context if it's there
         if (manager->context) {
@@ -352,133 +625,662 @@ void manager_cleanup(pulseaudio_manager *manager) {
             pa_threaded_mainloop_free(manager->mainloop);
         }
 
+        // The router, the recorder, the publisher, the device table, the preference
+        // store and the fallback chains are used from the mainloop thread, so they can
+        // only go once the loop is stopped
+        stream_router_destroy(manager->router);
+        event_recorder_close(manager->recorder);
+        if (manager->publisher) {
+            shm_state_destroy(manager->publisher->writer);
+            free(manager->publisher);
+        }
+        if (manager->table) {
+            free(manager->table->devices);
+            free(manager->table->streams);
+            free(manager->table);
+        }
+        free(manager->idle);
+        device_prefs_free(manager->prefs);
+        manager_fallback_free(manager->fallback);
+
         // Free the manager itself
         free(manager);
     }
 }
 
+void manager_cleanup(pulseaudio_manager *manager) {
+    metrics_call call = metrics_api_begin();
+    manager_cleanup_impl(manager);
+    metrics_api_end(METRIC_API_CLEANUP, call, true);
+
+    const char *trace_path = getenv("EASYPULSE_TRACE");
+    if (trace_path && *trace_path) {
+        trace_dump(trace_path);
+    }
+
+    log_flush();
+}
+
+
+
+
+/**
+ * @brief Locks the mainloop of the manager.
+ *
+ * The time spent waiting for the lock is recorded in the metrics and as a trace span,
+ * and the time the lock is held is measured until manager_unlock().
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ */
+void manager_lock(pulseaudio_manager *manager) {
+    uint64_t start = trace_begin();
+    uint64_t wait_start = metrics_lock_begin();
+    pa_threaded_mainloop_lock(manager->mainloop);
+    metrics_lock_acquired(wait_start);
+    trace_end("mainloop_lock", "lock", start);
+}
 
+/**
+ * @brief Unlocks the mainloop of the manager locked with manager_lock().
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ */
+void manager_unlock(pulseaudio_manager *manager) {
+    metrics_lock_released();
+    pa_threaded_mainloop_unlock(manager->mainloop);
+}
 
+/**
+ * @brief Waits for a signal of the mainloop thread, with the mainloop locked.
+ *
+ * The lock is released during the wait, which is not counted as holding it.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ */
+void manager_wait(pulseaudio_manager *manager) {
+    metrics_lock_suspend();
+    pa_threaded_mainloop_wait(manager->mainloop);
+    metrics_lock_resume();
+}
 
 /**
  * @brief Iterates through operations in the pulseaudio_manager.
  *
+ * Waits until the operation is no longer running, and records it as a round trip of
+ * the given kind.
+ *
  * @param manager Pointer to the pulseaudio_manager instance.
  * @param op Pointer to the pa_operation instance.
+ * @param kind Operation kind the wait time is recorded under.
  */
-static void iterate(pulseaudio_manager *manager, pa_operation *op) {
+static void iterate(pulseaudio_manager *manager, pa_operation *op, metric_id kind) {
+    uint64_t start = metrics_op_begin();
+
     //Leaves if operation is invalid.
-    if (!op) return;
+    if (!op) {
+        metrics_op_end(kind, start, false);
+        return;
+    }
 
     bool is_in_mainloop_thread = pa_threaded_mainloop_in_thread(manager->mainloop);
 
     // If we're not in the mainloop thread, lock it.
     if (!is_in_mainloop_thread) {
-        pa_threaded_mainloop_lock(manager->mainloop);
+        manager_lock(manager);
     }
 
     //Wait for the operation to complete.
     //The signaling to continue is performed inside the callback operation (op).
-    pa_threaded_mainloop_wait(manager->mainloop);
+    while (pa_operation_get_state(op) == PA_OPERATION_RUNNING) {
+        manager_wait(manager);
+    }
+    bool done = pa_operation_get_state(op) == PA_OPERATION_DONE;
 
     //Cleaning up.
     pa_operation_unref(op);
 
     // If we locked the mainloop earlier, unlock it now.
     if (!is_in_mainloop_thread) {
-        pa_threaded_mainloop_unlock(manager->mainloop);
+        manager_unlock(manager);
     }
+
+    metrics_op_end(kind, start, done);
+    metrics_round_trip();
 }
 
 /**
- * @brief Callback function for setting master volume on a device.
+ * @brief Waits for an operation that was started with the mainloop locked.
  *
- * This function is called when the asynchronous operation to set the volume
- * for a sink completes. It will signal the mainloop to stop waiting.
+ * Unlike iterate(), the caller must already hold the mainloop lock when the operation
+ * is started and when this function is called. This guarantees the completion signal
+ * cannot be missed. The operation is unreferenced before returning.
  *
- * @param c The PulseAudio context.
- * @param success Non-zero if the operation succeeded, zero if it failed.
- * @param userdata The userdata passed to the function, a pointer to the pulseaudio_manager.
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param op Pointer to the pa_operation instance.
+ * @param kind Operation kind the wait time is recorded under.
  */
-void manager_set_master_volume_cb(pa_context *c, int success, void *userdata) {
-    (void) c;
+static void wait_operation_locked(pulseaudio_manager *manager, pa_operation *op, metric_id kind) {
+    uint64_t start = metrics_op_begin();
 
-    pulseaudio_manager *manager = (pulseaudio_manager *)userdata;
+    if (!op) {
+        metrics_op_end(kind, start, false);
+        return;
+    }
 
-    // Check if the operation was successful
-    if (success) {
-        printf("Volume set successfully.\n");
-    } else {
-        printf("Failed to set volume.\n");
+    while (pa_operation_get_state(op) == PA_OPERATION_RUNNING) {
+        manager_wait(manager);
     }
 
-    // Signal the mainloop to stop waiting
-    pa_threaded_mainloop_signal(manager->mainloop, 0);
+    metrics_op_end(kind, start, pa_operation_get_state(op) == PA_OPERATION_DONE);
+    metrics_round_trip();
+
+    pa_operation_unref(op);
 }
 
 /**
- * @brief Sets the master volume of a given device.
- *
- * This function sets the master volume of a device specified by its PulseAudio ID.
+ * @brief Callback for the completion of a subscription request.
  *
- * @param manager Pointer to the pulseaudio_manager instance.
- * @param device_id The PulseAudio ID of the device.
- * @param volume The new volume level to set. This should be a value between 0 (mute) and 100 (maximum volume).
- * @return 0 if the operation was successful, or a non-zero error code if the operation failed.
+ * @param c The PulseAudio context.
+ * @param success Indicates if the operation was successful.
+ * @param userdata User-provided data, expected to be a pointer to a pulseaudio_manager instance.
  */
+static void manager_enable_events_cb(pa_context *c, int success, void *userdata) {
+    (void) c;
+
+    pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
+    if (!success) {
+        EASYPULSE_ERROR("Failed to subscribe to server events.");
+    }
+    pa_threaded_mainloop_signal(manager->mainloop, 0);
+}
+
 /**
- * @brief Sets the master volume of a given device.
+ * @brief Subscribes the manager to a set of server events.
  *
- * This function sets the master volume of a device specified by its PulseAudio ID.
+ * The subscription mask only grows: features that need events add their facilities
+ * to it, and every event received is dispatched by manager_subscribe_cb().
  *
- * @param manager Pointer to the pulseaudio_manager instance.
- * @param device_id The PulseAudio ID of the device.
- * @param volume The new volume level to set. This should be a value between 0 (mute) and 100 (maximum volume).
- * @return 0 if the operation was successful, or a non-zero error code if the operation failed.
+ * @param self Pointer to the pulseaudio_manager instance.
+ * @param mask Facilities to subscribe to, in addition to the current ones.
+ * @return true if the manager is subscribed to the requested facilities, false otherwise.
  */
-int manager_set_master_volume(pulseaudio_manager *manager, uint32_t device_id, int volume) {
-    if (!manager) {
-        fprintf(stderr, "Manager is NULL\n");
-        return -1;
-    }
-
-    if(volume < 0 || volume > 100) {
-        fprintf(stderr, "[manager_set_master_volume] The volume specified is out of range (0-100).\n");
-        return -1;
+static bool manager_enable_events(pulseaudio_manager *self, pa_subscription_mask_t mask) {
+    if ((self->event_mask & mask) == mask) {
+        return true;
     }
 
-    // Fetch the sink information for the device ID
-    const pa_sink_info *sink_info = get_output_device_by_index(device_id);
-    if (!sink_info) {
-        fprintf(stderr, "Could not retrieve sink info for device ID %u\n", device_id);
-        return -1;
+    bool is_in_mainloop_thread = pa_threaded_mainloop_in_thread(self->mainloop);
+    if (!is_in_mainloop_thread) {
+        manager_lock(self);
     }
 
-    // Calculate the PA volume from the provided percentage
-    pa_volume_t pa_volume = (pa_volume_t) ((double) volume / 100.0 * PA_VOLUME_NORM);
-
-    // Initialize a pa_cvolume structure and set the volume for all channels
-    pa_cvolume cvolume;
-    pa_cvolume_set(&cvolume, sink_info->channel_map.channels, pa_volume);
+    self->event_mask |= mask;
+    pa_operation *op = pa_context_subscribe(self->context, self->event_mask, manager_enable_events_cb, self);
 
-    // Start the asynchronous operation to set the sink volume
-    pa_operation *op = pa_context_set_sink_volume_by_index(manager->context, device_id, &cvolume, manager_set_master_volume_cb, manager);
     if (!op) {
-        fprintf(stderr, "Failed to start volume set operation\n");
-        return -1;
+        EASYPULSE_ERROR("Failed to subscribe to server events.");
+    } else if (is_in_mainloop_thread) {
+        // The reply is processed by this very thread once we return
+        pa_operation_unref(op);
+    } else {
+        wait_operation_locked(self, op, METRIC_OP_SUBSCRIBE);
     }
 
-    // Wait for the operation to complete
-    iterate(manager, op);
+    if (!is_in_mainloop_thread) {
+        manager_unlock(self);
+    }
 
-    return 0;
+    return op != NULL;
 }
 
 /**
- * @brief Callback function for handling the completion of an output mute toggle operation.
+ * @brief Runs the routing rules against a new stream.
  *
- * This function is invoked by the PulseAudio main loop upon the completion of an operation
- * to toggle the mute state of an output device (sink). It is used in conjunction with
+ * The stream is moved to the target device of the first matching rule. The move is
+ * fired and forgotten: this runs in the mainloop thread, which must never block.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param c The PulseAudio context, or NULL during a replay (nothing is sent to the server).
+ * @param index Index of the sink input.
+ * @param proplist Properties of the sink input.
+ * @return true if a rule matched the stream, false otherwise.
+ */
+static bool manager_route_sink_input(pulseaudio_manager *manager, pa_context *c, uint32_t index,
+                                     const pa_proplist *proplist) {
+    const char *target_code = stream_router_match(manager->router, proplist);
+    if (!target_code) {
+        return false;
+    }
+
+    if (c) {
+        pa_operation *op = pa_context_move_sink_input_by_name(c, index, target_code, NULL, NULL);
+        if (op) {
+            pa_operation_unref(op);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Callback for the information of a newly created sink input.
+ *
+ * Records the information when events are being recorded, and routes the stream.
+ *
+ * @param c The PulseAudio context.
+ * @param i The sink input information.
+ * @param eol End of list flag.
+ * @param userdata User-provided data, expected to be a pointer to a pulseaudio_manager instance.
+ */
+static void manager_route_sink_input_cb(pa_context *c, const pa_sink_input_info *i, int eol, void *userdata) {
+    pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
+
+    if (eol || !i) {
+        return;
+    }
+
+    if (manager->recorder) {
+        event_recorder_sink_input(manager->recorder, i);
+    }
+
+    manager_route_sink_input(manager, c, i->index, i->proplist);
+}
+
+/**
+ * @brief Returns the trace span name of a subscription event facility.
+ *
+ * @param facility The facility of the event.
+ * @return A string literal naming the span.
+ */
+static const char *event_span_name(pa_subscription_event_type_t facility) {
+    switch (facility) {
+        case PA_SUBSCRIPTION_EVENT_SINK: return "event:sink";
+        case PA_SUBSCRIPTION_EVENT_SOURCE: return "event:source";
+        case PA_SUBSCRIPTION_EVENT_SINK_INPUT: return "event:sink_input";
+        case PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT: return "event:source_output";
+        case PA_SUBSCRIPTION_EVENT_MODULE: return "event:module";
+        case PA_SUBSCRIPTION_EVENT_CLIENT: return "event:client";
+        case PA_SUBSCRIPTION_EVENT_SERVER: return "event:server";
+        case PA_SUBSCRIPTION_EVENT_CARD: return "event:card";
+        default: return "event:other";
+    }
+}
+
+static void manager_publisher_refresh(pulseaudio_manager *manager, pa_context *c);
+
+/**
+ * @brief Copies a string into a fixed-size field of the published state, truncating it.
+ */
+static void manager_publisher_copy(char *field, const char *value) {
+    snprintf(field, SHM_STATE_NAME_SIZE, "%s", value ? value : "");
+}
+
+/**
+ * @brief Fills a published device from the information of a sink or source.
+ */
+static void manager_publisher_device(shm_state_device *device, uint32_t index, const char *code,
+                                     const char *name, const pa_cvolume *volume, int mute) {
+    pa_volume_t average = pa_cvolume_avg(volume);
+
+    device->index = index;
+    device->channels = volume->channels;
+    device->volume = (int32_t) (((uint64_t) average * 100 + PA_VOLUME_NORM / 2) / PA_VOLUME_NORM);
+    device->mute = mute ? 1 : 0;
+    manager_publisher_copy(device->code, code);
+    manager_publisher_copy(device->name, name);
+}
+
+/**
+ * @brief Called when a query of a refresh is over: publishes the state once all of
+ * them are, and starts another refresh if devices changed in the meantime.
+ */
+static void manager_publisher_done(pulseaudio_manager *manager, pa_context *c) {
+    manager_publisher *publisher = manager->publisher;
+    if (--publisher->pending > 0) {
+        return;
+    }
+
+    shm_state_snapshot *state = &publisher->staging;
+    uint32_t outputs = state->output_count < SHM_STATE_MAX_DEVICES ? state->output_count : SHM_STATE_MAX_DEVICES;
+    uint32_t inputs = state->input_count < SHM_STATE_MAX_DEVICES ? state->input_count : SHM_STATE_MAX_DEVICES;
+
+    state->online = 1;
+    state->default_output = SHM_STATE_NONE;
+    state->default_input = SHM_STATE_NONE;
+    for (uint32_t i = 0; i < outputs; ++i) {
+        if (strcmp(state->outputs[i].code, publisher->default_sink) == 0) {
+            state->default_output = i;
+        }
+    }
+    for (uint32_t i = 0; i < inputs; ++i) {
+        if (strcmp(state->inputs[i].code, publisher->default_source) == 0) {
+            state->default_input = i;
+        }
+    }
+
+    if (publisher->writer) {
+        shm_state_publish(publisher->writer, state);
+    }
+    pa_threaded_mainloop_signal(manager->mainloop, 0);
+
+    if (publisher->dirty && publisher->writer) {
+        manager_publisher_refresh(manager, c);
+    }
+}
+
+static void manager_publisher_server_cb(pa_context *c, const pa_server_info *i, void *userdata) {
+    pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
+
+    if (i) {
+        manager_publisher_copy(manager->publisher->default_sink, i->default_sink_name);
+        manager_publisher_copy(manager->publisher->default_source, i->default_source_name);
+    }
+    manager_publisher_done(manager, c);
+}
+
+static void manager_publisher_sink_cb(pa_context *c, const pa_sink_info *i, int eol, void *userdata) {
+    pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
+    shm_state_snapshot *state = &manager->publisher->staging;
+
+    if (eol) {
+        manager_publisher_done(manager, c);
+        return;
+    }
+
+    if (state->output_count < SHM_STATE_MAX_DEVICES) {
+        manager_publisher_device(&state->outputs[state->output_count], i->index, i->name, i->description,
+                                 &i->volume, i->mute);
+    }
+    ++state->output_count;
+}
+
+static void manager_publisher_source_cb(pa_context *c, const pa_source_info *i, int eol, void *userdata) {
+    pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
+    shm_state_snapshot *state = &manager->publisher->staging;
+
+    if (eol) {
+        manager_publisher_done(manager, c);
+        return;
+    }
+
+    if (state->input_count < SHM_STATE_MAX_DEVICES) {
+        manager_publisher_device(&state->inputs[state->input_count], i->index, i->name, i->description,
+                                 &i->volume, i->mute);
+    }
+    ++state->input_count;
+}
+
+/**
+ * @brief Queries the server for the state of the devices, to publish it.
+ *
+ * Runs in the mainloop thread, or with the mainloop locked. The queries are sent
+ * together and the state is published when the last one completes. Events arriving
+ * while a refresh is in flight only mark it dirty, so a burst of events costs two
+ * refreshes at most.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param c The PulseAudio context.
+ */
+static void manager_publisher_refresh(pulseaudio_manager *manager, pa_context *c) {
+    manager_publisher *publisher = manager->publisher;
+    if (publisher->pending > 0) {
+        publisher->dirty = true;
+        return;
+    }
+
+    publisher->dirty = false;
+    publisher->staging.output_count = 0;
+    publisher->staging.input_count = 0;
+    publisher->default_sink[0] = '\0';
+    publisher->default_source[0] = '\0';
+
+    // One extra count, so that no reply can publish before all the queries are sent
+    publisher->pending = 1;
+    pa_operation *ops[3] = {
+        pa_context_get_server_info(c, manager_publisher_server_cb, manager),
+        pa_context_get_sink_info_list(c, manager_publisher_sink_cb, manager),
+        pa_context_get_source_info_list(c, manager_publisher_source_cb, manager),
+    };
+    for (int i = 0; i < 3; ++i) {
+        if (ops[i]) {
+            ++publisher->pending;
+            pa_operation_unref(ops[i]);
+        } else {
+            EASYPULSE_WARN("Failed to query the server for the published state.");
+        }
+    }
+    manager_publisher_done(manager, c);
+}
+
+/**
+ * @brief Dispatches a server event to the features interested in it.
+ *
+ * Runs in the mainloop thread, or in the thread replaying a log with the mainloop
+ * locked.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param c The PulseAudio context, or NULL during a replay (nothing is sent to the server).
+ * @param t Facility and type of the event.
+ * @param idx Index of the object the event refers to.
+ */
+static void manager_dispatch_event(pulseaudio_manager *manager, pa_context *c, pa_subscription_event_type_t t,
+                                   uint32_t idx) {
+    pa_subscription_event_type_t facility = t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+    pa_subscription_event_type_t type = t & PA_SUBSCRIPTION_EVENT_TYPE_MASK;
+    uint64_t trace_start = trace_begin();
+
+    // The device table is updated once for the idle policy and the fallback chains. The
+    // loss of a default device is handled first, audio is lost until it is
+    if (c && manager->table && manager->table->running) {
+        manager_table_event(manager, c, facility, type, idx);
+    }
+    if (c && manager->fallback && manager->fallback->running) {
+        manager_fallback_event(manager, c, facility);
+    }
+    if (c && manager->prefs && type == PA_SUBSCRIPTION_EVENT_NEW) {
+        manager_prefs_event(manager, c, facility, idx);
+    }
+
+    switch (facility) {
+        case PA_SUBSCRIPTION_EVENT_SINK_INPUT:
+            // New streams are routed as soon as they appear. During a replay, the
+            // information of the stream is the next record of the log.
+            if (c && type == PA_SUBSCRIPTION_EVENT_NEW &&
+                (stream_router_rule_count(manager->router) > 0 || manager->recorder)) {
+                pa_operation *op = pa_context_get_sink_input_info(c, idx, manager_route_sink_input_cb, manager);
+                if (op) {
+                    pa_operation_unref(op);
+                }
+            }
+            break;
+        case PA_SUBSCRIPTION_EVENT_SINK:
+        case PA_SUBSCRIPTION_EVENT_SOURCE:
+        case PA_SUBSCRIPTION_EVENT_SERVER:
+            if (c && manager->publisher && manager->publisher->writer) {
+                manager_publisher_refresh(manager, c);
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (manager->event_callback) {
+        uint64_t start = metrics_now_ns();
+        manager->event_callback(manager, t, idx, manager->event_userdata);
+        uint64_t elapsed = metrics_now_ns() - start;
+
+        bool slow = manager->slow_callback_usec > 0 && elapsed > manager->slow_callback_usec * 1000;
+        if (slow) {
+            EASYPULSE_WARN("Slow event callback: %.1f ms (threshold %.1f ms), the mainloop was blocked.",
+                    (double) elapsed / 1e6, (double) manager->slow_callback_usec / 1e3);
+        }
+        metrics_record(METRIC_CALLBACK, elapsed, !slow);
+    }
+
+    trace_end(event_span_name(facility), "event", trace_start);
+}
+
+/**
+ * @brief Callback for events reported by the PulseAudio subscription API.
+ *
+ * This is the single entry point for server events. It runs in the mainloop thread,
+ * records the event when events are being recorded and dispatches it.
+ *
+ * @param c The PulseAudio context.
+ * @param t Facility and type of the event.
+ * @param idx Index of the object the event refers to.
+ * @param userdata User-provided data, expected to be a pointer to a pulseaudio_manager instance.
+ */
+static void manager_subscribe_cb(pa_context *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata) {
+    pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
+
+    if (manager->recorder) {
+        event_recorder_event(manager->recorder, t, idx);
+    }
+
+    manager_dispatch_event(manager, c, t, idx);
+}
+
+/**
+ * @brief Callback of the heartbeat timer.
+ *
+ * The timer is due every MANAGER_HEARTBEAT_USEC. The mainloop dispatches it as soon as
+ * it is done with what it was doing, so the delay is the length of the mainloop
+ * iteration in progress: a long delay means a stall, caused by a slow callback or by
+ * a thread holding the mainloop lock.
+ *
+ * @param api The mainloop API.
+ * @param e The time event.
+ * @param tv Time the event was scheduled for.
+ * @param userdata User-provided data, expected to be a pointer to a pulseaudio_manager instance.
+ */
+static void manager_heartbeat_cb(pa_mainloop_api *api, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    (void) api;
+    (void) tv;
+
+    pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
+    pa_usec_t now = pa_rtclock_now();
+
+    if (now > manager->heartbeat_due) {
+        metrics_record(METRIC_MAINLOOP_LAG, (now - manager->heartbeat_due) * 1000, true);
+    } else {
+        metrics_record(METRIC_MAINLOOP_LAG, 0, true);
+    }
+
+    manager->heartbeat_due = now + MANAGER_HEARTBEAT_USEC;
+    pa_context_rttime_restart(manager->context, e, manager->heartbeat_due);
+}
+
+/**
+ * @brief Starts the heartbeat timer measuring mainloop stalls.
+ *
+ * Must be called with the mainloop locked.
+ *
+ * @param self Pointer to the pulseaudio_manager instance.
+ */
+static void manager_start_heartbeat(pulseaudio_manager *self) {
+    self->heartbeat_due = pa_rtclock_now() + MANAGER_HEARTBEAT_USEC;
+    self->heartbeat = pa_context_rttime_new(self->context, self->heartbeat_due, manager_heartbeat_cb, self);
+    if (!self->heartbeat) {
+        EASYPULSE_WARN("Failed to start the mainloop heartbeat.");
+    }
+}
+
+/**
+ * @brief Callback function for setting master volume on a device.
+ *
+ * This function is called when the asynchronous operation to set the volume
+ * for a sink completes. It will signal the mainloop to stop waiting.
+ *
+ * @param c The PulseAudio context.
+ * @param success Non-zero if the operation succeeded, zero if it failed.
+ * @param userdata The userdata passed to the function, a pointer to the pulseaudio_manager.
+ */
+void manager_set_master_volume_cb(pa_context *c, int success, void *userdata) {
+    (void) c;
+
+    pulseaudio_manager *manager = (pulseaudio_manager *)userdata;
+
+    // Check if the operation was successful
+    if (success) {
+        EASYPULSE_DEBUG("Volume set successfully.");
+    } else {
+        EASYPULSE_ERROR("Failed to set volume.");
+    }
+
+    // Signal the mainloop to stop waiting
+    pa_threaded_mainloop_signal(manager->mainloop, 0);
+}
+
+/**
+ * @brief Sets the master volume of a given device.
+ *
+ * This function sets the master volume of a device specified by its PulseAudio ID.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param device_id The PulseAudio ID of the device.
+ * @param volume The new volume level to set. This should be a value between 0 (mute) and 100 (maximum volume).
+ * @return 0 if the operation was successful, or a non-zero error code if the operation failed.
+ */
+/**
+ * @brief Sets the master volume of a given device.
+ *
+ * This function sets the master volume of a device specified by its PulseAudio ID.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param device_id The PulseAudio ID of the device.
+ * @param volume The new volume level to set. This should be a value between 0 (mute) and 100 (maximum volume).
+ * @return 0 if the operation was successful, or a non-zero error code if the operation failed.
+ */
+static int manager_set_master_volume_impl(pulseaudio_manager *manager, uint32_t device_id, int volume) {
+    if (!manager) {
+        EASYPULSE_ERROR("Manager is NULL");
+        return -1;
+    }
+
+    if(volume < 0 || volume > 100) {
+        EASYPULSE_ERROR("[manager_set_master_volume] The volume specified is out of range (0-100).");
+        return -1;
+    }
+
+    // Fetch the sink information for the device ID
+    const pa_sink_info *sink_info = get_output_device_by_index(device_id);
+    if (!sink_info) {
+        EASYPULSE_ERROR("Could not retrieve sink info for device ID %u", device_id);
+        return -1;
+    }
+
+    // Calculate the PA volume from the provided percentage
+    pa_volume_t pa_volume = (pa_volume_t) ((double) volume / 100.0 * PA_VOLUME_NORM);
+
+    // Initialize a pa_cvolume structure and set the volume for all channels
+    pa_cvolume cvolume;
+    pa_cvolume_set(&cvolume, sink_info->channel_map.channels, pa_volume);
+
+    // Start the asynchronous operation to set the sink volume
+    pa_operation *op = pa_context_set_sink_volume_by_index(manager->context, device_id, &cvolume, manager_set_master_volume_cb, manager);
+    if (!op) {
+        EASYPULSE_ERROR("Failed to start volume set operation");
+        return -1;
+    }
+
+    // Wait for the operation to complete
+    iterate(manager, op, METRIC_OP_SET_SINK_VOLUME);
+
+    return 0;
+}
+
+int manager_set_master_volume(pulseaudio_manager *manager, uint32_t device_id, int volume) {
+    metrics_call call = metrics_api_begin();
+    int result = manager_set_master_volume_impl(manager, device_id, volume);
+    metrics_api_end(METRIC_API_SET_MASTER_VOLUME, call, result == 0);
+    return result;
+}
+
+/**
+ * @brief Callback function for handling the completion of an output mute toggle operation.
+ *
+ * This function is invoked by the PulseAudio main loop upon the completion of an operation
+ * to toggle the mute state of an output device (sink). It is used in conjunction with
  * `pa_context_set_sink_mute_by_index` as part of the `manager_toggle_output_mute` function.
  * The callback checks if the mute toggle operation was successful and signals the mainloop
  * to continue processing.
@@ -495,7 +1297,7 @@ static void manager_toggle_output_mute_cb(pa_context *c, int success, void *user
 
     pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
     if (!success) {
-        fprintf(stderr, "Failed to toggle mute state.\n");
+        EASYPULSE_ERROR("Failed to toggle mute state.");
     }
 
     // Signal the mainloop to continue
@@ -507,30 +1309,37 @@ static void manager_toggle_output_mute_cb(pa_context *c, int success, void *user
  * Toggle the mute state of a given output device.
  *
  * @param manager A pointer to the initialized pulseaudio_manager instance.
- * @param index The index of the output device to toggle mute state.
+ * @param position The position of the output device in manager->outputs (not its PulseAudio index).
  * @param state The desired mute state (1 for ON/mute, 0 for OFF/unmute).
  * @return Returns 0 on success, -1 on failure.
  */
-int manager_toggle_output_mute(pulseaudio_manager *manager, uint32_t index, int state) {
+static int manager_toggle_output_mute_impl(pulseaudio_manager *manager, uint32_t position, int state) {
 
     if (!manager || !manager->context) {
-        fprintf(stderr, "Invalid PulseAudio manager or context.\n");
+        EASYPULSE_ERROR("Invalid PulseAudio manager or context.");
         return -1;
     }
 
-    if (index >= manager->output_count) {
-        fprintf(stderr, "Output device index out of range.\n");
+    if (position >= manager->output_count) {
+        EASYPULSE_ERROR("Output device position out of range.");
         return -1;
     }
 
     pa_operation *op = pa_context_set_sink_mute_by_index(manager->context,
-        index, state, manager_toggle_output_mute_cb, manager);
+        manager->outputs[position].index, state, manager_toggle_output_mute_cb, manager);
 
-    iterate(manager, op);
+    iterate(manager, op, METRIC_OP_SET_SINK_MUTE);
 
     return 0;
 }
 
+int manager_toggle_output_mute(pulseaudio_manager *manager, uint32_t position, int state) {
+    metrics_call call = metrics_api_begin();
+    int result = manager_toggle_output_mute_impl(manager, position, state);
+    metrics_api_end(METRIC_API_TOGGLE_OUTPUT_MUTE, call, result == 0);
+    return result;
+}
+
 /**
  * @brief Callback function for handling the completion of an input mute toggle operation.
  *
@@ -551,7 +1360,7 @@ static void manager_toggle_input_mute_cb(pa_context *c, int success, void *userd
 
     pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
     if (!success) {
-        fprintf(stderr, "Failed to toggle input mute state.\n");
+        EASYPULSE_ERROR("Failed to toggle input mute state.");
     }
 
     // Signal the mainloop to continue
@@ -562,30 +1371,37 @@ static void manager_toggle_input_mute_cb(pa_context *c, int success, void *userd
  * Toggle the mute state of a given input device.
  *
  * @param manager A pointer to the initialized pulseaudio_manager instance.
- * @param index The index of the input device to toggle mute state.
+ * @param position The position of the input device in manager->inputs (not its PulseAudio index).
  * @param state The desired mute state (1 for ON/mute, 0 for OFF/unmute).
  * @return Returns 0 on success, -1 on failure.
  */
-int manager_toggle_input_mute(pulseaudio_manager *manager, uint32_t index, int state) {
+static int manager_toggle_input_mute_impl(pulseaudio_manager *manager, uint32_t position, int state) {
 
     if (!manager || !manager->context) {
-        fprintf(stderr, "Invalid PulseAudio manager or context.\n");
+        EASYPULSE_ERROR("Invalid PulseAudio manager or context.");
         return -1;
     }
 
-    if (index >= manager->input_count) {
-        fprintf(stderr, "Input device index out of range.\n");
+    if (position >= manager->input_count) {
+        EASYPULSE_ERROR("Input device position out of range.");
         return -1;
     }
 
     pa_operation *op = pa_context_set_source_mute_by_index(manager->context,
-        index, state, manager_toggle_input_mute_cb, manager);
+        manager->inputs[position].index, state, manager_toggle_input_mute_cb, manager);
 
-    iterate(manager, op);
+    iterate(manager, op, METRIC_OP_SET_SOURCE_MUTE);
 
     return 0;
 }
 
+int manager_toggle_input_mute(pulseaudio_manager *manager, uint32_t position, int state) {
+    metrics_call call = metrics_api_begin();
+    int result = manager_toggle_input_mute_impl(manager, position, state);
+    metrics_api_end(METRIC_API_TOGGLE_INPUT_MUTE, call, result == 0);
+    return result;
+}
+
 /**
  * @brief Callback for handling the completion of setting the default sink.
  *
@@ -601,7 +1417,7 @@ static void manager_switch_default_output_cb(pa_context *c, int success, void *u
 
     pulseaudio_manager *manager = (pulseaudio_manager *)userdata;
     if (!success) {
-        fprintf(stderr, "Failed to set default sink.\n");
+        EASYPULSE_ERROR("Failed to set default sink.");
     }
     pa_threaded_mainloop_signal(manager->mainloop, 0);
 }
@@ -653,100 +1469,223 @@ static void manager_switch_default_output_cb_2(pa_context *c, const pa_sink_inpu
  * @param device_index Index of the output device to be set as the default.
  * @return True if the operation was successful, False otherwise.
  */
-bool manager_switch_default_output(pulseaudio_manager *self, uint32_t device_index) {
+static bool manager_switch_default_output_impl(pulseaudio_manager *self, uint32_t device_index) {
     //To be sent to the second callback.
     _shared_data_1 shared_data = {self, self->outputs[device_index].index};
 
     if (!self || !self->context || device_index >= self->output_count) {
-        fprintf(stderr, "Invalid arguments provided.\n");
+        EASYPULSE_ERROR("Invalid arguments provided.");
         return false;
     }
 
     const char *new_sink_name = self->outputs[device_index].code;
     if (!new_sink_name) {
-        fprintf(stderr, "Output device code is NULL.\n");
+        EASYPULSE_ERROR("Output device code is NULL.");
         return false;
     }
 
     // Set the new default sink
     pa_operation *op = pa_context_set_default_sink(self->context, new_sink_name, manager_switch_default_output_cb, self);
-    iterate(self, op);
+    iterate(self, op, METRIC_OP_SET_DEFAULT_SINK);
 
     shared_data.new_index = get_output_device_index_by_code(self->context, self->outputs[device_index].code);
     //fprintf(stderr, "[DEBUG, manager_switch_default_output()] index is %lu\n", (unsigned long) shared_data.new_index);
 
     // Move all sink inputs to the new default sink
     op = pa_context_get_sink_input_info_list(self->context, manager_switch_default_output_cb_2, &shared_data);
-    iterate(self, op);
+    iterate(self, op, METRIC_OP_GET_SINK_INPUT_INFO);
 
     return true;
 }
 
+bool manager_switch_default_output(pulseaudio_manager *self, uint32_t device_index) {
+    metrics_call call = metrics_api_begin();
+    bool result = manager_switch_default_output_impl(self, device_index);
+    metrics_api_end(METRIC_API_SWITCH_DEFAULT_OUTPUT, call, result);
+    return result;
+}
+
 /**
  * @brief Callback for handling the completion of setting the default source.
  *
  * This callback is invoked when the operation to set the default source in PulseAudio
- * is completed. It signals the main loop to continue the execution flow.
+ * is completed. It records the completion in the batch the operation belongs to.
  *
  * @param c The PulseAudio context.
  * @param success Indicates if the operation was successful.
- * @param userdata User-provided data, expected to be a pointer to a pulseaudio_manager instance.
+ * @param userdata User-provided data, expected to be a pointer to an op_batch.
  */
 static void manager_switch_default_input_cb(pa_context *c, int success, void *userdata) {
     (void) c;
 
-    pulseaudio_manager *manager = (pulseaudio_manager *)userdata;
     if (!success) {
-        fprintf(stderr, "Failed to set default source.\n");
+        EASYPULSE_ERROR("Failed to set default source.");
     }
-    pa_threaded_mainloop_signal(manager->mainloop, 0);
+    op_batch_complete((op_batch *) userdata, success != 0);
 }
 
-
 /**
- * @brief Switches the default input device to the specified device.
+ * @brief Callback collecting the monitor sources while switching the default input.
  *
- * This function sets the specified input device as the default source in PulseAudio.
- * It requires a valid PulseAudio context and uses the PulseAudio API to set the new default source.
+ * Recording streams attached to a monitor source capture what is being played, not
+ * an input device, so they must not follow the default input.
  *
- * @param self Pointer to the pulseaudio_manager instance.
- * @param device_index Index of the input device to be set as the default.
- * @return True if the operation was successful, False otherwise.
+ * @param c The PulseAudio context.
+ * @param i The source information.
+ * @param eol End of list flag.
+ * @param userdata User-provided data, expected to be a pointer to _shared_data_4.
  */
-bool manager_switch_default_input(pulseaudio_manager *self, uint32_t device_index) {
-    // Validate the arguments
-    if (!self || !self->context || device_index >= self->input_count) {
-        fprintf(stderr, "Invalid arguments provided.\n");
-        return false;
+static void manager_switch_default_input_cb_2(pa_context *c, const pa_source_info *i, int eol, void *userdata) {
+    (void) c;
+
+    _shared_data_4 *data = (_shared_data_4 *) userdata;
+
+    if (eol) {
+        op_batch_complete(data->batch, eol > 0);
+        return;
+    }
+
+    if (!i || i->monitor_of_sink == PA_INVALID_INDEX) {
+        return;
+    }
+
+    uint32_t *monitors = realloc(data->monitors, (data->monitor_count + 1) * sizeof(uint32_t));
+    if (!monitors) {
+        EASYPULSE_ERROR("Failed to allocate memory for monitor sources.");
+        return;
+    }
+    data->monitors = monitors;
+    data->monitors[data->monitor_count++] = i->index;
+}
+
+/**
+ * @brief Callback collecting the recording streams while switching the default input.
+ *
+ * @param c The PulseAudio context.
+ * @param o The source output information.
+ * @param eol End of list flag.
+ * @param userdata User-provided data, expected to be a pointer to _shared_data_4.
+ */
+static void manager_switch_default_input_cb_3(pa_context *c, const pa_source_output_info *o, int eol, void *userdata) {
+    (void) c;
+
+    _shared_data_4 *data = (_shared_data_4 *) userdata;
+
+    if (eol) {
+        op_batch_complete(data->batch, eol > 0);
+        return;
+    }
+
+    if (!o) {
+        return;
+    }
+
+    uint32_t *streams = realloc(data->streams, (data->stream_count + 1) * sizeof(uint32_t));
+    if (!streams) {
+        EASYPULSE_ERROR("Failed to allocate memory for recording streams.");
+        return;
+    }
+    data->streams = streams;
+
+    uint32_t *sources = realloc(data->stream_sources, (data->stream_count + 1) * sizeof(uint32_t));
+    if (!sources) {
+        EASYPULSE_ERROR("Failed to allocate memory for recording streams.");
+        return;
+    }
+    data->stream_sources = sources;
+
+    data->streams[data->stream_count] = o->index;
+    data->stream_sources[data->stream_count] = o->source;
+    data->stream_count++;
+}
+
+/**
+ * @brief Switches the default input device to the specified device.
+ *
+ * This function sets the specified input device as the default source in PulseAudio
+ * and moves all recording streams (source outputs) to it, except those recording from
+ * a monitor source. Setting the default and listing the streams are sent together,
+ * and all the moves are then sent as one batch, so the switch costs two round trips
+ * whatever the number of streams.
+ *
+ * @param self Pointer to the pulseaudio_manager instance.
+ * @param device_index Index of the input device to be set as the default.
+ * @return True if the operation was successful, False otherwise.
+ */
+static bool manager_switch_default_input_impl(pulseaudio_manager *self, uint32_t device_index) {
+    // Validate the arguments
+    if (!self || !self->context || device_index >= self->input_count) {
+        EASYPULSE_ERROR("Invalid arguments provided.");
+        return false;
     }
 
     // Retrieve the code (PulseAudio name) of the new default input device
     const char *new_source_name = self->inputs[device_index].code;
     if (!new_source_name) {
-        fprintf(stderr, "Input device code is NULL.\n");
+        EASYPULSE_ERROR("Input device code is NULL.");
         return false;
     }
+    uint32_t new_source_index = self->inputs[device_index].index;
 
-    // Lock the main loop to ensure thread safety during the operation
-    pa_threaded_mainloop_lock(self->mainloop);
+    op_batch batch;
+    op_batch_init(&batch, self->mainloop, METRIC_OP_BATCH);
+    _shared_data_4 data = { &batch, NULL, NULL, 0, NULL, 0 };
 
-    // Initiate the operation to set the new default source
-    pa_operation *op = pa_context_set_default_source(self->context, new_source_name, manager_switch_default_input_cb, self);
-    if (op) {
-        pa_operation_unref(op);
+    // Lock the main loop to ensure thread safety during the operation
+    manager_lock(self);
+
+    // Set the new default source while listing the streams and the monitor sources
+    op_batch_add(&batch, pa_context_set_default_source(self->context, new_source_name,
+        manager_switch_default_input_cb, &batch));
+    op_batch_add(&batch, pa_context_get_source_info_list(self->context,
+        manager_switch_default_input_cb_2, &data));
+    op_batch_add(&batch, pa_context_get_source_output_info_list(self->context,
+        manager_switch_default_input_cb_3, &data));
+    op_batch_wait(&batch);
+
+    bool success = batch.failed == 0;
+    if (!success) {
+        EASYPULSE_ERROR("Failed to set default source.");
     } else {
-        fprintf(stderr, "Failed to set default source.\n");
-        pa_threaded_mainloop_unlock(self->mainloop);
-        return false;
-    }
+        // Move every recording stream that is not already there, in one batch
+        op_batch moves;
+        op_batch_init(&moves, self->mainloop, METRIC_OP_MOVE_SOURCE_OUTPUT);
+
+        for (uint32_t i = 0; i < data.stream_count; ++i) {
+            bool is_monitor = false;
+            for (uint32_t j = 0; j < data.monitor_count && !is_monitor; ++j) {
+                is_monitor = data.stream_sources[i] == data.monitors[j];
+            }
+
+            if (is_monitor || data.stream_sources[i] == new_source_index) {
+                continue;
+            }
+
+            op_batch_add(&moves, pa_context_move_source_output_by_index(self->context, data.streams[i],
+                new_source_index, op_batch_success_cb, &moves));
+        }
+        op_batch_wait(&moves);
 
-    // Wait for the completion of the operation
-    pa_threaded_mainloop_wait(self->mainloop);
+        if (moves.failed > 0) {
+            EASYPULSE_ERROR("Failed to move %u recording stream(s) to the new default source.", moves.failed);
+        }
+    }
 
     // Unlock the main loop after the operation is complete
-    pa_threaded_mainloop_unlock(self->mainloop);
+    manager_unlock(self);
 
-    return true;
+    free(data.streams);
+    free(data.stream_sources);
+    free(data.monitors);
+
+    return success;
+}
+
+bool manager_switch_default_input(pulseaudio_manager *self, uint32_t device_index) {
+    metrics_call call = metrics_api_begin();
+    bool result = manager_switch_default_input_impl(self, device_index);
+    metrics_api_end(METRIC_API_SWITCH_DEFAULT_INPUT, call, result);
+    return result;
 }
 
 /**
@@ -766,7 +1705,7 @@ bool manager_switch_default_input(pulseaudio_manager *self, uint32_t device_inde
  * @return Returns 0 on success, -1 on failure (e.g., if both configuration files
  *         cannot be opened for writing).
  */
-int manager_set_pulseaudio_global_rate(int sample_rate) {
+static int manager_set_pulseaudio_global_rate_impl(int sample_rate) {
 
     //Delay for waiting to restarting pulseaudio (in seconds).
     const int restart_delay = 2;
@@ -827,15 +1766,15 @@ int manager_set_pulseaudio_global_rate(int sample_rate) {
     }
 
     if (!operation_successful) {
-        fprintf(stderr, "Failed to update PulseAudio configuration file\n");
+        EASYPULSE_ERROR("Failed to update PulseAudio configuration file");
         return -1;
     }
 
     // Check if running as root
     if (getuid() == 0) {
         // Inform the user to manually restart PulseAudio
-        printf("[WARNING] Pulseaudio cannot be restarted automatically as root.\n");
-        printf("Please restart PulseAudio manually to apply changes.\n");
+        EASYPULSE_WARN("Pulseaudio cannot be restarted automatically as root. "
+                       "Please restart PulseAudio manually to apply changes.");
         return 0;
     }
 
@@ -857,6 +1796,13 @@ int manager_set_pulseaudio_global_rate(int sample_rate) {
     return 0; // Configuration updated and PulseAudio restarted successfully
 }
 
+int manager_set_pulseaudio_global_rate(int sample_rate) {
+    metrics_call call = metrics_api_begin();
+    int result = manager_set_pulseaudio_global_rate_impl(sample_rate);
+    metrics_api_end(METRIC_API_SET_GLOBAL_RATE, call, result == 0);
+    return result;
+}
+
 
 /**
  * @brief Callback function for setting the mute state of a channel in a PulseAudio sink.
@@ -906,7 +1852,7 @@ static void manager_set_output_channel_mute_state_cb2(pa_context *c, int success
     _shared_data_2 *volume_data = (_shared_data_2 *) userdata;
 
     if (!success) {
-        fprintf(stderr, "Failed to set output device volume.\n");
+        EASYPULSE_ERROR("Failed to set output device volume.");
     }
     pa_threaded_mainloop_signal(volume_data->manager->mainloop, 0);
 }
@@ -924,11 +1870,11 @@ static void manager_set_output_channel_mute_state_cb2(pa_context *c, int success
  * @return Returns 0 on success, non-zero on failure.
  *
  */
-int manager_set_output_mute_state(pulseaudio_manager *self, uint32_t sink_index,
+static int manager_set_output_mute_state_impl(pulseaudio_manager *self, uint32_t sink_index,
 uint32_t channel_index, bool mute_state) {
 
     if (!self->context) {
-        fprintf(stderr, "Failed to get PulseAudio context.\n");
+        EASYPULSE_ERROR("Failed to get PulseAudio context.");
         return -1;
     }
     _shared_data_2 volume_data;
@@ -942,22 +1888,30 @@ uint32_t channel_index, bool mute_state) {
     manager_set_output_channel_mute_state_cb, &volume_data);
 
     if (!op) {
-        fprintf(stderr, "Failed to start output device information operation.\n");
+        EASYPULSE_ERROR("Failed to start output device information operation.");
         return -1;
     }
 
     // Wait for the operation to complete
-    iterate(self, op);
+    iterate(self, op, METRIC_OP_GET_SINK_INFO);
 
     // Set the updated volume
     op = pa_context_set_sink_volume_by_index(self->context, sink_index,
     &(volume_data.new_volume), manager_set_output_channel_mute_state_cb2, &volume_data);
 
-    iterate(self, op);
+    iterate(self, op, METRIC_OP_SET_SINK_VOLUME);
 
     return 0; // Success
 }
 
+int manager_set_output_mute_state(pulseaudio_manager *self, uint32_t sink_index,
+uint32_t channel_index, bool mute_state) {
+    metrics_call call = metrics_api_begin();
+    int result = manager_set_output_mute_state_impl(self, sink_index, channel_index, mute_state);
+    metrics_api_end(METRIC_API_SET_OUTPUT_MUTE_STATE, call, result == 0);
+    return result;
+}
+
 /**
  * @brief Callback function for handling input device information.
  *
@@ -1005,7 +1959,7 @@ static void manager_set_input_mute_state_cb2(pa_context *c, int success, void *u
     _shared_data_2 *volume_data = (_shared_data_2 *) userdata;
 
     if (!success) {
-        fprintf(stderr, "Failed to set input device volume.\n");
+        EASYPULSE_ERROR("Failed to set input device volume.");
     }
 
     pa_threaded_mainloop_signal(volume_data->manager->mainloop, 0);
@@ -1025,10 +1979,10 @@ static void manager_set_input_mute_state_cb2(pa_context *c, int success, void *u
  * @return Returns 0 on success, -1 on failure.
  *
  */
-int manager_set_input_mute_state(pulseaudio_manager *self, uint32_t input_index,
+static int manager_set_input_mute_state_impl(pulseaudio_manager *self, uint32_t input_index,
 uint32_t channel_index, bool mute_state) {
     if (!self->context) {
-        fprintf(stderr, "Failed to get PulseAudio context.\n");
+        EASYPULSE_ERROR("Failed to get PulseAudio context.");
         return -1;
     }
 
@@ -1042,27 +1996,35 @@ uint32_t channel_index, bool mute_state) {
     pa_operation *op = pa_context_get_source_info_by_index(self->context, input_index, manager_set_input_mute_state_cb, &volume_data);
 
     if (!op) {
-        fprintf(stderr, "Failed to start input device information operation.\n");
+        EASYPULSE_ERROR("Failed to start input device information operation.");
         return -1;
     }
 
     // Wait for the operation to complete
-    iterate(self, op);
+    iterate(self, op, METRIC_OP_GET_SOURCE_INFO);
 
     // Set the updated volume for the specified channel (effectively muting or unmuting the channel)
     op = pa_context_set_source_volume_by_index(self->context, input_index,
     &(volume_data.new_volume), manager_set_input_mute_state_cb2, &volume_data);
 
     if (!op) {
-        fprintf(stderr, "Failed to start source volume set operation.\n");
+        EASYPULSE_ERROR("Failed to start source volume set operation.");
         return -1;
     }
 
-    iterate(self, op);
+    iterate(self, op, METRIC_OP_SET_SOURCE_VOLUME);
 
     return 0;
 }
 
+int manager_set_input_mute_state(pulseaudio_manager *self, uint32_t input_index,
+uint32_t channel_index, bool mute_state) {
+    metrics_call call = metrics_api_begin();
+    int result = manager_set_input_mute_state_impl(self, input_index, channel_index, mute_state);
+    metrics_api_end(METRIC_API_SET_INPUT_MUTE_STATE, call, result == 0);
+    return result;
+}
+
 /**
  * @brief Moves playback from one sink to another.
  *
@@ -1075,9 +2037,9 @@ uint32_t channel_index, bool mute_state) {
  * @param sink2_index Index of the new sink (output device) to move streams to.
  * @return Returns 0 on success, -1 on failure.
  */
-int manager_move_output_playback(pulseaudio_manager *self, uint32_t sink1_index, uint32_t sink2_index) {
+static int manager_move_output_playback_impl(pulseaudio_manager *self, uint32_t sink1_index, uint32_t sink2_index) {
     if (!self || sink1_index >= self->output_count || sink2_index >= self->output_count) {
-        fprintf(stderr, "Invalid arguments provided.\n");
+        EASYPULSE_ERROR("Invalid arguments provided.");
         return -1;
     }
 
@@ -1087,15 +2049,22 @@ int manager_move_output_playback(pulseaudio_manager *self, uint32_t sink1_index,
     pa_operation *op = pa_context_get_sink_input_info_list(self->context, manager_switch_default_output_cb_2, &shared_data);
 
     if (!op) {
-        fprintf(stderr, "Failed to start sink input info list operation.\n");
+        EASYPULSE_ERROR("Failed to start sink input info list operation.");
         return -1;
     }
 
-    iterate(self, op);
+    iterate(self, op, METRIC_OP_GET_SINK_INPUT_INFO);
 
     return 0; // Success
 }
 
+int manager_move_output_playback(pulseaudio_manager *self, uint32_t sink1_index, uint32_t sink2_index) {
+    metrics_call call = metrics_api_begin();
+    int result = manager_move_output_playback_impl(self, sink1_index, sink2_index);
+    metrics_api_end(METRIC_API_MOVE_OUTPUT_PLAYBACK, call, result == 0);
+    return result;
+}
+
 /**
  * Callback function after attempting to move the sink input.
  * Signals the main loop upon completion.
@@ -1108,12 +2077,10 @@ static void manager_move_sink_input_cb(pa_context *c, int success, void *userdat
     (void) c; // Unused parameter
 
     pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
-    fprintf(stderr, "[DEBUG, manager_move_sink_input_cb] success is: %i\n", success);
-
     if (success) {
-        printf("Sink input moved successfully.\n");
+        EASYPULSE_DEBUG("Sink input moved successfully.");
     } else {
-        fprintf(stderr, "Failed to move sink input.\n");
+        EASYPULSE_ERROR("Failed to move sink input.");
     }
 
     // Signal the main loop that the operation is complete
@@ -1128,20 +2095,2308 @@ static void manager_move_sink_input_cb(pa_context *c, int success, void *userdat
  * @param target_sink_idx The index of the target sink.
  * @return Returns true if the operation was initiated successfully, false otherwise.
  */
-bool manager_move_sink_input(pulseaudio_manager *manager, uint32_t sink_input_idx, uint32_t target_sink_idx) {
+static bool manager_move_sink_input_impl(pulseaudio_manager *manager, uint32_t sink_input_idx, uint32_t target_sink_idx) {
     if (!manager || !manager->context) {
-        fprintf(stderr, "Invalid manager or context.\n");
+        EASYPULSE_ERROR("Invalid manager or context.");
         return false;
     }
 
     // Initiate the move operation
     pa_operation *op = pa_context_move_sink_input_by_index(manager->context, sink_input_idx, target_sink_idx, manager_move_sink_input_cb, manager);
     if (!op) {
-        fprintf(stderr, "pa_context_move_sink_input_by_index() failed.\n");
+        EASYPULSE_ERROR("pa_context_move_sink_input_by_index() failed.");
         return false;
     }
 
     // Iterate over the main loop until the operation is complete
-    iterate(manager, op);
+    iterate(manager, op, METRIC_OP_MOVE_SINK_INPUT);
     return true;
 }
+
+bool manager_move_sink_input(pulseaudio_manager *manager, uint32_t sink_input_idx, uint32_t target_sink_idx) {
+    metrics_call call = metrics_api_begin();
+    bool result = manager_move_sink_input_impl(manager, sink_input_idx, target_sink_idx);
+    metrics_api_end(METRIC_API_MOVE_SINK_INPUT, call, result);
+    return result;
+}
+
+/**
+ * @brief Moves a set of recording streams (source outputs) to a source, as one batch.
+ *
+ * All move requests are sent before waiting for any reply, so moving N streams costs
+ * a single round trip to the server.
+ *
+ * @param manager Pointer to the pulseaudio_manager structure.
+ * @param source_output_indices Indexes of the source outputs to move.
+ * @param count Number of source outputs in the array.
+ * @param target_source_idx The index of the target source.
+ * @return The number of source outputs moved, or -1 if the arguments are invalid.
+ */
+static int manager_move_source_outputs_impl(pulseaudio_manager *manager, const uint32_t *source_output_indices,
+uint32_t count, uint32_t target_source_idx) {
+    if (!manager || !manager->context || (count > 0 && !source_output_indices)) {
+        EASYPULSE_ERROR("Invalid manager or arguments.");
+        return -1;
+    }
+
+    op_batch batch;
+    op_batch_init(&batch, manager->mainloop, METRIC_OP_MOVE_SOURCE_OUTPUT);
+
+    manager_lock(manager);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        op_batch_add(&batch, pa_context_move_source_output_by_index(manager->context,
+            source_output_indices[i], target_source_idx, op_batch_success_cb, &batch));
+    }
+    op_batch_wait(&batch);
+
+    manager_unlock(manager);
+
+    if (batch.failed > 0) {
+        EASYPULSE_ERROR("Failed to move %u source output(s).", batch.failed);
+    }
+
+    return (int) batch.succeeded;
+}
+
+int manager_move_source_outputs(pulseaudio_manager *manager, const uint32_t *source_output_indices,
+uint32_t count, uint32_t target_source_idx) {
+    metrics_call call = metrics_api_begin();
+    int result = manager_move_source_outputs_impl(manager, source_output_indices, count, target_source_idx);
+    metrics_api_end(METRIC_API_MOVE_SOURCE_OUTPUTS, call, result >= 0 && (uint32_t) result == count);
+    return result;
+}
+
+/**
+ * Moves a recording stream (source output) to a new source.
+ *
+ * @param manager Pointer to the pulseaudio_manager structure.
+ * @param source_output_idx The index of the source output to be moved.
+ * @param target_source_idx The index of the target source.
+ * @return Returns true if the source output was moved, false otherwise.
+ */
+static bool manager_move_source_output_impl(pulseaudio_manager *manager, uint32_t source_output_idx, uint32_t target_source_idx) {
+    return manager_move_source_outputs_impl(manager, &source_output_idx, 1, target_source_idx) == 1;
+}
+
+bool manager_move_source_output(pulseaudio_manager *manager, uint32_t source_output_idx, uint32_t target_source_idx) {
+    metrics_call call = metrics_api_begin();
+    bool result = manager_move_source_output_impl(manager, source_output_idx, target_source_idx);
+    metrics_api_end(METRIC_API_MOVE_SOURCE_OUTPUT, call, result);
+    return result;
+}
+
+/**
+ * @brief Adds a routing rule to the manager.
+ *
+ * Every playback stream (sink input) created after this call whose proplist matches all
+ * the conditions of the rule is moved to the device identified by target_code, as soon
+ * as the server reports it. Rules are evaluated in the order they were added and the
+ * first matching one wins. Use manager_apply_routing_rules() to also route the streams
+ * that already exist.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param conditions Array of conditions that must all match.
+ * @param condition_count Number of conditions in the array.
+ * @param target_code Code (PulseAudio name) of the output device streams are moved to.
+ * @return The id of the new rule, or -1 on failure.
+ */
+int manager_add_routing_rule(pulseaudio_manager *manager, const route_condition *conditions,
+uint32_t condition_count, const char *target_code) {
+    if (!manager || !manager->context) {
+        EASYPULSE_ERROR("Invalid manager or context.");
+        return -1;
+    }
+
+    // The router and its rule table are read by the mainloop thread when streams appear
+    manager_lock(manager);
+    if (!manager->router) {
+        manager->router = stream_router_create();
+        if (!manager->router) {
+            manager_unlock(manager);
+            return -1;
+        }
+    }
+    int rule_id = stream_router_add_rule(manager->router, conditions, condition_count, target_code);
+    manager_unlock(manager);
+
+    if (rule_id < 0) {
+        return -1;
+    }
+
+    if (!manager_enable_events(manager, PA_SUBSCRIPTION_MASK_SINK_INPUT)) {
+        manager_remove_routing_rule(manager, rule_id);
+        return -1;
+    }
+
+    return rule_id;
+}
+
+/**
+ * @brief Removes a routing rule from the manager.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param rule_id Id returned by manager_add_routing_rule().
+ * @return true if the rule was removed, false if it does not exist.
+ */
+bool manager_remove_routing_rule(pulseaudio_manager *manager, int rule_id) {
+    if (!manager || !manager->router) {
+        return false;
+    }
+
+    manager_lock(manager);
+    bool removed = stream_router_remove_rule(manager->router, rule_id);
+    manager_unlock(manager);
+
+    return removed;
+}
+
+/**
+ * @brief Removes all routing rules from the manager.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ */
+void manager_clear_routing_rules(pulseaudio_manager *manager) {
+    if (!manager || !manager->router) {
+        return;
+    }
+
+    manager_lock(manager);
+    stream_router_clear(manager->router);
+    manager_unlock(manager);
+}
+
+/**
+ * @brief Sets a function called for every server event.
+ *
+ * The callback runs in the mainloop thread, after the manager has handled the event.
+ * Its duration is recorded in the metrics and, if it exceeds the slow callback
+ * threshold, reported on stderr: while it runs, every manager call is blocked.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param callback The function to call, or NULL to stop calling it.
+ * @param userdata Pointer passed to the callback.
+ * @return true on success, false if the manager could not subscribe to the events.
+ */
+bool manager_set_event_callback(pulseaudio_manager *manager, manager_event_cb callback, void *userdata) {
+    if (!manager || !manager->context) {
+        EASYPULSE_ERROR("Invalid PulseAudio manager or context.");
+        return false;
+    }
+
+    manager_lock(manager);
+    manager->event_callback = callback;
+    manager->event_userdata = userdata;
+    manager_unlock(manager);
+
+    return !callback || manager_enable_events(manager, PA_SUBSCRIPTION_MASK_ALL);
+}
+
+/**
+ * @brief Sets the duration above which a user callback is reported as slow.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param threshold Duration in microseconds, 0 to never report (MANAGER_SLOW_CALLBACK_USEC by default).
+ */
+void manager_set_slow_callback_threshold(pulseaudio_manager *manager, pa_usec_t threshold) {
+    if (!manager) {
+        return;
+    }
+
+    manager_lock(manager);
+    manager->slow_callback_usec = threshold;
+    manager_unlock(manager);
+}
+
+/**
+ * @brief Starts recording the server events into an event log.
+ *
+ * Every subscription event is recorded, as well as the information of every new sink
+ * input (which is queried for that purpose when no routing rule is loaded). A
+ * recording already in progress is closed first.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param path Path of the log file, replaced if it exists.
+ * @return true on success, false if the file cannot be created or the manager could
+ *         not subscribe to the events.
+ */
+bool manager_start_recording(pulseaudio_manager *manager, const char *path) {
+    if (!manager || !manager->context) {
+        EASYPULSE_ERROR("Invalid PulseAudio manager or context.");
+        return false;
+    }
+
+    event_recorder *recorder = event_recorder_open(path);
+    if (!recorder) {
+        return false;
+    }
+
+    manager_lock(manager);
+    event_recorder *previous = manager->recorder;
+    manager->recorder = recorder;
+    manager_unlock(manager);
+
+    event_recorder_close(previous);
+    return manager_enable_events(manager, PA_SUBSCRIPTION_MASK_ALL);
+}
+
+/**
+ * @brief Stops recording the server events and closes the event log.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @return true if the log is complete (or nothing was being recorded), false if
+ *         writing it failed.
+ */
+bool manager_stop_recording(pulseaudio_manager *manager) {
+    if (!manager || !manager->mainloop) {
+        return true;
+    }
+
+    manager_lock(manager);
+    event_recorder *recorder = manager->recorder;
+    manager->recorder = NULL;
+    manager_unlock(manager);
+
+    return event_recorder_close(recorder);
+}
+
+/**
+ * @brief Publishes the state of the devices in a shared memory segment.
+ *
+ * The segment is kept up to date from the sink, source and server events, so that
+ * other processes can read the state with shm_state_open() and shm_state_read()
+ * without connecting to the server. The first state is published before returning.
+ * Publishing can also be turned on by setting the EASYPULSE_PUBLISH environment
+ * variable to the name of the segment.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param name Name of the segment ("/name"), NULL for SHM_STATE_DEFAULT_NAME. A
+ *        segment of the same name is replaced.
+ * @return true on success, false otherwise.
+ */
+bool manager_start_publishing(pulseaudio_manager *manager, const char *name) {
+    if (!manager || !manager->context) {
+        EASYPULSE_ERROR("Invalid PulseAudio manager or context.");
+        return false;
+    }
+
+    shm_state_writer *writer = shm_state_create(name);
+    if (!writer) {
+        return false;
+    }
+
+    manager_lock(manager);
+
+    if (!manager->publisher) {
+        manager->publisher = calloc(1, sizeof(manager_publisher));
+        if (!manager->publisher) {
+            manager_unlock(manager);
+            EASYPULSE_ERROR("Failed to allocate memory for the state publisher.");
+            shm_state_destroy(writer);
+            return false;
+        }
+    }
+
+    shm_state_writer *previous = manager->publisher->writer;
+    manager->publisher->writer = writer;
+    manager_publisher_refresh(manager, manager->context);
+    while (manager->publisher->pending > 0) {
+        manager_wait(manager);
+    }
+
+    manager_unlock(manager);
+
+    shm_state_destroy(previous);
+    return manager_enable_events(manager, PA_SUBSCRIPTION_MASK_SINK | PA_SUBSCRIPTION_MASK_SOURCE |
+                                          PA_SUBSCRIPTION_MASK_SERVER);
+}
+
+/**
+ * @brief Stops publishing the state of the devices and removes the segment.
+ *
+ * Readers still mapping it see the state as offline.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ */
+void manager_stop_publishing(pulseaudio_manager *manager) {
+    if (!manager || !manager->mainloop || !manager->publisher) {
+        return;
+    }
+
+    // The publisher itself stays until the cleanup, replies may still be in flight
+    manager_lock(manager);
+    shm_state_writer *writer = manager->publisher->writer;
+    manager->publisher->writer = NULL;
+    manager_unlock(manager);
+
+    shm_state_destroy(writer);
+}
+
+/**
+ * @brief Callback for a suspend or resume sent by the idle policy without waiting.
+ */
+static void manager_idle_suspend_cb(pa_context *c, int success, void *userdata) {
+    (void) c;
+    (void) userdata;
+
+    if (!success) {
+        EASYPULSE_WARN("The idle policy failed to suspend or resume a device.");
+    }
+}
+
+/**
+ * @brief Sends a suspend or resume request for a device, without waiting for it.
+ *
+ * @param c The PulseAudio context.
+ * @param output Whether the device is a sink.
+ * @param index Index of the sink or source.
+ * @param suspend true to suspend, false to resume.
+ * @param cb Completion callback, or NULL.
+ * @param userdata Pointer passed to cb.
+ * @return The operation, or NULL if it could not be sent.
+ */
+static pa_operation *manager_suspend_request(pa_context *c, bool output, uint32_t index, bool suspend,
+                                             pa_context_success_cb_t cb, void *userdata) {
+    return output ? pa_context_suspend_sink_by_index(c, index, suspend, cb, userdata)
+                  : pa_context_suspend_source_by_index(c, index, suspend, cb, userdata);
+}
+
+/**
+ * @brief Finds a device of the device table.
+ *
+ * @return The device, or NULL if it is not in the table.
+ */
+static manager_table_device *manager_table_find_device(manager_device_table *table, bool output, uint32_t index) {
+    for (uint32_t i = 0; i < table->device_count; ++i) {
+        if (table->devices[i].output == output && table->devices[i].index == index) {
+            return &table->devices[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Finds a device watched by the idle policy.
+ *
+ * @return The device, or NULL if the policy does not run or does not watch it.
+ */
+static manager_table_device *manager_idle_find_device(pulseaudio_manager *manager, bool output, uint32_t index) {
+    if (!manager->idle || !manager->idle->running || !manager->table) {
+        return NULL;
+    }
+
+    manager_table_device *device = manager_table_find_device(manager->table, output, index);
+    return device && device->watched ? device : NULL;
+}
+
+static void manager_idle_timer_cb(pa_mainloop_api *api, pa_time_event *e, const struct timeval *tv, void *userdata);
+
+/**
+ * @brief Arms the timer of a device without streams, or disarms it if it has some.
+ *
+ * The timer is due a timeout after now, or at the end of a hold if that is later.
+ */
+static void manager_idle_arm(pulseaudio_manager *manager, manager_table_device *device) {
+    manager_idle *idle = manager->idle;
+    pa_mainloop_api *api = pa_threaded_mainloop_get_api(manager->mainloop);
+
+    if (device->streams > 0 || device->suspended || device->pinned || !idle->running) {
+        if (device->timer) {
+            api->time_free(device->timer);
+            device->timer = NULL;
+        }
+        return;
+    }
+
+    pa_usec_t due = pa_rtclock_now() + idle->timeout;
+    if (device->awake_until > due) {
+        due = device->awake_until;
+    }
+
+    if (device->timer) {
+        pa_context_rttime_restart(manager->context, device->timer, due);
+    } else {
+        device->timer = pa_context_rttime_new(manager->context, due, manager_idle_timer_cb, manager);
+        if (!device->timer) {
+            EASYPULSE_WARN("Failed to arm the idle timer of a device.");
+        }
+    }
+}
+
+/**
+ * @brief Starts watching a device of the table, and arms its timer.
+ *
+ * @param suspended Whether the device is already suspended.
+ */
+static void manager_idle_watch(pulseaudio_manager *manager, manager_table_device *device, bool suspended) {
+    device->watched = true;
+    device->pinned = false;
+    device->awake_until = 0;
+
+    // A device suspended by someone else is left alone until a stream comes
+    device->suspended = suspended && device->streams == 0;
+    manager_idle_arm(manager, device);
+}
+
+/**
+ * @brief Stops watching a device: disarms its timer and forgets the policy state.
+ */
+static void manager_idle_unwatch(pulseaudio_manager *manager, manager_table_device *device) {
+    if (device->timer) {
+        pa_threaded_mainloop_get_api(manager->mainloop)->time_free(device->timer);
+    }
+    device->watched = device->suspended = device->pinned = false;
+    device->awake_until = 0;
+    device->timer = NULL;
+}
+
+/**
+ * @brief Reacts to a stream that came to a device. A device suspended by the policy is
+ * resumed at once, the server does not do it for a device suspended by a client.
+ */
+static void manager_idle_attach(pulseaudio_manager *manager, pa_context *c, manager_table_device *device) {
+    if (!device->watched) {
+        return;
+    }
+
+    if (device->suspended) {
+        pa_operation *op = manager_suspend_request(c, device->output, device->index, false,
+                                                   manager_idle_suspend_cb, NULL);
+        if (op) {
+            pa_operation_unref(op);
+        }
+        device->suspended = false;
+    }
+    manager_idle_arm(manager, device);
+}
+
+/**
+ * @brief Reacts to a stream that left a device: arms its timer if it was the last one.
+ */
+static void manager_idle_detach(pulseaudio_manager *manager, manager_table_device *device) {
+    if (device->watched && device->streams == 0) {
+        manager_idle_arm(manager, device);
+    }
+}
+
+/**
+ * @brief Callback of the idle timer of a device: suspends it if it still has no stream.
+ */
+static void manager_idle_timer_cb(pa_mainloop_api *api, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    (void) tv;
+
+    pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
+    manager_device_table *table = manager->table;
+
+    for (uint32_t i = 0; i < table->device_count; ++i) {
+        manager_table_device *device = &table->devices[i];
+        if (device->timer != e) {
+            continue;
+        }
+
+        api->time_free(e);
+        device->timer = NULL;
+        if (device->streams == 0 && !device->suspended) {
+            pa_operation *op = manager_suspend_request(manager->context, device->output, device->index, true,
+                                                       manager_idle_suspend_cb, NULL);
+            if (op) {
+                pa_operation_unref(op);
+                device->suspended = true;
+            }
+        }
+        return;
+    }
+}
+
+/**
+ * @brief Adds a device to the device table, or updates it when it is listed again.
+ *
+ * With the idle policy running, the device is watched unless it is a monitor.
+ *
+ * @param suspended Whether the server reports the device suspended.
+ */
+static void manager_table_add_device(pulseaudio_manager *manager, bool output, uint32_t index, const char *name,
+                                     bool monitor, bool suspended) {
+    manager_device_table *table = manager->table;
+    manager_table_device *device = manager_table_find_device(table, output, index);
+
+    if (!device) {
+        if (table->device_count == table->device_capacity) {
+            uint32_t capacity = table->device_capacity ? table->device_capacity * 2 : 16;
+            manager_table_device *devices = realloc(table->devices, capacity * sizeof(manager_table_device));
+            if (!devices) {
+                EASYPULSE_ERROR("Failed to allocate memory for the device table.");
+                return;
+            }
+            table->devices = devices;
+            table->device_capacity = capacity;
+        }
+
+        device = &table->devices[table->device_count++];
+        memset(device, 0, sizeof(manager_table_device));
+        device->output = output;
+        device->index = index;
+
+        // Streams of the device may have been seen before it
+        for (uint32_t i = 0; i < table->stream_count; ++i) {
+            if (table->streams[i].output == output && table->streams[i].device == index) {
+                ++device->streams;
+            }
+        }
+    }
+    device->id = manager_device_stable_id(name);
+    device->monitor = monitor;
+
+    if (manager->idle && manager->idle->running && !monitor && !device->watched) {
+        manager_idle_watch(manager, device, suspended);
+    }
+}
+
+static void manager_fallback_lost(pulseaudio_manager *manager, pa_context *c, manager_table_device *device);
+
+/**
+ * @brief Removes a device that went away: the fallback chains recover if it was a
+ * default device, then the idle policy and the table forget it.
+ */
+static void manager_table_remove_device(pulseaudio_manager *manager, pa_context *c, bool output, uint32_t index) {
+    manager_device_table *table = manager->table;
+    manager_table_device *device = manager_table_find_device(table, output, index);
+    if (!device) {
+        return;
+    }
+
+    if (manager->fallback && manager->fallback->running) {
+        manager_fallback_lost(manager, c, device);
+    }
+    manager_idle_unwatch(manager, device);
+    *device = table->devices[--table->device_count];
+}
+
+/**
+ * @brief Moves a stream of the table to another device, and counts it there.
+ */
+static void manager_table_move_stream(pulseaudio_manager *manager, pa_context *c, manager_table_stream *stream,
+                                      uint32_t device_index) {
+    manager_device_table *table = manager->table;
+
+    manager_table_device *device = manager_table_find_device(table, stream->output, stream->device);
+    if (device && device->streams > 0) {
+        --device->streams;
+        manager_idle_detach(manager, device);
+    }
+
+    stream->device = device_index;
+    device = manager_table_find_device(table, stream->output, device_index);
+    if (device) {
+        ++device->streams;
+        manager_idle_attach(manager, c, device);
+    }
+}
+
+/**
+ * @brief Records the device of a stream in the stream table, new or moved.
+ */
+static void manager_table_set_stream(pulseaudio_manager *manager, pa_context *c, bool output, uint32_t index,
+                                     uint32_t device) {
+    manager_device_table *table = manager->table;
+
+    for (uint32_t i = 0; i < table->stream_count; ++i) {
+        manager_table_stream *stream = &table->streams[i];
+        if (stream->output == output && stream->index == index) {
+            if (stream->device != device) {
+                manager_table_move_stream(manager, c, stream, device);
+            }
+            return;
+        }
+    }
+
+    if (table->stream_count == table->stream_capacity) {
+        uint32_t capacity = table->stream_capacity ? table->stream_capacity * 2 : 32;
+        manager_table_stream *streams = realloc(table->streams, capacity * sizeof(manager_table_stream));
+        if (!streams) {
+            EASYPULSE_ERROR("Failed to allocate memory for the device table.");
+            return;
+        }
+        table->streams = streams;
+        table->stream_capacity = capacity;
+    }
+
+    manager_table_stream *stream = &table->streams[table->stream_count++];
+    *stream = (manager_table_stream) {output, index, PA_INVALID_INDEX};
+    manager_table_move_stream(manager, c, stream, device);
+}
+
+/**
+ * @brief Removes a stream from the stream table.
+ */
+static void manager_table_remove_stream(pulseaudio_manager *manager, bool output, uint32_t index) {
+    manager_device_table *table = manager->table;
+
+    for (uint32_t i = 0; i < table->stream_count; ++i) {
+        if (table->streams[i].output == output && table->streams[i].index == index) {
+            manager_table_device *device = manager_table_find_device(table, output, table->streams[i].device);
+            table->streams[i] = table->streams[--table->stream_count];
+            if (device && device->streams > 0) {
+                --device->streams;
+                manager_idle_detach(manager, device);
+            }
+            return;
+        }
+    }
+}
+
+static void manager_table_sink_cb(pa_context *c, const pa_sink_info *i, int eol, void *userdata) {
+    (void) c;
+
+    pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
+    if (!eol && i && manager->table->running) {
+        manager_table_add_device(manager, true, i->index, i->name, false, i->state == PA_SINK_SUSPENDED);
+    }
+}
+
+static void manager_table_source_cb(pa_context *c, const pa_source_info *i, int eol, void *userdata) {
+    (void) c;
+
+    // Monitor sources follow their sink
+    pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
+    if (!eol && i && manager->table->running) {
+        manager_table_add_device(manager, false, i->index, i->name, i->monitor_of_sink != PA_INVALID_INDEX,
+                                 i->state == PA_SOURCE_SUSPENDED);
+    }
+}
+
+static void manager_table_sink_input_cb(pa_context *c, const pa_sink_input_info *i, int eol, void *userdata) {
+    pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
+    if (!eol && i && manager->table->running) {
+        manager_table_set_stream(manager, c, true, i->index, i->sink);
+    }
+}
+
+static void manager_table_source_output_cb(pa_context *c, const pa_source_output_info *i, int eol, void *userdata) {
+    pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
+    if (!eol && i && manager->table->running) {
+        manager_table_set_stream(manager, c, false, i->index, i->source);
+    }
+}
+
+/**
+ * @brief Keeps the device table up to date from a server event, for the idle policy and
+ * the fallback chains at once.
+ *
+ * Runs in the mainloop thread. A new device and a new or changed stream cost one query
+ * of its own information; removals cost nothing. Nothing is polled.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param c The PulseAudio context.
+ * @param facility Facility of the event.
+ * @param type Type of the event.
+ * @param idx Index of the object the event refers to.
+ */
+static void manager_table_event(pulseaudio_manager *manager, pa_context *c, pa_subscription_event_type_t facility,
+                                pa_subscription_event_type_t type, uint32_t idx) {
+    pa_operation *op = NULL;
+    bool removed = type == PA_SUBSCRIPTION_EVENT_REMOVE;
+
+    switch (facility) {
+        case PA_SUBSCRIPTION_EVENT_SINK:
+            if (removed) {
+                manager_table_remove_device(manager, c, true, idx);
+            } else if (type == PA_SUBSCRIPTION_EVENT_NEW) {
+                op = pa_context_get_sink_info_by_index(c, idx, manager_table_sink_cb, manager);
+            }
+            break;
+        case PA_SUBSCRIPTION_EVENT_SOURCE:
+            if (removed) {
+                manager_table_remove_device(manager, c, false, idx);
+            } else if (type == PA_SUBSCRIPTION_EVENT_NEW) {
+                op = pa_context_get_source_info_by_index(c, idx, manager_table_source_cb, manager);
+            }
+            break;
+        case PA_SUBSCRIPTION_EVENT_SINK_INPUT:
+            if (removed) {
+                manager_table_remove_stream(manager, true, idx);
+            } else {
+                op = pa_context_get_sink_input_info(c, idx, manager_table_sink_input_cb, manager);
+            }
+            break;
+        case PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT:
+            if (removed) {
+                manager_table_remove_stream(manager, false, idx);
+            } else {
+                op = pa_context_get_source_output_info(c, idx, manager_table_source_output_cb, manager);
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (op) {
+        pa_operation_unref(op);
+    }
+}
+
+static void manager_table_list_sink_cb(pa_context *c, const pa_sink_info *i, int eol, void *userdata) {
+    _shared_data_8 *shared_data = (_shared_data_8 *) userdata;
+    if (eol != 0) {
+        op_batch_complete(shared_data->batch, eol > 0);
+        return;
+    }
+    manager_table_sink_cb(c, i, eol, shared_data->manager);
+}
+
+static void manager_table_list_source_cb(pa_context *c, const pa_source_info *i, int eol, void *userdata) {
+    _shared_data_8 *shared_data = (_shared_data_8 *) userdata;
+    if (eol != 0) {
+        op_batch_complete(shared_data->batch, eol > 0);
+        return;
+    }
+    manager_table_source_cb(c, i, eol, shared_data->manager);
+}
+
+static void manager_table_list_sink_input_cb(pa_context *c, const pa_sink_input_info *i, int eol, void *userdata) {
+    _shared_data_8 *shared_data = (_shared_data_8 *) userdata;
+    if (eol != 0) {
+        op_batch_complete(shared_data->batch, eol > 0);
+        return;
+    }
+    manager_table_sink_input_cb(c, i, eol, shared_data->manager);
+}
+
+static void manager_table_list_source_output_cb(pa_context *c, const pa_source_output_info *i, int eol,
+                                                void *userdata) {
+    _shared_data_8 *shared_data = (_shared_data_8 *) userdata;
+    if (eol != 0) {
+        op_batch_complete(shared_data->batch, eol > 0);
+        return;
+    }
+    manager_table_source_output_cb(c, i, eol, shared_data->manager);
+}
+
+/**
+ * @brief Starts keeping the device table, and lists the devices and streams into it.
+ *
+ * The listing is added to a batch the caller waits for. A table already kept is listed
+ * again, so that a feature starting later (the idle policy) sees the current state of
+ * the devices. Events handled during the listing update the same table. The manager
+ * must be subscribed to the device and stream events first, so that no change falls
+ * between the listing and the events. Mainloop locked.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param batch The batch the listing is added to.
+ * @param shared_data Data of the list callbacks, which must live until the batch is
+ *        waited for.
+ * @return false if the table could not be allocated.
+ */
+static bool manager_table_list(pulseaudio_manager *manager, op_batch *batch, _shared_data_8 *shared_data) {
+    if (!manager->table) {
+        manager->table = calloc(1, sizeof(manager_device_table));
+        if (!manager->table) {
+            EASYPULSE_ERROR("Failed to allocate memory for the device table.");
+            return false;
+        }
+    }
+    manager->table->running = true;
+
+    op_batch_add(batch, pa_context_get_sink_input_info_list(manager->context, manager_table_list_sink_input_cb,
+                                                            shared_data));
+    op_batch_add(batch, pa_context_get_source_output_info_list(manager->context, manager_table_list_source_output_cb,
+                                                               shared_data));
+    op_batch_add(batch, pa_context_get_sink_info_list(manager->context, manager_table_list_sink_cb, shared_data));
+    op_batch_add(batch, pa_context_get_source_info_list(manager->context, manager_table_list_source_cb,
+                                                        shared_data));
+    return true;
+}
+
+/**
+ * @brief Empties the device table once neither the idle policy nor a fallback chain
+ * needs it. Mainloop locked.
+ */
+static void manager_table_release(pulseaudio_manager *manager) {
+    manager_device_table *table = manager->table;
+    if (!table || (manager->idle && manager->idle->running) || (manager->fallback && manager->fallback->running)) {
+        return;
+    }
+
+    free(table->devices);
+    free(table->streams);
+    memset(table, 0, sizeof(manager_device_table));
+}
+
+/**
+ * @brief Stops the idle policy: disarms its timers and stops watching the devices.
+ *
+ * Must be called with the mainloop locked.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ */
+static void manager_idle_reset(pulseaudio_manager *manager) {
+    manager->idle->running = false;
+
+    manager_device_table *table = manager->table;
+    for (uint32_t i = 0; table && i < table->device_count; ++i) {
+        manager_idle_unwatch(manager, &table->devices[i]);
+    }
+    manager_table_release(manager);
+}
+
+/**
+ * @brief Suspends or resumes a device and waits for the server.
+ *
+ * With the idle policy running, a device suspended here is left alone by the policy
+ * (streams coming to it do not resume it) until it is resumed here, and a resumed
+ * device without streams gets its idle timer armed again.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param output Whether the device is an output.
+ * @param device_index Index of the sink or source.
+ * @param suspend true to suspend, false to resume.
+ * @return true on success, false otherwise.
+ */
+static bool manager_suspend_device_impl(pulseaudio_manager *manager, bool output, uint32_t device_index,
+                                        bool suspend) {
+    if (!manager || !manager->context) {
+        EASYPULSE_ERROR("Invalid PulseAudio manager or context.");
+        return false;
+    }
+
+    op_batch batch;
+    op_batch_init(&batch, manager->mainloop, METRIC_OP_SUSPEND);
+
+    manager_lock(manager);
+
+    op_batch_add(&batch, manager_suspend_request(manager->context, output, device_index, suspend,
+                                                 op_batch_success_cb, &batch));
+    op_batch_wait(&batch);
+
+    manager_table_device *device = manager_idle_find_device(manager, output, device_index);
+    if (device && batch.failed == 0) {
+        device->suspended = false;
+        device->pinned = suspend;
+        manager_idle_arm(manager, device);
+    }
+
+    manager_unlock(manager);
+
+    if (batch.failed > 0) {
+        EASYPULSE_ERROR("Failed to %s %s %u.", suspend ? "suspend" : "resume", output ? "output" : "input",
+                        device_index);
+        return false;
+    }
+    return true;
+}
+
+bool manager_suspend_output(pulseaudio_manager *manager, uint32_t device_index, bool suspend) {
+    metrics_call call = metrics_api_begin();
+    bool result = manager_suspend_device_impl(manager, true, device_index, suspend);
+    metrics_api_end(METRIC_API_SUSPEND_DEVICE, call, result);
+    return result;
+}
+
+bool manager_suspend_input(pulseaudio_manager *manager, uint32_t device_index, bool suspend) {
+    metrics_call call = metrics_api_begin();
+    bool result = manager_suspend_device_impl(manager, false, device_index, suspend);
+    metrics_api_end(METRIC_API_SUSPEND_DEVICE, call, result);
+    return result;
+}
+
+/**
+ * @brief Starts suspending the devices that stay without streams.
+ *
+ * The sinks and sources (monitors excepted) and the streams attached to them are read
+ * once, in a single round trip, into the device table the fallback chains share. From
+ * then on the table is kept up to date from the stream and device events: when the last
+ * stream of a device goes, a timer is armed, and the device is suspended if no stream
+ * came back when it fires. A stream appearing on (or moved to) a device the policy
+ * suspended resumes it at once. Nothing is polled.
+ *
+ * Calling it again while the policy runs changes the timeout. Resuming a device takes
+ * some time (the sound card is opened again), see manager_resume_and_hold_output().
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param timeout Time a device may stay without streams before it is suspended.
+ * @return true on success, false otherwise.
+ */
+static bool manager_start_idle_suspend_impl(pulseaudio_manager *manager, pa_usec_t timeout) {
+    if (!manager || !manager->context || timeout == 0) {
+        EASYPULSE_ERROR("Invalid PulseAudio manager or timeout.");
+        return false;
+    }
+
+    // Subscribed first, so that no change can fall between the listing and the events
+    if (!manager_enable_events(manager, PA_SUBSCRIPTION_MASK_SINK | PA_SUBSCRIPTION_MASK_SOURCE |
+                                        PA_SUBSCRIPTION_MASK_SINK_INPUT | PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT)) {
+        return false;
+    }
+
+    manager_lock(manager);
+
+    if (!manager->idle) {
+        manager->idle = calloc(1, sizeof(manager_idle));
+        if (!manager->idle) {
+            manager_unlock(manager);
+            EASYPULSE_ERROR("Failed to allocate memory for the idle policy.");
+            return false;
+        }
+    }
+
+    manager_idle *idle = manager->idle;
+    idle->timeout = timeout;
+    if (idle->running) {
+        for (uint32_t i = 0; i < manager->table->device_count; ++i) {
+            if (manager->table->devices[i].watched) {
+                manager_idle_arm(manager, &manager->table->devices[i]);
+            }
+        }
+        manager_unlock(manager);
+        return true;
+    }
+
+    // Timers are armed as soon as devices are listed, the listing only takes one round
+    // trip. A table already kept for the fallback chains is listed again, so that the
+    // devices are watched with their current state
+    idle->running = true;
+
+    op_batch batch;
+    _shared_data_8 shared_data = {&batch, manager};
+    op_batch_init(&batch, manager->mainloop, METRIC_OP_BATCH);
+    if (!manager_table_list(manager, &batch, &shared_data)) {
+        manager_idle_reset(manager);
+        manager_unlock(manager);
+        return false;
+    }
+    op_batch_wait(&batch);
+
+    if (batch.failed > 0) {
+        manager_idle_reset(manager);
+        manager_unlock(manager);
+        EASYPULSE_ERROR("Failed to read the devices and streams for the idle policy.");
+        return false;
+    }
+
+    manager_unlock(manager);
+    return true;
+}
+
+bool manager_start_idle_suspend(pulseaudio_manager *manager, pa_usec_t timeout) {
+    metrics_call call = metrics_api_begin();
+    bool result = manager_start_idle_suspend_impl(manager, timeout);
+    metrics_api_end(METRIC_API_IDLE_SUSPEND, call, result);
+    return result;
+}
+
+/**
+ * @brief Stops the idle suspend policy.
+ *
+ * The devices the policy suspended are resumed, in one round trip. manager_cleanup()
+ * stops the policy the same way.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ */
+void manager_stop_idle_suspend(pulseaudio_manager *manager) {
+    if (!manager || !manager->context || !manager->idle) {
+        return;
+    }
+
+    op_batch batch;
+    op_batch_init(&batch, manager->mainloop, METRIC_OP_SUSPEND);
+
+    manager_lock(manager);
+
+    manager_device_table *table = manager->table;
+    for (uint32_t i = 0; manager->idle->running && i < table->device_count; ++i) {
+        if (table->devices[i].watched && table->devices[i].suspended) {
+            op_batch_add(&batch, manager_suspend_request(manager->context, table->devices[i].output,
+                                                         table->devices[i].index, false, op_batch_success_cb, &batch));
+        }
+    }
+    manager_idle_reset(manager);
+    op_batch_wait(&batch);
+
+    manager_unlock(manager);
+
+    if (batch.failed > 0) {
+        EASYPULSE_WARN("Failed to resume %u device(s) suspended by the idle policy.", batch.failed);
+    }
+}
+
+/**
+ * @brief Resumes a device a client suspended, and keeps the idle policy off it for a
+ * while.
+ *
+ * Returns once the server has resumed the device. With the idle policy running, the
+ * device is then kept awake for hold even without streams, so it can be resumed before
+ * a switch or a playback that comes a little later without the policy suspending it
+ * again meanwhile.
+ *
+ * Only the suspends of the clients are undone: those of the idle policy and of
+ * manager_suspend_*(). A device that module-suspend-on-idle suspended stays suspended,
+ * the server resumes it when a stream comes to it.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param output Whether the device is an output.
+ * @param device_index Index of the sink or source.
+ * @param hold Time to keep the device awake, 0 for the timeout of the idle policy.
+ * @return true on success, false otherwise.
+ */
+static bool manager_resume_and_hold_impl(pulseaudio_manager *manager, bool output, uint32_t device_index,
+                                         pa_usec_t hold) {
+    if (!manager_suspend_device_impl(manager, output, device_index, false)) {
+        return false;
+    }
+
+    manager_lock(manager);
+
+    manager_table_device *device = manager_idle_find_device(manager, output, device_index);
+    if (device) {
+        device->awake_until = pa_rtclock_now() + (hold ? hold : manager->idle->timeout);
+        manager_idle_arm(manager, device);
+    }
+
+    manager_unlock(manager);
+    return true;
+}
+
+bool manager_resume_and_hold_output(pulseaudio_manager *manager, uint32_t device_index, pa_usec_t hold) {
+    metrics_call call = metrics_api_begin();
+    bool result = manager_resume_and_hold_impl(manager, true, device_index, hold);
+    metrics_api_end(METRIC_API_RESUME_AND_HOLD, call, result);
+    return result;
+}
+
+bool manager_resume_and_hold_input(pulseaudio_manager *manager, uint32_t device_index, pa_usec_t hold) {
+    metrics_call call = metrics_api_begin();
+    bool result = manager_resume_and_hold_impl(manager, false, device_index, hold);
+    metrics_api_end(METRIC_API_RESUME_AND_HOLD, call, result);
+    return result;
+}
+
+/**
+ * @brief Callback for a setting sent from the preference store without waiting.
+ *
+ * @param userdata Name of the setting, a string literal.
+ */
+static void manager_prefs_cb(pa_context *c, int success, void *userdata) {
+    (void) c;
+
+    if (!success) {
+        EASYPULSE_WARN("Failed to give back the saved %s of a device.", (const char *) userdata);
+    }
+}
+
+static void manager_prefs_send(pa_operation *op) {
+    if (op) {
+        pa_operation_unref(op);
+    }
+}
+
+/**
+ * @brief Sends the saved settings of a device that differ from its current ones.
+ *
+ * Runs in the mainloop thread, so nothing is waited for: the operations are sent back to
+ * back and the server applies them in order, in one round trip. The port goes first,
+ * since the server may restore a volume saved for the new port.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param c The PulseAudio context.
+ * @param output Whether the device is a sink.
+ * @param index Index of the device.
+ * @param name Name of the device.
+ * @param volume Current volume of the device.
+ * @param mute Current mute state of the device.
+ * @param port Active port of the device (NULL if none).
+ */
+static void manager_prefs_apply(pulseaudio_manager *manager, pa_context *c, bool output, uint32_t index,
+                                const char *name, const pa_cvolume *volume, int mute, const char *port) {
+    const device_prefs_entry *entry = device_prefs_find(manager->prefs, output ? DEVICE_PREFS_OUTPUT : DEVICE_PREFS_INPUT,
+                                                        manager_device_stable_id(name));
+    if (!entry) {
+        return;
+    }
+
+    const char *saved_port = device_prefs_get_string(manager->prefs, entry->port);
+    if (saved_port && (!port || strcmp(port, saved_port) != 0)) {
+        manager_prefs_send(output ? pa_context_set_sink_port_by_index(c, index, saved_port, manager_prefs_cb, "port")
+                                  : pa_context_set_source_port_by_index(c, index, saved_port, manager_prefs_cb, "port"));
+    }
+
+    pa_cvolume saved_volume;
+    if (device_prefs_get_volume(manager->prefs, entry, &saved_volume) && saved_volume.channels == volume->channels &&
+        !pa_cvolume_equal(&saved_volume, volume)) {
+        manager_prefs_send(output
+            ? pa_context_set_sink_volume_by_index(c, index, &saved_volume, manager_prefs_cb, "volume")
+            : pa_context_set_source_volume_by_index(c, index, &saved_volume, manager_prefs_cb, "volume"));
+    }
+
+    bool saved_mute = (entry->flags & DEVICE_PREFS_MUTED) != 0;
+    if ((entry->flags & DEVICE_PREFS_MUTE_SAVED) && saved_mute != (mute != 0)) {
+        manager_prefs_send(output ? pa_context_set_sink_mute_by_index(c, index, saved_mute, manager_prefs_cb, "mute state")
+                                  : pa_context_set_source_mute_by_index(c, index, saved_mute, manager_prefs_cb, "mute state"));
+    }
+
+    if (entry->flags & DEVICE_PREFS_DEFAULT) {
+        manager_prefs_send(output ? pa_context_set_default_sink(c, name, manager_prefs_cb, "default status")
+                                  : pa_context_set_default_source(c, name, manager_prefs_cb, "default status"));
+    }
+}
+
+static void manager_prefs_sink_cb(pa_context *c, const pa_sink_info *i, int eol, void *userdata) {
+    pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
+
+    if (eol || !i || !manager->prefs) {
+        return;
+    }
+    manager_prefs_apply(manager, c, true, i->index, i->name, &i->volume, i->mute,
+                        i->active_port ? i->active_port->name : NULL);
+}
+
+static void manager_prefs_source_cb(pa_context *c, const pa_source_info *i, int eol, void *userdata) {
+    pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
+
+    // Monitors follow their sink
+    if (eol || !i || !manager->prefs || i->monitor_of_sink != PA_INVALID_INDEX) {
+        return;
+    }
+    manager_prefs_apply(manager, c, false, i->index, i->name, &i->volume, i->mute,
+                        i->active_port ? i->active_port->name : NULL);
+}
+
+/**
+ * @brief Gives a new card its saved profile. The devices of the profile are then
+ * created, and get their own settings from their events.
+ */
+static void manager_prefs_card_cb(pa_context *c, const pa_card_info *i, int eol, void *userdata) {
+    pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
+
+    if (eol || !i || !manager->prefs) {
+        return;
+    }
+
+    const device_prefs_entry *entry = device_prefs_find(manager->prefs, DEVICE_PREFS_CARD,
+                                                        manager_device_stable_id(i->name));
+    const char *profile = entry ? device_prefs_get_string(manager->prefs, entry->profile) : NULL;
+    if (profile && (!i->active_profile || strcmp(i->active_profile->name, profile) != 0)) {
+        manager_prefs_send(pa_context_set_card_profile_by_index(c, i->index, profile, manager_prefs_cb, "profile"));
+    }
+}
+
+/**
+ * @brief Looks up a new sink, source or card in the preference store. Runs in the
+ * mainloop thread.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param c The PulseAudio context.
+ * @param facility Facility of the event.
+ * @param idx Index of the new object.
+ */
+static void manager_prefs_event(pulseaudio_manager *manager, pa_context *c, pa_subscription_event_type_t facility,
+                                uint32_t idx) {
+    switch (facility) {
+        case PA_SUBSCRIPTION_EVENT_SINK:
+            manager_prefs_send(pa_context_get_sink_info_by_index(c, idx, manager_prefs_sink_cb, manager));
+            break;
+        case PA_SUBSCRIPTION_EVENT_SOURCE:
+            manager_prefs_send(pa_context_get_source_info_by_index(c, idx, manager_prefs_source_cb, manager));
+            break;
+        case PA_SUBSCRIPTION_EVENT_CARD:
+            manager_prefs_send(pa_context_get_card_info_by_index(c, idx, manager_prefs_card_cb, manager));
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Applies saved settings to the devices that appear.
+ *
+ * Every sink, source and card reported new by the server is looked up in the store,
+ * and the saved settings that differ from its current ones are sent right away (see
+ * device_prefs.h). Devices already present are left as they are. The manager takes
+ * the store and frees it when it is replaced or at the cleanup.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param prefs The store, or NULL to stop applying settings.
+ * @return true on success, false if the manager could not subscribe to the events.
+ */
+bool manager_set_device_prefs(pulseaudio_manager *manager, device_prefs *prefs) {
+    if (!manager || !manager->context) {
+        EASYPULSE_ERROR("Invalid PulseAudio manager or context.");
+        device_prefs_free(prefs);
+        return false;
+    }
+
+    manager_lock(manager);
+    device_prefs *previous = manager->prefs;
+    manager->prefs = prefs;
+    manager_unlock(manager);
+
+    device_prefs_free(previous);
+    return !prefs || manager_enable_events(manager, PA_SUBSCRIPTION_MASK_SINK | PA_SUBSCRIPTION_MASK_SOURCE |
+                                                    PA_SUBSCRIPTION_MASK_CARD);
+}
+
+/**
+ * @brief Callback for the operations of a recovery. The last one records the time the
+ * recovery took, from the removal event.
+ */
+static void manager_fallback_done_cb(pa_context *c, int success, void *userdata) {
+    (void) c;
+
+    manager_fallback *fallback = ((pulseaudio_manager *) userdata)->fallback;
+    fallback->failed += !success;
+    if (--fallback->pending > 0) {
+        return;
+    }
+
+    uint64_t elapsed = metrics_now_ns() - fallback->recovery_start;
+    metrics_record(METRIC_FALLBACK_RECOVERY, elapsed, fallback->failed == 0);
+    if (fallback->failed > 0) {
+        EASYPULSE_WARN("Fallback recovery: %u operation(s) failed.", fallback->failed);
+    }
+    EASYPULSE_DEBUG("Fallback recovery took %.3f ms.", (double) elapsed / 1e6);
+}
+
+static void manager_fallback_send(pulseaudio_manager *manager, pa_operation *op) {
+    if (op) {
+        manager->fallback->pending++;
+        pa_operation_unref(op);
+    } else {
+        manager->fallback->failed++;
+    }
+}
+
+/**
+ * @brief Makes the first available device of the chain the default one and moves the
+ * streams of the lost device to it.
+ *
+ * Runs in the mainloop thread, so nothing is waited for: the new default and all the
+ * moves are sent back to back and the server handles them in one round trip. The
+ * streams are those the device table puts on the lost device, which the server has
+ * already moved to its own choice, or is about to.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param c The PulseAudio context.
+ * @param output Whether the lost device is a sink.
+ * @param lost Index of the lost device.
+ */
+static void manager_fallback_recover(pulseaudio_manager *manager, pa_context *c, bool output, uint32_t lost) {
+    manager_fallback *fallback = manager->fallback;
+    manager_fallback_chain *chain = &fallback->chains[output];
+    manager_device_table *table = manager->table;
+    const manager_table_device *target = NULL;
+    const char *code = NULL;
+
+    for (uint32_t rank = 0; rank < chain->length && !target; ++rank) {
+        for (uint32_t i = 0; i < table->device_count; ++i) {
+            const manager_table_device *device = &table->devices[i];
+            if (device->output == output && device->id == chain->ids[rank] && device->index != lost) {
+                target = device;
+                code = chain->codes[rank];
+                break;
+            }
+        }
+    }
+    if (!target) {
+        EASYPULSE_WARN("The default %s was lost and no device of its fallback chain is available.",
+                       output ? "output" : "input");
+        return;
+    }
+
+    if (fallback->pending == 0) {
+        fallback->recovery_start = metrics_now_ns();
+        fallback->failed = 0;
+    }
+
+    manager_fallback_send(manager, output ? pa_context_set_default_sink(c, code, manager_fallback_done_cb, manager)
+                                          : pa_context_set_default_source(c, code, manager_fallback_done_cb, manager));
+    uint32_t target_index = target->index;
+    chain->default_id = target->id;
+    for (uint32_t i = 0; i < table->stream_count; ++i) {
+        manager_table_stream *stream = &table->streams[i];
+        if (stream->output == output && stream->device == lost) {
+            manager_fallback_send(manager, output
+                ? pa_context_move_sink_input_by_index(c, stream->index, target_index, manager_fallback_done_cb, manager)
+                : pa_context_move_source_output_by_index(c, stream->index, target_index, manager_fallback_done_cb,
+                                                         manager));
+            manager_table_move_stream(manager, c, stream, target_index);
+        }
+    }
+
+    if (fallback->pending == 0) {
+        EASYPULSE_ERROR("Failed to switch to the fallback %s %s.", output ? "output" : "input", code);
+    }
+}
+
+/**
+ * @brief Recovers from the removal of a device of the table if it was a default one.
+ */
+static void manager_fallback_lost(pulseaudio_manager *manager, pa_context *c, manager_table_device *device) {
+    manager_fallback_chain *chain = &manager->fallback->chains[device->output];
+    if (chain->length > 0 && device->id == chain->default_id) {
+        manager_fallback_recover(manager, c, device->output, device->index);
+    }
+}
+
+static void manager_fallback_server_cb(pa_context *c, const pa_server_info *i, void *userdata) {
+    (void) c;
+
+    pulseaudio_manager *manager = (pulseaudio_manager *) userdata;
+    if (i && manager->fallback->running) {
+        manager->fallback->chains[1].default_id = i->default_sink_name ? manager_device_stable_id(i->default_sink_name) : 0;
+        manager->fallback->chains[0].default_id = i->default_source_name ?
+            manager_device_stable_id(i->default_source_name) : 0;
+    }
+}
+
+/**
+ * @brief Follows the default devices from the server events, the device table follows
+ * the rest. Runs in the mainloop thread.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param c The PulseAudio context.
+ * @param facility Facility of the event.
+ */
+static void manager_fallback_event(pulseaudio_manager *manager, pa_context *c, pa_subscription_event_type_t facility) {
+    if (facility != PA_SUBSCRIPTION_EVENT_SERVER) {
+        return;
+    }
+
+    pa_operation *op = pa_context_get_server_info(c, manager_fallback_server_cb, manager);
+    if (op) {
+        pa_operation_unref(op);
+    }
+}
+
+/**
+ * @brief Stops the fallback chains and releases the device table if the idle policy
+ * does not use it. Mainloop locked.
+ */
+static void manager_fallback_reset(pulseaudio_manager *manager) {
+    manager_fallback *fallback = manager->fallback;
+    fallback->chains[0].default_id = fallback->chains[1].default_id = 0;
+    fallback->running = false;
+    manager_table_release(manager);
+}
+
+static void manager_fallback_free_chain(manager_fallback_chain *chain) {
+    for (uint32_t i = 0; i < chain->length; ++i) {
+        free(chain->codes[i]);
+    }
+    free(chain->codes);
+    free(chain->ids);
+    memset(chain, 0, sizeof(manager_fallback_chain));
+}
+
+static void manager_fallback_free(manager_fallback *fallback) {
+    if (!fallback) {
+        return;
+    }
+    manager_fallback_free_chain(&fallback->chains[0]);
+    manager_fallback_free_chain(&fallback->chains[1]);
+    free(fallback);
+}
+
+static void manager_fallback_list_server_cb(pa_context *c, const pa_server_info *i, void *userdata) {
+    _shared_data_8 *shared_data = (_shared_data_8 *) userdata;
+    manager_fallback_server_cb(c, i, shared_data->manager);
+    op_batch_complete(shared_data->batch, i != NULL);
+}
+
+/**
+ * @brief Sets the devices made default, by priority, when the default device of a
+ * direction disappears.
+ *
+ * The devices, the streams and the default devices are read once, in a single round
+ * trip, and kept up to date from the events, in the device table the idle policy
+ * shares. When the default device is removed (a USB interface unplugged), the mainloop
+ * thread makes the first device of the chain that is still present the default one and
+ * moves the streams the lost device had to it, all in one pipelined burst, without
+ * waiting for a manager call. The time from the removal
+ * event to the last reply is recorded in the metrics (METRIC_FALLBACK_RECOVERY).
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param output Whether the chain is that of the outputs.
+ * @param codes Codes (PulseAudio names) of the devices, by priority. They need not be
+ *        present when the chain is set.
+ * @param count Number of codes, 0 to remove the chain.
+ * @return true on success, false otherwise.
+ */
+static bool manager_set_fallbacks_impl(pulseaudio_manager *manager, bool output, const char *const *codes,
+                                       uint32_t count) {
+    if (!manager || !manager->context || (count > 0 && !codes)) {
+        EASYPULSE_ERROR("Invalid PulseAudio manager or fallback chain.");
+        return false;
+    }
+
+    manager_fallback_chain chain = {0};
+    if (count > 0) {
+        chain.codes = calloc(count, sizeof(char *));
+        chain.ids = calloc(count, sizeof(uint64_t));
+        bool ok = chain.codes && chain.ids;
+        for (uint32_t i = 0; ok && i < count; ++i, ++chain.length) {
+            ok = codes[i] && (chain.codes[i] = strdup(codes[i]));
+            chain.ids[i] = ok ? manager_device_stable_id(codes[i]) : 0;
+        }
+        if (!ok) {
+            EASYPULSE_ERROR("Invalid device code or out of memory in the fallback chain.");
+            manager_fallback_free_chain(&chain);
+            return false;
+        }
+    }
+
+    // Subscribed first, so that no change can fall between the listing and the events
+    if (count > 0 && !manager_enable_events(manager, PA_SUBSCRIPTION_MASK_SINK | PA_SUBSCRIPTION_MASK_SOURCE |
+                                                     PA_SUBSCRIPTION_MASK_SINK_INPUT |
+                                                     PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT |
+                                                     PA_SUBSCRIPTION_MASK_SERVER)) {
+        manager_fallback_free_chain(&chain);
+        return false;
+    }
+
+    manager_lock(manager);
+
+    if (!manager->fallback) {
+        manager->fallback = calloc(1, sizeof(manager_fallback));
+        if (!manager->fallback) {
+            manager_unlock(manager);
+            EASYPULSE_ERROR("Failed to allocate memory for the fallback chains.");
+            manager_fallback_free_chain(&chain);
+            return false;
+        }
+    }
+
+    manager_fallback *fallback = manager->fallback;
+    manager_fallback_free_chain(&fallback->chains[output]);
+    fallback->chains[output] = chain;
+
+    // The default devices are only followed while a chain is set
+    if (fallback->chains[0].length == 0 && fallback->chains[1].length == 0) {
+        manager_fallback_reset(manager);
+        manager_unlock(manager);
+        return true;
+    }
+    if (fallback->running) {
+        manager_unlock(manager);
+        return true;
+    }
+
+    // The default devices are read with the device table, in the same round trip
+    fallback->running = true;
+
+    op_batch batch;
+    _shared_data_8 shared_data = {&batch, manager};
+    op_batch_init(&batch, manager->mainloop, METRIC_OP_BATCH);
+    if (!manager_table_list(manager, &batch, &shared_data)) {
+        manager_fallback_reset(manager);
+        manager_unlock(manager);
+        return false;
+    }
+    op_batch_add(&batch, pa_context_get_server_info(manager->context, manager_fallback_list_server_cb, &shared_data));
+    op_batch_wait(&batch);
+
+    if (batch.failed > 0) {
+        manager_fallback_reset(manager);
+        manager_unlock(manager);
+        EASYPULSE_ERROR("Failed to read the devices and streams for the fallback chains.");
+        return false;
+    }
+
+    manager_unlock(manager);
+    return true;
+}
+
+bool manager_set_output_fallbacks(pulseaudio_manager *manager, const char *const *codes, uint32_t count) {
+    metrics_call call = metrics_api_begin();
+    bool result = manager_set_fallbacks_impl(manager, true, codes, count);
+    metrics_api_end(METRIC_API_SET_FALLBACKS, call, result);
+    return result;
+}
+
+bool manager_set_input_fallbacks(pulseaudio_manager *manager, const char *const *codes, uint32_t count) {
+    metrics_call call = metrics_api_begin();
+    bool result = manager_set_fallbacks_impl(manager, false, codes, count);
+    metrics_api_end(METRIC_API_SET_FALLBACKS, call, result);
+    return result;
+}
+
+static bool manager_replay_events_impl(pulseaudio_manager *manager, const char *path, event_replay_stats *stats) {
+    if (!manager || !manager->mainloop) {
+        EASYPULSE_ERROR("Invalid PulseAudio manager.");
+        return false;
+    }
+
+    event_reader *reader = event_reader_open(path);
+    if (!reader) {
+        return false;
+    }
+
+    event_replay_stats result = {0};
+    event_log_record record;
+
+    // The handlers expect to run in the mainloop thread, so live events wait meanwhile
+    manager_lock(manager);
+    uint64_t start = metrics_now_ns();
+
+    while (event_reader_next(reader, &record)) {
+        switch (record.kind) {
+            case EVENT_LOG_EVENT:
+                manager_dispatch_event(manager, NULL, record.event, record.index);
+                ++result.events;
+                break;
+            case EVENT_LOG_SINK_INPUT:
+                if (manager_route_sink_input(manager, NULL, record.index, record.proplist)) {
+                    ++result.routed;
+                }
+                ++result.sink_inputs;
+                break;
+        }
+        result.recorded_usec = record.time_usec;
+    }
+
+    result.elapsed_ns = metrics_now_ns() - start;
+    manager_unlock(manager);
+
+    bool complete = !event_reader_truncated(reader);
+    if (!complete) {
+        EASYPULSE_WARN("%s ends with a damaged record, the records before it were replayed.", path);
+    }
+    event_reader_close(reader);
+
+    if (stats) {
+        *stats = result;
+    }
+    return complete;
+}
+
+/**
+ * @brief Feeds an event log back through the event handling of the manager.
+ *
+ * The records are replayed at full speed, in the calling thread and with the mainloop
+ * locked: events are dispatched as if they came from the server and the information of
+ * new sink inputs is matched against the routing rules, then the event callback is
+ * called. Nothing is sent to the server, the streams a rule matches are only counted.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param path Path of a log written by manager_start_recording().
+ * @param stats Where to store the counts and the duration of the replay (may be NULL).
+ * @return true if the whole log was replayed, false if it cannot be read or ends with
+ *         a damaged record (the records before it are still replayed).
+ */
+bool manager_replay_events(pulseaudio_manager *manager, const char *path, event_replay_stats *stats) {
+    metrics_call call = metrics_api_begin();
+    bool result = manager_replay_events_impl(manager, path, stats);
+    metrics_api_end(METRIC_API_REPLAY_EVENTS, call, result);
+    return result;
+}
+
+/**
+ * Callback after moving an existing stream to the target of its routing rule.
+ *
+ * @param c PulseAudio context.
+ * @param success Indicates if the operation was successful.
+ * @param userdata User data passed to the callback, expected to be _shared_data_3.
+ */
+static void manager_apply_routing_rules_cb2(pa_context *c, int success, void *userdata) {
+    (void) c;
+
+    _shared_data_3 *pass = (_shared_data_3 *) userdata;
+    if (success) {
+        pass->moved++;
+    }
+    pass->pending--;
+    pa_threaded_mainloop_signal(pass->manager->mainloop, 0);
+}
+
+/**
+ * @brief Callback for each existing sink input while applying the routing rules.
+ *
+ * Matching streams are moved without waiting for each move to complete, so all the moves
+ * are in flight at the same time.
+ *
+ * @param c The PulseAudio context.
+ * @param i The sink input information.
+ * @param eol End of list flag.
+ * @param userdata User-provided data, expected to be a pointer to _shared_data_3.
+ */
+static void manager_apply_routing_rules_cb(pa_context *c, const pa_sink_input_info *i, int eol, void *userdata) {
+    _shared_data_3 *pass = (_shared_data_3 *) userdata;
+
+    if (eol || !i) {
+        pa_threaded_mainloop_signal(pass->manager->mainloop, 0);
+        return;
+    }
+
+    const char *target_code = stream_router_match(pass->manager->router, i->proplist);
+    if (!target_code) {
+        return;
+    }
+
+    pa_operation *op = pa_context_move_sink_input_by_name(c, i->index, target_code,
+        manager_apply_routing_rules_cb2, pass);
+    if (op) {
+        pass->pending++;
+        pa_operation_unref(op);
+    }
+}
+
+/**
+ * @brief Applies the routing rules to the playback streams that already exist.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @return The number of streams moved, or -1 on failure.
+ */
+static int manager_apply_routing_rules_impl(pulseaudio_manager *manager) {
+    if (!manager || !manager->context) {
+        EASYPULSE_ERROR("Invalid manager or context.");
+        return -1;
+    }
+
+    if (stream_router_rule_count(manager->router) == 0) {
+        return 0;
+    }
+
+    _shared_data_3 pass = { manager, 0, 0 };
+
+    manager_lock(manager);
+
+    pa_operation *op = pa_context_get_sink_input_info_list(manager->context, manager_apply_routing_rules_cb, &pass);
+    if (!op) {
+        EASYPULSE_ERROR("Failed to start sink input info list operation.");
+        manager_unlock(manager);
+        return -1;
+    }
+    wait_operation_locked(manager, op, METRIC_OP_GET_SINK_INPUT_INFO);
+
+    // Wait for the moves issued while the list was being received
+    if (pass.pending > 0) {
+        uint64_t start = metrics_op_begin();
+        while (pass.pending > 0) {
+            manager_wait(manager);
+        }
+        metrics_op_end(METRIC_OP_MOVE_SINK_INPUT, start, true);
+        metrics_round_trip();
+    }
+
+    manager_unlock(manager);
+
+    return pass.moved;
+}
+
+int manager_apply_routing_rules(pulseaudio_manager *manager) {
+    metrics_call call = metrics_api_begin();
+    int result = manager_apply_routing_rules_impl(manager);
+    metrics_api_end(METRIC_API_APPLY_ROUTING_RULES, call, result >= 0);
+    return result;
+}
+
+/**
+ * @brief Callback for the completion of a module load in a batch.
+ *
+ * @param c The PulseAudio context.
+ * @param idx Index of the new module, or PA_INVALID_INDEX on failure.
+ * @param userdata User-provided data, expected to be a pointer to _shared_data_5.
+ */
+static void manager_load_modules_cb(pa_context *c, uint32_t idx, void *userdata) {
+    (void) c;
+
+    _shared_data_5 *data = (_shared_data_5 *) userdata;
+    data->request->index = idx;
+    op_batch_complete(data->batch, idx != PA_INVALID_INDEX);
+}
+
+/**
+ * @brief Loads several server modules in one batch.
+ *
+ * All the load requests are sent before waiting for any answer, so provisioning a
+ * large number of virtual devices (null sinks, remap sinks, loopbacks...) costs a
+ * single round trip. The index of each loaded module is stored in its request.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param requests Modules to load. On return, index holds the module index, or
+ *                 PA_INVALID_INDEX if the module could not be loaded.
+ * @param count Number of requests.
+ * @return The number of modules loaded, or -1 on invalid arguments.
+ */
+static int manager_load_modules_impl(pulseaudio_manager *manager, module_request *requests, uint32_t count) {
+    if (!manager || !manager->context || (count > 0 && !requests)) {
+        EASYPULSE_ERROR("Invalid manager or arguments.");
+        return -1;
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    _shared_data_5 *slots = calloc(count, sizeof(_shared_data_5));
+    if (!slots) {
+        EASYPULSE_ERROR("Failed to allocate memory for module requests.");
+        return -1;
+    }
+
+    op_batch batch;
+    op_batch_init(&batch, manager->mainloop, METRIC_OP_LOAD_MODULE);
+
+    manager_lock(manager);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        slots[i].batch = &batch;
+        slots[i].request = &requests[i];
+        requests[i].index = PA_INVALID_INDEX;
+
+        if (!requests[i].name) {
+            batch.failed++;
+            continue;
+        }
+
+        op_batch_add(&batch, pa_context_load_module(manager->context, requests[i].name,
+            requests[i].arguments, manager_load_modules_cb, &slots[i]));
+    }
+    op_batch_wait(&batch);
+
+    manager_unlock(manager);
+
+    if (batch.failed > 0) {
+        EASYPULSE_ERROR("Failed to load %u module(s).", batch.failed);
+    }
+
+    free(slots);
+    return (int) batch.succeeded;
+}
+
+int manager_load_modules(pulseaudio_manager *manager, module_request *requests, uint32_t count) {
+    metrics_call call = metrics_api_begin();
+    int result = manager_load_modules_impl(manager, requests, count);
+    metrics_api_end(METRIC_API_LOAD_MODULES, call, result >= 0 && (uint32_t) result == count);
+    return result;
+}
+
+/**
+ * @brief Loads a server module.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param name Name of the module (e.g. "module-null-sink").
+ * @param arguments Module arguments (e.g. "sink_name=virtual1"), or NULL.
+ * @return Index of the loaded module, or PA_INVALID_INDEX on failure.
+ */
+static uint32_t manager_load_module_impl(pulseaudio_manager *manager, const char *name, const char *arguments) {
+    module_request request = { name, arguments, PA_INVALID_INDEX };
+
+    manager_load_modules_impl(manager, &request, 1);
+    return request.index;
+}
+
+uint32_t manager_load_module(pulseaudio_manager *manager, const char *name, const char *arguments) {
+    metrics_call call = metrics_api_begin();
+    uint32_t result = manager_load_module_impl(manager, name, arguments);
+    metrics_api_end(METRIC_API_LOAD_MODULE, call, result != PA_INVALID_INDEX);
+    return result;
+}
+
+/**
+ * @brief Unloads several server modules in one batch.
+ *
+ * The devices and streams created by a module are removed by the server together
+ * with it; their owner_module field tells which module they belong to.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param module_indices Indexes of the modules to unload.
+ * @param count Number of modules.
+ * @return The number of modules unloaded, or -1 on invalid arguments.
+ */
+static int manager_unload_modules_impl(pulseaudio_manager *manager, const uint32_t *module_indices, uint32_t count) {
+    if (!manager || !manager->context || (count > 0 && !module_indices)) {
+        EASYPULSE_ERROR("Invalid manager or arguments.");
+        return -1;
+    }
+
+    op_batch batch;
+    op_batch_init(&batch, manager->mainloop, METRIC_OP_UNLOAD_MODULE);
+
+    manager_lock(manager);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        op_batch_add(&batch, pa_context_unload_module(manager->context, module_indices[i],
+            op_batch_success_cb, &batch));
+    }
+    op_batch_wait(&batch);
+
+    manager_unlock(manager);
+
+    if (batch.failed > 0) {
+        EASYPULSE_ERROR("Failed to unload %u module(s).", batch.failed);
+    }
+
+    return (int) batch.succeeded;
+}
+
+int manager_unload_modules(pulseaudio_manager *manager, const uint32_t *module_indices, uint32_t count) {
+    metrics_call call = metrics_api_begin();
+    int result = manager_unload_modules_impl(manager, module_indices, count);
+    metrics_api_end(METRIC_API_UNLOAD_MODULES, call, result >= 0 && (uint32_t) result == count);
+    return result;
+}
+
+/**
+ * @brief Unloads a server module.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param module_index Index of the module.
+ * @return true if the module was unloaded, false otherwise.
+ */
+static bool manager_unload_module_impl(pulseaudio_manager *manager, uint32_t module_index) {
+    return manager_unload_modules_impl(manager, &module_index, 1) == 1;
+}
+
+bool manager_unload_module(pulseaudio_manager *manager, uint32_t module_index) {
+    metrics_call call = metrics_api_begin();
+    bool result = manager_unload_module_impl(manager, module_index);
+    metrics_api_end(METRIC_API_UNLOAD_MODULE, call, result);
+    return result;
+}
+
+/**
+ * @brief Callback for the module list requested by manager_list_modules.
+ *
+ * @param c The PulseAudio context.
+ * @param info The module information.
+ * @param eol End of list flag.
+ * @param userdata User-provided data, expected to be a pointer to _shared_data_7.
+ */
+static void manager_list_modules_cb(pa_context *c, const pa_module_info *info, int eol, void *userdata) {
+    (void) c;
+
+    _shared_data_7 *data = (_shared_data_7 *) userdata;
+
+    if (eol) {
+        pa_threaded_mainloop_signal(data->manager->mainloop, 0);
+        return;
+    }
+
+    if (!info || data->failed) {
+        return;
+    }
+
+    module_info *modules = realloc(data->list->modules, (data->list->count + 1) * sizeof(module_info));
+    if (!modules) {
+        EASYPULSE_ERROR("Failed to allocate memory for module list.");
+        data->failed = true;
+        return;
+    }
+    data->list->modules = modules;
+
+    module_info *module = &modules[data->list->count++];
+    module->index = info->index;
+    module->name = info->name ? strdup(info->name) : NULL;
+    module->argument = info->argument ? strdup(info->argument) : NULL;
+    module->n_used = info->n_used;
+}
+
+/**
+ * @brief Lists the modules loaded in the server.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @return The list of modules, or NULL on failure. It must be freed with module_list_cleanup().
+ */
+static module_list *manager_list_modules_impl(pulseaudio_manager *manager) {
+    if (!manager || !manager->context) {
+        EASYPULSE_ERROR("Invalid manager or context.");
+        return NULL;
+    }
+
+    module_list *list = calloc(1, sizeof(module_list));
+    if (!list) {
+        EASYPULSE_ERROR("Failed to allocate memory for module list.");
+        return NULL;
+    }
+
+    _shared_data_7 data = { manager, list, false };
+
+    manager_lock(manager);
+    pa_operation *op = pa_context_get_module_info_list(manager->context, manager_list_modules_cb, &data);
+    if (!op) {
+        data.failed = true;
+    }
+    wait_operation_locked(manager, op, METRIC_OP_GET_MODULE_INFO);
+    manager_unlock(manager);
+
+    if (data.failed) {
+        EASYPULSE_ERROR("Failed to list modules.");
+        module_list_cleanup(list);
+        return NULL;
+    }
+
+    return list;
+}
+
+module_list *manager_list_modules(pulseaudio_manager *manager) {
+    metrics_call call = metrics_api_begin();
+    module_list *result = manager_list_modules_impl(manager);
+    metrics_api_end(METRIC_API_LIST_MODULES, call, result != NULL);
+    return result;
+}
+
+/**
+ * @brief Frees a module list returned by manager_list_modules().
+ *
+ * @param list The list to free. If NULL, the function does nothing.
+ */
+void module_list_cleanup(module_list *list) {
+    if (!list) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < list->count; ++i) {
+        free(list->modules[i].name);
+        free(list->modules[i].argument);
+    }
+    free(list->modules);
+    free(list);
+}
+
+/**
+ * @brief Checks whether a set of outputs are driven by the same clock.
+ *
+ * Outputs on the same ALSA card share the card clock, so their streams never drift
+ * apart and need no rate adjustment.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param device_indices Indexes of the outputs in the manager outputs array.
+ * @param count Number of outputs.
+ * @return true if all the outputs belong to the same ALSA card.
+ */
+static bool outputs_share_clock(pulseaudio_manager *manager, const uint32_t *device_indices, uint32_t count) {
+    int first_card = -1;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        const char *alsa_id = manager->outputs[device_indices[i]].alsa_id;
+        int card, device;
+
+        if (!alsa_id || sscanf(alsa_id, "hw:%d,%d", &card, &device) != 2) {
+            return false;
+        }
+
+        if (i == 0) {
+            first_card = card;
+        } else if (card != first_card) {
+            return false;
+        }
+    }
+
+    return count > 0;
+}
+
+/**
+ * @brief Creates an output that plays to several outputs simultaneously.
+ *
+ * Loads a module-combine-sink instance over the given outputs and adds the resulting
+ * sink to the outputs of the manager, where it can be used like any other device
+ * (volume, mute, default, stream moves...).
+ *
+ * When all the outputs share a clock domain (they belong to the same ALSA card) and
+ * the configuration does not say otherwise, rate adjustment is disabled and the combined
+ * sink runs at the common sample rate of the outputs, so no resampler is needed.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param device_indices Indexes (in the outputs array) of the outputs to combine.
+ * @param count Number of outputs to combine.
+ * @param sink_name Code to give to the combined sink, or NULL to generate one.
+ * @param config Resampling and latency settings, or NULL for automatic settings.
+ * @return The index of the combined output in the outputs array, or -1 on failure.
+ */
+static int manager_create_combined_output_impl(pulseaudio_manager *manager, const uint32_t *device_indices,
+uint32_t count, const char *sink_name, const combined_output_config *config) {
+    if (!manager || !manager->context || !device_indices || count == 0) {
+        EASYPULSE_ERROR("Invalid arguments provided.");
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if (device_indices[i] >= manager->output_count || !manager->outputs[device_indices[i]].code) {
+            EASYPULSE_ERROR("Output device position out of range.");
+            return -1;
+        }
+    }
+
+    // Generate a sink name that is not in use
+    char generated_name[64];
+    if (!sink_name) {
+        for (uint32_t n = 1; !sink_name; ++n) {
+            snprintf(generated_name, sizeof(generated_name), "easypulse_combined_%u", n);
+            sink_name = generated_name;
+            for (uint32_t i = 0; i < manager->output_count; ++i) {
+                if (manager->outputs[i].code && strcmp(manager->outputs[i].code, generated_name) == 0) {
+                    sink_name = NULL;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Pick the resampling settings
+    bool shared_clock = outputs_share_clock(manager, device_indices, count);
+    int adjust_time = (config && config->adjust_time >= 0) ? config->adjust_time : (shared_clock ? 0 : -1);
+    int adjust_threshold = (config && config->adjust_threshold >= 0) ? config->adjust_threshold : -1;
+    const char *resample_method = config ? config->resample_method : NULL;
+
+    int common_rate = manager->outputs[device_indices[0]].sample_rate;
+    for (uint32_t i = 1; i < count; ++i) {
+        if (manager->outputs[device_indices[i]].sample_rate != common_rate) {
+            common_rate = 0;
+        }
+    }
+
+    // Build the module arguments
+    size_t args_size = 256 + strlen(sink_name) + (resample_method ? strlen(resample_method) : 0);
+    for (uint32_t i = 0; i < count; ++i) {
+        args_size += strlen(manager->outputs[device_indices[i]].code) + 1;
+    }
+
+    char *args = malloc(args_size);
+    if (!args) {
+        EASYPULSE_ERROR("Failed to allocate memory for module arguments.");
+        return -1;
+    }
+
+    size_t len = (size_t) snprintf(args, args_size, "sink_name=%s slaves=", sink_name);
+    for (uint32_t i = 0; i < count; ++i) {
+        len += (size_t) snprintf(args + len, args_size - len, "%s%s", i ? "," : "",
+                                 manager->outputs[device_indices[i]].code);
+    }
+    if (adjust_time >= 0) {
+        len += (size_t) snprintf(args + len, args_size - len, " adjust_time=%d", adjust_time);
+    }
+    if (adjust_threshold >= 0) {
+        len += (size_t) snprintf(args + len, args_size - len, " adjust_threshold=%d", adjust_threshold);
+    }
+    if (resample_method) {
+        len += (size_t) snprintf(args + len, args_size - len, " resample_method=%s", resample_method);
+    }
+    if (shared_clock && common_rate > 0) {
+        len += (size_t) snprintf(args + len, args_size - len, " rate=%d", common_rate);
+    }
+
+    uint32_t module_index = manager_load_module_impl(manager, "module-combine-sink", args);
+    free(args);
+
+    if (module_index == PA_INVALID_INDEX) {
+        EASYPULSE_ERROR("Failed to load module-combine-sink.");
+        return -1;
+    }
+
+    // Add the combined sink to the outputs
+    pa_sink_info *info = get_output_device_by_name(sink_name);
+    pulseaudio_device *outputs = info ? realloc(manager->outputs, (manager->output_count + 1) * sizeof(pulseaudio_device)) : NULL;
+    combined_output *combined = outputs ? realloc(manager->combined, (manager->combined_count + 1) * sizeof(combined_output)) : NULL;
+
+    if (outputs) {
+        manager->outputs = outputs;
+    }
+    if (combined) {
+        manager->combined = combined;
+    }
+
+    if (!info || !outputs || !combined) {
+        EASYPULSE_ERROR("Failed to add the combined output to the device table.");
+        if (info) {
+            free((char *)info->description);
+            free(info);
+        }
+        manager_unload_module_impl(manager, module_index);
+        return -1;
+    }
+
+    pulseaudio_device *device = &manager->outputs[manager->output_count];
+    memset(device, 0, sizeof(pulseaudio_device));
+    info->name = sink_name; // The name is not kept by get_output_device_by_name()
+    manager_fill_output_device(device, info);
+
+    free((char *)info->description);
+    free(info);
+
+    combined_output *record = &manager->combined[manager->combined_count];
+    memset(record, 0, sizeof(combined_output));
+    record->module_index = module_index;
+    record->code = strdup(sink_name);
+    record->slaves = calloc(count, sizeof(char *));
+    if (record->slaves) {
+        for (uint32_t i = 0; i < count; ++i) {
+            record->slaves[i] = strdup(manager->outputs[device_indices[i]].code);
+        }
+        record->slave_count = count;
+    }
+    record->resample_method = resample_method ? strdup(resample_method) : NULL;
+    record->adjust_time = adjust_time;
+    record->adjust_threshold = adjust_threshold;
+    record->shared_clock = shared_clock;
+
+    manager->combined_count++;
+    return (int) manager->output_count++;
+}
+
+int manager_create_combined_output(pulseaudio_manager *manager, const uint32_t *device_indices,
+uint32_t count, const char *sink_name, const combined_output_config *config) {
+    metrics_call call = metrics_api_begin();
+    int result = manager_create_combined_output_impl(manager, device_indices, count, sink_name, config);
+    metrics_api_end(METRIC_API_CREATE_COMBINED_OUTPUT, call, result >= 0);
+    return result;
+}
+
+/**
+ * @brief Finds the combined output record of an output device.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param device_index Index of the output in the outputs array.
+ * @return The position of the record in the combined array, or -1 if the output
+ *         is not a combined output.
+ */
+static int find_combined_output(const pulseaudio_manager *manager, uint32_t device_index) {
+    if (device_index >= manager->output_count || !manager->outputs[device_index].code) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < manager->combined_count; ++i) {
+        if (strcmp(manager->combined[i].code, manager->outputs[device_index].code) == 0) {
+            return (int) i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Gets the configuration of a combined output.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param device_index Index of the output in the outputs array.
+ * @return The combined output record, or NULL if the output is not a combined output.
+ *         The record is owned by the manager.
+ */
+const combined_output *manager_get_combined_output(const pulseaudio_manager *manager, uint32_t device_index) {
+    if (!manager) {
+        return NULL;
+    }
+
+    int position = find_combined_output(manager, device_index);
+    return position < 0 ? NULL : &manager->combined[position];
+}
+
+/**
+ * @brief Removes a combined output created with manager_create_combined_output().
+ *
+ * Unloads the module-combine-sink instance and removes the output from the outputs
+ * array. The outputs after it move down by one position.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param device_index Index of the combined output in the outputs array.
+ * @return true if the combined output was removed, false otherwise.
+ */
+static bool manager_destroy_combined_output_impl(pulseaudio_manager *manager, uint32_t device_index) {
+    if (!manager || !manager->context) {
+        EASYPULSE_ERROR("Invalid manager or context.");
+        return false;
+    }
+
+    int position = find_combined_output(manager, device_index);
+    if (position < 0) {
+        EASYPULSE_ERROR("Output device %u is not a combined output.", device_index);
+        return false;
+    }
+
+    if (!manager_unload_module_impl(manager, manager->combined[position].module_index)) {
+        EASYPULSE_ERROR("Failed to unload module-combine-sink.");
+        return false;
+    }
+
+    manager_free_device(&manager->outputs[device_index]);
+    memmove(&manager->outputs[device_index], &manager->outputs[device_index + 1],
+            (manager->output_count - device_index - 1) * sizeof(pulseaudio_device));
+    manager->output_count--;
+
+    free_combined_output(&manager->combined[position]);
+    memmove(&manager->combined[position], &manager->combined[position + 1],
+            (manager->combined_count - position - 1) * sizeof(combined_output));
+    manager->combined_count--;
+
+    return true;
+}
+
+bool manager_destroy_combined_output(pulseaudio_manager *manager, uint32_t device_index) {
+    metrics_call call = metrics_api_begin();
+    bool result = manager_destroy_combined_output_impl(manager, device_index);
+    metrics_api_end(METRIC_API_DESTROY_COMBINED_OUTPUT, call, result);
+    return result;
+}
+
+/**
+ * @brief Callback for the sink information requested by manager_get_output_latency.
+ *
+ * @param c The PulseAudio context.
+ * @param info The sink information.
+ * @param eol End of list flag.
+ * @param userdata User-provided data, expected to be a pointer to _shared_data_6.
+ */
+static void manager_get_output_latency_cb(pa_context *c, const pa_sink_info *info, int eol, void *userdata) {
+    (void) c;
+
+    _shared_data_6 *data = (_shared_data_6 *) userdata;
+
+    if (eol) {
+        pa_threaded_mainloop_signal(data->manager->mainloop, 0);
+        return;
+    }
+
+    if (info) {
+        data->found = true;
+        data->latency = info->latency;
+        data->configured_latency = info->configured_latency;
+    }
+}
+
+/**
+ * @brief Gets the latency of an output device.
+ *
+ * For a combined output, this is the latency of the combined sink, which includes the
+ * buffering added to keep the combined devices in sync.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param device_index Index of the output in the outputs array.
+ * @param latency Where to store the current latency (in usec). May be NULL.
+ * @param configured_latency Where to store the configured latency (in usec). May be NULL.
+ * @return 0 on success, -1 on failure.
+ */
+static int manager_get_output_latency_impl(pulseaudio_manager *manager, uint32_t device_index,
+pa_usec_t *latency, pa_usec_t *configured_latency) {
+    if (!manager || !manager->context || device_index >= manager->output_count) {
+        EASYPULSE_ERROR("Invalid arguments provided.");
+        return -1;
+    }
+
+    _shared_data_6 data = { manager, false, 0, 0 };
+
+    manager_lock(manager);
+    pa_operation *op = pa_context_get_sink_info_by_index(manager->context, manager->outputs[device_index].index,
+        manager_get_output_latency_cb, &data);
+    wait_operation_locked(manager, op, METRIC_OP_GET_SINK_INFO);
+    manager_unlock(manager);
+
+    if (!data.found) {
+        EASYPULSE_ERROR("Could not retrieve sink info for output %u.", device_index);
+        return -1;
+    }
+
+    if (latency) {
+        *latency = data.latency;
+    }
+    if (configured_latency) {
+        *configured_latency = data.configured_latency;
+    }
+
+    return 0;
+}
+
+int manager_get_output_latency(pulseaudio_manager *manager, uint32_t device_index,
+pa_usec_t *latency, pa_usec_t *configured_latency) {
+    metrics_call call = metrics_api_begin();
+    int result = manager_get_output_latency_impl(manager, device_index, latency, configured_latency);
+    metrics_api_end(METRIC_API_GET_OUTPUT_LATENCY, call, result == 0);
+    return result;
+}
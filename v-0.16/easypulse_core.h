@@ -13,14 +13,28 @@
 
 #include <pulse/pulseaudio.h>
 #include "system_query.h"
+#include "stream_router.h"
+#include "event_log.h"
+#include "shm_state.h"
+#include "device_prefs.h"
+#include <inttypes.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // Forward declarations
 typedef struct pulseaudio_manager pulseaudio_manager;
 typedef struct pulseaudio_device pulseaudio_device;
 typedef struct pulseaudio_volume pulseaudio_volume;
+typedef struct manager_meter manager_meter;
+typedef struct manager_publisher manager_publisher;
+typedef struct manager_device_table manager_device_table;
+typedef struct manager_idle manager_idle;
+typedef struct manager_fallback manager_fallback;
 
 
 typedef struct {
@@ -48,7 +62,7 @@ struct pulseaudio_device {
     char *alsa_id;                               // Alsa ID of the device.
     int sample_rate;                             // Current sample rate of the device.
     pa_card_profile_info *active_profile;        // Active alsa profile of this device.
-    char **channel_names;                        // Public channel names.
+    const char *channel_names[PA_CHANNELS_MAX];  // Names of the first max_channels channels (static strings, NULL if unknown).
     int master_volume;                           // Average volume of all channels (in percentage).
     int *channel_volume;                         // Volume of each individual channel (in percentage).
     bool mute;                                   // Mute status of the devices (true for muted, false for unmuted).
@@ -56,8 +70,78 @@ struct pulseaudio_device {
     int max_channels;                            // The maximum number of channels of the device.
     pa_card_profile_info *profiles;              // Array of available profiles for the device
     uint32_t profile_count;                      // Number of available profiles
+    uint32_t owner_module;                       // Module that created the device (PA_INVALID_INDEX if none).
 };
 
+/**
+ * @brief A module to load with manager_load_modules().
+ */
+typedef struct module_request {
+    const char *name;             // Name of the module (e.g. "module-null-sink").
+    const char *arguments;        // Module arguments, or NULL.
+    uint32_t index;               // Set to the index of the loaded module (PA_INVALID_INDEX on failure).
+} module_request;
+
+/**
+ * @brief A module loaded in the server.
+ */
+typedef struct module_info {
+    uint32_t index;               // Index of the module.
+    char *name;                   // Name of the module.
+    char *argument;               // Arguments the module was loaded with (may be NULL).
+    uint32_t n_used;              // Usage counter (PA_INVALID_INDEX if unknown).
+} module_info;
+
+typedef struct module_list {
+    module_info *modules;         // Array of modules.
+    uint32_t count;               // Number of modules.
+} module_list;
+
+/**
+ * @brief Resampling and latency settings of a combined output.
+ *
+ * Negative numbers and NULL strings select the automatic setting: rate adjustment is
+ * disabled when all the combined devices share a clock domain (same ALSA card), and
+ * the server defaults are used otherwise.
+ */
+typedef struct combined_output_config {
+    const char *resample_method;  // Resampler used for the combined devices (e.g. "speex-float-1").
+    int adjust_time;              // Seconds between rate adjustments, 0 disables them.
+    int adjust_threshold;         // Drift (in ms) that triggers a rate adjustment.
+} combined_output_config;
+
+/**
+ * @brief An output device created by combining other outputs (module-combine-sink).
+ */
+typedef struct combined_output {
+    uint32_t module_index;        // Index of the module-combine-sink instance.
+    char *code;                   // Code (PulseAudio name) of the combined sink.
+    char **slaves;                // Codes of the devices the audio is played to.
+    uint32_t slave_count;         // Number of combined devices.
+    char *resample_method;        // Resampler in use (NULL for the server default).
+    int adjust_time;              // Seconds between rate adjustments (0 = disabled, -1 = server default).
+    int adjust_threshold;         // Drift (in ms) triggering an adjustment (-1 = server default).
+    bool shared_clock;            // All combined devices share the same clock domain.
+} combined_output;
+
+#define MANAGER_SLOW_CALLBACK_USEC 10000   // Default duration above which a user callback is reported as slow.
+#define MANAGER_HEARTBEAT_USEC 100000      // Period of the timer measuring mainloop stalls.
+#define MANAGER_STABLE_ID_FORMAT "@%016" PRIx64   // Written form of manager_device_stable_id().
+
+/**
+ * @brief Callback for server events, set with manager_set_event_callback().
+ *
+ * Runs in the mainloop thread, so it must return quickly and must not call the
+ * manager_* functions, which wait for that very thread.
+ *
+ * @param manager The manager that received the event.
+ * @param event Facility and type of the event (PA_SUBSCRIPTION_EVENT_*).
+ * @param index Index of the object the event refers to.
+ * @param userdata The pointer given to manager_set_event_callback().
+ */
+typedef void (*manager_event_cb)(pulseaudio_manager *manager, pa_subscription_event_type_t event,
+                                 uint32_t index, void *userdata);
+
 /**
  * @brief Represents the main manager for PulseAudio operations.
  */
@@ -71,25 +155,55 @@ struct pulseaudio_manager {
     char *active_input_device;                 // Pointer to active input device.
     uint32_t output_count;                     // Number of pulseaudio sinks (outputs).
     uint32_t input_count;                      // Number of pulseaudio sources (inputs).
+    pa_subscription_mask_t event_mask;         // Server events the manager is subscribed to.
+    stream_router *router;                     // Routing rules applied to new streams (NULL if none).
+    combined_output *combined;                 // Combined outputs created by the manager.
+    uint32_t combined_count;                   // Number of combined outputs.
+    manager_event_cb event_callback;           // User callback for server events (NULL if none).
+    void *event_userdata;                      // Pointer passed to event_callback.
+    pa_usec_t slow_callback_usec;              // User callbacks running longer are reported (0 = never).
+    pa_time_event *heartbeat;                  // Timer measuring mainloop stalls (NULL when metrics were off).
+    pa_usec_t heartbeat_due;                   // Time the heartbeat is expected to fire.
+    event_recorder *recorder;                  // Log the server events are recorded to (NULL if none).
+    manager_meter **meters;                    // Peak meters opened by peak_meter.c.
+    uint32_t meter_count;                      // Number of peak meters.
+    manager_publisher *publisher;              // Publisher of the device state in shared memory (NULL if none).
+    manager_device_table *table;               // Devices and streams for idle and fallbacks (NULL if unused).
+    manager_idle *idle;                        // Idle suspend policy (NULL if never started).
+    device_prefs *prefs;                       // Settings given back to the devices that appear (NULL if none).
+    manager_fallback *fallback;                // Fallback chains (NULL if never set).
 };
 
+/**
+ * @brief Outcome of manager_replay_events().
+ */
+typedef struct event_replay_stats {
+    uint64_t events;              // Subscription events dispatched.
+    uint64_t sink_inputs;         // Sink input informations matched against the routing rules.
+    uint64_t routed;              // Streams a routing rule would have moved.
+    uint64_t recorded_usec;       // Time between the start of the recording and its last record.
+    uint64_t elapsed_ns;          // Time the replay took.
+} event_replay_stats;
+
 pulseaudio_manager *manager_create(void);
 void manager_cleanup(pulseaudio_manager *manager);                 //Cleans up the manager.
+bool manager_refresh_devices(pulseaudio_manager *manager);         //Enumerates the devices again.
+uint64_t manager_device_stable_id(const char *code);              //Stable id of a device, a hash of its code.
 
 int manager_set_master_volume(pulseaudio_manager *manager,
 uint32_t device_id, int volume);                                   //Sets the master volume of a given volume.
 
 int manager_toggle_output_mute(pulseaudio_manager *manager,
-uint32_t index, int state);                                        //Toggles the volume of output device to muted / unmuted.
+uint32_t position, int state);                                     //Toggles the output device at position in outputs to muted / unmuted.
 
 int manager_toggle_input_mute(pulseaudio_manager *manager,
-uint32_t index, int state);                                        //Toggles the volume of input device to muted / unmuted.
+uint32_t position, int state);                                     //Toggles the input device at position in inputs to muted / unmuted.
 
 bool manager_switch_default_output(pulseaudio_manager *self,
-uint32_t device_index);                                            //Changes the default output device.
+uint32_t device_index);                                            //Changes the default output device (position in outputs).
 
 bool manager_switch_default_input(pulseaudio_manager *self,
-uint32_t device_index);                                            //Changes the default input device.
+uint32_t device_index);                                            //Changes the default input device (position in inputs) and moves recording streams to it.
 
 int manager_set_output_sample_rate(pulseaudio_manager *manager,
 uint32_t device_index, int sample_rate);                           //Changes the output of an output device.
@@ -108,5 +222,101 @@ uint32_t sink1_index, uint32_t sink2_index);                      //Moves playba
 bool manager_move_sink_input(pulseaudio_manager *manager,
 uint32_t source_sink, uint32_t target_sink);                       //Moves sink input from a device to another
 
+bool manager_move_source_output(pulseaudio_manager *manager,
+uint32_t source_output_idx, uint32_t target_source_idx);          //Moves a recording stream to another input device.
+
+int manager_move_source_outputs(pulseaudio_manager *manager,
+const uint32_t *source_output_indices, uint32_t count,
+uint32_t target_source_idx);                                       //Moves several recording streams in one batch.
+
+int manager_create_combined_output(pulseaudio_manager *manager,
+const uint32_t *device_indices, uint32_t count, const char *sink_name,
+const combined_output_config *config);                             //Plays to several outputs at once. Returns the new output index.
+
+bool manager_destroy_combined_output(pulseaudio_manager *manager,
+uint32_t device_index);                                            //Removes a combined output.
+
+const combined_output *manager_get_combined_output(
+const pulseaudio_manager *manager, uint32_t device_index);        //Gets the configuration of a combined output.
+
+int manager_get_output_latency(pulseaudio_manager *manager,
+uint32_t device_index, pa_usec_t *latency,
+pa_usec_t *configured_latency);                                    //Gets the current and configured latency of an output.
+
+uint32_t manager_load_module(pulseaudio_manager *manager,
+const char *name, const char *arguments);                          //Loads a module. Returns its index or PA_INVALID_INDEX.
+
+int manager_load_modules(pulseaudio_manager *manager,
+module_request *requests, uint32_t count);                         //Loads several modules in one batch.
+
+bool manager_unload_module(pulseaudio_manager *manager,
+uint32_t module_index);                                            //Unloads a module.
+
+int manager_unload_modules(pulseaudio_manager *manager,
+const uint32_t *module_indices, uint32_t count);                   //Unloads several modules in one batch.
+
+module_list *manager_list_modules(pulseaudio_manager *manager);    //Lists the loaded modules.
+void module_list_cleanup(module_list *list);                       //Frees a module list.
+
+int manager_add_routing_rule(pulseaudio_manager *manager,
+const route_condition *conditions, uint32_t condition_count,
+const char *target_code);                                          //Adds a rule moving new matching streams to a device.
+
+bool manager_remove_routing_rule(pulseaudio_manager *manager,
+int rule_id);                                                      //Removes a routing rule.
+
+void manager_clear_routing_rules(pulseaudio_manager *manager);     //Removes all routing rules.
+
+int manager_apply_routing_rules(pulseaudio_manager *manager);      //Applies the routing rules to the streams already playing.
+
+bool manager_set_event_callback(pulseaudio_manager *manager,
+manager_event_cb callback, void *userdata);                        //Calls a function for every server event (NULL to stop).
+
+void manager_set_slow_callback_threshold(pulseaudio_manager *manager,
+pa_usec_t threshold);                                              //Sets the duration above which callbacks are reported as slow.
+
+bool manager_start_recording(pulseaudio_manager *manager,
+const char *path);                                                 //Records the server events into an event log.
+
+bool manager_stop_recording(pulseaudio_manager *manager);          //Stops recording and closes the event log.
+
+bool manager_start_publishing(pulseaudio_manager *manager,
+const char *name);                                                 //Publishes the device state in shared memory (see shm_state.h).
+
+void manager_stop_publishing(pulseaudio_manager *manager);         //Stops publishing and removes the segment.
+
+bool manager_suspend_output(pulseaudio_manager *manager,
+uint32_t device_index, bool suspend);                              //Suspends or resumes an output device (by index).
+
+bool manager_suspend_input(pulseaudio_manager *manager,
+uint32_t device_index, bool suspend);                              //Suspends or resumes an input device (by index).
+
+bool manager_start_idle_suspend(pulseaudio_manager *manager,
+pa_usec_t timeout);                                                //Suspends the devices left without streams for timeout.
+
+void manager_stop_idle_suspend(pulseaudio_manager *manager);       //Stops the idle policy and resumes the devices it suspended.
+
+bool manager_resume_and_hold_output(pulseaudio_manager *manager,
+uint32_t device_index, pa_usec_t hold);                            //Undoes a client suspend of an output and keeps the idle policy off it for hold.
+
+bool manager_resume_and_hold_input(pulseaudio_manager *manager,
+uint32_t device_index, pa_usec_t hold);                            //Undoes a client suspend of an input and keeps the idle policy off it for hold.
+
+bool manager_set_device_prefs(pulseaudio_manager *manager,
+device_prefs *prefs);                                              //Applies saved settings to the devices that appear (takes the store, NULL to stop).
+
+bool manager_set_output_fallbacks(pulseaudio_manager *manager,
+const char *const *codes, uint32_t count);                         //Outputs made default, by priority, when the default one disappears.
+
+bool manager_set_input_fallbacks(pulseaudio_manager *manager,
+const char *const *codes, uint32_t count);                         //Inputs made default, by priority, when the default one disappears.
+
+bool manager_replay_events(pulseaudio_manager *manager,
+const char *path, event_replay_stats *stats);                      //Feeds an event log through the event handling, without the server.
+
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif // CORE_H
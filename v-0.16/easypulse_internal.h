@@ -0,0 +1,29 @@
+/**
+ * @file easypulse_internal.h
+ * @brief Helpers of the manager shared by the modules of the library, not by programs.
+ *
+ * Every module that waits on the mainloop of a manager from another thread (batch
+ * scripts, scenes, playback and capture streams, peak meters) locks, unlocks and waits
+ * with these, so that the time spent waiting for and holding the lock is recorded in
+ * the metrics and the trace the same way as for the manager_* functions.
+ */
+
+#ifndef EASYPULSE_INTERNAL_H
+#define EASYPULSE_INTERNAL_H
+
+#include "easypulse_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void manager_lock(pulseaudio_manager *manager);                   //Locks the mainloop of the manager, with metrics and a trace span.
+void manager_unlock(pulseaudio_manager *manager);                 //Unlocks the mainloop locked with manager_lock().
+void manager_wait(pulseaudio_manager *manager);                   //Waits for a signal of the mainloop thread, with the mainloop locked.
+void manager_close_meters(pulseaudio_manager *manager);           //Closes the peak meters of the manager (peak_meter.c).
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
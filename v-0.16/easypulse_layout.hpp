@@ -0,0 +1,532 @@
+/**
+ * @file easypulse_layout.hpp
+ * @brief Channel layouts known at compile time (mono, stereo, 5.1, 7.1), with a dynamic fallback.
+ *
+ * A layout is a type listing its channel positions, so the number of channels, which
+ * channels are on the left, right, front or rear, and where a position sits are all
+ * constants. layout_volume<Layout> holds one pa_volume_t per channel in a std::array and
+ * implements the volume math of libpulse (average, scaling, balance and fade) with the
+ * loops over the channels unrolled and the position tests folded away. remix<In, Out>()
+ * converts interleaved float frames with a matrix computed at compile time, in which the
+ * zero coefficients are left out of the generated code.
+ *
+ * Channel maps that are none of the fixed layouts go through dynamic_volume, which uses
+ * the libpulse functions on a pa_cvolume, and remix_dynamic(), which builds the same
+ * matrix at run time. with_layout() picks the fixed layout matching a map, if any:
+ *
+ *     easypulse::with_layout(info->channel_map, [&](auto layout) {
+ *         using L = decltype(layout);
+ *         if constexpr (easypulse::is_fixed_layout_v<L>) { ... easypulse::layout_volume<L> ... }
+ *         else { ... easypulse::dynamic_volume(info->volume, info->channel_map) ... }
+ *     });
+ *
+ * Volumes in percent use the rounding of the C API (pulseaudio_device::volume).
+ */
+
+#ifndef EASYPULSE_LAYOUT_HPP
+#define EASYPULSE_LAYOUT_HPP
+
+#include <pulse/pulseaudio.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace easypulse {
+
+namespace detail {
+
+//Position tests, as in libpulse (channelmap.c).
+constexpr bool on_left(pa_channel_position_t p) noexcept {
+    return p == PA_CHANNEL_POSITION_FRONT_LEFT || p == PA_CHANNEL_POSITION_REAR_LEFT
+        || p == PA_CHANNEL_POSITION_FRONT_LEFT_OF_CENTER || p == PA_CHANNEL_POSITION_SIDE_LEFT
+        || p == PA_CHANNEL_POSITION_TOP_FRONT_LEFT || p == PA_CHANNEL_POSITION_TOP_REAR_LEFT;
+}
+constexpr bool on_right(pa_channel_position_t p) noexcept {
+    return p == PA_CHANNEL_POSITION_FRONT_RIGHT || p == PA_CHANNEL_POSITION_REAR_RIGHT
+        || p == PA_CHANNEL_POSITION_FRONT_RIGHT_OF_CENTER || p == PA_CHANNEL_POSITION_SIDE_RIGHT
+        || p == PA_CHANNEL_POSITION_TOP_FRONT_RIGHT || p == PA_CHANNEL_POSITION_TOP_REAR_RIGHT;
+}
+constexpr bool on_front(pa_channel_position_t p) noexcept {
+    return p == PA_CHANNEL_POSITION_FRONT_LEFT || p == PA_CHANNEL_POSITION_FRONT_RIGHT
+        || p == PA_CHANNEL_POSITION_FRONT_CENTER || p == PA_CHANNEL_POSITION_TOP_FRONT_LEFT
+        || p == PA_CHANNEL_POSITION_TOP_FRONT_RIGHT || p == PA_CHANNEL_POSITION_TOP_FRONT_CENTER
+        || p == PA_CHANNEL_POSITION_FRONT_LEFT_OF_CENTER || p == PA_CHANNEL_POSITION_FRONT_RIGHT_OF_CENTER;
+}
+constexpr bool on_rear(pa_channel_position_t p) noexcept {
+    return p == PA_CHANNEL_POSITION_REAR_LEFT || p == PA_CHANNEL_POSITION_REAR_RIGHT
+        || p == PA_CHANNEL_POSITION_REAR_CENTER || p == PA_CHANNEL_POSITION_TOP_REAR_LEFT
+        || p == PA_CHANNEL_POSITION_TOP_REAR_RIGHT || p == PA_CHANNEL_POSITION_TOP_REAR_CENTER;
+}
+constexpr bool on_center(pa_channel_position_t p) noexcept {
+    return p == PA_CHANNEL_POSITION_MONO || p == PA_CHANNEL_POSITION_FRONT_CENTER
+        || p == PA_CHANNEL_POSITION_REAR_CENTER || p == PA_CHANNEL_POSITION_TOP_CENTER
+        || p == PA_CHANNEL_POSITION_TOP_FRONT_CENTER || p == PA_CHANNEL_POSITION_TOP_REAR_CENTER;
+}
+
+//Calls f(std::integral_constant<std::size_t, I>) for I = 0 .. N - 1, without a loop.
+template <typename F, std::size_t... I>
+constexpr void unroll(F &&f, std::index_sequence<I...>) {
+    (f(std::integral_constant<std::size_t, I>()), ...);
+}
+template <std::size_t N, typename F>
+constexpr void unroll(F &&f) {
+    unroll(std::forward<F>(f), std::make_index_sequence<N>());
+}
+
+constexpr pa_volume_t clamp_volume(std::uint64_t v) noexcept {
+    return v > PA_VOLUME_MAX ? PA_VOLUME_MAX : static_cast<pa_volume_t>(v);
+}
+
+//Position of p in positions, or count if absent.
+constexpr std::size_t find(const pa_channel_position_t *positions, std::size_t count, pa_channel_position_t p) noexcept {
+    for (std::size_t i = 0; i < count; ++i)
+        if (positions[i] == p)
+            return i;
+    return count;
+}
+
+//Position of the first channel of positions for which test() holds, or count.
+template <typename Test>
+constexpr std::size_t find_if(const pa_channel_position_t *positions, std::size_t count, Test test) noexcept {
+    for (std::size_t i = 0; i < count; ++i)
+        if (test(positions[i]))
+            return i;
+    return count;
+}
+
+constexpr float minus_3db = 0.70710678f;
+
+//Remix matrix from in_count channels to out_count channels, matrix[out][in] (row major,
+//out_count rows of in_count coefficients). Rules, applied per input channel:
+// - the same position in the output takes it unchanged;
+// - a mono input goes to every output channel but the LFE, a mono output takes the
+//   average of the inputs but the LFE;
+// - a missing center goes to the front left and right at -3 dB, a missing LFE is
+//   dropped, a missing side or rear channel goes to the rear or side channel of the same
+//   side, or else to its front channel;
+// - output rear and side channels with no input of their own copy the front of their side.
+//Rows whose coefficients add up to more than 1 are normalized so the mix cannot clip.
+constexpr void build_remix(const pa_channel_position_t *in, std::size_t in_count,
+                           const pa_channel_position_t *out, std::size_t out_count, float *matrix) noexcept {
+    for (std::size_t i = 0; i < in_count * out_count; ++i)
+        matrix[i] = 0.0f;
+
+    bool in_mono = in_count == 1 && in[0] == PA_CHANNEL_POSITION_MONO;
+    bool out_mono = out_count == 1 && out[0] == PA_CHANNEL_POSITION_MONO;
+    std::size_t in_mixed = 0;
+    for (std::size_t i = 0; i < in_count; ++i)
+        if (in[i] != PA_CHANNEL_POSITION_LFE)
+            ++in_mixed;
+
+    for (std::size_t i = 0; i < in_count; ++i) {
+        pa_channel_position_t p = in[i];
+        std::size_t o = find(out, out_count, p);
+
+        if (o < out_count) {
+            matrix[o * in_count + i] = 1.0f;
+        } else if (in_mono) {
+            for (std::size_t k = 0; k < out_count; ++k)
+                if (out[k] != PA_CHANNEL_POSITION_LFE)
+                    matrix[k * in_count + i] = 1.0f;
+        } else if (out_mono) {
+            if (p != PA_CHANNEL_POSITION_LFE && in_mixed > 0)
+                matrix[i] = 1.0f / static_cast<float>(in_mixed);
+        } else if (on_center(p)) {
+            std::size_t l = find(out, out_count, PA_CHANNEL_POSITION_FRONT_LEFT);
+            std::size_t r = find(out, out_count, PA_CHANNEL_POSITION_FRONT_RIGHT);
+            std::size_t c = find(out, out_count, PA_CHANNEL_POSITION_FRONT_CENTER);
+            if (c < out_count) {
+                matrix[c * in_count + i] = 1.0f;
+            } else {
+                if (l < out_count)
+                    matrix[l * in_count + i] = minus_3db;
+                if (r < out_count)
+                    matrix[r * in_count + i] = minus_3db;
+            }
+        } else if (on_left(p) || on_right(p)) {
+            bool left = on_left(p);
+            auto same_side_back = [left](pa_channel_position_t q) {
+                return (left ? on_left(q) : on_right(q)) && !on_front(q);
+            };
+            std::size_t k = find_if(out, out_count, same_side_back);
+            if (k == out_count)
+                k = find(out, out_count, left ? PA_CHANNEL_POSITION_FRONT_LEFT : PA_CHANNEL_POSITION_FRONT_RIGHT);
+            if (k < out_count)
+                matrix[k * in_count + i] = 1.0f;
+        }
+    }
+
+    if (!in_mono) {
+        for (std::size_t k = 0; k < out_count; ++k) {
+            pa_channel_position_t q = out[k];
+            if (on_front(q) || !(on_left(q) || on_right(q)) || find(in, in_count, q) < in_count)
+                continue;
+            bool fed = false;
+            for (std::size_t i = 0; i < in_count; ++i)
+                fed = fed || matrix[k * in_count + i] != 0.0f;
+            if (fed)
+                continue;
+            std::size_t front = find(in, in_count, on_left(q) ? PA_CHANNEL_POSITION_FRONT_LEFT : PA_CHANNEL_POSITION_FRONT_RIGHT);
+            if (front < in_count)
+                matrix[k * in_count + front] = 1.0f;
+        }
+    }
+
+    for (std::size_t k = 0; k < out_count; ++k) {
+        float sum = 0.0f;
+        for (std::size_t i = 0; i < in_count; ++i)
+            sum += matrix[k * in_count + i];
+        if (sum > 1.0f)
+            for (std::size_t i = 0; i < in_count; ++i)
+                matrix[k * in_count + i] /= sum;
+    }
+}
+
+} // namespace detail
+
+//Channel layout fixed at compile time.
+template <pa_channel_position_t... Positions>
+struct channel_layout {
+    static_assert(sizeof...(Positions) > 0 && sizeof...(Positions) <= PA_CHANNELS_MAX, "invalid channel count");
+
+    static constexpr std::size_t channels = sizeof...(Positions);
+    static constexpr std::array<pa_channel_position_t, channels> positions = {{Positions...}};
+
+    //Position of p in the layout, or channels if absent.
+    static constexpr std::size_t index_of(pa_channel_position_t p) noexcept {
+        return detail::find(positions.data(), channels, p);
+    }
+    static constexpr bool contains(pa_channel_position_t p) noexcept { return index_of(p) < channels; }
+
+    //True if map has exactly the positions of the layout, in order.
+    static constexpr bool matches(const pa_channel_map &map) noexcept {
+        if (map.channels != channels)
+            return false;
+        for (std::size_t i = 0; i < channels; ++i)
+            if (map.map[i] != positions[i])
+                return false;
+        return true;
+    }
+
+    static constexpr pa_channel_map channel_map() noexcept {
+        pa_channel_map map{};
+        map.channels = static_cast<std::uint8_t>(channels);
+        for (std::size_t i = 0; i < channels; ++i)
+            map.map[i] = positions[i];
+        return map;
+    }
+};
+
+//Layouts of the devices we see in practice. The surround orders are those of the ALSA
+//channel maps, which is what the sinks and sources of sound cards report.
+using mono_layout = channel_layout<PA_CHANNEL_POSITION_MONO>;
+using stereo_layout = channel_layout<PA_CHANNEL_POSITION_FRONT_LEFT, PA_CHANNEL_POSITION_FRONT_RIGHT>;
+using surround51_layout = channel_layout<PA_CHANNEL_POSITION_FRONT_LEFT, PA_CHANNEL_POSITION_FRONT_RIGHT,
+                                         PA_CHANNEL_POSITION_REAR_LEFT, PA_CHANNEL_POSITION_REAR_RIGHT,
+                                         PA_CHANNEL_POSITION_FRONT_CENTER, PA_CHANNEL_POSITION_LFE>;
+using surround71_layout = channel_layout<PA_CHANNEL_POSITION_FRONT_LEFT, PA_CHANNEL_POSITION_FRONT_RIGHT,
+                                         PA_CHANNEL_POSITION_REAR_LEFT, PA_CHANNEL_POSITION_REAR_RIGHT,
+                                         PA_CHANNEL_POSITION_FRONT_CENTER, PA_CHANNEL_POSITION_LFE,
+                                         PA_CHANNEL_POSITION_SIDE_LEFT, PA_CHANNEL_POSITION_SIDE_RIGHT>;
+
+template <typename T>
+struct is_fixed_layout : std::false_type {};
+template <pa_channel_position_t... Positions>
+struct is_fixed_layout<channel_layout<Positions...>> : std::true_type {};
+template <typename T>
+inline constexpr bool is_fixed_layout_v = is_fixed_layout<T>::value;
+
+//Percent (as in the C API) to a volume, and back.
+constexpr pa_volume_t volume_from_percent(int percent) noexcept {
+    return percent <= 0 ? PA_VOLUME_MUTED : detail::clamp_volume(static_cast<std::uint64_t>(percent) * PA_VOLUME_NORM / 100);
+}
+constexpr int volume_to_percent(pa_volume_t volume) noexcept {
+    return static_cast<int>((static_cast<std::uint64_t>(volume) * 100 + PA_VOLUME_NORM / 2) / PA_VOLUME_NORM);
+}
+
+//Volume of each channel of a fixed layout.
+template <typename Layout>
+class layout_volume {
+    static_assert(is_fixed_layout_v<Layout>, "layout_volume needs a channel_layout");
+
+public:
+    using layout = Layout;
+    static constexpr std::size_t channels = Layout::channels;
+
+    //Channels on each side, at the front and at the rear, as bit masks.
+    static constexpr std::uint32_t mask(bool (*test)(pa_channel_position_t)) noexcept {
+        std::uint32_t bits = 0;
+        for (std::size_t i = 0; i < channels; ++i)
+            if (test(Layout::positions[i]))
+                bits |= 1u << i;
+        return bits;
+    }
+    static constexpr std::uint32_t left_mask = mask(detail::on_left);
+    static constexpr std::uint32_t right_mask = mask(detail::on_right);
+    static constexpr std::uint32_t front_mask = mask(detail::on_front);
+    static constexpr std::uint32_t rear_mask = mask(detail::on_rear);
+    static constexpr bool can_balance = left_mask && right_mask;
+    static constexpr bool can_fade = front_mask && rear_mask;
+
+    constexpr layout_volume() noexcept : layout_volume(PA_VOLUME_NORM) {}
+    constexpr explicit layout_volume(pa_volume_t volume) noexcept { set(volume); }
+
+    static constexpr layout_volume from_percent(int percent) noexcept { return layout_volume(volume_from_percent(percent)); }
+
+    //Volume of a device or stream, if it has the channel count of the layout.
+    static constexpr std::optional<layout_volume> from(const pa_cvolume &volume) noexcept {
+        if (volume.channels != channels)
+            return std::nullopt;
+        layout_volume result;
+        detail::unroll<channels>([&](auto c) { result.values_[c] = volume.values[c]; });
+        return result;
+    }
+
+    constexpr pa_cvolume cvolume() const noexcept {
+        pa_cvolume volume{};
+        volume.channels = static_cast<std::uint8_t>(channels);
+        detail::unroll<channels>([&](auto c) { volume.values[c] = values_[c]; });
+        return volume;
+    }
+
+    constexpr pa_volume_t &operator[](std::size_t channel) noexcept { return values_[channel]; }
+    constexpr pa_volume_t operator[](std::size_t channel) const noexcept { return values_[channel]; }
+    constexpr pa_volume_t &at(pa_channel_position_t position) noexcept { return values_[index_of_checked(position)]; }
+    constexpr const std::array<pa_volume_t, channels> &values() const noexcept { return values_; }
+
+    constexpr void set(pa_volume_t volume) noexcept {
+        detail::unroll<channels>([&](auto c) { values_[c] = volume; });
+    }
+
+    constexpr pa_volume_t average() const noexcept { return average_of(~0u); }
+    constexpr int percent() const noexcept { return volume_to_percent(average()); }
+
+    constexpr pa_volume_t max() const noexcept {
+        pa_volume_t m = PA_VOLUME_MUTED;
+        detail::unroll<channels>([&](auto c) { m = values_[c] > m ? values_[c] : m; });
+        return m;
+    }
+
+    constexpr pa_volume_t min() const noexcept {
+        pa_volume_t m = PA_VOLUME_MAX;
+        detail::unroll<channels>([&](auto c) { m = values_[c] < m ? values_[c] : m; });
+        return m;
+    }
+
+    //Scales the channels so that the loudest is at volume, keeping their ratios (pa_cvolume_scale()).
+    constexpr layout_volume &scale(pa_volume_t volume) noexcept {
+        pa_volume_t t = max();
+        if (t <= PA_VOLUME_MUTED) {
+            set(volume);
+            return *this;
+        }
+        detail::unroll<channels>([&](auto c) {
+            values_[c] = detail::clamp_volume(static_cast<std::uint64_t>(values_[c]) * volume / t);
+        });
+        return *this;
+    }
+
+    //Balance from -1 (left only) to 1 (right only), 0 if the layout has no left and right (pa_cvolume_get_balance()).
+    constexpr float balance() const noexcept {
+        if constexpr (!can_balance)
+            return 0.0f;
+        return ratio(average_of(left_mask), average_of(right_mask));
+    }
+
+    //Fade from -1 (front only) to 1 (rear only), 0 if the layout has no front and rear (pa_cvolume_get_fade()).
+    constexpr float fade() const noexcept {
+        if constexpr (!can_fade)
+            return 0.0f;
+        return ratio(average_of(front_mask), average_of(rear_mask));
+    }
+
+    //Sets the balance, keeping the loudest side (pa_cvolume_set_balance()).
+    constexpr layout_volume &set_balance(float balance) noexcept {
+        if constexpr (can_balance)
+            apply_ratio(left_mask, right_mask, balance);
+        return *this;
+    }
+
+    //Sets the fade, keeping the loudest of front and rear (pa_cvolume_set_fade()).
+    constexpr layout_volume &set_fade(float fade) noexcept {
+        if constexpr (can_fade)
+            apply_ratio(front_mask, rear_mask, fade);
+        return *this;
+    }
+
+    constexpr bool operator==(const layout_volume &other) const noexcept { return values_ == other.values_; }
+    constexpr bool operator!=(const layout_volume &other) const noexcept { return !(*this == other); }
+
+private:
+    static constexpr std::size_t index_of_checked(pa_channel_position_t position) noexcept {
+        std::size_t i = Layout::index_of(position);
+        return i < channels ? i : 0;
+    }
+
+    constexpr pa_volume_t average_of(std::uint32_t bits) const noexcept {
+        std::uint64_t sum = 0;
+        std::uint32_t count = 0;
+        detail::unroll<channels>([&](auto c) {
+            if (bits & (1u << c)) {
+                sum += values_[c];
+                ++count;
+            }
+        });
+        return count ? static_cast<pa_volume_t>(sum / count) : PA_VOLUME_MUTED;
+    }
+
+    static constexpr float ratio(pa_volume_t a, pa_volume_t b) noexcept {
+        if (a == b)
+            return 0.0f;
+        return a > b ? -1.0f + static_cast<float>(b) / static_cast<float>(a)
+                     : 1.0f - static_cast<float>(a) / static_cast<float>(b);
+    }
+
+    //Gives the channels of a_bits and b_bits the averages the new ratio asks for.
+    constexpr void apply_ratio(std::uint32_t a_bits, std::uint32_t b_bits, float value) noexcept {
+        value = value < -1.0f ? -1.0f : value > 1.0f ? 1.0f : value;
+        pa_volume_t a = average_of(a_bits);
+        pa_volume_t b = average_of(b_bits);
+        pa_volume_t m = a > b ? a : b;
+        pa_volume_t na = value <= 0.0f ? m : static_cast<pa_volume_t>((1.0f - value) * static_cast<float>(m));
+        pa_volume_t nb = value <= 0.0f ? static_cast<pa_volume_t>((value + 1.0f) * static_cast<float>(m)) : m;
+
+        detail::unroll<channels>([&](auto c) {
+            if (a_bits & (1u << c))
+                values_[c] = a == 0 ? na : detail::clamp_volume(static_cast<std::uint64_t>(na) * values_[c] / a);
+            else if (b_bits & (1u << c))
+                values_[c] = b == 0 ? nb : detail::clamp_volume(static_cast<std::uint64_t>(nb) * values_[c] / b);
+        });
+    }
+
+    std::array<pa_volume_t, channels> values_{};
+};
+
+using mono_volume = layout_volume<mono_layout>;
+using stereo_volume = layout_volume<stereo_layout>;
+using surround51_volume = layout_volume<surround51_layout>;
+using surround71_volume = layout_volume<surround71_layout>;
+
+//Volume of a channel map that is none of the fixed layouts, through the functions of libpulse.
+class dynamic_volume {
+public:
+    dynamic_volume(const pa_cvolume &volume, const pa_channel_map &map) noexcept : volume_(volume), map_(map) {}
+
+    const pa_cvolume &cvolume() const noexcept { return volume_; }
+    const pa_channel_map &channel_map() const noexcept { return map_; }
+    std::size_t channels() const noexcept { return volume_.channels; }
+
+    pa_volume_t &operator[](std::size_t channel) noexcept { return volume_.values[channel]; }
+    pa_volume_t operator[](std::size_t channel) const noexcept { return volume_.values[channel]; }
+
+    void set(pa_volume_t volume) noexcept { pa_cvolume_set(&volume_, volume_.channels, volume); }
+    pa_volume_t average() const noexcept { return pa_cvolume_avg(&volume_); }
+    int percent() const noexcept { return volume_to_percent(average()); }
+    pa_volume_t max() const noexcept { return pa_cvolume_max(&volume_); }
+    pa_volume_t min() const noexcept { return pa_cvolume_min(&volume_); }
+
+    dynamic_volume &scale(pa_volume_t volume) noexcept {
+        pa_cvolume_scale(&volume_, volume);
+        return *this;
+    }
+
+    float balance() const noexcept { return pa_cvolume_get_balance(&volume_, &map_); }
+    float fade() const noexcept { return pa_cvolume_get_fade(&volume_, &map_); }
+
+    //The map must have left and right (or front and rear) channels, else nothing changes.
+    dynamic_volume &set_balance(float balance) noexcept {
+        pa_cvolume_set_balance(&volume_, &map_, balance);
+        return *this;
+    }
+    dynamic_volume &set_fade(float fade) noexcept {
+        pa_cvolume_set_fade(&volume_, &map_, fade);
+        return *this;
+    }
+
+private:
+    pa_cvolume volume_;
+    pa_channel_map map_;
+};
+
+//Remix matrix from In to Out, matrix[out][in], computed at compile time (see detail::build_remix()).
+template <typename In, typename Out>
+constexpr std::array<std::array<float, In::channels>, Out::channels> make_remix_matrix() noexcept {
+    float flat[In::channels * Out::channels] = {};
+    detail::build_remix(In::positions.data(), In::channels, Out::positions.data(), Out::channels, flat);
+
+    std::array<std::array<float, In::channels>, Out::channels> matrix{};
+    for (std::size_t o = 0; o < Out::channels; ++o)
+        for (std::size_t i = 0; i < In::channels; ++i)
+            matrix[o][i] = flat[o * In::channels + i];
+    return matrix;
+}
+
+template <typename In, typename Out>
+inline constexpr auto remix_matrix = make_remix_matrix<In, Out>();
+
+//Remixes frames interleaved float frames from In to Out. Each output sample is a sum over
+//the nonzero coefficients only, with no loop over the channels.
+template <typename In, typename Out>
+void remix(const float *in, float *out, std::size_t frames) noexcept {
+    static_assert(is_fixed_layout_v<In> && is_fixed_layout_v<Out>, "remix needs channel_layout types");
+
+    for (std::size_t f = 0; f < frames; ++f, in += In::channels, out += Out::channels) {
+        detail::unroll<Out::channels>([&](auto o) {
+            float sample = 0.0f;
+            detail::unroll<In::channels>([&](auto i) {
+                constexpr float k = remix_matrix<In, Out>[decltype(o)::value][decltype(i)::value];
+                if constexpr (k == 1.0f)
+                    sample += in[i];
+                else if constexpr (k != 0.0f)
+                    sample += k * in[i];
+            });
+            out[o] = sample;
+        });
+    }
+}
+
+//Remixes between any two channel maps, with the matrix built at run time. Returns false
+//if a map is invalid.
+inline bool remix_dynamic(const pa_channel_map &in_map, const float *in,
+                          const pa_channel_map &out_map, float *out, std::size_t frames) noexcept {
+    if (!pa_channel_map_valid(&in_map) || !pa_channel_map_valid(&out_map))
+        return false;
+
+    std::size_t in_count = in_map.channels;
+    std::size_t out_count = out_map.channels;
+    float matrix[PA_CHANNELS_MAX * PA_CHANNELS_MAX];
+    detail::build_remix(in_map.map, in_count, out_map.map, out_count, matrix);
+
+    for (std::size_t f = 0; f < frames; ++f, in += in_count, out += out_count) {
+        for (std::size_t o = 0; o < out_count; ++o) {
+            const float *row = matrix + o * in_count;
+            float sample = 0.0f;
+            for (std::size_t i = 0; i < in_count; ++i)
+                sample += row[i] * in[i];
+            out[o] = sample;
+        }
+    }
+    return true;
+}
+
+//Calls f with the fixed layout matching map (mono_layout{}, stereo_layout{}, ...), or with
+//map itself if there is none. f must return the same type in every case.
+template <typename F>
+decltype(auto) with_layout(const pa_channel_map &map, F &&f) {
+    if (stereo_layout::matches(map))
+        return f(stereo_layout{});
+    if (mono_layout::matches(map))
+        return f(mono_layout{});
+    if (surround51_layout::matches(map))
+        return f(surround51_layout{});
+    if (surround71_layout::matches(map))
+        return f(surround71_layout{});
+    return f(map);
+}
+
+} // namespace easypulse
+
+#endif
@@ -0,0 +1,293 @@
+/**
+ * @file easypulse_log.c
+ * @brief Implementation of the leveled logging.
+ *
+ * The ring is a bounded multi-producer single-consumer queue. Every slot carries a
+ * sequence number telling whether it is free for the producer of a given position
+ * or holds a message for the consumer. Producers claim a position with a compare and
+ * swap on the head, format the message in the slot and publish it with a release
+ * store of its sequence. The logging thread is the only consumer.
+ *
+ * The logging thread is started by the first message and sleeps on a semaphore that
+ * the producers post (sem_post never blocks). If the thread cannot be started, the
+ * messages are written synchronously instead.
+ */
+
+#include "easypulse_log.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#define LOG_RING_MASK (LOG_RING_SLOTS - 1)
+
+//A message waiting for the sink.
+typedef struct log_slot {
+    _Atomic uint64_t sequence;      // Position + 1 when the message is ready, position of the next lap when free.
+    log_level level;
+    const char *function;           // Function that wrote the message (a string literal).
+    char message[LOG_MESSAGE_SIZE];
+} log_slot;
+
+static log_slot ring[LOG_RING_SLOTS];
+static _Atomic uint64_t head = 0;               // Next position to claim.
+static _Atomic uint64_t tail = 0;               // Next position to hand to the sink.
+static _Atomic uint64_t dropped = 0;            // Messages lost because the ring was full.
+
+static _Atomic int runtime_level = LOG_LEVEL_WARN;
+static _Atomic(log_sink) sink = NULL;
+static _Atomic(void *) sink_userdata = NULL;
+
+static pthread_once_t start_once = PTHREAD_ONCE_INIT;
+static sem_t wakeup;                            // Posted for every queued message.
+static atomic_bool threaded = false;            // Whether the logging thread is running.
+static pthread_mutex_t sync_lock = PTHREAD_MUTEX_INITIALIZER;   // Serializes the synchronous writes.
+
+static const char *const level_names[] = {
+    [LOG_LEVEL_ERROR] = "error",
+    [LOG_LEVEL_WARN] = "warn",
+    [LOG_LEVEL_INFO] = "info",
+    [LOG_LEVEL_DEBUG] = "debug",
+};
+
+/**
+ * @brief Sets the most detailed level written.
+ *
+ * @param level Messages of this level and the more important ones are written.
+ */
+void log_set_level(log_level level) {
+    atomic_store_explicit(&runtime_level, (int) level, memory_order_relaxed);
+}
+
+/**
+ * @brief Returns the most detailed level written.
+ */
+log_level log_get_level(void) {
+    return (log_level) atomic_load_explicit(&runtime_level, memory_order_relaxed);
+}
+
+/**
+ * @brief Returns whether messages of a level are written.
+ */
+bool log_enabled(log_level level) {
+    return (int) level <= atomic_load_explicit(&runtime_level, memory_order_relaxed);
+}
+
+/**
+ * @brief Parses the name of a level.
+ *
+ * @param name "error", "warn" (or "warning"), "info" or "debug", in any case.
+ * @param level Where to store the level.
+ * @return true if the name is known, false otherwise.
+ */
+bool log_level_from_name(const char *name, log_level *level) {
+    if (!name || !level) {
+        return false;
+    }
+
+    for (int i = LOG_LEVEL_ERROR; i <= LOG_LEVEL_DEBUG; ++i) {
+        if (strcasecmp(name, level_names[i]) == 0) {
+            *level = (log_level) i;
+            return true;
+        }
+    }
+    if (strcasecmp(name, "warning") == 0) {
+        *level = LOG_LEVEL_WARN;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Returns the name of a level.
+ */
+const char *log_level_name(log_level level) {
+    if (level < LOG_LEVEL_ERROR || level > LOG_LEVEL_DEBUG) {
+        return "unknown";
+    }
+    return level_names[level];
+}
+
+/**
+ * @brief Sends the messages to a function instead of stderr.
+ *
+ * The sink is called from the logging thread only, one message at a time. It must not
+ * call log_flush(). Messages already queued may still go to the previous sink.
+ *
+ * @param function The sink, or NULL to go back to stderr.
+ * @param userdata Pointer passed to the sink.
+ */
+void log_set_sink(log_sink function, void *userdata) {
+    atomic_store_explicit(&sink_userdata, userdata, memory_order_relaxed);
+    atomic_store_explicit(&sink, function, memory_order_release);
+}
+
+/**
+ * @brief Hands a message to the sink.
+ */
+static void deliver(log_level level, const char *function, const char *message) {
+    log_sink current = atomic_load_explicit(&sink, memory_order_acquire);
+    if (current) {
+        current(level, function, message, atomic_load_explicit(&sink_userdata, memory_order_relaxed));
+    } else if (level == LOG_LEVEL_DEBUG) {
+        fprintf(stderr, "easypulse %s: %s: %s\n", log_level_name(level), function, message);
+    } else {
+        fprintf(stderr, "easypulse %s: %s\n", log_level_name(level), message);
+    }
+}
+
+/**
+ * @brief Hands the published messages to the sink. Logging thread only.
+ */
+static void drain(void) {
+    uint64_t position = atomic_load_explicit(&tail, memory_order_relaxed);
+
+    for (;;) {
+        log_slot *slot = &ring[position & LOG_RING_MASK];
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != position + 1) {
+            break;
+        }
+
+        deliver(slot->level, slot->function, slot->message);
+
+        atomic_store_explicit(&slot->sequence, position + LOG_RING_SLOTS, memory_order_release);
+        atomic_store_explicit(&tail, ++position, memory_order_release);
+    }
+
+    uint64_t lost = atomic_exchange_explicit(&dropped, 0, memory_order_relaxed);
+    if (lost > 0) {
+        char message[64];
+        snprintf(message, sizeof(message), "%llu log messages dropped", (unsigned long long) lost);
+        deliver(LOG_LEVEL_WARN, __func__, message);
+    }
+}
+
+/**
+ * @brief Main function of the logging thread.
+ */
+static void *log_thread(void *arg) {
+    (void) arg;
+
+    for (;;) {
+        while (sem_wait(&wakeup) != 0) {
+        }
+        drain();
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Prepares the ring and starts the logging thread.
+ */
+static void log_start(void) {
+    for (uint64_t i = 0; i < LOG_RING_SLOTS; ++i) {
+        atomic_store_explicit(&ring[i].sequence, i, memory_order_relaxed);
+    }
+
+    if (sem_init(&wakeup, 0, 0) != 0) {
+        return;
+    }
+
+    pthread_attr_t attr;
+    pthread_t thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    bool started = pthread_create(&thread, &attr, log_thread, NULL) == 0;
+    pthread_attr_destroy(&attr);
+
+    if (started) {
+        atomic_store_explicit(&threaded, true, memory_order_release);
+        atexit(log_flush);
+    }
+}
+
+/**
+ * @brief Formats a message into a free slot of the ring.
+ *
+ * @return true if the message was queued, false if the ring is full.
+ */
+static bool enqueue(log_level level, const char *function, const char *format, va_list args) {
+    uint64_t position = atomic_load_explicit(&head, memory_order_relaxed);
+    log_slot *slot;
+
+    for (;;) {
+        slot = &ring[position & LOG_RING_MASK];
+        int64_t lap = (int64_t) (atomic_load_explicit(&slot->sequence, memory_order_acquire) - position);
+        if (lap == 0) {
+            if (atomic_compare_exchange_weak_explicit(&head, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (lap < 0) {
+            return false;
+        } else {
+            position = atomic_load_explicit(&head, memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    slot->function = function;
+    vsnprintf(slot->message, sizeof(slot->message), format, args);
+
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Queues a message for the sink.
+ *
+ * Use the EASYPULSE_ERROR/WARN/INFO/DEBUG macros, which skip disabled levels before
+ * formatting anything. A trailing newline in the format is not needed.
+ *
+ * @param level Level of the message.
+ * @param function Function writing the message (a string literal, such as __func__).
+ * @param format printf() format of the message.
+ */
+void log_write(log_level level, const char *function, const char *format, ...) {
+    pthread_once(&start_once, log_start);
+
+    va_list args;
+    va_start(args, format);
+
+    if (atomic_load_explicit(&threaded, memory_order_acquire)) {
+        if (enqueue(level, function, format, args)) {
+            sem_post(&wakeup);
+        } else {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        }
+    } else {
+        char message[LOG_MESSAGE_SIZE];
+        vsnprintf(message, sizeof(message), format, args);
+        pthread_mutex_lock(&sync_lock);
+        deliver(level, function, message);
+        pthread_mutex_unlock(&sync_lock);
+    }
+
+    va_end(args);
+}
+
+/**
+ * @brief Waits until the messages queued so far have been handed to the sink.
+ *
+ * Called at exit, so that the last messages of a program are not lost.
+ */
+void log_flush(void) {
+    if (!atomic_load_explicit(&threaded, memory_order_acquire)) {
+        return;
+    }
+
+    uint64_t target = atomic_load_explicit(&head, memory_order_acquire);
+    sem_post(&wakeup);
+
+    struct timespec pause = { 0, 1000000 };
+    while (atomic_load_explicit(&tail, memory_order_acquire) < target) {
+        nanosleep(&pause, NULL);
+    }
+}
@@ -0,0 +1,74 @@
+/**
+ * @file easypulse_log.h
+ * @brief Leveled logging of the library messages.
+ *
+ * Messages are written with the EASYPULSE_ERROR/WARN/INFO/DEBUG macros. A message
+ * costs nothing when its level is above LOG_COMPILE_LEVEL (the call is removed by the
+ * compiler) and one relaxed atomic load when it is above the runtime level.
+ *
+ * Enabled messages are formatted by the calling thread into a lock-free ring and
+ * handed to the sink by a background thread, so the mainloop thread never blocks on
+ * stdio. When the ring is full, messages are dropped and their number is reported.
+ * The default sink writes to stderr; log_set_sink() installs another one.
+ *
+ * The runtime level is LOG_LEVEL_WARN unless changed with log_set_level(), or with
+ * the EASYPULSE_LOG_LEVEL environment variable ("error", "warn", "info" or "debug")
+ * read by manager_create(). Debug messages are only compiled in when building with
+ * -DLOG_COMPILE_LEVEL=LOG_LEVEL_DEBUG.
+ */
+
+#ifndef EASYPULSE_LOG_H
+#define EASYPULSE_LOG_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOG_RING_SLOTS 256       // Messages waiting for the sink (power of two).
+#define LOG_MESSAGE_SIZE 240     // Longest message, longer ones are truncated.
+
+//Severity of a message, from the most to the least important.
+typedef enum log_level {
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG
+} log_level;
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO   // Messages above this level are compiled out.
+#endif
+
+//Receives the messages, one at a time, from the logging thread.
+typedef void (*log_sink)(log_level level, const char *function, const char *message, void *userdata);
+
+#define EASYPULSE_LOG(level, ...)                                           \
+    do {                                                                    \
+        if ((level) <= LOG_COMPILE_LEVEL && log_enabled(level)) {           \
+            log_write((level), __func__, __VA_ARGS__);                      \
+        }                                                                   \
+    } while (0)
+
+#define EASYPULSE_ERROR(...) EASYPULSE_LOG(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define EASYPULSE_WARN(...) EASYPULSE_LOG(LOG_LEVEL_WARN, __VA_ARGS__)
+#define EASYPULSE_INFO(...) EASYPULSE_LOG(LOG_LEVEL_INFO, __VA_ARGS__)
+#define EASYPULSE_DEBUG(...) EASYPULSE_LOG(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+void log_set_level(log_level level);                                 //Sets the most detailed level written.
+log_level log_get_level(void);                                       //Gets the most detailed level written.
+bool log_enabled(log_level level);                                   //Whether messages of a level are written.
+bool log_level_from_name(const char *name, log_level *level);        //Parses "error", "warn", "info" or "debug".
+const char *log_level_name(log_level level);                         //Name of a level.
+
+void log_set_sink(log_sink sink, void *userdata);                    //Sends the messages to a function (NULL for stderr).
+void log_write(log_level level, const char *function,
+const char *format, ...) __attribute__((format(printf, 3, 4)));      //Queues a message (use the macros instead).
+void log_flush(void);                                                //Waits until the queued messages are written.
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
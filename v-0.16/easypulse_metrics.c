@@ -0,0 +1,535 @@
+/**
+ * @file easypulse_metrics.c
+ * @brief Implementation of the call counters and latency histograms.
+ *
+ * Each thread that records a value gets its own shard, linked into a global list
+ * the first time. Only the owning thread writes to a shard, so updates are plain
+ * relaxed load/store pairs on cache lines no other thread writes. Readers walk the
+ * list and sum the shards. Shards are never freed, so the values recorded by
+ * threads that have exited are kept.
+ *
+ * Resetting does not touch the shards (that would race with their owners): it
+ * stores the current totals as a baseline that is subtracted from later snapshots.
+ *
+ * The probes also feed the tracer: when tracing is on, every entry point call and
+ * operation is recorded as a span, whether metrics are enabled or not.
+ */
+
+#include "easypulse_metrics.h"
+#include "easypulse_trace.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//Counters written by a single thread.
+typedef struct metrics_shard {
+    _Atomic uint64_t count[METRIC_COUNT];
+    _Atomic uint64_t errors[METRIC_COUNT];
+    _Atomic uint64_t round_trips[METRIC_COUNT];
+    _Atomic uint64_t total_ns[METRIC_COUNT];
+    _Atomic uint64_t buckets[METRIC_COUNT][METRICS_BUCKETS];
+    struct metrics_shard *next;
+} metrics_shard;
+
+static atomic_bool enabled = false;
+static _Atomic(metrics_shard *) shards = NULL;      // List of all the shards.
+
+static _Thread_local metrics_shard *local_shard = NULL;
+static _Thread_local uint64_t local_round_trips = 0;
+
+// Mainloop lock held by the calling thread. Locks are recursive, so only the outermost
+// lock and unlock delimit the hold; waits inside it are not counted.
+static _Thread_local uint32_t local_lock_depth = 0;
+static _Thread_local uint64_t local_hold_start = 0;     // Start of the current hold segment (0 if not timed).
+static _Thread_local uint64_t local_held_ns = 0;        // Hold time of the previous segments.
+
+static pthread_mutex_t baseline_lock = PTHREAD_MUTEX_INITIALIZER;
+static metrics_snapshot baseline;                   // Totals at the last reset.
+
+static const char *const metric_names[METRIC_COUNT] = {
+    [METRIC_API_CREATE] = "manager_create",
+    [METRIC_API_REFRESH_DEVICES] = "manager_refresh_devices",
+    [METRIC_API_CLEANUP] = "manager_cleanup",
+    [METRIC_API_SET_MASTER_VOLUME] = "manager_set_master_volume",
+    [METRIC_API_TOGGLE_OUTPUT_MUTE] = "manager_toggle_output_mute",
+    [METRIC_API_TOGGLE_INPUT_MUTE] = "manager_toggle_input_mute",
+    [METRIC_API_SWITCH_DEFAULT_OUTPUT] = "manager_switch_default_output",
+    [METRIC_API_SWITCH_DEFAULT_INPUT] = "manager_switch_default_input",
+    [METRIC_API_SET_GLOBAL_RATE] = "manager_set_pulseaudio_global_rate",
+    [METRIC_API_SET_OUTPUT_MUTE_STATE] = "manager_set_output_mute_state",
+    [METRIC_API_SET_INPUT_MUTE_STATE] = "manager_set_input_mute_state",
+    [METRIC_API_MOVE_OUTPUT_PLAYBACK] = "manager_move_output_playback",
+    [METRIC_API_MOVE_SINK_INPUT] = "manager_move_sink_input",
+    [METRIC_API_MOVE_SOURCE_OUTPUT] = "manager_move_source_output",
+    [METRIC_API_MOVE_SOURCE_OUTPUTS] = "manager_move_source_outputs",
+    [METRIC_API_APPLY_ROUTING_RULES] = "manager_apply_routing_rules",
+    [METRIC_API_LOAD_MODULE] = "manager_load_module",
+    [METRIC_API_LOAD_MODULES] = "manager_load_modules",
+    [METRIC_API_UNLOAD_MODULE] = "manager_unload_module",
+    [METRIC_API_UNLOAD_MODULES] = "manager_unload_modules",
+    [METRIC_API_LIST_MODULES] = "manager_list_modules",
+    [METRIC_API_CREATE_COMBINED_OUTPUT] = "manager_create_combined_output",
+    [METRIC_API_DESTROY_COMBINED_OUTPUT] = "manager_destroy_combined_output",
+    [METRIC_API_GET_OUTPUT_LATENCY] = "manager_get_output_latency",
+    [METRIC_API_REPLAY_EVENTS] = "manager_replay_events",
+    [METRIC_API_GET_PEAK] = "manager_get_peak",
+    [METRIC_API_ALSA_SET_VOLUME] = "alsa_mixer_set_volume",
+    [METRIC_API_ALSA_SET_MUTE] = "alsa_mixer_set_mute",
+    [METRIC_API_RUN_SCRIPT] = "script_run",
+    [METRIC_API_SCENE_CAPTURE] = "scene_capture",
+    [METRIC_API_SCENE_RESTORE] = "scene_restore",
+    [METRIC_API_SUSPEND_DEVICE] = "manager_suspend_device",
+    [METRIC_API_IDLE_SUSPEND] = "manager_start_idle_suspend",
+    [METRIC_API_RESUME_AND_HOLD] = "manager_resume_and_hold",
+    [METRIC_API_STREAM_OPEN] = "audio_stream_open",
+    [METRIC_API_STREAM_SET_PROFILE] = "audio_stream_set_profile",
+    [METRIC_API_SET_FALLBACKS] = "manager_set_fallbacks",
+    [METRIC_OP_GET_SINK_INFO] = "op:get_sink_info",
+    [METRIC_OP_GET_SOURCE_INFO] = "op:get_source_info",
+    [METRIC_OP_GET_SINK_INPUT_INFO] = "op:get_sink_input_info",
+    [METRIC_OP_GET_SOURCE_OUTPUT_INFO] = "op:get_source_output_info",
+    [METRIC_OP_GET_MODULE_INFO] = "op:get_module_info",
+    [METRIC_OP_SET_SINK_VOLUME] = "op:set_sink_volume",
+    [METRIC_OP_SET_SOURCE_VOLUME] = "op:set_source_volume",
+    [METRIC_OP_SET_SINK_MUTE] = "op:set_sink_mute",
+    [METRIC_OP_SET_SOURCE_MUTE] = "op:set_source_mute",
+    [METRIC_OP_SET_DEFAULT_SINK] = "op:set_default_sink",
+    [METRIC_OP_SET_DEFAULT_SOURCE] = "op:set_default_source",
+    [METRIC_OP_MOVE_SINK_INPUT] = "op:move_sink_input",
+    [METRIC_OP_MOVE_SOURCE_OUTPUT] = "op:move_source_output",
+    [METRIC_OP_LOAD_MODULE] = "op:load_module",
+    [METRIC_OP_UNLOAD_MODULE] = "op:unload_module",
+    [METRIC_OP_SUBSCRIBE] = "op:subscribe",
+    [METRIC_OP_SUSPEND] = "op:suspend",
+    [METRIC_OP_SET_BUFFER_ATTR] = "op:set_buffer_attr",
+    [METRIC_OP_DRAIN] = "op:drain",
+    [METRIC_OP_BATCH] = "op:batch",
+    [METRIC_OP_QUERY] = "op:system_query",
+    [METRIC_LOCK_WAIT] = "mainloop:lock_wait",
+    [METRIC_LOCK_HOLD] = "mainloop:lock_hold",
+    [METRIC_MAINLOOP_LAG] = "mainloop:lag",
+    [METRIC_CALLBACK] = "mainloop:user_callback",
+    [METRIC_FALLBACK_RECOVERY] = "mainloop:fallback_recovery",
+};
+
+/**
+ * @brief Turns recording on or off.
+ *
+ * @param on true to record, false to stop recording. Recorded values are kept.
+ */
+void metrics_enable(bool on) {
+    atomic_store_explicit(&enabled, on, memory_order_relaxed);
+}
+
+/**
+ * @brief Returns whether recording is on.
+ */
+bool metrics_enabled(void) {
+    return atomic_load_explicit(&enabled, memory_order_relaxed);
+}
+
+/**
+ * @brief Returns the monotonic time in nanoseconds.
+ */
+uint64_t metrics_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * @brief Maps a value to its histogram bucket.
+ *
+ * Values below METRICS_SUB_BUCKETS get a bucket each. Above that, every power of two
+ * is split into METRICS_SUB_BUCKETS equal ranges.
+ *
+ * @param value The value (ns).
+ * @return The bucket index.
+ */
+static uint32_t bucket_of(uint64_t value) {
+    if (value < METRICS_SUB_BUCKETS) {
+        return (uint32_t) value;
+    }
+
+    uint32_t magnitude = 63 - (uint32_t) __builtin_clzll(value);   // >= 2
+    uint32_t sub = (uint32_t) (value >> (magnitude - 2)) & (METRICS_SUB_BUCKETS - 1);
+    return (magnitude - 1) * METRICS_SUB_BUCKETS + sub;
+}
+
+/**
+ * @brief Returns the smallest value of a histogram bucket.
+ *
+ * @param bucket The bucket index.
+ * @return The lower bound of the bucket (ns).
+ */
+static uint64_t bucket_low(uint32_t bucket) {
+    if (bucket < METRICS_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    uint32_t magnitude = bucket / METRICS_SUB_BUCKETS + 1;
+    uint64_t sub = bucket % METRICS_SUB_BUCKETS;
+    return (METRICS_SUB_BUCKETS + sub) << (magnitude - 2);
+}
+
+/**
+ * @brief Returns the width of a histogram bucket.
+ *
+ * @param bucket The bucket index.
+ * @return The number of values in the bucket.
+ */
+static uint64_t bucket_width(uint32_t bucket) {
+    if (bucket < METRICS_SUB_BUCKETS) {
+        return 1;
+    }
+
+    return 1ull << (bucket / METRICS_SUB_BUCKETS - 1);
+}
+
+/**
+ * @brief Returns the shard of the calling thread, creating it if needed.
+ *
+ * @return The shard, or NULL if memory allocation fails.
+ */
+static metrics_shard *get_shard(void) {
+    if (local_shard) {
+        return local_shard;
+    }
+
+    metrics_shard *shard = calloc(1, sizeof(metrics_shard));
+    if (!shard) {
+        return NULL;
+    }
+
+    shard->next = atomic_load_explicit(&shards, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&shards, &shard->next, shard,
+                                                  memory_order_release, memory_order_relaxed)) {
+    }
+
+    local_shard = shard;
+    return shard;
+}
+
+/**
+ * @brief Adds a value to a counter owned by the calling thread.
+ */
+static inline void shard_add(_Atomic uint64_t *counter, uint64_t value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+                          memory_order_relaxed);
+}
+
+/**
+ * @brief Records one call of a metric in the shard of the calling thread.
+ *
+ * @param id The metric.
+ * @param elapsed_ns Wall time of the call.
+ * @param round_trips Round trips made by the call.
+ * @param ok Whether the call succeeded.
+ */
+static void record(metric_id id, uint64_t elapsed_ns, uint64_t round_trips, bool ok) {
+    metrics_shard *shard = get_shard();
+    if (!shard || id >= METRIC_COUNT) {
+        return;
+    }
+
+    shard_add(&shard->count[id], 1);
+    if (!ok) {
+        shard_add(&shard->errors[id], 1);
+    }
+    shard_add(&shard->round_trips[id], round_trips);
+    shard_add(&shard->total_ns[id], elapsed_ns);
+    shard_add(&shard->buckets[id][bucket_of(elapsed_ns)], 1);
+}
+
+/**
+ * @brief Starts timing a call of a public entry point.
+ *
+ * @return The state to pass to metrics_api_end().
+ */
+metrics_call metrics_api_begin(void) {
+    metrics_call call = { 0, local_round_trips };
+
+    if (metrics_enabled() || trace_enabled()) {
+        call.start_ns = metrics_now_ns();
+    }
+
+    return call;
+}
+
+/**
+ * @brief Records a call of a public entry point.
+ *
+ * The round trips counted by metrics_round_trip() since metrics_api_begin() are
+ * attributed to the call. Entry points never call each other (they share the *_impl
+ * functions), so a call and its round trips are recorded once.
+ *
+ * @param id The entry point.
+ * @param call The value returned by metrics_api_begin().
+ * @param ok Whether the call succeeded.
+ */
+void metrics_api_end(metric_id id, metrics_call call, bool ok) {
+    if (call.start_ns == 0) {
+        return;
+    }
+
+    uint64_t elapsed = metrics_now_ns() - call.start_ns;
+    if (metrics_enabled()) {
+        record(id, elapsed, local_round_trips - call.round_trips, ok);
+    }
+    trace_span(metrics_name(id), "api", call.start_ns, elapsed);
+}
+
+/**
+ * @brief Starts timing a PulseAudio operation.
+ *
+ * @return The start time, or 0 when both recording and tracing are disabled.
+ */
+uint64_t metrics_op_begin(void) {
+    return (metrics_enabled() || trace_enabled()) ? metrics_now_ns() : 0;
+}
+
+/**
+ * @brief Records a PulseAudio operation.
+ *
+ * @param id The operation kind.
+ * @param start_ns The value returned by metrics_op_begin().
+ * @param ok Whether the operation succeeded.
+ */
+void metrics_op_end(metric_id id, uint64_t start_ns, bool ok) {
+    if (start_ns == 0) {
+        return;
+    }
+
+    uint64_t elapsed = metrics_now_ns() - start_ns;
+    if (metrics_enabled()) {
+        record(id, elapsed, 0, ok);
+    }
+    trace_span(metrics_name(id), "op", start_ns, elapsed);
+}
+
+/**
+ * @brief Counts a server round trip for the entry point calls in progress on this thread.
+ */
+void metrics_round_trip(void) {
+    local_round_trips++;
+}
+
+/**
+ * @brief Records a value measured by the caller.
+ *
+ * @param id The metric.
+ * @param elapsed_ns The measured time.
+ * @param ok Whether the call succeeded.
+ */
+void metrics_record(metric_id id, uint64_t elapsed_ns, bool ok) {
+    if (metrics_enabled()) {
+        record(id, elapsed_ns, 0, ok);
+    }
+}
+
+/**
+ * @brief Starts timing a wait for a mainloop lock.
+ *
+ * @return The start time, to pass to metrics_lock_acquired() (0 when recording is disabled).
+ */
+uint64_t metrics_lock_begin(void) {
+    return metrics_enabled() ? metrics_now_ns() : 0;
+}
+
+/**
+ * @brief Records the wait for a mainloop lock that has just been acquired.
+ *
+ * When the calling thread did not hold a lock yet, the hold starts being timed.
+ *
+ * @param start_ns The value returned by metrics_lock_begin().
+ */
+void metrics_lock_acquired(uint64_t start_ns) {
+    uint64_t now = start_ns ? metrics_now_ns() : 0;
+    if (start_ns) {
+        metrics_record(METRIC_LOCK_WAIT, now - start_ns, true);
+    }
+
+    if (local_lock_depth++ == 0) {
+        local_hold_start = now;
+        local_held_ns = 0;
+    }
+}
+
+/**
+ * @brief Records the time a mainloop lock was held, when its outermost hold ends.
+ */
+void metrics_lock_released(void) {
+    if (local_lock_depth == 0 || --local_lock_depth > 0) {
+        return;
+    }
+
+    if (local_hold_start) {
+        metrics_record(METRIC_LOCK_HOLD, local_held_ns + (metrics_now_ns() - local_hold_start), true);
+    }
+    local_hold_start = 0;
+}
+
+/**
+ * @brief Pauses the hold time while pa_threaded_mainloop_wait() releases the lock.
+ */
+void metrics_lock_suspend(void) {
+    if (local_lock_depth > 0 && local_hold_start) {
+        local_held_ns += metrics_now_ns() - local_hold_start;
+    }
+}
+
+/**
+ * @brief Resumes the hold time once pa_threaded_mainloop_wait() has taken the lock back.
+ */
+void metrics_lock_resume(void) {
+    if (local_lock_depth > 0 && local_hold_start) {
+        local_hold_start = metrics_now_ns();
+    }
+}
+
+/**
+ * @brief Sums the shards of all the threads.
+ *
+ * @param snapshot Where to store the totals.
+ */
+static void sum_shards(metrics_snapshot *snapshot) {
+    memset(snapshot, 0, sizeof(metrics_snapshot));
+
+    for (metrics_shard *shard = atomic_load_explicit(&shards, memory_order_acquire); shard; shard = shard->next) {
+        for (uint32_t id = 0; id < METRIC_COUNT; ++id) {
+            metrics_stat *stat = &snapshot->stats[id];
+            stat->count += atomic_load_explicit(&shard->count[id], memory_order_relaxed);
+            stat->errors += atomic_load_explicit(&shard->errors[id], memory_order_relaxed);
+            stat->round_trips += atomic_load_explicit(&shard->round_trips[id], memory_order_relaxed);
+            stat->total_ns += atomic_load_explicit(&shard->total_ns[id], memory_order_relaxed);
+            for (uint32_t b = 0; b < METRICS_BUCKETS; ++b) {
+                stat->buckets[b] += atomic_load_explicit(&shard->buckets[id][b], memory_order_relaxed);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Merges the counters of all the threads.
+ *
+ * Values being recorded while the snapshot is taken may or may not be included.
+ *
+ * @param snapshot Where to store the merged values.
+ */
+void metrics_snapshot_take(metrics_snapshot *snapshot) {
+    if (!snapshot) {
+        return;
+    }
+
+    sum_shards(snapshot);
+
+    pthread_mutex_lock(&baseline_lock);
+    for (uint32_t id = 0; id < METRIC_COUNT; ++id) {
+        metrics_stat *stat = &snapshot->stats[id];
+        const metrics_stat *base = &baseline.stats[id];
+        stat->count -= base->count;
+        stat->errors -= base->errors;
+        stat->round_trips -= base->round_trips;
+        stat->total_ns -= base->total_ns;
+        for (uint32_t b = 0; b < METRICS_BUCKETS; ++b) {
+            stat->buckets[b] -= base->buckets[b];
+        }
+    }
+    pthread_mutex_unlock(&baseline_lock);
+}
+
+/**
+ * @brief Restarts all the metrics from zero.
+ */
+void metrics_reset(void) {
+    pthread_mutex_lock(&baseline_lock);
+    sum_shards(&baseline);
+    pthread_mutex_unlock(&baseline_lock);
+}
+
+/**
+ * @brief Estimates a percentile of the wall time of a metric.
+ *
+ * @param stat The merged values of the metric.
+ * @param p The percentile, between 0 and 100.
+ * @return The estimated value (middle of the bucket holding the percentile) in ns,
+ *         or 0 if the metric has no values.
+ */
+uint64_t metrics_percentile(const metrics_stat *stat, double p) {
+    if (!stat || stat->count == 0) {
+        return 0;
+    }
+
+    if (p < 0.0) p = 0.0;
+    if (p > 100.0) p = 100.0;
+
+    uint64_t rank = (uint64_t) (p / 100.0 * (double) stat->count);
+    if (rank >= stat->count) {
+        rank = stat->count - 1;
+    }
+
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < METRICS_BUCKETS; ++b) {
+        seen += stat->buckets[b];
+        if (seen > rank) {
+            return bucket_low(b) + bucket_width(b) / 2;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Returns the name of a metric.
+ *
+ * @param id The metric.
+ * @return The name, or "unknown".
+ */
+const char *metrics_name(metric_id id) {
+    if (id >= METRIC_COUNT || !metric_names[id]) {
+        return "unknown";
+    }
+    return metric_names[id];
+}
+
+/**
+ * @brief Prints a table of the metrics that have been recorded at least once.
+ *
+ * Times are in microseconds. The rt/call column is the average number of server
+ * round trips per call.
+ *
+ * @param out The stream to print to.
+ */
+void metrics_dump(FILE *out) {
+    metrics_snapshot *snapshot = malloc(sizeof(metrics_snapshot));
+    if (!out || !snapshot) {
+        free(snapshot);
+        return;
+    }
+
+    metrics_snapshot_take(snapshot);
+
+    fprintf(out, "%-36s %10s %8s %8s %10s %10s %10s %10s\n",
+            "metric", "count", "errors", "rt/call", "mean(us)", "p50(us)", "p90(us)", "p99(us)");
+
+    for (uint32_t id = 0; id < METRIC_COUNT; ++id) {
+        const metrics_stat *stat = &snapshot->stats[id];
+        if (stat->count == 0) {
+            continue;
+        }
+
+        fprintf(out, "%-36s %10llu %8llu %8.2f %10.1f %10.1f %10.1f %10.1f\n",
+                metrics_name((metric_id) id),
+                (unsigned long long) stat->count,
+                (unsigned long long) stat->errors,
+                (double) stat->round_trips / (double) stat->count,
+                (double) stat->total_ns / (double) stat->count / 1000.0,
+                (double) metrics_percentile(stat, 50.0) / 1000.0,
+                (double) metrics_percentile(stat, 90.0) / 1000.0,
+                (double) metrics_percentile(stat, 99.0) / 1000.0);
+    }
+
+    free(snapshot);
+}
@@ -0,0 +1,159 @@
+/**
+ * @file easypulse_metrics.h
+ * @brief Call counters and latency histograms for the easypulse manager.
+ *
+ * Every public manager_* entry point and every kind of PulseAudio operation the
+ * manager waits for is a metric. For each metric the library records the number of
+ * calls, the number of failed calls, the number of server round trips (entry points
+ * only) and a histogram of the wall time.
+ *
+ * Histograms use log2 magnitudes split into METRICS_SUB_BUCKETS linear sub-buckets,
+ * which gives a relative error below 25% over the whole nanosecond to hours range
+ * with a fixed, small number of buckets.
+ *
+ * The mainloop itself is instrumented too: the time spent waiting for and holding
+ * the mainloop lock of a manager, the delay of a heartbeat timer (how long the
+ * mainloop thread was busy before it could dispatch it) and the time spent in user
+ * callbacks, where slow callbacks are counted as errors.
+ *
+ * Recording is lock-free: each thread writes to its own shard, and the shards are
+ * only merged when a snapshot is taken. Recording is disabled until metrics_enable()
+ * is called, in which case each probe costs one relaxed atomic load.
+ */
+
+#ifndef EASYPULSE_METRICS_H
+#define EASYPULSE_METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METRICS_SUB_BUCKETS 4                              // Linear sub-buckets per power of two.
+#define METRICS_BUCKETS ((64 - 1) * METRICS_SUB_BUCKETS)   // Buckets of a histogram (values in ns).
+
+//Instrumented API entry points and operation kinds.
+typedef enum metric_id {
+    // Public entry points
+    METRIC_API_CREATE,
+    METRIC_API_REFRESH_DEVICES,
+    METRIC_API_CLEANUP,
+    METRIC_API_SET_MASTER_VOLUME,
+    METRIC_API_TOGGLE_OUTPUT_MUTE,
+    METRIC_API_TOGGLE_INPUT_MUTE,
+    METRIC_API_SWITCH_DEFAULT_OUTPUT,
+    METRIC_API_SWITCH_DEFAULT_INPUT,
+    METRIC_API_SET_GLOBAL_RATE,
+    METRIC_API_SET_OUTPUT_MUTE_STATE,
+    METRIC_API_SET_INPUT_MUTE_STATE,
+    METRIC_API_MOVE_OUTPUT_PLAYBACK,
+    METRIC_API_MOVE_SINK_INPUT,
+    METRIC_API_MOVE_SOURCE_OUTPUT,
+    METRIC_API_MOVE_SOURCE_OUTPUTS,
+    METRIC_API_APPLY_ROUTING_RULES,
+    METRIC_API_LOAD_MODULE,
+    METRIC_API_LOAD_MODULES,
+    METRIC_API_UNLOAD_MODULE,
+    METRIC_API_UNLOAD_MODULES,
+    METRIC_API_LIST_MODULES,
+    METRIC_API_CREATE_COMBINED_OUTPUT,
+    METRIC_API_DESTROY_COMBINED_OUTPUT,
+    METRIC_API_GET_OUTPUT_LATENCY,
+    METRIC_API_REPLAY_EVENTS,
+    METRIC_API_GET_PEAK,
+    METRIC_API_ALSA_SET_VOLUME,
+    METRIC_API_ALSA_SET_MUTE,
+    METRIC_API_RUN_SCRIPT,
+    METRIC_API_SCENE_CAPTURE,
+    METRIC_API_SCENE_RESTORE,
+    METRIC_API_SUSPEND_DEVICE,
+    METRIC_API_IDLE_SUSPEND,
+    METRIC_API_RESUME_AND_HOLD,
+    METRIC_API_STREAM_OPEN,
+    METRIC_API_STREAM_SET_PROFILE,
+    METRIC_API_SET_FALLBACKS,
+
+    // PulseAudio operations
+    METRIC_OP_GET_SINK_INFO,
+    METRIC_OP_GET_SOURCE_INFO,
+    METRIC_OP_GET_SINK_INPUT_INFO,
+    METRIC_OP_GET_SOURCE_OUTPUT_INFO,
+    METRIC_OP_GET_MODULE_INFO,
+    METRIC_OP_SET_SINK_VOLUME,
+    METRIC_OP_SET_SOURCE_VOLUME,
+    METRIC_OP_SET_SINK_MUTE,
+    METRIC_OP_SET_SOURCE_MUTE,
+    METRIC_OP_SET_DEFAULT_SINK,
+    METRIC_OP_SET_DEFAULT_SOURCE,
+    METRIC_OP_MOVE_SINK_INPUT,
+    METRIC_OP_MOVE_SOURCE_OUTPUT,
+    METRIC_OP_LOAD_MODULE,
+    METRIC_OP_UNLOAD_MODULE,
+    METRIC_OP_SUBSCRIBE,
+    METRIC_OP_SUSPEND,
+    METRIC_OP_SET_BUFFER_ATTR,
+    METRIC_OP_DRAIN,
+    METRIC_OP_BATCH,             // Batch mixing several operation kinds.
+    METRIC_OP_QUERY,             // Operation of the system_query.c helpers.
+
+    // Mainloop
+    METRIC_LOCK_WAIT,            // Wait for the mainloop lock.
+    METRIC_LOCK_HOLD,            // Lock held by a caller, pa_threaded_mainloop_wait() excluded.
+    METRIC_MAINLOOP_LAG,         // Delay of the heartbeat timer of the mainloop.
+    METRIC_CALLBACK,             // Time spent in a user callback (slow calls count as errors).
+    METRIC_FALLBACK_RECOVERY,    // Loss of a default device to its fallback set and its streams moved.
+
+    METRIC_COUNT
+} metric_id;
+
+//Merged values of one metric.
+typedef struct metrics_stat {
+    uint64_t count;                       // Number of calls.
+    uint64_t errors;                      // Number of failed calls.
+    uint64_t round_trips;                 // Server round trips made by the calls.
+    uint64_t total_ns;                    // Sum of the wall times.
+    uint64_t buckets[METRICS_BUCKETS];    // Wall time histogram.
+} metrics_stat;
+
+//Merged values of every metric.
+typedef struct metrics_snapshot {
+    metrics_stat stats[METRIC_COUNT];
+} metrics_snapshot;
+
+//State of an entry point call, returned by metrics_api_begin().
+typedef struct metrics_call {
+    uint64_t start_ns;        // Start time (0 when recording is disabled).
+    uint64_t round_trips;     // Round trip counter of the thread at the start.
+} metrics_call;
+
+void metrics_enable(bool enabled);                                  //Turns recording on or off.
+bool metrics_enabled(void);                                         //Whether recording is on.
+uint64_t metrics_now_ns(void);                                      //Monotonic time in nanoseconds.
+
+metrics_call metrics_api_begin(void);                               //Starts timing an entry point call.
+void metrics_api_end(metric_id id, metrics_call call, bool ok);     //Records an entry point call.
+uint64_t metrics_op_begin(void);                                    //Starts timing an operation (0 when disabled).
+void metrics_op_end(metric_id id, uint64_t start_ns, bool ok);      //Records an operation.
+void metrics_round_trip(void);                                      //Counts a round trip for the calls in progress.
+void metrics_record(metric_id id, uint64_t elapsed_ns, bool ok);    //Records a value measured by the caller.
+
+uint64_t metrics_lock_begin(void);                                  //Starts timing a wait for a mainloop lock.
+void metrics_lock_acquired(uint64_t start_ns);                      //Records the wait and starts timing the hold.
+void metrics_lock_released(void);                                   //Records the time the lock was held.
+void metrics_lock_suspend(void);                                    //The lock is released by pa_threaded_mainloop_wait().
+void metrics_lock_resume(void);                                     //The lock is taken back after pa_threaded_mainloop_wait().
+
+void metrics_snapshot_take(metrics_snapshot *snapshot);             //Merges the per-thread counters.
+uint64_t metrics_percentile(const metrics_stat *stat, double p);    //Estimates a percentile (ns) from a histogram.
+const char *metrics_name(metric_id id);                             //Name of a metric.
+void metrics_dump(FILE *out);                                       //Prints a table of the metrics in use.
+void metrics_reset(void);                                           //Restarts all metrics from zero.
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
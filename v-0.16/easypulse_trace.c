@@ -0,0 +1,243 @@
+/**
+ * @file easypulse_trace.c
+ * @brief Implementation of the span tracer.
+ *
+ * Every thread records into its own ring buffer, linked into a global list the
+ * first time it records a span. The owning thread is the only writer: it fills a
+ * slot and then publishes it by advancing the ring head. Readers copy the slots
+ * between the oldest live index and the head, then drop the ones the writer may
+ * have overwritten meanwhile, so dumping never blocks the traced threads.
+ *
+ * Span names and categories are not copied: they must be string literals.
+ */
+
+#define _GNU_SOURCE // For gettid().
+
+#include "easypulse_trace.h"
+#include "easypulse_log.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+//A recorded span.
+typedef struct trace_event {
+    const char *name;
+    const char *category;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+} trace_event;
+
+//Spans of a single thread.
+typedef struct trace_ring {
+    trace_event events[TRACE_RING_EVENTS];
+    _Atomic uint64_t head;          // Number of spans ever recorded.
+    _Atomic uint64_t cleared;       // Value of head at the last trace_clear().
+    pid_t tid;                      // Thread id shown in the trace.
+    struct trace_ring *next;
+} trace_ring;
+
+static atomic_bool enabled = false;
+static _Atomic(trace_ring *) rings = NULL;     // List of all the rings.
+static _Thread_local trace_ring *local_ring = NULL;
+
+/**
+ * @brief Returns the monotonic time in nanoseconds.
+ */
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * @brief Turns tracing on or off.
+ *
+ * @param on true to record spans, false to stop. Recorded spans are kept.
+ */
+void trace_enable(bool on) {
+    atomic_store_explicit(&enabled, on, memory_order_relaxed);
+}
+
+/**
+ * @brief Returns whether tracing is on.
+ */
+bool trace_enabled(void) {
+    return atomic_load_explicit(&enabled, memory_order_relaxed);
+}
+
+/**
+ * @brief Returns the ring of the calling thread, creating it if needed.
+ *
+ * @return The ring, or NULL if memory allocation fails.
+ */
+static trace_ring *get_ring(void) {
+    if (local_ring) {
+        return local_ring;
+    }
+
+    trace_ring *ring = calloc(1, sizeof(trace_ring));
+    if (!ring) {
+        return NULL;
+    }
+    ring->tid = gettid();
+
+    ring->next = atomic_load_explicit(&rings, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&rings, &ring->next, ring,
+                                                  memory_order_release, memory_order_relaxed)) {
+    }
+
+    local_ring = ring;
+    return ring;
+}
+
+/**
+ * @brief Starts a span.
+ *
+ * @return The start time to pass to trace_end(), or 0 when tracing is off.
+ */
+uint64_t trace_begin(void) {
+    return trace_enabled() ? now_ns() : 0;
+}
+
+/**
+ * @brief Records a span measured by the caller.
+ *
+ * @param name Name of the span (string literal).
+ * @param category Category of the span (string literal).
+ * @param start_ns Start time, from the CLOCK_MONOTONIC clock.
+ * @param duration_ns Duration of the span.
+ */
+void trace_span(const char *name, const char *category, uint64_t start_ns, uint64_t duration_ns) {
+    if (start_ns == 0 || !trace_enabled()) {
+        return;
+    }
+
+    trace_ring *ring = get_ring();
+    if (!ring) {
+        return;
+    }
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    trace_event *event = &ring->events[head % TRACE_RING_EVENTS];
+    event->name = name;
+    event->category = category;
+    event->start_ns = start_ns;
+    event->duration_ns = duration_ns;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/**
+ * @brief Ends a span started with trace_begin().
+ *
+ * @param name Name of the span (string literal).
+ * @param category Category of the span (string literal).
+ * @param start_ns The value returned by trace_begin(). Nothing is recorded if 0.
+ */
+void trace_end(const char *name, const char *category, uint64_t start_ns) {
+    if (start_ns == 0) {
+        return;
+    }
+
+    trace_span(name, category, start_ns, now_ns() - start_ns);
+}
+
+/**
+ * @brief Writes the spans of a ring as trace events.
+ *
+ * @param out The stream to write to.
+ * @param ring The ring.
+ * @param pid Process id shown in the trace.
+ * @param first Whether no event has been written yet (updated).
+ */
+static void write_ring(FILE *out, trace_ring *ring, pid_t pid, bool *first) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t begin = atomic_load_explicit(&ring->cleared, memory_order_relaxed);
+    if (head - begin > TRACE_RING_EVENTS) {
+        begin = head - TRACE_RING_EVENTS;
+    }
+
+    uint64_t count = head - begin;
+    if (count == 0) {
+        return;
+    }
+
+    trace_event *copy = malloc(count * sizeof(trace_event));
+    if (!copy) {
+        return;
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+        copy[i] = ring->events[(begin + i) % TRACE_RING_EVENTS];
+    }
+
+    // Spans the writer may have overwritten while they were being copied are dropped
+    uint64_t head_after = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t valid_from = head_after > TRACE_RING_EVENTS ? head_after - TRACE_RING_EVENTS : 0;
+
+    for (uint64_t i = 0; i < count; ++i) {
+        if (begin + i < valid_from) {
+            continue;
+        }
+
+        fprintf(out, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+                *first ? "" : ",", copy[i].name, copy[i].category,
+                (double) copy[i].start_ns / 1000.0, (double) copy[i].duration_ns / 1000.0,
+                (int) pid, (int) ring->tid);
+        *first = false;
+    }
+
+    free(copy);
+}
+
+/**
+ * @brief Writes the recorded spans as Chrome trace event JSON.
+ *
+ * Can be called while other threads are still recording.
+ *
+ * @param out The stream to write to.
+ */
+void trace_write(FILE *out) {
+    if (!out) {
+        return;
+    }
+
+    pid_t pid = getpid();
+    bool first = true;
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (trace_ring *ring = atomic_load_explicit(&rings, memory_order_acquire); ring; ring = ring->next) {
+        write_ring(out, ring, pid, &first);
+    }
+    fprintf(out, "\n]}\n");
+}
+
+/**
+ * @brief Writes the recorded spans to a file.
+ *
+ * @param path Path of the JSON file to create.
+ * @return true if the file was written, false otherwise.
+ */
+bool trace_dump(const char *path) {
+    if (!path) {
+        return false;
+    }
+
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        EASYPULSE_ERROR("[trace_dump()] Cannot open %s for writing.", path);
+        return false;
+    }
+
+    trace_write(out);
+    return fclose(out) == 0;
+}
+
+/**
+ * @brief Forgets the spans recorded so far.
+ */
+void trace_clear(void) {
+    for (trace_ring *ring = atomic_load_explicit(&rings, memory_order_acquire); ring; ring = ring->next) {
+        atomic_store_explicit(&ring->cleared, atomic_load_explicit(&ring->head, memory_order_acquire),
+                              memory_order_relaxed);
+    }
+}
@@ -0,0 +1,49 @@
+/**
+ * @file easypulse_trace.h
+ * @brief Opt-in span tracer with Chrome trace (Perfetto) export.
+ *
+ * When tracing is enabled, the library records a span for every manager_* call,
+ * every wait for a PulseAudio operation, every acquisition of the mainloop lock,
+ * every ALSA probe and every subscription event it handles. Spans go to a ring
+ * buffer owned by the recording thread, so the oldest spans of a thread are
+ * overwritten once TRACE_RING_EVENTS spans have been recorded.
+ *
+ * trace_dump() writes the spans in the Chrome trace event JSON format, which can be
+ * opened in https://ui.perfetto.dev or chrome://tracing.
+ *
+ * Tracing can also be turned on without code changes by setting the EASYPULSE_TRACE
+ * environment variable to a file path: tracing starts in manager_create() and the
+ * trace is written to that path by manager_cleanup().
+ */
+
+#ifndef EASYPULSE_TRACE_H
+#define EASYPULSE_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_RING_EVENTS 4096   // Spans kept per thread.
+
+void trace_enable(bool enabled);                                     //Turns tracing on or off.
+bool trace_enabled(void);                                            //Whether tracing is on.
+
+uint64_t trace_begin(void);                                          //Starts a span. Returns 0 when tracing is off.
+void trace_end(const char *name, const char *category,
+uint64_t start_ns);                                                  //Ends a span started with trace_begin().
+void trace_span(const char *name, const char *category,
+uint64_t start_ns, uint64_t duration_ns);                            //Records a span measured by the caller.
+
+void trace_write(FILE *out);                                         //Writes the spans as Chrome trace JSON.
+bool trace_dump(const char *path);                                   //Writes the spans to a file.
+void trace_clear(void);                                              //Forgets the spans recorded so far.
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
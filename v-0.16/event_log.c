@@ -0,0 +1,392 @@
+/**
+ * @file event_log.c
+ * @brief Implementation of the event log recorder and reader.
+ *
+ * The recorder is used from the mainloop thread, so it only appends to a buffered file
+ * and never flushes on its own. The reader loads the whole log in memory, so that a
+ * replay measures the event handling and not the disk.
+ */
+
+#include "event_log.h"
+#include "easypulse_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define EVENT_RECORDER_BUFFER (64 * 1024)   // stdio buffer of the log file.
+
+struct event_recorder {
+    FILE *file;
+    uint64_t last_usec;         // Monotonic time of the previous record.
+    bool failed;                // A write failed, the log is incomplete.
+    uint8_t payload[EVENT_LOG_MAX_PAYLOAD];
+};
+
+struct event_reader {
+    uint8_t *data;              // Whole content of the file.
+    size_t size;
+    size_t offset;              // Start of the next record.
+    uint64_t time_usec;         // Time of the last record read.
+    bool truncated;             // Reading stopped on a damaged record.
+    pa_proplist *proplist;      // Properties of the last sink input read.
+    char key[EVENT_LOG_MAX_PAYLOAD + 1];    // A string of a payload always fits.
+    char value[EVENT_LOG_MAX_PAYLOAD + 1];
+};
+
+static uint64_t clock_usec(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t) ts.tv_sec * 1000000ull + (uint64_t) ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Creates a log file and writes its header.
+ *
+ * @param path Path of the file, replaced if it exists.
+ * @return The recorder, or NULL on failure.
+ */
+event_recorder *event_recorder_open(const char *path) {
+    if (!path) {
+        return NULL;
+    }
+
+    event_recorder *recorder = calloc(1, sizeof(event_recorder));
+    if (!recorder) {
+        EASYPULSE_ERROR("Failed to allocate memory for the event recorder.");
+        return NULL;
+    }
+
+    recorder->file = fopen(path, "wb");
+    if (!recorder->file) {
+        EASYPULSE_ERROR("Cannot open %s for writing.", path);
+        free(recorder);
+        return NULL;
+    }
+    setvbuf(recorder->file, NULL, _IOFBF, EVENT_RECORDER_BUFFER);
+
+    event_log_header header = {
+        .magic = EVENT_LOG_MAGIC,
+        .version = EVENT_LOG_VERSION,
+        .header_size = sizeof(event_log_header),
+        .start_usec = clock_usec(CLOCK_REALTIME),
+    };
+    recorder->failed = fwrite(&header, sizeof(header), 1, recorder->file) != 1;
+    recorder->last_usec = clock_usec(CLOCK_MONOTONIC);
+
+    return recorder;
+}
+
+/**
+ * @brief Appends a record with the payload prepared in recorder->payload.
+ */
+static void event_recorder_append(event_recorder *recorder, event_log_kind kind, uint16_t length) {
+    uint64_t now = clock_usec(CLOCK_MONOTONIC);
+    uint64_t delta = now - recorder->last_usec;
+    recorder->last_usec = now;
+
+    event_log_record_header header = {
+        .delta_usec = delta > UINT32_MAX ? UINT32_MAX : (uint32_t) delta,
+        .kind = (uint8_t) kind,
+        .length = length,
+    };
+
+    if (fwrite(&header, sizeof(header), 1, recorder->file) != 1 ||
+        (length > 0 && fwrite(recorder->payload, length, 1, recorder->file) != 1)) {
+        recorder->failed = true;
+    }
+}
+
+/**
+ * @brief Appends a subscription event.
+ *
+ * @param recorder The recorder.
+ * @param event Facility and type of the event.
+ * @param index Index of the object the event refers to.
+ */
+void event_recorder_event(event_recorder *recorder, pa_subscription_event_type_t event, uint32_t index) {
+    uint32_t fields[2] = { (uint32_t) event, index };
+    memcpy(recorder->payload, fields, sizeof(fields));
+    event_recorder_append(recorder, EVENT_LOG_EVENT, sizeof(fields));
+}
+
+/**
+ * @brief Copies a length-prefixed string into a payload.
+ *
+ * @return The offset following the string, or 0 if it does not fit.
+ */
+static size_t put_string(uint8_t *payload, size_t offset, const char *string) {
+    size_t length = strlen(string);
+    if (length > UINT16_MAX || offset + sizeof(uint16_t) + length > EVENT_LOG_MAX_PAYLOAD) {
+        return 0;
+    }
+
+    uint16_t prefix = (uint16_t) length;
+    memcpy(payload + offset, &prefix, sizeof(prefix));
+    memcpy(payload + offset + sizeof(prefix), string, length);
+    return offset + sizeof(prefix) + length;
+}
+
+/**
+ * @brief Appends the information of a sink input: its index, its sink and its string
+ * properties.
+ *
+ * @param recorder The recorder.
+ * @param info The sink input information, as given to a pa_sink_input_info_cb_t.
+ */
+void event_recorder_sink_input(event_recorder *recorder, const pa_sink_input_info *info) {
+    uint32_t fields[2] = { info->index, info->sink };
+    memcpy(recorder->payload, fields, sizeof(fields));
+
+    size_t count_offset = sizeof(fields);
+    size_t offset = count_offset + sizeof(uint16_t);
+    uint16_t count = 0;
+
+    void *state = NULL;
+    const char *key;
+    while (info->proplist && count < UINT16_MAX && (key = pa_proplist_iterate(info->proplist, &state))) {
+        const char *value = pa_proplist_gets(info->proplist, key);
+        if (!value) {
+            continue;
+        }
+
+        size_t next = put_string(recorder->payload, offset, key);
+        next = next ? put_string(recorder->payload, next, value) : 0;
+        if (!next) {
+            continue;
+        }
+        offset = next;
+        ++count;
+    }
+
+    memcpy(recorder->payload + count_offset, &count, sizeof(count));
+    event_recorder_append(recorder, EVENT_LOG_SINK_INPUT, (uint16_t) offset);
+}
+
+/**
+ * @brief Flushes and closes the log file, and frees the recorder.
+ *
+ * @param recorder The recorder (NULL is ignored).
+ * @return true if every record was written, false otherwise.
+ */
+bool event_recorder_close(event_recorder *recorder) {
+    if (!recorder) {
+        return true;
+    }
+
+    bool ok = !recorder->failed;
+    if (fclose(recorder->file) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        EASYPULSE_ERROR("Failed to write the event log, it is incomplete.");
+    }
+
+    free(recorder);
+    return ok;
+}
+
+/**
+ * @brief Loads a log file in memory.
+ *
+ * @param path Path of the file.
+ * @return The reader, positioned on the first record, or NULL on failure.
+ */
+event_reader *event_reader_open(const char *path) {
+    if (!path) {
+        return NULL;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        EASYPULSE_ERROR("Cannot open %s for reading.", path);
+        return NULL;
+    }
+
+    event_reader *reader = calloc(1, sizeof(event_reader));
+    long size = -1;
+    if (reader && fseek(file, 0, SEEK_END) == 0) {
+        size = ftell(file);
+        rewind(file);
+    }
+    if (reader && size >= 0) {
+        reader->size = (size_t) size;
+        reader->data = malloc(reader->size ? reader->size : 1);
+        reader->proplist = pa_proplist_new();
+    }
+
+    bool ok = reader && reader->data && reader->proplist &&
+              fread(reader->data, 1, reader->size, file) == reader->size;
+    fclose(file);
+
+    event_log_header header;
+    if (ok && reader->size >= sizeof(header)) {
+        memcpy(&header, reader->data, sizeof(header));
+        ok = memcmp(header.magic, EVENT_LOG_MAGIC, sizeof(header.magic)) == 0 &&
+             header.version == EVENT_LOG_VERSION && header.header_size >= sizeof(header) &&
+             header.header_size <= reader->size;
+    } else {
+        ok = false;
+    }
+
+    if (!ok) {
+        EASYPULSE_ERROR("%s is not a readable event log.", path);
+        event_reader_close(reader);
+        return NULL;
+    }
+
+    reader->offset = header.header_size;
+    return reader;
+}
+
+/**
+ * @brief Reads a length-prefixed string of a payload into a NUL-terminated buffer.
+ *
+ * @return The offset following the string, or 0 if the payload is too short.
+ */
+static size_t get_string(const uint8_t *payload, size_t length, size_t offset, char *buffer) {
+    uint16_t size;
+    if (offset + sizeof(size) > length) {
+        return 0;
+    }
+    memcpy(&size, payload + offset, sizeof(size));
+    offset += sizeof(size);
+    if (offset + size > length) {
+        return 0;
+    }
+
+    memcpy(buffer, payload + offset, size);
+    buffer[size] = '\0';
+    return offset + size;
+}
+
+/**
+ * @brief Decodes the payload of a sink input record.
+ *
+ * @return false if the payload is malformed.
+ */
+static bool read_sink_input(event_reader *reader, const uint8_t *payload, size_t length, event_log_record *record) {
+    uint32_t fields[2];
+    uint16_t count;
+    if (length < sizeof(fields) + sizeof(count)) {
+        return false;
+    }
+    memcpy(fields, payload, sizeof(fields));
+    memcpy(&count, payload + sizeof(fields), sizeof(count));
+
+    record->index = fields[0];
+    record->sink = fields[1];
+    record->proplist = reader->proplist;
+
+    size_t offset = sizeof(fields) + sizeof(count);
+
+    pa_proplist_clear(reader->proplist);
+    for (uint16_t i = 0; i < count; ++i) {
+        offset = get_string(payload, length, offset, reader->key);
+        offset = offset ? get_string(payload, length, offset, reader->value) : 0;
+        if (!offset) {
+            return false;
+        }
+        pa_proplist_sets(reader->proplist, reader->key, reader->value);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Reads the next record.
+ *
+ * The proplist of a sink input record belongs to the reader and is only valid until
+ * the next call.
+ *
+ * @param reader The reader.
+ * @param record Where to store the record.
+ * @return true if a record was read, false at the end of the log or on a damaged record.
+ */
+bool event_reader_next(event_reader *reader, event_log_record *record) {
+    event_log_record_header header;
+
+    while (reader->offset + sizeof(header) <= reader->size) {
+        memcpy(&header, reader->data + reader->offset, sizeof(header));
+        const uint8_t *payload = reader->data + reader->offset + sizeof(header);
+        if (reader->offset + sizeof(header) + header.length > reader->size) {
+            break;
+        }
+        reader->offset += sizeof(header) + header.length;
+        reader->time_usec += header.delta_usec;
+
+        memset(record, 0, sizeof(*record));
+        record->kind = (event_log_kind) header.kind;
+        record->time_usec = reader->time_usec;
+
+        switch (header.kind) {
+            case EVENT_LOG_EVENT: {
+                uint32_t fields[2];
+                if (header.length < sizeof(fields)) {
+                    reader->truncated = true;
+                    return false;
+                }
+                memcpy(fields, payload, sizeof(fields));
+                record->event = (pa_subscription_event_type_t) fields[0];
+                record->index = fields[1];
+                return true;
+            }
+            case EVENT_LOG_SINK_INPUT:
+                if (!read_sink_input(reader, payload, header.length, record)) {
+                    reader->truncated = true;
+                    return false;
+                }
+                return true;
+            default:
+                // Record kinds added by later versions are skipped
+                break;
+        }
+    }
+
+    if (reader->offset != reader->size) {
+        reader->truncated = true;
+    }
+    return false;
+}
+
+/**
+ * @brief Goes back to the first record, to replay a log several times.
+ *
+ * @param reader The reader.
+ */
+void event_reader_rewind(event_reader *reader) {
+    event_log_header header;
+    memcpy(&header, reader->data, sizeof(header));
+    reader->offset = header.header_size;
+    reader->time_usec = 0;
+    reader->truncated = false;
+}
+
+/**
+ * @brief Returns whether reading stopped on a damaged or incomplete record.
+ *
+ * A recording interrupted by a crash usually ends with a partial record; the records
+ * before it are still read.
+ *
+ * @param reader The reader.
+ */
+bool event_reader_truncated(const event_reader *reader) {
+    return reader->truncated;
+}
+
+/**
+ * @brief Frees a reader.
+ *
+ * @param reader The reader (NULL is ignored).
+ */
+void event_reader_close(event_reader *reader) {
+    if (!reader) {
+        return;
+    }
+
+    if (reader->proplist) {
+        pa_proplist_free(reader->proplist);
+    }
+    free(reader->data);
+    free(reader);
+}
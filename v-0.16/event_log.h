@@ -0,0 +1,96 @@
+/**
+ * @file event_log.h
+ * @brief Binary recording of server events, for offline replay.
+ *
+ * An event log holds the subscription events received by a manager and the query
+ * responses it acted on (the information of new sink inputs, which the routing rules
+ * are matched against), in the order they were received and with their timestamps.
+ * manager_replay_events() feeds a log back through the event handling of a manager,
+ * so that an event storm seen in production (a USB hub reset, a misbehaving client
+ * creating hundreds of streams) can be reproduced and measured without the devices.
+ *
+ * The file starts with an event_log_header and is followed by records, each made of
+ * an event_log_record_header and its payload. Integers are stored in the byte order of
+ * the recording host.
+ *
+ *  - EVENT_LOG_EVENT payload: uint32 event type, uint32 object index.
+ *  - EVENT_LOG_SINK_INPUT payload: uint32 sink input index, uint32 sink index,
+ *    uint16 property count, then for every property a uint16 length and the bytes of
+ *    the key, and a uint16 length and the bytes of the value (no terminators).
+ *
+ * Only string properties are recorded, as they are the only ones the routing rules
+ * look at.
+ *
+ * Recording can also be turned on without code changes by setting the EASYPULSE_RECORD
+ * environment variable to a file path: recording starts in manager_create() and the
+ * log is closed by manager_cleanup().
+ */
+
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <pulse/pulseaudio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EVENT_LOG_MAGIC "EPEV"
+#define EVENT_LOG_VERSION 1
+#define EVENT_LOG_MAX_PAYLOAD 65535   // Properties that do not fit are left out of the record.
+
+//Kind of a record.
+typedef enum event_log_kind {
+    EVENT_LOG_EVENT = 1,        // Subscription event.
+    EVENT_LOG_SINK_INPUT = 2    // Information of a sink input, as returned by the server.
+} event_log_kind;
+
+//Header at the start of the file.
+typedef struct event_log_header {
+    char magic[4];              // EVENT_LOG_MAGIC.
+    uint16_t version;           // EVENT_LOG_VERSION.
+    uint16_t header_size;       // sizeof(event_log_header), records start right after.
+    uint64_t start_usec;        // Wall clock time of the start of the recording (µs since the epoch).
+} event_log_header;
+
+//Header of every record.
+typedef struct event_log_record_header {
+    uint32_t delta_usec;        // Time since the previous record (saturates at UINT32_MAX).
+    uint8_t kind;               // event_log_kind.
+    uint8_t reserved;
+    uint16_t length;            // Size of the payload following the header.
+} event_log_record_header;
+
+//A record read back from a log.
+typedef struct event_log_record {
+    event_log_kind kind;
+    uint64_t time_usec;                 // Time since the start of the recording.
+    pa_subscription_event_type_t event; // EVENT_LOG_EVENT: facility and type of the event.
+    uint32_t index;                     // Index of the object (event) or of the sink input.
+    uint32_t sink;                      // EVENT_LOG_SINK_INPUT: sink the stream is playing to.
+    const pa_proplist *proplist;        // EVENT_LOG_SINK_INPUT: string properties, owned by the reader.
+} event_log_record;
+
+typedef struct event_recorder event_recorder;
+typedef struct event_reader event_reader;
+
+event_recorder *event_recorder_open(const char *path);                  //Creates a log file. Returns NULL on failure.
+void event_recorder_event(event_recorder *recorder,
+pa_subscription_event_type_t event, uint32_t index);                    //Appends a subscription event.
+void event_recorder_sink_input(event_recorder *recorder,
+const pa_sink_input_info *info);                                        //Appends the information of a sink input.
+bool event_recorder_close(event_recorder *recorder);                    //Flushes and closes the file. Returns false if writes failed.
+
+event_reader *event_reader_open(const char *path);                      //Loads a log file. Returns NULL on failure.
+bool event_reader_next(event_reader *reader, event_log_record *record); //Reads the next record. Returns false at the end.
+void event_reader_rewind(event_reader *reader);                         //Goes back to the first record.
+bool event_reader_truncated(const event_reader *reader);               //Whether reading stopped on a damaged record.
+void event_reader_close(event_reader *reader);                          //Frees the reader.
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
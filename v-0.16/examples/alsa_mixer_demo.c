@@ -0,0 +1,66 @@
+/**
+ * @file alsa_mixer_demo.c
+ * @brief Demo Program for the direct ALSA mixer control path.
+ *
+ * This program opens the hardware mixer of the first output device, prints its volume
+ * and mute state, optionally sets the volume given on the command line, and then
+ * prints the changes made by other programs (alsamixer, hardware buttons, the sound
+ * server) for ten seconds.
+ *
+ * Usage: alsa_mixer_demo [volume]
+ */
+
+#include "../alsa_mixer.h"
+#include "../easypulse_core.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void print_change(alsa_mixer *mixer, int volume, bool mute, void *userdata) {
+    (void) mixer;
+    (void) userdata;
+
+    printf("Changed: volume %d%%, %s\n", volume, mute ? "muted" : "unmuted");
+}
+
+int main(int argc, char *argv[]) {
+    pulseaudio_manager *manager = manager_create();
+    if (!manager) {
+        fprintf(stderr, "Failed to initialize PulseAudio manager\n");
+        return 1;
+    }
+    if (manager->output_count == 0) {
+        fprintf(stderr, "No output device.\n");
+        manager_cleanup(manager);
+        return 1;
+    }
+
+    alsa_mixer *mixer = alsa_mixer_open_device(&manager->outputs[0], true);
+    if (!mixer) {
+        fprintf(stderr, "%s has no hardware mixer.\n", manager->outputs[0].name);
+        manager_cleanup(manager);
+        return 1;
+    }
+
+    int volume;
+    bool mute = false;
+    if (alsa_mixer_get_volume(mixer, &volume) == 0) {
+        alsa_mixer_get_mute(mixer, &mute);
+        printf("%s, element %s: volume %d%%, %s\n", manager->outputs[0].name, alsa_mixer_element_name(mixer),
+               volume, mute ? "muted" : "unmuted");
+    }
+
+    if (argc > 1 && alsa_mixer_set_volume(mixer, atoi(argv[1])) == 0) {
+        printf("Volume set to %d%%\n", atoi(argv[1]));
+    }
+
+    alsa_mixer_set_callback(mixer, print_change, NULL);
+    for (int i = 0; i < 10; ++i) {
+        if (alsa_mixer_wait(mixer, 1000) < 0) {
+            break;
+        }
+    }
+
+    alsa_mixer_close(mixer);
+    manager_cleanup(manager);
+    return 0;
+}
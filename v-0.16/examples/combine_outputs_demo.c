@@ -0,0 +1,62 @@
+/**
+ * @file combine_outputs_demo.c
+ * @brief Demo Program for playing to several output devices at once.
+ *
+ * This program lists the output devices, combines the two devices selected by the
+ * user into a single output, makes it the default output and prints its latency.
+ * The combined output is removed when the user presses Enter.
+ */
+
+#include "../easypulse_core.h"
+#include <stdio.h>
+
+int main(void) {
+    pulseaudio_manager *manager = manager_create();
+    if (!manager) {
+        fprintf(stderr, "Failed to initialize PulseAudio manager\n");
+        return 1;
+    }
+
+    printf("Output devices:\n");
+    for (uint32_t i = 0; i < manager->output_count; ++i) {
+        printf("%u: %s (%s)\n", i + 1, manager->outputs[i].name,
+               manager->outputs[i].alsa_id ? manager->outputs[i].alsa_id : "no ALSA device");
+    }
+
+    uint32_t first, second;
+    printf("\nDevices to combine (e.g. 1 2): ");
+    if (scanf("%u %u", &first, &second) != 2 || first < 1 || second < 1 ||
+        first > manager->output_count || second > manager->output_count || first == second) {
+        fprintf(stderr, "Invalid devices.\n");
+        manager_cleanup(manager);
+        return 1;
+    }
+
+    uint32_t devices[2] = { first - 1, second - 1 };
+    int combined = manager_create_combined_output(manager, devices, 2, NULL, NULL);
+    if (combined < 0) {
+        fprintf(stderr, "Failed to create the combined output\n");
+        manager_cleanup(manager);
+        return 1;
+    }
+
+    const combined_output *info = manager_get_combined_output(manager, (uint32_t) combined);
+    printf("Created %s (module %u), shared clock: %s, adjust_time: %d\n", info->code,
+           info->module_index, info->shared_clock ? "yes" : "no", info->adjust_time);
+
+    manager_switch_default_output(manager, (uint32_t) combined);
+
+    pa_usec_t latency, configured_latency;
+    if (manager_get_output_latency(manager, (uint32_t) combined, &latency, &configured_latency) == 0) {
+        printf("Latency: %llu usec (configured: %llu usec)\n",
+               (unsigned long long) latency, (unsigned long long) configured_latency);
+    }
+
+    printf("Press Enter to remove the combined output...");
+    getchar();
+    getchar();
+
+    manager_destroy_combined_output(manager, (uint32_t) combined);
+    manager_cleanup(manager);
+    return 0;
+}
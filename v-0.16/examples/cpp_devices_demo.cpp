@@ -0,0 +1,54 @@
+/**
+ * @file cpp_devices_demo.cpp
+ * @brief Demo Program for the C++ layer (easypulse.hpp).
+ *
+ * Prints the devices with their channels and profiles, then the playback streams with
+ * their application, without copying a single string and without any cleanup call:
+ * the manager and the stream list are freed by their owners.
+ */
+
+#include "../easypulse.hpp"
+#include <cstdio>
+#include <string_view>
+
+static void print(std::string_view text) {
+    std::fwrite(text.data(), 1, text.size(), stdout);
+}
+
+static void print_devices(const char *kind, easypulse::device_range devices, std::string_view default_code) {
+    for (easypulse::device_view device : devices) {
+        std::printf("%c %s %u: ", device.code() == default_code ? '*' : ' ', kind, device.index());
+        print(device.name());
+        std::printf(", volume %d%%%s\n", device.volume(), device.mute() ? ", muted" : "");
+
+        for (std::size_t channel = 0; channel < device.channel_count(); ++channel) {
+            std::printf("      channel %zu: ", channel);
+            print(device.channel_name(channel));
+            std::printf("\n");
+        }
+        for (easypulse::profile_view profile : device.profiles()) {
+            std::printf("      profile ");
+            print(profile.name());
+            std::printf("%s\n", device.active_profile() && profile.name() == device.active_profile().name() ? " (active)" : "");
+        }
+    }
+}
+
+int main() {
+    easypulse::manager manager = easypulse::manager::create();
+    if (!manager) {
+        std::fprintf(stderr, "Failed to initialize PulseAudio manager\n");
+        return 1;
+    }
+
+    print_devices("Output", manager.outputs(), manager.default_output());
+    print_devices("Input", manager.inputs(), manager.default_input());
+
+    easypulse::output_streams streams = manager.sink_inputs();
+    for (const easypulse::output_stream_view &stream : streams) {
+        std::printf("  Stream %u on output %u: ", stream.index(), stream.device());
+        print(stream.property(PA_PROP_APPLICATION_NAME));
+        std::printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+/**
+ * @file device_prefs_demo.c
+ * @brief Demo Program for the per-device preference store.
+ *
+ * "save" adds the current settings of every device and card to a store file (the
+ * devices already saved and not plugged in are kept), "watch" gives the saved settings
+ * back to every device that appears during the given number of seconds, and "show"
+ * prints the content of a store file. Save with a USB interface plugged in and set up,
+ * unplug it, start watch and plug it back in.
+ *
+ * Usage: device_prefs_demo save|watch|show <file> [seconds]
+ */
+
+#include "../easypulse_core.h"
+#include "../scene.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int save(pulseaudio_manager *manager, const char *path) {
+    // Updates the store, so that the devices unplugged now keep their settings
+    device_prefs *prefs = access(path, F_OK) == 0 ? device_prefs_load(path) : device_prefs_create();
+    if (!prefs) {
+        return 1;
+    }
+
+    mixer_scene *scene = scene_capture(manager);
+    bool saved = scene && scene_store_device_prefs(scene, prefs) && device_prefs_save(prefs, path);
+    if (saved) {
+        const device_prefs_header *header = device_prefs_get_header(prefs);
+        printf("Saved %u devices and cards to %s (%u bytes).\n", header->entry_count, path, header->size);
+    } else {
+        fprintf(stderr, "Failed to save the device settings\n");
+    }
+    scene_free(scene);
+    device_prefs_free(prefs);
+    return saved ? 0 : 1;
+}
+
+static int watch(pulseaudio_manager *manager, const char *path, int seconds) {
+    device_prefs *prefs = device_prefs_load(path);
+    if (!prefs || !manager_set_device_prefs(manager, prefs)) {
+        return 1;
+    }
+
+    printf("Giving the saved settings back to the devices that appear, for %d s.\n", seconds);
+    sleep((unsigned) seconds);
+    return 0;
+}
+
+static int show(const char *path) {
+    device_prefs *prefs = device_prefs_load(path);
+    if (!prefs) {
+        return 1;
+    }
+
+    static const char *const kinds[] = { "Output", "Input", "Card" };
+    const device_prefs_header *header = device_prefs_get_header(prefs);
+    const device_prefs_entry *entries = device_prefs_get_entries(prefs);
+
+    for (uint32_t i = 0; i < header->entry_count; ++i) {
+        const device_prefs_entry *entry = &entries[i];
+        printf("%c %-6s " MANAGER_STABLE_ID_FORMAT ":", entry->flags & DEVICE_PREFS_DEFAULT ? '*' : ' ',
+               kinds[entry->kind], entry->id);
+
+        pa_cvolume volume;
+        if (device_prefs_get_volume(prefs, entry, &volume)) {
+            for (uint8_t channel = 0; channel < volume.channels; ++channel) {
+                printf(" %u%%", (unsigned) ((uint64_t) volume.values[channel] * 100 / PA_VOLUME_NORM));
+            }
+        }
+        if (entry->flags & DEVICE_PREFS_MUTE_SAVED) {
+            printf("%s", entry->flags & DEVICE_PREFS_MUTED ? " muted" : "");
+        }
+        const char *port = device_prefs_get_string(prefs, entry->port);
+        const char *profile = device_prefs_get_string(prefs, entry->profile);
+        printf("%s%s%s%s\n", port ? " port " : "", port ? port : "", profile ? " profile " : "",
+               profile ? profile : "");
+    }
+
+    device_prefs_free(prefs);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3 || (strcmp(argv[1], "save") != 0 && strcmp(argv[1], "watch") != 0 &&
+                     strcmp(argv[1], "show") != 0)) {
+        fprintf(stderr, "Usage: %s save|watch|show <file> [seconds]\n", argv[0]);
+        return 1;
+    }
+    if (strcmp(argv[1], "show") == 0) {
+        return show(argv[2]);
+    }
+
+    pulseaudio_manager *manager = manager_create();
+    if (!manager) {
+        fprintf(stderr, "Failed to initialize PulseAudio manager\n");
+        return 1;
+    }
+
+    int result = strcmp(argv[1], "save") == 0 ? save(manager, argv[2])
+                                              : watch(manager, argv[2], argc > 3 ? atoi(argv[3]) : 60);
+    manager_cleanup(manager);
+    return result;
+}
@@ -0,0 +1,53 @@
+/**
+ * @file fallback_chain_demo.c
+ * @brief Demo Program for the output fallback chain.
+ *
+ * Sets the outputs given on the command line as the fallback chain, by priority, and
+ * waits for two minutes. Unplug the default output meanwhile (a USB interface): the
+ * first output of the chain still present becomes the default one at once and the
+ * streams follow. The recovery times are printed at the end.
+ *
+ * Usage: fallback_chain_demo <output code>...
+ */
+
+#include "../easypulse_core.h"
+#include "../easypulse_metrics.h"
+#include <stdio.h>
+#include <unistd.h>
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <output code>...\n", argv[0]);
+        return 1;
+    }
+
+    metrics_enable(true);
+
+    pulseaudio_manager *manager = manager_create();
+    if (!manager) {
+        fprintf(stderr, "Failed to initialize PulseAudio manager\n");
+        return 1;
+    }
+
+    if (!manager_set_output_fallbacks(manager, (const char *const *) &argv[1], (uint32_t) (argc - 1))) {
+        fprintf(stderr, "Failed to set the fallback chain\n");
+        manager_cleanup(manager);
+        return 1;
+    }
+    printf("Fallback chain of %d output(s) set, unplug the default output.\n", argc - 1);
+    sleep(120);
+
+    metrics_snapshot snapshot;
+    metrics_snapshot_take(&snapshot);
+    const metrics_stat *recovery = &snapshot.stats[METRIC_FALLBACK_RECOVERY];
+    if (recovery->count > 0) {
+        printf("%llu recoveries (%llu with failures), median %.3f ms, max %.3f ms.\n",
+               (unsigned long long) recovery->count, (unsigned long long) recovery->errors,
+               metrics_percentile(recovery, 50.0) / 1e6, metrics_percentile(recovery, 100.0) / 1e6);
+    } else {
+        printf("The default output was not lost.\n");
+    }
+
+    manager_cleanup(manager);
+    return 0;
+}
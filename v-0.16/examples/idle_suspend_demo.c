@@ -0,0 +1,59 @@
+/**
+ * @file idle_suspend_demo.c
+ * @brief Demo Program for the idle suspend policy.
+ *
+ * Suspends the devices that stay without streams for the given number of seconds, and
+ * resumes the default output every minute, keeping it awake for 2 s as a planned
+ * playback would. Start and stop a player meanwhile and watch "pactl list short
+ * sinks": the output is suspended a few seconds after the player stops, and resumed as
+ * soon as it starts again.
+ *
+ * Usage: idle_suspend_demo [timeout in seconds] [run time in seconds]
+ */
+
+#include "../easypulse_core.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int main(int argc, char *argv[]) {
+    int timeout = argc > 1 ? atoi(argv[1]) : 5;
+    int run_time = argc > 2 ? atoi(argv[2]) : 180;
+
+    if (timeout <= 0 || run_time <= 0) {
+        fprintf(stderr, "Usage: %s [timeout in seconds] [run time in seconds]\n", argv[0]);
+        return 1;
+    }
+
+    pulseaudio_manager *manager = manager_create();
+    if (!manager) {
+        fprintf(stderr, "Failed to initialize PulseAudio manager\n");
+        return 1;
+    }
+
+    if (!manager_start_idle_suspend(manager, (pa_usec_t) timeout * PA_USEC_PER_SEC)) {
+        fprintf(stderr, "Failed to start the idle suspend policy\n");
+        manager_cleanup(manager);
+        return 1;
+    }
+    printf("Suspending devices idle for %d s, for %d s.\n", timeout, run_time);
+
+    for (int elapsed = 0; elapsed < run_time; elapsed += 60) {
+        sleep(run_time - elapsed < 60 ? run_time - elapsed : 60);
+
+        for (uint32_t i = 0; i < manager->output_count; ++i) {
+            const pulseaudio_device *output = &manager->outputs[i];
+            if (manager->active_output_device && strcmp(output->code, manager->active_output_device) == 0) {
+                // Kept awake for 2 s, as if a sound was about to be played
+                bool resumed = manager_resume_and_hold_output(manager, output->index, 2 * PA_USEC_PER_SEC);
+                printf("Resumed %s: %s\n", output->name, resumed ? "ok" : "failed");
+            }
+        }
+    }
+
+    // Resumes what the policy suspended
+    manager_stop_idle_suspend(manager);
+    manager_cleanup(manager);
+    return 0;
+}
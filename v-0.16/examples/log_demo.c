@@ -0,0 +1,49 @@
+/**
+ * @file log_demo.c
+ * @brief Demo Program for the leveled logging of the library.
+ *
+ * This program installs its own log sink, which prefixes every message with its level
+ * and counts them, and then performs a few manager operations at two runtime levels:
+ * the default one (warnings and errors only) and the info level. One of the
+ * operations is given an invalid volume so that an error is written.
+ *
+ * Debug messages (such as "Volume set successfully.") only show up when the library is
+ * built with -DLOG_COMPILE_LEVEL=LOG_LEVEL_DEBUG and EASYPULSE_LOG_LEVEL=debug is set.
+ */
+
+#include "../easypulse_core.h"
+#include "../easypulse_log.h"
+#include <stdio.h>
+
+static void print_message(log_level level, const char *function, const char *message, void *userdata) {
+    unsigned *counts = (unsigned *) userdata;
+    ++counts[level];
+    printf("  [%s] %s(): %s\n", log_level_name(level), function, message);
+}
+
+int main(void) {
+    unsigned counts[LOG_LEVEL_DEBUG + 1] = {0};
+    log_set_sink(print_message, counts);
+
+    pulseaudio_manager *manager = manager_create();
+    if (!manager) {
+        fprintf(stderr, "Failed to initialize PulseAudio manager\n");
+        return 1;
+    }
+
+    printf("Runtime level: %s\n", log_level_name(log_get_level()));
+    manager_set_master_volume(manager, manager->outputs[0].index, 150);
+    manager_set_master_volume(manager, manager->outputs[0].index, 50);
+    log_flush();
+
+    log_set_level(LOG_LEVEL_INFO);
+    printf("Runtime level: %s\n", log_level_name(log_get_level()));
+    manager_set_master_volume(manager, manager->outputs[0].index, 150);
+    manager_set_master_volume(manager, manager->outputs[0].index, 50);
+
+    manager_cleanup(manager);
+
+    printf("Messages: %u errors, %u warnings, %u info, %u debug\n", counts[LOG_LEVEL_ERROR],
+           counts[LOG_LEVEL_WARN], counts[LOG_LEVEL_INFO], counts[LOG_LEVEL_DEBUG]);
+    return 0;
+}
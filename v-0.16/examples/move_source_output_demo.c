@@ -0,0 +1,68 @@
+/**
+ * @file move_source_output_demo.c
+ * @brief Demo Program for moving recording streams between input devices.
+ *
+ * This program lists the recording streams (source outputs) and the input devices
+ * (sources), then moves every recording stream to the input device selected by the
+ * user in a single batch.
+ */
+
+#include "../easypulse_core.h"
+#include "../system_query.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(void) {
+    pulseaudio_manager *manager = manager_create();
+    if (!manager) {
+        fprintf(stderr, "Failed to initialize PulseAudio manager\n");
+        return 1;
+    }
+
+    input_stream_list *streams = get_input_streams(manager->context);
+    if (!streams) {
+        fprintf(stderr, "Failed to list source outputs\n");
+        manager_cleanup(manager);
+        return 1;
+    }
+
+    printf("Recording streams:\n");
+    for (uint32_t i = 0; i < streams->num_inputs; ++i) {
+        printf("ID: %u, Name: %s, Source: %u\n", streams->outputs[i].index,
+               streams->outputs[i].name, streams->outputs[i].parent_index);
+    }
+
+    printf("\nInput devices:\n");
+    for (uint32_t i = 0; i < manager->input_count; ++i) {
+        printf("%u: %s\n", i + 1, manager->inputs[i].name);
+    }
+
+    uint32_t choice;
+    printf("\nMove all recording streams to device: ");
+    if (scanf("%u", &choice) != 1 || choice < 1 || choice > manager->input_count) {
+        fprintf(stderr, "Invalid device.\n");
+        input_streams_cleanup(streams);
+        manager_cleanup(manager);
+        return 1;
+    }
+
+    uint32_t *indices = calloc(streams->num_inputs ? streams->num_inputs : 1, sizeof(uint32_t));
+    if (!indices) {
+        input_streams_cleanup(streams);
+        manager_cleanup(manager);
+        return 1;
+    }
+    for (uint32_t i = 0; i < streams->num_inputs; ++i) {
+        indices[i] = streams->outputs[i].index;
+    }
+
+    int moved = manager_move_source_outputs(manager, indices, streams->num_inputs,
+                                            manager->inputs[choice - 1].index);
+    printf("Moved %d of %u recording stream(s) to %s\n", moved, streams->num_inputs,
+           manager->inputs[choice - 1].name);
+
+    free(indices);
+    input_streams_cleanup(streams);
+    manager_cleanup(manager);
+    return 0;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file peak_meter_demo.c
+ * @brief Demo Program for the peak meters of the manager.
+ *
+ * This program creates a manager, prints the devices it found and then
+ * the peak level of the default output and input ten times per second, for five
+ * seconds.
+ */
+
+#include "../peak_meter.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static uint32_t find_device(const pulseaudio_device *devices, uint32_t count, const char *code) {
+    for (uint32_t i = 0; i < count; ++i) {
+        if (code && strcmp(devices[i].code, code) == 0) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+static void print_bar(const char *label, int result, float peak) {
+    char bar[41];
+    int length = result == 0 ? (int) (peak * 40.0f) : 0;
+
+    memset(bar, ' ', sizeof(bar) - 1);
+    memset(bar, '#', (size_t) length);
+    bar[sizeof(bar) - 1] = '\0';
+    printf("%s [%s] %s", label, bar, result == 0 ? "" : "(no meter) ");
+}
+
+int main(void) {
+    pulseaudio_manager *manager = manager_create();
+    if (!manager) {
+        fprintf(stderr, "Failed to initialize the manager\n");
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < manager->output_count; ++i) {
+        printf("Output %u: %s (volume %d%%%s)\n", manager->outputs[i].index, manager->outputs[i].name,
+               manager->outputs[i].master_volume, manager->outputs[i].mute ? ", muted" : "");
+    }
+    for (uint32_t i = 0; i < manager->input_count; ++i) {
+        printf("Input %u: %s (volume %d%%%s)\n", manager->inputs[i].index, manager->inputs[i].name,
+               manager->inputs[i].master_volume, manager->inputs[i].mute ? ", muted" : "");
+    }
+
+    if (manager->output_count == 0 || manager->input_count == 0) {
+        manager_cleanup(manager);
+        return 0;
+    }
+
+    uint32_t output = find_device(manager->outputs, manager->output_count, manager->active_output_device);
+    uint32_t input = find_device(manager->inputs, manager->input_count, manager->active_input_device);
+
+    for (int i = 0; i < 50; ++i) {
+        float peak = 0.0f;
+        int result = manager_get_output_peak(manager, output, &peak);
+        print_bar("out", result, peak);
+        result = manager_get_input_peak(manager, input, &peak);
+        print_bar("in", result, peak);
+        printf("\r");
+        fflush(stdout);
+        usleep(100000);
+    }
+    printf("\n");
+
+    manager_cleanup(manager);
+    return 0;
+}
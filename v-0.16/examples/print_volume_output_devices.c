@@ -41,8 +41,6 @@ int main() {
             continue;
         }
 
-        char **channel_names = NULL;
-
         printf("   Device %u: %s\n", i, sinks[i]->description);
 
         // Get the ALSA ID for the sink
@@ -53,16 +51,12 @@ int main() {
         int sample_rate = get_output_sample_rate(alsa_id, sinks[i]);
         printf("\tSample Rate: %d Hz\n", sample_rate);
 
-        channel_names = get_output_channel_names(sinks[i]->name, sinks[i]->channel_map.channels);
-
         // Iterate through each channel
         for (uint8_t ch = 0; ch < sinks[i]->channel_map.channels; ++ch) {
             pa_volume_t volume = get_channel_volume(sinks[i], ch);
             float volume_percent = (float)volume / PA_VOLUME_NORM * 100;
-            printf("\tChannel %u name: %s, volume: %.2f%%\n", (ch + 1), channel_names[ch], volume_percent);
-            free(channel_names[ch]);
+            printf("\tChannel %u name: %s, volume: %.2f%%\n", (ch + 1), channel_position_name(sinks[i]->channel_map.map[ch]), volume_percent);
         }
-        free(channel_names);
     }
 
     // Cleanup
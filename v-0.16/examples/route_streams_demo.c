@@ -0,0 +1,67 @@
+/**
+ * @file route_streams_demo.c
+ * @brief Demonstrates rule-based routing of playback streams.
+ *
+ * This program lists the available output devices, asks the user for an application
+ * name and a target device, and installs a routing rule. Every stream of that
+ * application is then moved to the chosen device as soon as it appears, until the
+ * user presses Enter.
+ *
+ * Example:
+ * ```
+ * 1: Built-in Audio Analog Stereo
+ * 2: USB Headset
+ * Application name to route: Firefox
+ * Target device: 2
+ * Routing 'Firefox' streams to USB Headset. Press Enter to stop.
+ * ```
+ */
+
+#include "../easypulse_core.h"
+#include <stdio.h>
+#include <string.h>
+
+int main(void) {
+    pulseaudio_manager *manager = manager_create();
+    if (!manager) {
+        fprintf(stderr, "Failed to create the PulseAudio manager.\n");
+        return 1;
+    }
+
+    printf("\n***STREAM ROUTING DEMO***\n\nAvailable output devices:\n");
+    for (uint32_t i = 0; i < manager->output_count; ++i) {
+        printf("%u: %s\n", i + 1, manager->outputs[i].name);
+    }
+
+    char application[128];
+    printf("\nApplication name to route: ");
+    if (!fgets(application, sizeof(application), stdin)) {
+        manager_cleanup(manager);
+        return 1;
+    }
+    application[strcspn(application, "\n")] = '\0';
+
+    uint32_t index;
+    printf("Target device: ");
+    if (scanf("%u", &index) != 1 || index < 1 || index > manager->output_count) {
+        fprintf(stderr, "Invalid device.\n");
+        manager_cleanup(manager);
+        return 1;
+    }
+    getchar(); // Consume the newline left by scanf
+
+    route_condition condition = { PA_PROP_APPLICATION_NAME, ROUTE_MATCH_EXACT, application };
+    if (manager_add_routing_rule(manager, &condition, 1, manager->outputs[index - 1].code) < 0) {
+        fprintf(stderr, "Failed to add routing rule.\n");
+        manager_cleanup(manager);
+        return 1;
+    }
+
+    int moved = manager_apply_routing_rules(manager);
+    printf("Routing '%s' streams to %s (%d already moved). Press Enter to stop.\n",
+           application, manager->outputs[index - 1].name, moved);
+    getchar();
+
+    manager_cleanup(manager);
+    return 0;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file scene_demo.c
+ * @brief Demo Program for the mixer scenes.
+ *
+ * "save" captures the mixer state into a scene file, "restore" brings the mixer back to
+ * it and tells how many operations it took, "show" prints the content of a scene file.
+ * Save a scene per room preset, then switch between them with restore.
+ *
+ * Usage: scene_demo save|restore|show <file>
+ */
+
+#include "../easypulse_core.h"
+#include "../scene.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+static int save(pulseaudio_manager *manager, const char *path) {
+    mixer_scene *scene = scene_capture(manager);
+    if (!scene) {
+        fprintf(stderr, "Failed to capture the mixer state\n");
+        return 1;
+    }
+
+    bool saved = scene_save(scene, path);
+    if (saved) {
+        const scene_header *header = scene_get_header(scene);
+        printf("Saved %u devices, %u cards and %u streams to %s (%u bytes).\n", header->device_count,
+               header->card_count, header->stream_count, path, header->size);
+    }
+    scene_free(scene);
+    return saved ? 0 : 1;
+}
+
+static int restore(pulseaudio_manager *manager, const char *path) {
+    mixer_scene *scene = scene_load(path);
+    if (!scene) {
+        return 1;
+    }
+
+    scene_restore_stats stats;
+    int sent = scene_restore(manager, scene, &stats);
+    scene_free(scene);
+    if (sent < 0) {
+        fprintf(stderr, "Failed to restore the scene\n");
+        return 1;
+    }
+
+    printf("%u operations (%u failed) in %u round trips, %.3f ms.\n", stats.operations, stats.failed,
+           stats.round_trips, stats.elapsed_ns / 1e6);
+    if (stats.missing > 0) {
+        printf("%u devices, cards or streams of the scene are not present.\n", stats.missing);
+    }
+    return stats.failed > 0 ? 1 : 0;
+}
+
+static int show(const char *path) {
+    mixer_scene *scene = scene_load(path);
+    if (!scene) {
+        return 1;
+    }
+
+    const scene_header *header = scene_get_header(scene);
+    const scene_device *devices = scene_get_devices(scene);
+    const scene_card *cards = scene_get_cards(scene);
+    const scene_stream *streams = scene_get_streams(scene);
+    const uint32_t *volumes = scene_get_volumes(scene);
+
+    for (uint32_t i = 0; i < header->device_count; ++i) {
+        const scene_device *device = &devices[i];
+        uint64_t default_id = device->output ? header->default_output : header->default_input;
+        printf("%c %s " MANAGER_STABLE_ID_FORMAT ":", device->id == default_id ? '*' : ' ',
+               device->output ? "Output" : "Input", device->id);
+        for (uint8_t channel = 0; channel < device->channels; ++channel) {
+            printf(" %u%%", (unsigned) ((uint64_t) volumes[device->volumes + channel] * 100 / PA_VOLUME_NORM));
+        }
+        const char *port = scene_get_string(scene, device->port);
+        printf("%s%s%s\n", device->mute ? ", muted" : "", port ? ", port " : "", port ? port : "");
+    }
+    for (uint32_t i = 0; i < header->card_count; ++i) {
+        const char *profile = scene_get_string(scene, cards[i].profile);
+        printf("  Card " MANAGER_STABLE_ID_FORMAT ": %s\n", cards[i].id, profile ? profile : "(no profile)");
+    }
+    for (uint32_t i = 0; i < header->stream_count; ++i) {
+        printf("  %s stream " MANAGER_STABLE_ID_FORMAT " on " MANAGER_STABLE_ID_FORMAT "\n",
+               streams[i].output ? "Playback" : "Recording", streams[i].id, streams[i].device);
+    }
+
+    scene_free(scene);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s save|restore|show <file>\n", argv[0]);
+        return 1;
+    }
+    if (strcmp(argv[1], "show") == 0) {
+        return show(argv[2]);
+    }
+
+    pulseaudio_manager *manager = manager_create();
+    if (!manager) {
+        fprintf(stderr, "Failed to initialize PulseAudio manager\n");
+        return 1;
+    }
+
+    int result;
+    if (strcmp(argv[1], "save") == 0) {
+        result = save(manager, argv[2]);
+    } else if (strcmp(argv[1], "restore") == 0) {
+        result = restore(manager, argv[2]);
+    } else {
+        fprintf(stderr, "Unknown command: %s\n", argv[1]);
+        result = 1;
+    }
+
+    manager_cleanup(manager);
+    return result;
+}
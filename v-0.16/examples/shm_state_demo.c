@@ -0,0 +1,83 @@
+/**
+ * @file shm_state_demo.c
+ * @brief Demo Program for the mixer state published in shared memory.
+ *
+ * Started with "publish", this program creates a manager that publishes the state of
+ * the devices for a minute. Started without arguments (in other terminals, as many
+ * times as wanted), it maps the published state and prints it every time it changes,
+ * without ever connecting to the sound server.
+ *
+ * Usage: shm_state_demo [publish]
+ */
+
+#include "../easypulse_core.h"
+#include "../shm_state.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static int publish(void) {
+    pulseaudio_manager *manager = manager_create();
+    if (!manager) {
+        fprintf(stderr, "Failed to initialize PulseAudio manager\n");
+        return 1;
+    }
+
+    if (!manager_start_publishing(manager, SHM_STATE_DEFAULT_NAME)) {
+        fprintf(stderr, "Failed to publish the state\n");
+        manager_cleanup(manager);
+        return 1;
+    }
+
+    printf("Publishing the state as %s for a minute.\n", SHM_STATE_DEFAULT_NAME);
+    sleep(60);
+
+    manager_cleanup(manager);
+    return 0;
+}
+
+static void print_devices(const char *kind, const shm_state_device *devices, uint32_t count, uint32_t active) {
+    for (uint32_t i = 0; i < count && i < SHM_STATE_MAX_DEVICES; ++i) {
+        printf("%c %s %u: %s, volume %d%%%s\n", i == active ? '*' : ' ', kind, devices[i].index, devices[i].name,
+               devices[i].volume, devices[i].mute ? ", muted" : "");
+    }
+}
+
+static int watch(void) {
+    shm_state_reader *reader = shm_state_open(SHM_STATE_DEFAULT_NAME);
+    if (!reader) {
+        fprintf(stderr, "Nothing is published, start \"shm_state_demo publish\" first.\n");
+        return 1;
+    }
+
+    // The sequence is a load from the mapping: polling it costs no system call
+    uint32_t last = 0;
+    for (int i = 0; i < 600; ++i, usleep(100000)) {
+        uint32_t sequence = shm_state_sequence(reader);
+        if (sequence == last) {
+            continue;
+        }
+        last = sequence;
+
+        shm_state_snapshot state;
+        if (!shm_state_read(reader, &state)) {
+            continue;
+        }
+        printf("Update %llu%s\n", (unsigned long long) state.generation, state.online ? "" : " (publisher stopped)");
+        print_devices("Output", state.outputs, state.output_count, state.default_output);
+        print_devices("Input", state.inputs, state.input_count, state.default_input);
+        if (!state.online) {
+            break;
+        }
+    }
+
+    shm_state_close(reader);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "publish") == 0) {
+        return publish();
+    }
+    return watch();
+}
@@ -0,0 +1,82 @@
+/**
+ * @file stream_profile_demo.c
+ * @brief Demo Program for the buffer profiles of the library-owned streams.
+ *
+ * Plays a quiet square wave on the default output for two seconds with the profile
+ * given on the command line, prints the buffer attributes the server granted, then
+ * switches the stream to the bulk profile and plays two more seconds.
+ *
+ * Usage: stream_profile_demo [ultra-low|interactive|bulk]
+ */
+
+#include "../audio_stream.h"
+#include <stdio.h>
+#include <string.h>
+
+#define RATE 48000
+#define CHANNELS 2
+
+static void print_attr(const audio_stream *stream, const pa_sample_spec *spec) {
+    const pa_buffer_attr *attr = audio_stream_buffer_attr(stream);
+    printf("%-12s tlength %u (%llu us), minreq %u (%llu us), prebuf %u, maxlength %u\n",
+           stream_profile_name(audio_stream_profile(stream)),
+           attr->tlength, (unsigned long long) pa_bytes_to_usec(attr->tlength, spec),
+           attr->minreq, (unsigned long long) pa_bytes_to_usec(attr->minreq, spec),
+           attr->prebuf, attr->maxlength);
+}
+
+// Writes seconds of a 440 Hz square wave at 1/16 of the full scale
+static bool play(audio_stream *stream, int seconds) {
+    int16_t frames[RATE / 100 * CHANNELS];
+    uint32_t t = 0;
+
+    for (int block = 0; block < seconds * 100; ++block) {
+        for (size_t i = 0; i < sizeof(frames) / sizeof(frames[0]); i += CHANNELS, ++t) {
+            int16_t sample = (t * 440 / (RATE / 2)) % 2 ? 2048 : -2048;
+            frames[i] = sample;
+            frames[i + 1] = sample;
+        }
+        if (!audio_stream_write(stream, frames, sizeof(frames))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    int profile = stream_profile_from_name(argc > 1 ? argv[1] : "interactive");
+    if (profile < 0) {
+        fprintf(stderr, "Usage: %s [ultra-low|interactive|bulk]\n", argv[0]);
+        return 1;
+    }
+
+    pulseaudio_manager *manager = manager_create();
+    if (!manager) {
+        fprintf(stderr, "Failed to initialize PulseAudio manager\n");
+        return 1;
+    }
+
+    pa_sample_spec spec = { PA_SAMPLE_S16LE, RATE, CHANNELS };
+    audio_stream *stream = audio_stream_open(manager, true, NULL, "stream_profile_demo", &spec,
+                                             (stream_buffer_profile) profile);
+    if (!stream) {
+        fprintf(stderr, "Failed to open the stream\n");
+        manager_cleanup(manager);
+        return 1;
+    }
+
+    print_attr(stream, &spec);
+    bool ok = play(stream, 2);
+
+    if (ok && audio_stream_set_profile(stream, STREAM_PROFILE_BULK)) {
+        print_attr(stream, &spec);
+        ok = play(stream, 2);
+    }
+    if (ok) {
+        audio_stream_drain(stream);
+    }
+
+    audio_stream_close(stream);
+    manager_cleanup(manager);
+    return ok ? 0 : 1;
+}
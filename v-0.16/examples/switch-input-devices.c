@@ -68,7 +68,7 @@ int main() {
     }
 
     // Switch to the selected device
-    if (manager_switch_default_input(manager, manager->inputs[choice - 1].index) == true) {
+    if (manager_switch_default_input(manager, choice - 1) == true) {
         printf("Successfully switched to the selected input device.\n");
     } else {
         fprintf(stderr, "Failed to switch to the selected input device.\n");
@@ -32,7 +32,7 @@ int main() {
     }
 
     // Switch to the selected device
-    if (manager_switch_default_output(manager, manager->outputs[choice - 1].index) == true) {
+    if (manager_switch_default_output(manager, choice - 1) == true) {
         printf("Successfully switched to the selected output device.\n");
     } else {
         fprintf(stderr, "Failed to switch to the selected output device.\n");
@@ -0,0 +1,74 @@
+/**
+ * @file virtual_sinks_demo.c
+ * @brief Demo Program for provisioning virtual output devices.
+ *
+ * This program creates the number of null sinks requested by the user in a single
+ * batch, prints the modules loaded in the server, and unloads the null sinks again
+ * in a single batch.
+ */
+
+#include "../easypulse_core.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(void) {
+    pulseaudio_manager *manager = manager_create();
+    if (!manager) {
+        fprintf(stderr, "Failed to initialize PulseAudio manager\n");
+        return 1;
+    }
+
+    uint32_t count;
+    printf("Number of virtual sinks to create: ");
+    if (scanf("%u", &count) != 1 || count < 1 || count > 1000) {
+        fprintf(stderr, "Invalid number.\n");
+        manager_cleanup(manager);
+        return 1;
+    }
+
+    module_request *requests = calloc(count, sizeof(module_request));
+    char (*arguments)[64] = calloc(count, sizeof(*arguments));
+    uint32_t *indices = calloc(count, sizeof(uint32_t));
+    if (!requests || !arguments || !indices) {
+        free(requests);
+        free(arguments);
+        free(indices);
+        manager_cleanup(manager);
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        snprintf(arguments[i], sizeof(arguments[i]), "sink_name=easypulse_virtual_%u", i + 1);
+        requests[i].name = "module-null-sink";
+        requests[i].arguments = arguments[i];
+    }
+
+    int loaded = manager_load_modules(manager, requests, count);
+    printf("Loaded %d of %u virtual sink(s)\n", loaded, count);
+
+    module_list *modules = manager_list_modules(manager);
+    if (modules) {
+        printf("\nLoaded modules:\n");
+        for (uint32_t i = 0; i < modules->count; ++i) {
+            printf("%u: %s %s\n", modules->modules[i].index, modules->modules[i].name,
+                   modules->modules[i].argument ? modules->modules[i].argument : "");
+        }
+        module_list_cleanup(modules);
+    }
+
+    uint32_t unload_count = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (requests[i].index != PA_INVALID_INDEX) {
+            indices[unload_count++] = requests[i].index;
+        }
+    }
+
+    int unloaded = manager_unload_modules(manager, indices, unload_count);
+    printf("\nUnloaded %d virtual sink(s)\n", unloaded);
+
+    free(requests);
+    free(arguments);
+    free(indices);
+    manager_cleanup(manager);
+    return 0;
+}
@@ -0,0 +1,556 @@
+/**
+ * @file json_writer.c
+ * @brief Implementation of the streaming JSON writer.
+ */
+
+#include "json_writer.h"
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define JSON_LEVEL(depth) (1ull << ((depth) - 1))
+
+//Bytes that cannot appear as is in a JSON string.
+static bool json_needs_escape(unsigned char c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+/**
+ * @brief Writes the buffer of a descriptor writer to its descriptor.
+ */
+static void json_flush(json_writer *writer) {
+    size_t done = 0;
+    while (done < writer->length) {
+        ssize_t written = write(writer->fd, writer->buffer + done, writer->length - done);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            writer->failed = true;
+            break;
+        }
+        done += (size_t) written;
+    }
+    writer->length = 0;
+}
+
+/**
+ * @brief Appends bytes to the output.
+ *
+ * A buffer writer that runs out of room stops copying but keeps counting the bytes in
+ * total.
+ */
+static void json_put(json_writer *writer, const char *data, size_t length) {
+    writer->total += length;
+    if (writer->failed || writer->truncated) {
+        return;
+    }
+
+    if (writer->fd < 0) {
+        // One byte is kept for the terminating NUL
+        if (writer->length + length >= writer->capacity) {
+            writer->truncated = true;
+            return;
+        }
+        memcpy(writer->buffer + writer->length, data, length);
+        writer->length += length;
+        return;
+    }
+
+    while (length > 0 && !writer->failed) {
+        if (writer->length == writer->capacity) {
+            json_flush(writer);
+            continue;
+        }
+        size_t chunk = writer->capacity - writer->length;
+        chunk = chunk < length ? chunk : length;
+        memcpy(writer->buffer + writer->length, data, chunk);
+        writer->length += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+static void json_put_char(json_writer *writer, char c) {
+    if (!writer->failed && !writer->truncated && writer->length + 1 < writer->capacity) {
+        writer->buffer[writer->length++] = c;
+        writer->total++;
+        return;
+    }
+    json_put(writer, &c, 1);
+}
+
+/**
+ * @brief Writes what separates a value from the previous one.
+ *
+ * @return false if a value cannot be written here (a member of an object without key).
+ */
+static bool json_begin_value(json_writer *writer) {
+    if (writer->depth == 0) {
+        return !writer->failed;
+    }
+
+    uint64_t level = JSON_LEVEL(writer->depth);
+    if (writer->in_object & level) {
+        if (!writer->after_key) {
+            writer->failed = true;
+            return false;
+        }
+        writer->after_key = false;
+    } else {
+        if (writer->has_items & level) {
+            json_put_char(writer, ',');
+        }
+        writer->has_items |= level;
+    }
+    return !writer->failed;
+}
+
+static void json_open(json_writer *writer, char c, bool object) {
+    if (!json_begin_value(writer)) {
+        return;
+    }
+    if (writer->depth == JSON_WRITER_MAX_DEPTH) {
+        writer->failed = true;
+        return;
+    }
+
+    json_put_char(writer, c);
+    uint64_t level = JSON_LEVEL(++writer->depth);
+    writer->has_items &= ~level;
+    writer->in_object = object ? writer->in_object | level : writer->in_object & ~level;
+}
+
+static void json_close(json_writer *writer, char c, bool object) {
+    if (writer->failed) {
+        return;
+    }
+    if (writer->depth == 0 || writer->after_key || ((writer->in_object & JSON_LEVEL(writer->depth)) != 0) != object) {
+        writer->failed = true;
+        return;
+    }
+    writer->depth--;
+    json_put_char(writer, c);
+}
+
+static void json_put_escaped(json_writer *writer, const char *value, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+
+    json_put_char(writer, '"');
+    size_t start = 0;
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char c = (unsigned char) value[i];
+        if (!json_needs_escape(c)) {
+            continue;
+        }
+
+        // Runs of plain characters are copied at once
+        json_put(writer, value + start, i - start);
+        start = i + 1;
+
+        char escape[6] = { '\\', (char) c };
+        size_t escape_length = 2;
+        switch (c) {
+            case '"': case '\\': break;
+            case '\b': escape[1] = 'b'; break;
+            case '\f': escape[1] = 'f'; break;
+            case '\n': escape[1] = 'n'; break;
+            case '\r': escape[1] = 'r'; break;
+            case '\t': escape[1] = 't'; break;
+            default:
+                memcpy(escape + 1, "u00", 3);
+                escape[4] = hex[c >> 4];
+                escape[5] = hex[c & 0xf];
+                escape_length = 6;
+                break;
+        }
+        json_put(writer, escape, escape_length);
+    }
+    json_put(writer, value + start, length - start);
+    json_put_char(writer, '"');
+}
+
+/**
+ * @brief Starts a writer on a buffer of the caller.
+ *
+ * The JSON is NUL-terminated by json_writer_finish().
+ *
+ * @param writer The writer to initialize.
+ * @param buffer The buffer.
+ * @param capacity Size of the buffer.
+ */
+void json_writer_init_buffer(json_writer *writer, char *buffer, size_t capacity) {
+    memset(writer, 0, sizeof(json_writer));
+    writer->buffer = buffer;
+    writer->capacity = capacity;
+    writer->fd = -1;
+    writer->failed = !buffer || capacity == 0;
+}
+
+/**
+ * @brief Starts a writer on a file descriptor.
+ *
+ * @param writer The writer to initialize.
+ * @param fd The descriptor (a file, pipe or socket). It is not closed.
+ * @param buffer Buffer of the caller the JSON goes through.
+ * @param capacity Size of the buffer (a few kilobytes is enough).
+ */
+void json_writer_init_fd(json_writer *writer, int fd, char *buffer, size_t capacity) {
+    memset(writer, 0, sizeof(json_writer));
+    writer->buffer = buffer;
+    writer->capacity = capacity;
+    writer->fd = fd;
+    writer->failed = fd < 0 || !buffer || capacity < 2;
+}
+
+/**
+ * @brief Completes the output: flushes a descriptor writer, NUL-terminates a buffer.
+ *
+ * @param writer The writer.
+ * @return true if the JSON was written completely and every object and array was closed.
+ *         When a buffer writer returns false with truncated set, total is the size
+ *         needed (the terminating NUL excepted).
+ */
+bool json_writer_finish(json_writer *writer) {
+    if (writer->fd >= 0) {
+        if (!writer->failed) {
+            json_flush(writer);
+        }
+    } else if (writer->buffer && writer->capacity > 0) {
+        writer->buffer[writer->length] = '\0';
+    }
+    return !writer->failed && !writer->truncated && writer->depth == 0 && !writer->after_key;
+}
+
+void json_writer_begin_object(json_writer *writer) {
+    json_open(writer, '{', true);
+}
+
+void json_writer_end_object(json_writer *writer) {
+    json_close(writer, '}', true);
+}
+
+void json_writer_begin_array(json_writer *writer) {
+    json_open(writer, '[', false);
+}
+
+void json_writer_end_array(json_writer *writer) {
+    json_close(writer, ']', false);
+}
+
+/**
+ * @brief Writes the key of the next member of the current object.
+ *
+ * @param writer The writer.
+ * @param key The key, escaped like any string.
+ */
+void json_writer_key(json_writer *writer, const char *key) {
+    if (writer->failed) {
+        return;
+    }
+    uint64_t level = writer->depth ? JSON_LEVEL(writer->depth) : 0;
+    if (!(writer->in_object & level) || writer->after_key || !key) {
+        writer->failed = true;
+        return;
+    }
+
+    if (writer->has_items & level) {
+        json_put_char(writer, ',');
+    }
+    writer->has_items |= level;
+    json_put_escaped(writer, key, strlen(key));
+    json_put_char(writer, ':');
+    writer->after_key = true;
+}
+
+void json_writer_string(json_writer *writer, const char *value) {
+    if (!value) {
+        json_writer_null(writer);
+        return;
+    }
+    json_writer_string_n(writer, value, strlen(value));
+}
+
+void json_writer_string_n(json_writer *writer, const char *value, size_t length) {
+    if (json_begin_value(writer)) {
+        json_put_escaped(writer, value, length);
+    }
+}
+
+void json_writer_uint(json_writer *writer, uint64_t value) {
+    if (!json_begin_value(writer)) {
+        return;
+    }
+
+    char digits[20];
+    size_t position = sizeof(digits);
+    do {
+        digits[--position] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    json_put(writer, digits + position, sizeof(digits) - position);
+}
+
+void json_writer_int(json_writer *writer, int64_t value) {
+    if (value >= 0) {
+        json_writer_uint(writer, (uint64_t) value);
+        return;
+    }
+    if (!json_begin_value(writer)) {
+        return;
+    }
+
+    char digits[21];
+    size_t position = sizeof(digits);
+    uint64_t magnitude = 0 - (uint64_t) value;
+    do {
+        digits[--position] = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    digits[--position] = '-';
+    json_put(writer, digits + position, sizeof(digits) - position);
+}
+
+void json_writer_double(json_writer *writer, double value) {
+    if (!isfinite(value)) {
+        json_writer_null(writer);
+        return;
+    }
+    if (!json_begin_value(writer)) {
+        return;
+    }
+
+    char text[32];
+    int length = snprintf(text, sizeof(text), "%.17g", value);
+    json_put(writer, text, (size_t) length);
+}
+
+void json_writer_bool(json_writer *writer, bool value) {
+    if (json_begin_value(writer)) {
+        json_put(writer, value ? "true" : "false", value ? 4 : 5);
+    }
+}
+
+void json_writer_null(json_writer *writer) {
+    if (json_begin_value(writer)) {
+        json_put(writer, "null", 4);
+    }
+}
+
+//Writes an index, null for PA_INVALID_INDEX.
+static void json_writer_index(json_writer *writer, uint32_t index) {
+    if (index == PA_INVALID_INDEX) {
+        json_writer_null(writer);
+    } else {
+        json_writer_uint(writer, index);
+    }
+}
+
+static void json_writer_profile(json_writer *writer, const pa_card_profile_info *profile) {
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "name");
+    json_writer_string(writer, profile->name);
+    json_writer_key(writer, "description");
+    json_writer_string(writer, profile->description);
+    json_writer_key(writer, "sinks");
+    json_writer_uint(writer, profile->n_sinks);
+    json_writer_key(writer, "sources");
+    json_writer_uint(writer, profile->n_sources);
+    json_writer_key(writer, "priority");
+    json_writer_uint(writer, profile->priority);
+    json_writer_end_object(writer);
+}
+
+/**
+ * @brief Writes a device: names, sample rate, volume, channels and profiles.
+ *
+ * @param writer The writer.
+ * @param device The device, as held by the manager.
+ */
+void json_writer_device(json_writer *writer, const pulseaudio_device *device) {
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "index");
+    json_writer_uint(writer, device->index);
+    json_writer_key(writer, "code");
+    json_writer_string(writer, device->code);
+    json_writer_key(writer, "name");
+    json_writer_string(writer, device->name);
+    json_writer_key(writer, "alsa_id");
+    json_writer_string(writer, device->alsa_id);
+    json_writer_key(writer, "sample_rate");
+    json_writer_int(writer, device->sample_rate);
+    json_writer_key(writer, "volume");
+    json_writer_int(writer, device->master_volume);
+    json_writer_key(writer, "mute");
+    json_writer_bool(writer, device->mute);
+    json_writer_key(writer, "min_channels");
+    json_writer_int(writer, device->min_channels);
+    json_writer_key(writer, "max_channels");
+    json_writer_int(writer, device->max_channels);
+    json_writer_key(writer, "owner_module");
+    json_writer_index(writer, device->owner_module);
+
+    // The channel names and volumes, when known, have max_channels entries
+    json_writer_key(writer, "channels");
+    json_writer_begin_array(writer);
+    int channels = device->channel_names[0] || device->channel_volume ? device->max_channels : 0;
+    for (int i = 0; i < channels; ++i) {
+        json_writer_begin_object(writer);
+        json_writer_key(writer, "name");
+        json_writer_string(writer, i < (int) PA_CHANNELS_MAX ? device->channel_names[i] : NULL);
+        json_writer_key(writer, "volume");
+        if (device->channel_volume) {
+            json_writer_int(writer, device->channel_volume[i]);
+        } else {
+            json_writer_null(writer);
+        }
+        json_writer_end_object(writer);
+    }
+    json_writer_end_array(writer);
+
+    json_writer_key(writer, "active_profile");
+    json_writer_string(writer, device->active_profile ? device->active_profile->name : NULL);
+    json_writer_key(writer, "profiles");
+    json_writer_begin_array(writer);
+    for (uint32_t i = 0; device->profiles && i < device->profile_count; ++i) {
+        json_writer_profile(writer, &device->profiles[i]);
+    }
+    json_writer_end_array(writer);
+    json_writer_end_object(writer);
+}
+
+void json_writer_devices(json_writer *writer, const pulseaudio_device *devices, uint32_t count) {
+    json_writer_begin_array(writer);
+    for (uint32_t i = 0; devices && i < count; ++i) {
+        json_writer_device(writer, &devices[i]);
+    }
+    json_writer_end_array(writer);
+}
+
+/**
+ * @brief Writes the selected properties of a stream as an object.
+ *
+ * Keys the stream does not have are left out.
+ */
+static void json_writer_proplist(json_writer *writer, const pa_proplist *proplist, const char *const *keys,
+                                 size_t key_count) {
+    json_writer_begin_object(writer);
+    if (!proplist) {
+        json_writer_end_object(writer);
+        return;
+    }
+
+    if (keys) {
+        for (size_t i = 0; i < key_count; ++i) {
+            const char *value = pa_proplist_gets(proplist, keys[i]);
+            if (value) {
+                json_writer_key(writer, keys[i]);
+                json_writer_string(writer, value);
+            }
+        }
+    } else {
+        void *state = NULL;
+        const char *key;
+        while ((key = pa_proplist_iterate(proplist, &state))) {
+            // Binary properties have no string value
+            const char *value = pa_proplist_gets(proplist, key);
+            if (value) {
+                json_writer_key(writer, key);
+                json_writer_string(writer, value);
+            }
+        }
+    }
+    json_writer_end_object(writer);
+}
+
+/**
+ * @brief Writes the members shared by playback and recording streams.
+ */
+static void json_writer_stream(json_writer *writer, uint32_t index, const char *device_key, uint32_t device,
+                               uint32_t owner_module, const char *name, const char *driver,
+                               const pa_sample_spec *spec, const pa_cvolume *volume, const pa_proplist *proplist,
+                               const char *const *keys, size_t key_count) {
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "index");
+    json_writer_uint(writer, index);
+    json_writer_key(writer, device_key);
+    json_writer_index(writer, device);
+    json_writer_key(writer, "owner_module");
+    json_writer_index(writer, owner_module);
+    json_writer_key(writer, "name");
+    json_writer_string(writer, name);
+    json_writer_key(writer, "driver");
+    json_writer_string(writer, driver);
+    json_writer_key(writer, "sample_rate");
+    json_writer_uint(writer, spec->rate);
+    json_writer_key(writer, "channels");
+    json_writer_uint(writer, spec->channels);
+
+    // Percentages, rounded as the device volumes are
+    json_writer_key(writer, "volume");
+    json_writer_begin_array(writer);
+    for (uint8_t i = 0; i < volume->channels && i < PA_CHANNELS_MAX; ++i) {
+        json_writer_uint(writer, ((uint64_t) volume->values[i] * 100 + PA_VOLUME_NORM / 2) / PA_VOLUME_NORM);
+    }
+    json_writer_end_array(writer);
+
+    json_writer_key(writer, "properties");
+    json_writer_proplist(writer, proplist, keys, key_count);
+    json_writer_end_object(writer);
+}
+
+void json_writer_output_streams(json_writer *writer, const output_stream_list *list, const char *const *keys,
+                                size_t key_count) {
+    json_writer_begin_array(writer);
+    for (uint32_t i = 0; list && i < list->num_inputs; ++i) {
+        const output_stream_info *stream = &list->inputs[i];
+        json_writer_stream(writer, stream->index, "sink", stream->parent_index, stream->owner_module, stream->name,
+                           stream->driver, &stream->sample_spec, &stream->volume, stream->proplist, keys, key_count);
+    }
+    json_writer_end_array(writer);
+}
+
+void json_writer_input_streams(json_writer *writer, const input_stream_list *list, const char *const *keys,
+                               size_t key_count) {
+    json_writer_begin_array(writer);
+    for (uint32_t i = 0; list && i < list->num_inputs; ++i) {
+        const input_stream_info *stream = &list->outputs[i];
+        json_writer_stream(writer, stream->index, "source", stream->parent_index, stream->owner_module, stream->name,
+                           stream->driver, &stream->sample_spec, &stream->volume, stream->proplist, keys, key_count);
+    }
+    json_writer_end_array(writer);
+}
+
+/**
+ * @brief Writes the whole model: default devices, devices and streams.
+ *
+ * @param writer The writer.
+ * @param manager The manager holding the devices.
+ * @param outputs Playback streams (from get_output_streams()), or NULL to leave them out.
+ * @param inputs Recording streams (from get_input_streams()), or NULL to leave them out.
+ * @param keys Proplist keys written for the streams, or NULL for all of them.
+ * @param key_count Number of keys.
+ */
+void json_writer_manager(json_writer *writer, const pulseaudio_manager *manager, const output_stream_list *outputs,
+                         const input_stream_list *inputs, const char *const *keys, size_t key_count) {
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "default_output");
+    json_writer_string(writer, manager->active_output_device);
+    json_writer_key(writer, "default_input");
+    json_writer_string(writer, manager->active_input_device);
+    json_writer_key(writer, "outputs");
+    json_writer_devices(writer, manager->outputs, manager->output_count);
+    json_writer_key(writer, "inputs");
+    json_writer_devices(writer, manager->inputs, manager->input_count);
+    if (outputs) {
+        json_writer_key(writer, "sink_inputs");
+        json_writer_output_streams(writer, outputs, keys, key_count);
+    }
+    if (inputs) {
+        json_writer_key(writer, "source_outputs");
+        json_writer_input_streams(writer, inputs, keys, key_count);
+    }
+    json_writer_end_object(writer);
+}
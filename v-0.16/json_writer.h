@@ -0,0 +1,98 @@
+/**
+ * @file json_writer.h
+ * @brief Streaming JSON writer, and JSON serialization of the devices and streams.
+ *
+ * A json_writer writes JSON text as it is produced, with no intermediate tree and no
+ * allocation: into a buffer of the caller (json_writer_init_buffer()), or through a
+ * buffer of the caller that is flushed to a file descriptor whenever it is full
+ * (json_writer_init_fd()). Commas and nesting are tracked by the writer, up to
+ * JSON_WRITER_MAX_DEPTH levels; strings are escaped as they are copied.
+ *
+ * When a buffer writer runs out of room it keeps counting what it would have written,
+ * so json_writer_finish() fails and total tells the size to retry with, as snprintf()
+ * does. The other errors (failed write, too deep or mismatched nesting, value without
+ * key) are sticky: the following calls do nothing and json_writer_finish() returns
+ * false.
+ *
+ * The json_writer_device(), json_writer_*_streams() and json_writer_manager() functions
+ * write the model of the library with these primitives: devices with their channels and
+ * the profiles of their card, streams with the proplist keys the caller selects.
+ */
+
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include "easypulse_core.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JSON_WRITER_MAX_DEPTH 64        // Nesting levels of objects and arrays.
+
+//State of a writer. The fields are read-only for the caller.
+typedef struct json_writer {
+    char *buffer;                       // Buffer of the caller.
+    size_t capacity;                    // Size of the buffer.
+    size_t length;                      // Bytes in the buffer (not yet flushed for a descriptor).
+    size_t total;                       // Bytes of JSON produced so far, written or not.
+    int fd;                             // Descriptor the buffer is flushed to (-1 for a buffer writer).
+    bool failed;                        // A write failed or the calls were out of order.
+    bool truncated;                     // The buffer was too small (total still counts).
+    bool after_key;                     // A key was written, its value comes next.
+    uint32_t depth;                     // Objects and arrays open.
+    uint64_t has_items;                 // Bit per level: something was written at this level.
+    uint64_t in_object;                 // Bit per level: the level is an object.
+} json_writer;
+
+void json_writer_init_buffer(json_writer *writer,
+char *buffer, size_t capacity);                                     //Writes into a buffer of the caller.
+
+void json_writer_init_fd(json_writer *writer, int fd,
+char *buffer, size_t capacity);                                     //Writes to a descriptor through a buffer of the caller.
+
+bool json_writer_finish(json_writer *writer);                       //Flushes and terminates. Returns false if the JSON is incomplete.
+
+void json_writer_begin_object(json_writer *writer);                 //Writes "{".
+void json_writer_end_object(json_writer *writer);                   //Writes "}".
+void json_writer_begin_array(json_writer *writer);                  //Writes "[".
+void json_writer_end_array(json_writer *writer);                    //Writes "]".
+void json_writer_key(json_writer *writer, const char *key);         //Writes the key of the next member of an object.
+
+void json_writer_string(json_writer *writer, const char *value);    //Writes an escaped string (null for NULL).
+void json_writer_string_n(json_writer *writer,
+const char *value, size_t length);                                  //Writes an escaped string of a given length.
+
+void json_writer_int(json_writer *writer, int64_t value);           //Writes an integer.
+void json_writer_uint(json_writer *writer, uint64_t value);         //Writes an unsigned integer.
+void json_writer_double(json_writer *writer, double value);         //Writes a number (null if not finite).
+void json_writer_bool(json_writer *writer, bool value);             //Writes true or false.
+void json_writer_null(json_writer *writer);                         //Writes null.
+
+void json_writer_device(json_writer *writer,
+const pulseaudio_device *device);                                   //Writes a device with its channels and profiles.
+
+void json_writer_devices(json_writer *writer,
+const pulseaudio_device *devices, uint32_t count);                  //Writes an array of devices.
+
+void json_writer_output_streams(json_writer *writer,
+const output_stream_list *list,
+const char *const *keys, size_t key_count);                         //Writes the playback streams (all properties if keys is NULL).
+
+void json_writer_input_streams(json_writer *writer,
+const input_stream_list *list,
+const char *const *keys, size_t key_count);                         //Writes the recording streams (all properties if keys is NULL).
+
+void json_writer_manager(json_writer *writer,
+const pulseaudio_manager *manager,
+const output_stream_list *outputs, const input_stream_list *inputs,
+const char *const *keys, size_t key_count);                         //Writes the devices, defaults and streams (lists may be NULL).
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
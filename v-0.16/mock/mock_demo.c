@@ -0,0 +1,86 @@
+/**
+ * @file mock_demo.c
+ * @brief Demo Program running the manager against the mock PulseAudio server.
+ *
+ * This program builds a small simulated server (a card with a stereo output and
+ * input, two null sinks and a few playback streams), creates a manager on it and
+ * exercises a few operations: moving streams, muting, switching the default output
+ * and unplugging a device. It then injects failures to show how they surface, and
+ * prints the number of requests the server received. No PulseAudio daemon is used.
+ */
+
+#include "../easypulse_core.h"
+#include "pulse_mock.h"
+#include <stdio.h>
+
+static void print_outputs(const pulseaudio_manager *manager) {
+    for (uint32_t i = 0; i < manager->output_count; ++i) {
+        printf("  [%u] %s (%s)%s\n", manager->outputs[i].index, manager->outputs[i].code, manager->outputs[i].name,
+               manager->outputs[i].mute ? " muted" : "");
+    }
+}
+
+// Position in manager->outputs of a sink, which the mute and default output setters take
+static uint32_t output_position(const pulseaudio_manager *manager, uint32_t sink) {
+    for (uint32_t i = 0; i < manager->output_count; ++i) {
+        if (manager->outputs[i].index == sink) {
+            return i;
+        }
+    }
+    return UINT32_MAX;
+}
+
+int main(void) {
+    mock_seed(42);
+    mock_add_default_devices();
+    uint32_t speakers = mock_add_sink("mock_speakers", "Mock Speakers", PA_INVALID_INDEX, 2, 48000);
+    uint32_t headset = mock_add_sink("mock_headset", "Mock Headset", PA_INVALID_INDEX, 2, 48000);
+
+    uint32_t music = mock_add_sink_input("Music Player", "music", speakers, false);
+    uint32_t call = mock_add_sink_input("Voice Call", "phone", speakers, false);
+    mock_add_sink_input("Notifications", "event", PA_INVALID_INDEX, true);
+
+    // Every request takes 200 microseconds, like a round trip to a busy daemon
+    for (int kind = 0; kind < MOCK_OP_KIND_COUNT; ++kind) {
+        mock_set_latency((mock_op_kind) kind, 200);
+    }
+
+    pulseaudio_manager *manager = manager_create();
+    if (!manager) {
+        fprintf(stderr, "Failed to initialize PulseAudio manager\n");
+        return 1;
+    }
+
+    printf("Outputs:\n");
+    print_outputs(manager);
+
+    printf("\nMoving the call to the headset...\n");
+    manager_move_sink_input(manager, call, headset);
+    printf("  Music is on sink %u, call is on sink %u\n", mock_sink_input_sink(music), mock_sink_input_sink(call));
+
+    printf("\nMaking the next two moves fail...\n");
+    mock_fail_next(MOCK_OP_MOVE, 2);
+    manager_move_sink_input(manager, music, headset);
+    manager_move_sink_input(manager, music, headset);
+    printf("  Music is still on sink %u\n", mock_sink_input_sink(music));
+
+    printf("\nMuting and switching the default output to the headset...\n");
+    manager_toggle_output_mute(manager, output_position(manager, speakers), 1);
+    manager_switch_default_output(manager, output_position(manager, headset));
+    printf("  Default sink is now %u\n", mock_default_sink());
+
+    printf("\nUnplugging the headset...\n");
+    mock_remove_sink(headset);
+    printf("  Call moved to sink %u, default sink is now %u\n", mock_sink_input_sink(call), mock_default_sink());
+
+    manager_cleanup(manager);
+
+    printf("\nRequests received by the mock server:\n");
+    printf("  info: %llu, volume: %llu, mute: %llu, default: %llu, move: %llu, subscribe: %llu\n",
+           (unsigned long long) mock_op_count(MOCK_OP_INFO), (unsigned long long) mock_op_count(MOCK_OP_SET_VOLUME),
+           (unsigned long long) mock_op_count(MOCK_OP_SET_MUTE), (unsigned long long) mock_op_count(MOCK_OP_SET_DEFAULT),
+           (unsigned long long) mock_op_count(MOCK_OP_MOVE), (unsigned long long) mock_op_count(MOCK_OP_SUBSCRIBE));
+
+    mock_reset();
+    return 0;
+}
@@ -0,0 +1,2393 @@
+/**
+ * @file pulse_mock.c
+ * @brief Implementation of the mock PulseAudio server.
+ *
+ * The server state (devices, streams, cards, modules, settings) is global and
+ * protected by a single recursive mutex, so tests can change it from any thread
+ * while contexts are connected.
+ *
+ * Operations created by a context are queued on that context and the context's
+ * eventfd is written. The eventfd is watched by an io event of the context's
+ * mainloop, so the queued operations are picked up by the mainloop thread, which
+ * arms a time event per operation with the latency configured for its kind. When
+ * the time event fires, the operation is executed against the server state and its
+ * callback runs, exactly like a reply from a real server. Subscription events are
+ * queued on the subscribed contexts and delivered the same way.
+ *
+ * pa_context_disconnect() does not touch the mainloop: pending operations are
+ * cancelled when their time event fires, and events still armed when the mainloop
+ * is freed release their references from their destroy callbacks.
+ */
+
+#include "pulse_mock.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define MOCK_DEVICE_LATENCY 20000   // Latency reported by every device, in microseconds.
+#define MOCK_STREAM_RATE 44100      // Sample rate of the simulated streams.
+#define MOCK_BUFFER_USEC 100000     // Buffer the server sets up on a card device, in microseconds.
+#define MOCK_FRAGMENT_USEC 25000    // Fragment of that buffer.
+
+//A sink, a source or a stream of the simulated server.
+typedef struct mock_node {
+    uint32_t index;
+    char *name;
+    char *description;
+    uint32_t card;                  // Card of a device, PA_INVALID_INDEX if none.
+    uint32_t owner_module;          // Module that created the node, PA_INVALID_INDEX if none.
+    uint32_t peer;                  // Monitor of a sink, sink of a monitor, device of a stream.
+    pa_sample_spec spec;
+    pa_channel_map map;
+    pa_cvolume volume;
+    bool mute;
+    bool suspended;
+    bool corked;
+    uint32_t port;                  // Active port of a device on a card (see mock_sink_ports).
+    pa_proplist *proplist;
+} mock_node;
+
+#define MOCK_PORT_COUNT 2           // Ports of every device on a card.
+
+//Ports of the sinks and the sources (monitors excluded) on a card.
+static const char *const mock_sink_ports[MOCK_PORT_COUNT][2] = {
+    { "analog-output-speaker", "Speakers" },
+    { "analog-output-headphones", "Headphones" },
+};
+static const char *const mock_source_ports[MOCK_PORT_COUNT][2] = {
+    { "analog-input-mic", "Microphone" },
+    { "analog-input-linein", "Line In" },
+};
+
+//Nodes of one kind, sorted by index.
+typedef struct mock_table {
+    mock_node *nodes;
+    uint32_t count;
+    uint32_t next_index;
+} mock_table;
+
+typedef struct mock_card {
+    uint32_t index;
+    char *name;
+    char **profiles;
+    uint32_t profile_count;
+    uint32_t active;                // Index of the active profile in profiles.
+    pa_proplist *proplist;
+} mock_card;
+
+typedef struct mock_module {
+    uint32_t index;
+    char *name;
+    char *argument;
+} mock_module;
+
+//A subscription event waiting to be delivered.
+typedef struct mock_event {
+    pa_subscription_event_type_t type;
+    uint32_t index;
+} mock_event;
+
+typedef enum mock_lookup {
+    LOOKUP_ALL,
+    LOOKUP_INDEX,
+    LOOKUP_NAME
+} mock_lookup;
+
+typedef void (*mock_run_fn)(pa_operation *o, bool failed);
+typedef void (*mock_info_fn)(pa_operation *o, const mock_node *node);
+
+struct pa_operation {
+    atomic_int refcount;
+    pa_operation_state_t state;
+    pa_context *context;
+    mock_op_kind kind;
+    mock_run_fn run;
+
+    // Request
+    mock_table *table;              // Table the request applies to, if any.
+    pa_subscription_event_type_t facility;
+    mock_lookup lookup;
+    uint32_t index;
+    char *name;
+    uint32_t target;
+    char *target_name;
+    char *argument;
+    pa_cvolume volume;
+    int flag;
+    mock_info_fn info;
+
+    void (*cb)(void);
+    void *userdata;
+    pa_operation_notify_cb_t state_cb;
+    void *state_userdata;
+
+    uint32_t latency;
+    pa_operation *next;             // Next operation in the submit queue, then in the scheduled queue.
+    bool scheduled;                 // In the scheduled queue of its context.
+};
+
+struct pa_context {
+    atomic_int refcount;
+    pa_mainloop_api *api;
+    pa_context_state_t state;
+    int error;
+
+    pa_context_notify_cb_t state_cb;
+    void *state_userdata;
+    pa_context_subscribe_cb_t subscribe_cb;
+    void *subscribe_userdata;
+    pa_subscription_mask_t mask;
+
+    int wake_fd;                    // Written when operations or events are queued.
+    pa_usec_t last_due;             // Time the last scheduled operation runs at.
+
+    // Mainloop thread only
+    pa_operation *scheduled;        // Operations waiting for their latency, in order.
+    pa_operation **scheduled_tail;
+
+    // Protected by the server mutex
+    pa_operation *submitted;
+    pa_operation **submitted_tail;
+    mock_event *events;
+    uint32_t event_count;
+    uint32_t event_capacity;
+    pa_context *next;               // Next context of the server.
+};
+
+static struct {
+    pthread_mutex_t mutex;
+
+    mock_table sinks;
+    mock_table sources;
+    mock_table sink_inputs;
+    mock_table source_outputs;
+
+    mock_card *cards;
+    uint32_t card_count;
+    uint32_t next_card;
+
+    mock_module *modules;
+    uint32_t module_count;
+    uint32_t next_module;
+
+    uint32_t default_sink;
+    uint32_t default_source;
+
+    uint32_t latency[MOCK_OP_KIND_COUNT];
+    double failure_rate[MOCK_OP_KIND_COUNT];
+    uint32_t fail_next[MOCK_OP_KIND_COUNT];
+    uint64_t op_count[MOCK_OP_KIND_COUNT];
+    uint32_t rng;
+
+    pa_context *contexts;
+} server;
+
+static pthread_once_t server_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Initializes the server mutex and the default state.
+ */
+static void server_init(void) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&server.mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    server.default_sink = PA_INVALID_INDEX;
+    server.default_source = PA_INVALID_INDEX;
+    server.rng = 1;
+}
+
+static void server_lock(void) {
+    pthread_once(&server_once, server_init);
+    pthread_mutex_lock(&server.mutex);
+}
+
+static void server_unlock(void) {
+    pthread_mutex_unlock(&server.mutex);
+}
+
+/**
+ * @brief Returns the next value of the failure generator (xorshift32).
+ */
+static uint32_t next_random(void) {
+    uint32_t x = server.rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    server.rng = x;
+    return x;
+}
+
+/**
+ * @brief Decides whether an operation of the given kind fails. Server mutex held.
+ */
+static bool should_fail(mock_op_kind kind) {
+    if (server.fail_next[kind] > 0) {
+        --server.fail_next[kind];
+        return true;
+    }
+    if (server.failure_rate[kind] <= 0.0) {
+        return false;
+    }
+    return (double) (next_random() >> 8) / 16777216.0 < server.failure_rate[kind];
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Tables
+ * ---------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief Returns the position of a node in its table, or -1 if there is no such node.
+ */
+static int64_t table_position(const mock_table *table, uint32_t index) {
+    uint32_t low = 0;
+    uint32_t high = table->count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (table->nodes[mid].index < index) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return (low < table->count && table->nodes[low].index == index) ? (int64_t) low : -1;
+}
+
+static mock_node *table_find(mock_table *table, uint32_t index) {
+    int64_t position = table_position(table, index);
+    return position < 0 ? NULL : &table->nodes[position];
+}
+
+static mock_node *table_find_name(mock_table *table, const char *name) {
+    if (!name) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < table->count; ++i) {
+        if (strcmp(table->nodes[i].name, name) == 0) {
+            return &table->nodes[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Appends a node with the next index of the table.
+ *
+ * @return The zeroed node, or NULL if memory allocation fails.
+ */
+static mock_node *table_add(mock_table *table) {
+    mock_node *nodes = realloc(table->nodes, (table->count + 1) * sizeof(mock_node));
+    if (!nodes) {
+        return NULL;
+    }
+    table->nodes = nodes;
+
+    mock_node *node = &table->nodes[table->count++];
+    memset(node, 0, sizeof(mock_node));
+    node->index = table->next_index++;
+    node->card = PA_INVALID_INDEX;
+    node->owner_module = PA_INVALID_INDEX;
+    node->peer = PA_INVALID_INDEX;
+    return node;
+}
+
+static void node_free(mock_node *node) {
+    free(node->name);
+    free(node->description);
+    if (node->proplist) {
+        pa_proplist_free(node->proplist);
+    }
+}
+
+static void table_remove(mock_table *table, uint32_t index) {
+    int64_t position = table_position(table, index);
+    if (position < 0) {
+        return;
+    }
+    node_free(&table->nodes[position]);
+    memmove(&table->nodes[position], &table->nodes[position + 1],
+            (table->count - (uint32_t) position - 1) * sizeof(mock_node));
+    --table->count;
+}
+
+static void table_clear(mock_table *table) {
+    for (uint32_t i = 0; i < table->count; ++i) {
+        node_free(&table->nodes[i]);
+    }
+    free(table->nodes);
+    memset(table, 0, sizeof(mock_table));
+}
+
+static mock_card *find_card(uint32_t index) {
+    for (uint32_t i = 0; i < server.card_count; ++i) {
+        if (server.cards[i].index == index) {
+            return &server.cards[i];
+        }
+    }
+    return NULL;
+}
+
+static mock_card *find_card_name(const char *name) {
+    for (uint32_t i = 0; name && i < server.card_count; ++i) {
+        if (strcmp(server.cards[i].name, name) == 0) {
+            return &server.cards[i];
+        }
+    }
+    return NULL;
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Subscription events
+ * ---------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief Wakes the mainloop of a context.
+ */
+static void context_wake(pa_context *c) {
+    uint64_t one = 1;
+    if (write(c->wake_fd, &one, sizeof(one)) < 0) {
+        // The counter cannot overflow in practice; a failed write leaves the fd readable anyway
+    }
+}
+
+/**
+ * @brief Queues a subscription event on every context subscribed to its facility. Server mutex held.
+ *
+ * @param type Facility and type of the event.
+ * @param index Index of the object the event is about.
+ */
+static void emit_event(pa_subscription_event_type_t type, uint32_t index) {
+    uint32_t facility_bit = 1u << (type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK);
+
+    for (pa_context *c = server.contexts; c; c = c->next) {
+        if (c->state != PA_CONTEXT_READY || !((uint32_t) c->mask & facility_bit)) {
+            continue;
+        }
+
+        if (c->event_count == c->event_capacity) {
+            uint32_t capacity = c->event_capacity ? c->event_capacity * 2 : 16;
+            mock_event *events = realloc(c->events, capacity * sizeof(mock_event));
+            if (!events) {
+                continue;
+            }
+            c->events = events;
+            c->event_capacity = capacity;
+        }
+        c->events[c->event_count].type = type;
+        c->events[c->event_count].index = index;
+        ++c->event_count;
+        context_wake(c);
+    }
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Server state changes (server mutex held)
+ * ---------------------------------------------------------------------------------------------- */
+
+static void set_default_sink_locked(uint32_t index) {
+    if (server.default_sink != index) {
+        server.default_sink = index;
+        emit_event(PA_SUBSCRIPTION_EVENT_SERVER | PA_SUBSCRIPTION_EVENT_CHANGE, PA_INVALID_INDEX);
+    }
+}
+
+static void set_default_source_locked(uint32_t index) {
+    if (server.default_source != index) {
+        server.default_source = index;
+        emit_event(PA_SUBSCRIPTION_EVENT_SERVER | PA_SUBSCRIPTION_EVENT_CHANGE, PA_INVALID_INDEX);
+    }
+}
+
+/**
+ * @brief Fills the common fields of a new device node.
+ */
+static bool init_device(mock_node *node, const char *name, const char *description,
+                        uint32_t card, uint8_t channels, uint32_t rate) {
+    node->name = strdup(name);
+    node->description = strdup(description ? description : name);
+    node->proplist = pa_proplist_new();
+    if (!node->name || !node->description || !node->proplist) {
+        return false;
+    }
+
+    node->card = card;
+    node->spec.format = PA_SAMPLE_S16LE;
+    node->spec.rate = rate ? rate : MOCK_STREAM_RATE;
+    node->spec.channels = channels ? channels : 2;
+    pa_channel_map_init_auto(&node->map, node->spec.channels, PA_CHANNEL_MAP_DEFAULT);
+    pa_cvolume_set(&node->volume, node->spec.channels, PA_VOLUME_NORM);
+
+    pa_proplist_sets(node->proplist, "device.description", node->description);
+    mock_card *owner = find_card(card);
+    if (owner) {
+        pa_proplist_sets(node->proplist, "alsa.card_name", owner->name);
+        pa_proplist_sets(node->proplist, PA_PROP_DEVICE_CLASS, "sound");
+        pa_proplist_setf(node->proplist, PA_PROP_DEVICE_BUFFERING_BUFFER_SIZE, "%zu",
+                         pa_usec_to_bytes(MOCK_BUFFER_USEC, &node->spec));
+        pa_proplist_setf(node->proplist, PA_PROP_DEVICE_BUFFERING_FRAGMENT_SIZE, "%zu",
+                         pa_usec_to_bytes(MOCK_FRAGMENT_USEC, &node->spec));
+    } else {
+        pa_proplist_sets(node->proplist, PA_PROP_DEVICE_CLASS, "abstract");
+    }
+    return true;
+}
+
+static uint32_t add_source_locked(const char *name, const char *description, uint32_t card,
+                                  uint8_t channels, uint32_t rate, uint32_t owner_module, uint32_t monitor_of) {
+    if (!name || table_find_name(&server.sources, name)) {
+        return PA_INVALID_INDEX;
+    }
+
+    mock_node *node = table_add(&server.sources);
+    if (!node) {
+        return PA_INVALID_INDEX;
+    }
+    uint32_t index = node->index;
+    if (!init_device(node, name, description, card, channels, rate)) {
+        table_remove(&server.sources, index);
+        return PA_INVALID_INDEX;
+    }
+    node->owner_module = owner_module;
+    node->peer = monitor_of;
+    if (monitor_of != PA_INVALID_INDEX) {
+        pa_proplist_sets(node->proplist, PA_PROP_DEVICE_CLASS, "monitor");
+    }
+
+    emit_event(PA_SUBSCRIPTION_EVENT_SOURCE | PA_SUBSCRIPTION_EVENT_NEW, index);
+
+    // A real source replaces a monitor as the default, as the server's fallback selection does
+    mock_node *current = table_find(&server.sources, server.default_source);
+    if (!current || (current->peer != PA_INVALID_INDEX && monitor_of == PA_INVALID_INDEX)) {
+        set_default_source_locked(index);
+    }
+    return index;
+}
+
+static uint32_t add_sink_locked(const char *name, const char *description, uint32_t card,
+                                uint8_t channels, uint32_t rate, uint32_t owner_module) {
+    if (!name || table_find_name(&server.sinks, name)) {
+        return PA_INVALID_INDEX;
+    }
+
+    mock_node *node = table_add(&server.sinks);
+    if (!node) {
+        return PA_INVALID_INDEX;
+    }
+    uint32_t index = node->index;
+    if (!init_device(node, name, description, card, channels, rate)) {
+        table_remove(&server.sinks, index);
+        return PA_INVALID_INDEX;
+    }
+    node->owner_module = owner_module;
+
+    emit_event(PA_SUBSCRIPTION_EVENT_SINK | PA_SUBSCRIPTION_EVENT_NEW, index);
+
+    char monitor_name[256];
+    char monitor_description[300];
+    snprintf(monitor_name, sizeof(monitor_name), "%s.monitor", name);
+    snprintf(monitor_description, sizeof(monitor_description), "Monitor of %s", description ? description : name);
+    uint32_t monitor = add_source_locked(monitor_name, monitor_description, card, channels, rate,
+                                         owner_module, index);
+
+    node = table_find(&server.sinks, index);
+    node->peer = monitor;
+
+    if (server.default_sink == PA_INVALID_INDEX) {
+        set_default_sink_locked(index);
+    }
+    return index;
+}
+
+/**
+ * @brief Returns the first device of a table other than the given one, preferring non monitors.
+ */
+static uint32_t pick_fallback(mock_table *table, uint32_t removed, bool skip_monitors) {
+    uint32_t fallback = PA_INVALID_INDEX;
+    for (uint32_t i = 0; i < table->count; ++i) {
+        mock_node *node = &table->nodes[i];
+        if (node->index == removed) {
+            continue;
+        }
+        if (!skip_monitors || node->peer == PA_INVALID_INDEX) {
+            return node->index;
+        }
+        if (fallback == PA_INVALID_INDEX) {
+            fallback = node->index;
+        }
+    }
+    return fallback;
+}
+
+/**
+ * @brief Moves the streams of a removed device to the default device, or kills them.
+ */
+static void rescue_streams_locked(mock_table *streams, uint32_t device, uint32_t target,
+                                  pa_subscription_event_type_t facility) {
+    for (uint32_t i = 0; i < streams->count;) {
+        mock_node *stream = &streams->nodes[i];
+        if (stream->peer != device) {
+            ++i;
+            continue;
+        }
+        if (target != PA_INVALID_INDEX) {
+            stream->peer = target;
+            emit_event(facility | PA_SUBSCRIPTION_EVENT_CHANGE, stream->index);
+            ++i;
+        } else {
+            uint32_t index = stream->index;
+            table_remove(streams, index);
+            emit_event(facility | PA_SUBSCRIPTION_EVENT_REMOVE, index);
+        }
+    }
+}
+
+static bool remove_source_locked(uint32_t index) {
+    mock_node *node = table_find(&server.sources, index);
+    if (!node) {
+        return false;
+    }
+
+    if (server.default_source == index) {
+        set_default_source_locked(pick_fallback(&server.sources, index, true));
+    }
+    rescue_streams_locked(&server.source_outputs, index, server.default_source,
+                          PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT);
+
+    table_remove(&server.sources, index);
+    emit_event(PA_SUBSCRIPTION_EVENT_SOURCE | PA_SUBSCRIPTION_EVENT_REMOVE, index);
+    return true;
+}
+
+static bool remove_sink_locked(uint32_t index) {
+    mock_node *node = table_find(&server.sinks, index);
+    if (!node) {
+        return false;
+    }
+    uint32_t monitor = node->peer;
+
+    if (server.default_sink == index) {
+        set_default_sink_locked(pick_fallback(&server.sinks, index, false));
+    }
+    rescue_streams_locked(&server.sink_inputs, index, server.default_sink, PA_SUBSCRIPTION_EVENT_SINK_INPUT);
+
+    table_remove(&server.sinks, index);
+    emit_event(PA_SUBSCRIPTION_EVENT_SINK | PA_SUBSCRIPTION_EVENT_REMOVE, index);
+
+    if (monitor != PA_INVALID_INDEX) {
+        remove_source_locked(monitor);
+    }
+    return true;
+}
+
+static uint32_t add_stream_locked(mock_table *streams, pa_subscription_event_type_t facility,
+                                  const char *application, const char *media_role, uint32_t device, bool corked) {
+    mock_node *node = table_add(streams);
+    if (!node) {
+        return PA_INVALID_INDEX;
+    }
+    uint32_t index = node->index;
+
+    node->name = strdup(application ? application : "stream");
+    node->proplist = pa_proplist_new();
+    if (!node->name || !node->proplist) {
+        table_remove(streams, index);
+        return PA_INVALID_INDEX;
+    }
+
+    node->peer = device;
+    node->corked = corked;
+    node->spec.format = PA_SAMPLE_S16LE;
+    node->spec.rate = MOCK_STREAM_RATE;
+    node->spec.channels = 2;
+    pa_channel_map_init_auto(&node->map, 2, PA_CHANNEL_MAP_DEFAULT);
+    pa_cvolume_set(&node->volume, 2, PA_VOLUME_NORM);
+
+    pa_proplist_sets(node->proplist, PA_PROP_APPLICATION_NAME, node->name);
+    pa_proplist_sets(node->proplist, PA_PROP_MEDIA_NAME, node->name);
+    if (media_role) {
+        pa_proplist_sets(node->proplist, PA_PROP_MEDIA_ROLE, media_role);
+    }
+
+    emit_event(facility | PA_SUBSCRIPTION_EVENT_NEW, index);
+    return index;
+}
+
+/**
+ * @brief Returns the value of a key=value module argument.
+ *
+ * Values may be quoted with single or double quotes.
+ *
+ * @return The value (to be freed), or NULL if the key is absent.
+ */
+static char *module_argument(const char *arguments, const char *key) {
+    size_t key_len = strlen(key);
+    const char *p = arguments;
+
+    while (p && *p) {
+        while (*p == ' ' || *p == '\t') {
+            ++p;
+        }
+        if (!*p) {
+            break;
+        }
+
+        const char *token = p;
+        const char *value = NULL;
+        const char *value_end = NULL;
+        while (*p && *p != ' ' && *p != '\t') {
+            if (*p == '=' && !value) {
+                value = p + 1;
+                if (*value == '\'' || *value == '"') {
+                    char quote = *value++;
+                    const char *close = strchr(value, quote);
+                    value_end = close ? close : value + strlen(value);
+                    p = close ? close + 1 : value_end;
+                    continue;
+                }
+            }
+            ++p;
+        }
+        if (value && !value_end) {
+            value_end = p;
+        }
+
+        if (value && (size_t) (value - 1 - token) == key_len && strncmp(token, key, key_len) == 0) {
+            return strndup(value, (size_t) (value_end - value));
+        }
+    }
+    return NULL;
+}
+
+static uint32_t module_argument_uint(const char *arguments, const char *key, uint32_t fallback) {
+    char *value = module_argument(arguments, key);
+    if (!value) {
+        return fallback;
+    }
+    uint32_t result = (uint32_t) strtoul(value, NULL, 10);
+    free(value);
+    return result ? result : fallback;
+}
+
+/**
+ * @brief Loads a module, creating the devices it provides.
+ *
+ * @return The module index, or PA_INVALID_INDEX if the module could not be initialized.
+ */
+static uint32_t load_module_locked(const char *name, const char *arguments) {
+    if (!name) {
+        return PA_INVALID_INDEX;
+    }
+
+    mock_module *modules = realloc(server.modules, (server.module_count + 1) * sizeof(mock_module));
+    if (!modules) {
+        return PA_INVALID_INDEX;
+    }
+    server.modules = modules;
+
+    uint32_t index = server.next_module;
+    bool is_sink = strcmp(name, "module-null-sink") == 0 || strcmp(name, "module-combine-sink") == 0 ||
+                   strcmp(name, "module-remap-sink") == 0;
+    bool is_source = strcmp(name, "module-null-source") == 0;
+
+    if (is_sink || is_source) {
+        char *device_name = module_argument(arguments, is_sink ? "sink_name" : "source_name");
+        const char *fallback_name = is_sink ? "null" : "source.null";
+        uint8_t channels = (uint8_t) module_argument_uint(arguments, "channels", 2);
+        uint32_t rate = module_argument_uint(arguments, "rate", MOCK_STREAM_RATE);
+
+        uint32_t device = is_sink
+            ? add_sink_locked(device_name ? device_name : fallback_name, NULL, PA_INVALID_INDEX, channels, rate, index)
+            : add_source_locked(device_name ? device_name : fallback_name, NULL, PA_INVALID_INDEX, channels, rate,
+                                index, PA_INVALID_INDEX);
+        free(device_name);
+        if (device == PA_INVALID_INDEX) {
+            return PA_INVALID_INDEX;
+        }
+    }
+
+    mock_module *module = &server.modules[server.module_count++];
+    module->index = index;
+    module->name = strdup(name);
+    module->argument = arguments ? strdup(arguments) : NULL;
+    ++server.next_module;
+
+    emit_event(PA_SUBSCRIPTION_EVENT_MODULE | PA_SUBSCRIPTION_EVENT_NEW, index);
+    return index;
+}
+
+static bool unload_module_locked(uint32_t index) {
+    uint32_t position = 0;
+    while (position < server.module_count && server.modules[position].index != index) {
+        ++position;
+    }
+    if (position == server.module_count) {
+        return false;
+    }
+
+    for (uint32_t i = server.sinks.count; i > 0; --i) {
+        if (server.sinks.nodes[i - 1].owner_module == index) {
+            remove_sink_locked(server.sinks.nodes[i - 1].index);
+        }
+    }
+    for (uint32_t i = server.sources.count; i > 0; --i) {
+        if (i <= server.sources.count && server.sources.nodes[i - 1].owner_module == index) {
+            remove_source_locked(server.sources.nodes[i - 1].index);
+        }
+    }
+
+    free(server.modules[position].name);
+    free(server.modules[position].argument);
+    memmove(&server.modules[position], &server.modules[position + 1],
+            (server.module_count - position - 1) * sizeof(mock_module));
+    --server.module_count;
+
+    emit_event(PA_SUBSCRIPTION_EVENT_MODULE | PA_SUBSCRIPTION_EVENT_REMOVE, index);
+    return true;
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Operations
+ * ---------------------------------------------------------------------------------------------- */
+
+static void op_free(pa_operation *o) {
+    free(o->name);
+    free(o->target_name);
+    free(o->argument);
+    free(o);
+}
+
+pa_operation *pa_operation_ref(pa_operation *o) {
+    atomic_fetch_add(&o->refcount, 1);
+    return o;
+}
+
+void pa_operation_unref(pa_operation *o) {
+    if (o && atomic_fetch_sub(&o->refcount, 1) == 1) {
+        op_free(o);
+    }
+}
+
+pa_operation_state_t pa_operation_get_state(const pa_operation *o) {
+    return o->state;
+}
+
+void pa_operation_set_state_callback(pa_operation *o, pa_operation_notify_cb_t cb, void *userdata) {
+    o->state_cb = cb;
+    o->state_userdata = userdata;
+}
+
+static void op_set_state(pa_operation *o, pa_operation_state_t state) {
+    if (o->state != PA_OPERATION_RUNNING) {
+        return;
+    }
+    o->state = state;
+    if (o->state_cb) {
+        o->state_cb(o, o->state_userdata);
+    }
+}
+
+void pa_operation_cancel(pa_operation *o) {
+    op_set_state(o, PA_OPERATION_CANCELLED);
+}
+
+/**
+ * @brief Allocates an operation of a context. The caller fills the request and calls op_submit().
+ *
+ * @return The operation, or NULL with the context error set.
+ */
+static pa_operation *op_new(pa_context *c, mock_op_kind kind, mock_run_fn run, void (*cb)(void), void *userdata) {
+    if (!c || (kind != MOCK_OP_CONNECT && c->state != PA_CONTEXT_READY)) {
+        if (c) {
+            c->error = PA_ERR_BADSTATE;
+        }
+        return NULL;
+    }
+
+    pa_operation *o = calloc(1, sizeof(pa_operation));
+    if (!o) {
+        c->error = PA_ERR_INTERNAL;
+        return NULL;
+    }
+    atomic_init(&o->refcount, 2);   // The caller and the submit queue
+    o->state = PA_OPERATION_RUNNING;
+    o->context = c;
+    o->kind = kind;
+    o->run = run;
+    o->cb = cb;
+    o->userdata = userdata;
+    return o;
+}
+
+/**
+ * @brief Queues an operation on its context and wakes the context's mainloop.
+ *
+ * @return The operation.
+ */
+static pa_operation *op_submit(pa_operation *o) {
+    server_lock();
+    ++server.op_count[o->kind];
+    o->latency = server.latency[o->kind];
+    *o->context->submitted_tail = o;
+    o->context->submitted_tail = &o->next;
+    context_wake(o->context);
+    server_unlock();
+    return o;
+}
+
+static void op_timer_destroy_cb(pa_mainloop_api *api, pa_time_event *e, void *userdata) {
+    (void) api;
+    (void) e;
+    pa_operation_unref(userdata);
+}
+
+/**
+ * @brief Runs an operation, or cancels it if it was cancelled or its context is gone.
+ */
+static void op_run(pa_operation *o) {
+    pa_context *c = o->context;
+
+    bool live = o->kind == MOCK_OP_CONNECT ? c->state == PA_CONTEXT_CONNECTING : c->state == PA_CONTEXT_READY;
+    if (o->state == PA_OPERATION_RUNNING && live) {
+        server_lock();
+        bool failed = should_fail(o->kind);
+        o->run(o, failed);
+        server_unlock();
+        op_set_state(o, PA_OPERATION_DONE);
+    } else {
+        op_set_state(o, PA_OPERATION_CANCELLED);
+    }
+}
+
+/**
+ * @brief Runs an operation whose latency has elapsed, after the operations scheduled
+ * before it.
+ *
+ * Time events due at the same time are not dispatched in the order they were created,
+ * so the operations of a context are also kept in a queue: the first timer to fire
+ * runs everything up to its own operation, and the timers of operations that already
+ * ran do nothing.
+ */
+static void op_timer_cb(pa_mainloop_api *api, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    (void) tv;
+    pa_operation *o = userdata;
+    pa_context *c = o->context;
+
+    while (o->scheduled) {
+        pa_operation *first = c->scheduled;
+        c->scheduled = first->next;
+        if (!c->scheduled) {
+            c->scheduled_tail = &c->scheduled;
+        }
+        first->next = NULL;
+        first->scheduled = false;
+        op_run(first);
+    }
+
+    api->time_free(e);
+}
+
+/**
+ * @brief Arms the time event of an operation taken from the submit queue.
+ */
+static void op_schedule(pa_context *c, pa_operation *o) {
+    // The server executes the requests of a client in order: a request never runs
+    // before the previous one, even if it has a shorter latency
+    pa_usec_t due = pa_rtclock_now() + o->latency;
+    if (due < c->last_due) {
+        due = c->last_due;
+    }
+    c->last_due = due;
+
+    pa_time_event *timer = pa_context_rttime_new(c, due, op_timer_cb, o);
+    if (!timer) {
+        op_set_state(o, PA_OPERATION_CANCELLED);
+        pa_operation_unref(o);
+        return;
+    }
+    c->api->time_set_destroy(timer, op_timer_destroy_cb);
+
+    o->scheduled = true;
+    *c->scheduled_tail = o;
+    c->scheduled_tail = &o->next;
+}
+
+/**
+ * @brief Calls the callback of an operation that reports success or failure.
+ */
+static void finish_success(pa_operation *o, bool success, int error) {
+    if (!success) {
+        o->context->error = error;
+    }
+    if (o->cb) {
+        ((pa_context_success_cb_t) o->cb)(o->context, success, o->userdata);
+    }
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Context
+ * ---------------------------------------------------------------------------------------------- */
+
+static void context_set_state(pa_context *c, pa_context_state_t state) {
+    if (c->state == state) {
+        return;
+    }
+    c->state = state;
+    if (c->state_cb) {
+        c->state_cb(c, c->state_userdata);
+    }
+}
+
+static void context_free(pa_context *c) {
+    server_lock();
+    for (pa_context **link = &server.contexts; *link; link = &(*link)->next) {
+        if (*link == c) {
+            *link = c->next;
+            break;
+        }
+    }
+    pa_operation *o = c->submitted;
+    while (o) {
+        pa_operation *next = o->next;
+        pa_operation_unref(o);
+        o = next;
+    }
+    server_unlock();
+
+    free(c->events);
+    close(c->wake_fd);
+    free(c);
+}
+
+pa_context *pa_context_ref(pa_context *c) {
+    atomic_fetch_add(&c->refcount, 1);
+    return c;
+}
+
+void pa_context_unref(pa_context *c) {
+    if (c && atomic_fetch_sub(&c->refcount, 1) == 1) {
+        context_free(c);
+    }
+}
+
+/**
+ * @brief Picks up the operations and events queued on a context. Runs in the mainloop thread.
+ */
+static void context_wake_cb(pa_mainloop_api *api, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
+    (void) api;
+    (void) e;
+    (void) events;
+    pa_context *c = userdata;
+
+    uint64_t value;
+    if (read(fd, &value, sizeof(value)) < 0) {
+        // Spurious wakeup: nothing was queued
+    }
+
+    server_lock();
+    pa_operation *submitted = c->submitted;
+    c->submitted = NULL;
+    c->submitted_tail = &c->submitted;
+    mock_event *queued = c->events;
+    uint32_t queued_count = c->event_count;
+    c->events = NULL;
+    c->event_count = 0;
+    c->event_capacity = 0;
+    server_unlock();
+
+    while (submitted) {
+        pa_operation *next = submitted->next;
+        submitted->next = NULL;
+        op_schedule(c, submitted);
+        submitted = next;
+    }
+
+    for (uint32_t i = 0; i < queued_count; ++i) {
+        if (c->state == PA_CONTEXT_READY && c->subscribe_cb) {
+            c->subscribe_cb(c, queued[i].type, queued[i].index, c->subscribe_userdata);
+        }
+    }
+    free(queued);
+}
+
+static void context_wake_destroy_cb(pa_mainloop_api *api, pa_io_event *e, void *userdata) {
+    (void) api;
+    (void) e;
+    pa_context_unref(userdata);
+}
+
+pa_context *pa_context_new_with_proplist(pa_mainloop_api *mainloop, const char *name, const pa_proplist *proplist) {
+    (void) name;
+    (void) proplist;
+    if (!mainloop) {
+        return NULL;
+    }
+
+    pa_context *c = calloc(1, sizeof(pa_context));
+    if (!c) {
+        return NULL;
+    }
+    c->api = mainloop;
+    c->state = PA_CONTEXT_UNCONNECTED;
+    c->submitted_tail = &c->submitted;
+    c->scheduled_tail = &c->scheduled;
+    c->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (c->wake_fd < 0) {
+        free(c);
+        return NULL;
+    }
+
+    // The io event keeps a reference until the mainloop frees it
+    atomic_init(&c->refcount, 2);
+    pa_io_event *wake = mainloop->io_new(mainloop, c->wake_fd, PA_IO_EVENT_INPUT, context_wake_cb, c);
+    if (!wake) {
+        close(c->wake_fd);
+        free(c);
+        return NULL;
+    }
+    mainloop->io_set_destroy(wake, context_wake_destroy_cb);
+
+    server_lock();
+    c->next = server.contexts;
+    server.contexts = c;
+    server_unlock();
+    return c;
+}
+
+pa_context *pa_context_new(pa_mainloop_api *mainloop, const char *name) {
+    return pa_context_new_with_proplist(mainloop, name, NULL);
+}
+
+void pa_context_set_state_callback(pa_context *c, pa_context_notify_cb_t cb, void *userdata) {
+    c->state_cb = cb;
+    c->state_userdata = userdata;
+}
+
+void pa_context_set_subscribe_callback(pa_context *c, pa_context_subscribe_cb_t cb, void *userdata) {
+    c->subscribe_cb = cb;
+    c->subscribe_userdata = userdata;
+}
+
+int pa_context_errno(const pa_context *c) {
+    return c ? c->error : PA_ERR_INVALID;
+}
+
+/**
+ * @brief Converts a monotonic time to the wall clock time the mainloop API takes.
+ *
+ * @return NULL for PA_USEC_INVALID, which disables the time event.
+ */
+static struct timeval *rttime_to_timeval(struct timeval *tv, pa_usec_t usec) {
+    if (usec == PA_USEC_INVALID) {
+        return NULL;
+    }
+
+    pa_usec_t now = pa_rtclock_now();
+    pa_gettimeofday(tv);
+    if (usec > now) {
+        pa_timeval_add(tv, usec - now);
+    }
+    return tv;
+}
+
+pa_time_event *pa_context_rttime_new(const pa_context *c, pa_usec_t usec, pa_time_event_cb_t cb, void *userdata) {
+    struct timeval tv;
+    return c->api->time_new(c->api, rttime_to_timeval(&tv, usec), cb, userdata);
+}
+
+void pa_context_rttime_restart(const pa_context *c, pa_time_event *e, pa_usec_t usec) {
+    struct timeval tv;
+    c->api->time_restart(e, rttime_to_timeval(&tv, usec));
+}
+
+pa_context_state_t pa_context_get_state(const pa_context *c) {
+    return c->state;
+}
+
+static void run_connect(pa_operation *o, bool failed) {
+    if (failed) {
+        o->context->error = PA_ERR_CONNECTIONREFUSED;
+        context_set_state(o->context, PA_CONTEXT_FAILED);
+    } else {
+        context_set_state(o->context, PA_CONTEXT_READY);
+    }
+}
+
+int pa_context_connect(pa_context *c, const char *server_name, pa_context_flags_t flags, const pa_spawn_api *api) {
+    (void) server_name;
+    (void) flags;
+    (void) api;
+
+    if (c->state != PA_CONTEXT_UNCONNECTED) {
+        c->error = PA_ERR_BADSTATE;
+        return -1;
+    }
+
+    pa_operation *o = op_new(c, MOCK_OP_CONNECT, run_connect, NULL, NULL);
+    if (!o) {
+        return -1;
+    }
+    atomic_init(&o->refcount, 1);   // Nobody holds the connection request but the queue
+    context_set_state(c, PA_CONTEXT_CONNECTING);
+    op_submit(o);
+    return 0;
+}
+
+void pa_context_disconnect(pa_context *c) {
+    if (!c || c->state == PA_CONTEXT_FAILED || c->state == PA_CONTEXT_TERMINATED) {
+        return;
+    }
+    context_set_state(c, PA_CONTEXT_TERMINATED);
+}
+
+static void run_subscribe(pa_operation *o, bool failed) {
+    if (!failed) {
+        o->context->mask = (pa_subscription_mask_t) o->flag;
+    }
+    finish_success(o, !failed, PA_ERR_UNKNOWN);
+}
+
+pa_operation *pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata) {
+    pa_operation *o = op_new(c, MOCK_OP_SUBSCRIBE, run_subscribe, (void (*)(void)) cb, userdata);
+    if (!o) {
+        return NULL;
+    }
+    o->flag = (int) m;
+    return op_submit(o);
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Introspection
+ * ---------------------------------------------------------------------------------------------- */
+
+static bool node_matches(const pa_operation *o, const mock_node *node) {
+    switch (o->lookup) {
+        case LOOKUP_INDEX:
+            return node->index == o->index;
+        case LOOKUP_NAME:
+            return o->name && strcmp(node->name, o->name) == 0;
+        default:
+            return true;
+    }
+}
+
+static bool device_running(const mock_node *device, mock_table *streams) {
+    for (uint32_t i = 0; i < streams->count; ++i) {
+        if (streams->nodes[i].peer == device->index && !streams->nodes[i].corked) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void emit_sink_info(pa_operation *o, const mock_node *node) {
+    mock_node *monitor = table_find(&server.sources, node->peer);
+
+    pa_sink_info info;
+    memset(&info, 0, sizeof(info));
+    info.name = node->name;
+    info.index = node->index;
+    info.description = node->description;
+    info.sample_spec = node->spec;
+    info.channel_map = node->map;
+    info.owner_module = node->owner_module;
+    info.volume = node->volume;
+    info.mute = node->mute;
+    info.monitor_source = node->peer;
+    info.monitor_source_name = monitor ? monitor->name : NULL;
+    info.latency = MOCK_DEVICE_LATENCY;
+    info.configured_latency = MOCK_DEVICE_LATENCY;
+    info.driver = "pulse_mock.c";
+    info.flags = PA_SINK_HW_VOLUME_CTRL | PA_SINK_HW_MUTE_CTRL | PA_SINK_LATENCY | PA_SINK_DECIBEL_VOLUME;
+    if (node->card != PA_INVALID_INDEX) {
+        info.flags |= PA_SINK_HARDWARE;
+    }
+    info.proplist = node->proplist;
+    info.base_volume = PA_VOLUME_NORM;
+    info.state = node->suspended ? PA_SINK_SUSPENDED
+                 : device_running(node, &server.sink_inputs) ? PA_SINK_RUNNING : PA_SINK_IDLE;
+    info.n_volume_steps = PA_VOLUME_NORM + 1;
+    info.card = node->card;
+
+    pa_sink_port_info ports[MOCK_PORT_COUNT];
+    pa_sink_port_info *port_list[MOCK_PORT_COUNT + 1] = { NULL };
+    if (node->card != PA_INVALID_INDEX) {
+        for (uint32_t i = 0; i < MOCK_PORT_COUNT; ++i) {
+            ports[i] = (pa_sink_port_info) {
+                .name = mock_sink_ports[i][0],
+                .description = mock_sink_ports[i][1],
+                .priority = MOCK_PORT_COUNT - i,
+                .available = PA_PORT_AVAILABLE_UNKNOWN,
+            };
+            port_list[i] = &ports[i];
+        }
+        info.n_ports = MOCK_PORT_COUNT;
+        info.ports = port_list;
+        info.active_port = port_list[node->port];
+    }
+
+    ((pa_sink_info_cb_t) o->cb)(o->context, &info, 0, o->userdata);
+}
+
+static void emit_source_info(pa_operation *o, const mock_node *node) {
+    mock_node *sink = table_find(&server.sinks, node->peer);
+
+    pa_source_info info;
+    memset(&info, 0, sizeof(info));
+    info.name = node->name;
+    info.index = node->index;
+    info.description = node->description;
+    info.sample_spec = node->spec;
+    info.channel_map = node->map;
+    info.owner_module = node->owner_module;
+    info.volume = node->volume;
+    info.mute = node->mute;
+    info.monitor_of_sink = node->peer;
+    info.monitor_of_sink_name = sink ? sink->name : NULL;
+    info.latency = MOCK_DEVICE_LATENCY;
+    info.configured_latency = MOCK_DEVICE_LATENCY;
+    info.driver = "pulse_mock.c";
+    info.flags = PA_SOURCE_HW_VOLUME_CTRL | PA_SOURCE_LATENCY;
+    if (node->card != PA_INVALID_INDEX) {
+        info.flags |= PA_SOURCE_HARDWARE;
+    }
+    info.proplist = node->proplist;
+    info.base_volume = PA_VOLUME_NORM;
+    info.state = node->suspended ? PA_SOURCE_SUSPENDED
+                 : device_running(node, &server.source_outputs) ? PA_SOURCE_RUNNING : PA_SOURCE_IDLE;
+    info.n_volume_steps = PA_VOLUME_NORM + 1;
+    info.card = node->card;
+
+    pa_source_port_info ports[MOCK_PORT_COUNT];
+    pa_source_port_info *port_list[MOCK_PORT_COUNT + 1] = { NULL };
+    if (node->card != PA_INVALID_INDEX && node->peer == PA_INVALID_INDEX) {
+        for (uint32_t i = 0; i < MOCK_PORT_COUNT; ++i) {
+            ports[i] = (pa_source_port_info) {
+                .name = mock_source_ports[i][0],
+                .description = mock_source_ports[i][1],
+                .priority = MOCK_PORT_COUNT - i,
+                .available = PA_PORT_AVAILABLE_UNKNOWN,
+            };
+            port_list[i] = &ports[i];
+        }
+        info.n_ports = MOCK_PORT_COUNT;
+        info.ports = port_list;
+        info.active_port = port_list[node->port];
+    }
+
+    ((pa_source_info_cb_t) o->cb)(o->context, &info, 0, o->userdata);
+}
+
+static void emit_sink_input_info(pa_operation *o, const mock_node *node) {
+    pa_sink_input_info info;
+    memset(&info, 0, sizeof(info));
+    info.index = node->index;
+    info.name = node->name;
+    info.owner_module = PA_INVALID_INDEX;
+    info.client = PA_INVALID_INDEX;
+    info.sink = node->peer;
+    info.sample_spec = node->spec;
+    info.channel_map = node->map;
+    info.volume = node->volume;
+    info.buffer_usec = MOCK_DEVICE_LATENCY;
+    info.sink_usec = MOCK_DEVICE_LATENCY;
+    info.resample_method = "speex-float-1";
+    info.driver = "pulse_mock.c";
+    info.mute = node->mute;
+    info.proplist = node->proplist;
+    info.corked = node->corked;
+    info.has_volume = 1;
+    info.volume_writable = 1;
+
+    ((pa_sink_input_info_cb_t) o->cb)(o->context, &info, 0, o->userdata);
+}
+
+static void emit_source_output_info(pa_operation *o, const mock_node *node) {
+    pa_source_output_info info;
+    memset(&info, 0, sizeof(info));
+    info.index = node->index;
+    info.name = node->name;
+    info.owner_module = PA_INVALID_INDEX;
+    info.client = PA_INVALID_INDEX;
+    info.source = node->peer;
+    info.sample_spec = node->spec;
+    info.channel_map = node->map;
+    info.buffer_usec = MOCK_DEVICE_LATENCY;
+    info.source_usec = MOCK_DEVICE_LATENCY;
+    info.resample_method = "speex-float-1";
+    info.driver = "pulse_mock.c";
+    info.proplist = node->proplist;
+    info.corked = node->corked;
+    info.volume = node->volume;
+    info.mute = node->mute;
+    info.has_volume = 1;
+    info.volume_writable = 1;
+
+    ((pa_source_output_info_cb_t) o->cb)(o->context, &info, 0, o->userdata);
+}
+
+/**
+ * @brief Runs a sink, source or stream info request, listing every matching node.
+ *
+ * The callbacks of the four info types share the (context, info, eol, userdata)
+ * layout, so the end of list and error calls are made through pa_sink_info_cb_t.
+ */
+static void run_node_info(pa_operation *o, bool failed) {
+    pa_sink_info_cb_t cb = (pa_sink_info_cb_t) o->cb;
+    if (!cb) {
+        return;
+    }
+    if (failed) {
+        o->context->error = PA_ERR_UNKNOWN;
+        cb(o->context, NULL, -1, o->userdata);
+        return;
+    }
+
+    bool found = false;
+    for (uint32_t i = 0; i < o->table->count; ++i) {
+        if (node_matches(o, &o->table->nodes[i])) {
+            found = true;
+            o->info(o, &o->table->nodes[i]);
+        }
+    }
+
+    if (!found && o->lookup != LOOKUP_ALL) {
+        o->context->error = PA_ERR_NOENTITY;
+        cb(o->context, NULL, -1, o->userdata);
+        return;
+    }
+    cb(o->context, NULL, 1, o->userdata);
+}
+
+static pa_operation *node_info_request(pa_context *c, mock_table *table, mock_info_fn info, mock_lookup lookup,
+                                       uint32_t index, const char *name, void (*cb)(void), void *userdata) {
+    pa_operation *o = op_new(c, MOCK_OP_INFO, run_node_info, cb, userdata);
+    if (!o) {
+        return NULL;
+    }
+    o->table = table;
+    o->info = info;
+    o->lookup = lookup;
+    o->index = index;
+    if (name && !(o->name = strdup(name))) {
+        pa_operation_unref(o);
+        pa_operation_unref(o);
+        return NULL;
+    }
+    return op_submit(o);
+}
+
+pa_operation *pa_context_get_sink_info_list(pa_context *c, pa_sink_info_cb_t cb, void *userdata) {
+    return node_info_request(c, &server.sinks, emit_sink_info, LOOKUP_ALL, PA_INVALID_INDEX, NULL,
+                             (void (*)(void)) cb, userdata);
+}
+
+pa_operation *pa_context_get_sink_info_by_index(pa_context *c, uint32_t idx, pa_sink_info_cb_t cb, void *userdata) {
+    return node_info_request(c, &server.sinks, emit_sink_info, LOOKUP_INDEX, idx, NULL,
+                             (void (*)(void)) cb, userdata);
+}
+
+pa_operation *pa_context_get_sink_info_by_name(pa_context *c, const char *name, pa_sink_info_cb_t cb, void *userdata) {
+    return node_info_request(c, &server.sinks, emit_sink_info, LOOKUP_NAME, PA_INVALID_INDEX, name,
+                             (void (*)(void)) cb, userdata);
+}
+
+pa_operation *pa_context_get_source_info_list(pa_context *c, pa_source_info_cb_t cb, void *userdata) {
+    return node_info_request(c, &server.sources, emit_source_info, LOOKUP_ALL, PA_INVALID_INDEX, NULL,
+                             (void (*)(void)) cb, userdata);
+}
+
+pa_operation *pa_context_get_source_info_by_index(pa_context *c, uint32_t idx, pa_source_info_cb_t cb, void *userdata) {
+    return node_info_request(c, &server.sources, emit_source_info, LOOKUP_INDEX, idx, NULL,
+                             (void (*)(void)) cb, userdata);
+}
+
+pa_operation *pa_context_get_source_info_by_name(pa_context *c, const char *name, pa_source_info_cb_t cb,
+                                                 void *userdata) {
+    return node_info_request(c, &server.sources, emit_source_info, LOOKUP_NAME, PA_INVALID_INDEX, name,
+                             (void (*)(void)) cb, userdata);
+}
+
+pa_operation *pa_context_get_sink_input_info(pa_context *c, uint32_t idx, pa_sink_input_info_cb_t cb, void *userdata) {
+    return node_info_request(c, &server.sink_inputs, emit_sink_input_info, LOOKUP_INDEX, idx, NULL,
+                             (void (*)(void)) cb, userdata);
+}
+
+pa_operation *pa_context_get_sink_input_info_list(pa_context *c, pa_sink_input_info_cb_t cb, void *userdata) {
+    return node_info_request(c, &server.sink_inputs, emit_sink_input_info, LOOKUP_ALL, PA_INVALID_INDEX, NULL,
+                             (void (*)(void)) cb, userdata);
+}
+
+pa_operation *pa_context_get_source_output_info(pa_context *c, uint32_t idx, pa_source_output_info_cb_t cb,
+                                                void *userdata) {
+    return node_info_request(c, &server.source_outputs, emit_source_output_info, LOOKUP_INDEX, idx, NULL,
+                             (void (*)(void)) cb, userdata);
+}
+
+pa_operation *pa_context_get_source_output_info_list(pa_context *c, pa_source_output_info_cb_t cb, void *userdata) {
+    return node_info_request(c, &server.source_outputs, emit_source_output_info, LOOKUP_ALL, PA_INVALID_INDEX,
+                             NULL, (void (*)(void)) cb, userdata);
+}
+
+static void emit_card_info(pa_operation *o, const mock_card *card) {
+    pa_card_profile_info *profiles = calloc(card->profile_count, sizeof(pa_card_profile_info));
+    pa_card_profile_info2 *profiles2 = calloc(card->profile_count, sizeof(pa_card_profile_info2));
+    pa_card_profile_info2 **profile_pointers = calloc(card->profile_count + 1, sizeof(pa_card_profile_info2 *));
+    if (card->profile_count && (!profiles || !profiles2 || !profile_pointers)) {
+        free(profiles);
+        free(profiles2);
+        free(profile_pointers);
+        return;
+    }
+
+    for (uint32_t i = 0; i < card->profile_count; ++i) {
+        profiles[i].name = profiles2[i].name = card->profiles[i];
+        profiles[i].description = profiles2[i].description = card->profiles[i];
+        profiles[i].priority = profiles2[i].priority = card->profile_count - i;
+        profiles[i].n_sinks = profiles2[i].n_sinks = strcmp(card->profiles[i], "off") == 0 ? 0 : 1;
+        profiles[i].n_sources = profiles2[i].n_sources = profiles[i].n_sinks;
+        profiles2[i].available = 1;
+        profile_pointers[i] = &profiles2[i];
+    }
+
+    pa_card_info info;
+    memset(&info, 0, sizeof(info));
+    info.index = card->index;
+    info.name = card->name;
+    info.owner_module = PA_INVALID_INDEX;
+    info.driver = "pulse_mock.c";
+    info.n_profiles = card->profile_count;
+    info.profiles = profiles;
+    info.active_profile = card->profile_count ? &profiles[card->active] : NULL;
+    info.proplist = card->proplist;
+    info.profiles2 = profile_pointers;
+    info.active_profile2 = card->profile_count ? &profiles2[card->active] : NULL;
+
+    ((pa_card_info_cb_t) o->cb)(o->context, &info, 0, o->userdata);
+
+    free(profiles);
+    free(profiles2);
+    free(profile_pointers);
+}
+
+static void run_card_info(pa_operation *o, bool failed) {
+    pa_card_info_cb_t cb = (pa_card_info_cb_t) o->cb;
+    if (!cb) {
+        return;
+    }
+    if (failed) {
+        o->context->error = PA_ERR_UNKNOWN;
+        cb(o->context, NULL, -1, o->userdata);
+        return;
+    }
+
+    bool found = false;
+    for (uint32_t i = 0; i < server.card_count; ++i) {
+        mock_card *card = &server.cards[i];
+        if ((o->lookup == LOOKUP_INDEX && card->index != o->index) ||
+            (o->lookup == LOOKUP_NAME && (!o->name || strcmp(card->name, o->name) != 0))) {
+            continue;
+        }
+        found = true;
+        emit_card_info(o, card);
+    }
+
+    if (!found && o->lookup != LOOKUP_ALL) {
+        o->context->error = PA_ERR_NOENTITY;
+        cb(o->context, NULL, -1, o->userdata);
+        return;
+    }
+    cb(o->context, NULL, 1, o->userdata);
+}
+
+static pa_operation *card_info_request(pa_context *c, mock_lookup lookup, uint32_t index, const char *name,
+                                       pa_card_info_cb_t cb, void *userdata) {
+    pa_operation *o = op_new(c, MOCK_OP_INFO, run_card_info, (void (*)(void)) cb, userdata);
+    if (!o) {
+        return NULL;
+    }
+    o->lookup = lookup;
+    o->index = index;
+    if (name && !(o->name = strdup(name))) {
+        pa_operation_unref(o);
+        pa_operation_unref(o);
+        return NULL;
+    }
+    return op_submit(o);
+}
+
+pa_operation *pa_context_get_card_info_list(pa_context *c, pa_card_info_cb_t cb, void *userdata) {
+    return card_info_request(c, LOOKUP_ALL, PA_INVALID_INDEX, NULL, cb, userdata);
+}
+
+pa_operation *pa_context_get_card_info_by_index(pa_context *c, uint32_t idx, pa_card_info_cb_t cb, void *userdata) {
+    return card_info_request(c, LOOKUP_INDEX, idx, NULL, cb, userdata);
+}
+
+pa_operation *pa_context_get_card_info_by_name(pa_context *c, const char *name, pa_card_info_cb_t cb, void *userdata) {
+    return card_info_request(c, LOOKUP_NAME, PA_INVALID_INDEX, name, cb, userdata);
+}
+
+static void run_module_info(pa_operation *o, bool failed) {
+    pa_module_info_cb_t cb = (pa_module_info_cb_t) o->cb;
+    if (!cb) {
+        return;
+    }
+    if (failed) {
+        o->context->error = PA_ERR_UNKNOWN;
+        cb(o->context, NULL, -1, o->userdata);
+        return;
+    }
+
+    bool found = false;
+    for (uint32_t i = 0; i < server.module_count; ++i) {
+        mock_module *module = &server.modules[i];
+        if (o->lookup == LOOKUP_INDEX && module->index != o->index) {
+            continue;
+        }
+        found = true;
+
+        pa_module_info info;
+        memset(&info, 0, sizeof(info));
+        info.index = module->index;
+        info.name = module->name;
+        info.argument = module->argument;
+        info.n_used = PA_INVALID_INDEX;
+        cb(o->context, &info, 0, o->userdata);
+    }
+
+    if (!found && o->lookup != LOOKUP_ALL) {
+        o->context->error = PA_ERR_NOENTITY;
+        cb(o->context, NULL, -1, o->userdata);
+        return;
+    }
+    cb(o->context, NULL, 1, o->userdata);
+}
+
+pa_operation *pa_context_get_module_info_list(pa_context *c, pa_module_info_cb_t cb, void *userdata) {
+    pa_operation *o = op_new(c, MOCK_OP_INFO, run_module_info, (void (*)(void)) cb, userdata);
+    if (!o) {
+        return NULL;
+    }
+    o->lookup = LOOKUP_ALL;
+    return op_submit(o);
+}
+
+pa_operation *pa_context_get_module_info(pa_context *c, uint32_t idx, pa_module_info_cb_t cb, void *userdata) {
+    pa_operation *o = op_new(c, MOCK_OP_INFO, run_module_info, (void (*)(void)) cb, userdata);
+    if (!o) {
+        return NULL;
+    }
+    o->lookup = LOOKUP_INDEX;
+    o->index = idx;
+    return op_submit(o);
+}
+
+static void run_server_info(pa_operation *o, bool failed) {
+    pa_server_info_cb_t cb = (pa_server_info_cb_t) o->cb;
+    if (!cb) {
+        return;
+    }
+    if (failed) {
+        o->context->error = PA_ERR_UNKNOWN;
+        cb(o->context, NULL, o->userdata);
+        return;
+    }
+
+    mock_node *sink = table_find(&server.sinks, server.default_sink);
+    mock_node *source = table_find(&server.sources, server.default_source);
+
+    pa_server_info info;
+    memset(&info, 0, sizeof(info));
+    info.user_name = "mock";
+    info.host_name = "localhost";
+    info.server_version = "17.0.0";
+    info.server_name = "pulseaudio";
+    info.sample_spec.format = PA_SAMPLE_S16LE;
+    info.sample_spec.rate = MOCK_STREAM_RATE;
+    info.sample_spec.channels = 2;
+    pa_channel_map_init_auto(&info.channel_map, 2, PA_CHANNEL_MAP_DEFAULT);
+    info.default_sink_name = sink ? sink->name : NULL;
+    info.default_source_name = source ? source->name : NULL;
+
+    cb(o->context, &info, o->userdata);
+}
+
+pa_operation *pa_context_get_server_info(pa_context *c, pa_server_info_cb_t cb, void *userdata) {
+    pa_operation *o = op_new(c, MOCK_OP_INFO, run_server_info, (void (*)(void)) cb, userdata);
+    return o ? op_submit(o) : NULL;
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Device and stream control
+ * ---------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief Returns the device addressed by an operation, by index or by name.
+ */
+static mock_node *op_device(pa_operation *o) {
+    return o->lookup == LOOKUP_NAME ? table_find_name(o->table, o->name) : table_find(o->table, o->index);
+}
+
+/**
+ * @brief Creates a device control operation. The caller fills the request and calls op_submit().
+ */
+static pa_operation *device_request(pa_context *c, mock_op_kind kind, mock_run_fn run, mock_table *table,
+                                    pa_subscription_event_type_t facility, uint32_t index, const char *name,
+                                    pa_context_success_cb_t cb, void *userdata) {
+    pa_operation *o = op_new(c, kind, run, (void (*)(void)) cb, userdata);
+    if (!o) {
+        return NULL;
+    }
+    o->table = table;
+    o->facility = facility;
+    o->lookup = name ? LOOKUP_NAME : LOOKUP_INDEX;
+    o->index = index;
+    if (name && !(o->name = strdup(name))) {
+        pa_operation_unref(o);
+        pa_operation_unref(o);
+        return NULL;
+    }
+    return o;
+}
+
+static void run_set_volume(pa_operation *o, bool failed) {
+    mock_node *node = failed ? NULL : op_device(o);
+    if (node && o->volume.channels != node->spec.channels && o->volume.channels != 1) {
+        finish_success(o, false, PA_ERR_INVALID);
+        return;
+    }
+    if (node) {
+        if (o->volume.channels == 1) {
+            pa_cvolume_set(&node->volume, node->spec.channels, o->volume.values[0]);
+        } else {
+            node->volume = o->volume;
+        }
+        emit_event(o->facility | PA_SUBSCRIPTION_EVENT_CHANGE, node->index);
+    }
+    finish_success(o, node != NULL, failed ? PA_ERR_UNKNOWN : PA_ERR_NOENTITY);
+}
+
+static pa_operation *volume_request(pa_context *c, mock_table *table, pa_subscription_event_type_t facility,
+                                    uint32_t index, const char *name, const pa_cvolume *volume,
+                                    pa_context_success_cb_t cb, void *userdata) {
+    if (!volume) {
+        c->error = PA_ERR_INVALID;
+        return NULL;
+    }
+    pa_operation *o = device_request(c, MOCK_OP_SET_VOLUME, run_set_volume, table, facility, index, name,
+                                     cb, userdata);
+    if (!o) {
+        return NULL;
+    }
+    o->volume = *volume;
+    return op_submit(o);
+}
+
+pa_operation *pa_context_set_sink_volume_by_index(pa_context *c, uint32_t idx, const pa_cvolume *volume,
+                                                  pa_context_success_cb_t cb, void *userdata) {
+    return volume_request(c, &server.sinks, PA_SUBSCRIPTION_EVENT_SINK, idx, NULL, volume, cb, userdata);
+}
+
+pa_operation *pa_context_set_sink_volume_by_name(pa_context *c, const char *name, const pa_cvolume *volume,
+                                                 pa_context_success_cb_t cb, void *userdata) {
+    return volume_request(c, &server.sinks, PA_SUBSCRIPTION_EVENT_SINK, PA_INVALID_INDEX, name, volume,
+                          cb, userdata);
+}
+
+pa_operation *pa_context_set_source_volume_by_index(pa_context *c, uint32_t idx, const pa_cvolume *volume,
+                                                    pa_context_success_cb_t cb, void *userdata) {
+    return volume_request(c, &server.sources, PA_SUBSCRIPTION_EVENT_SOURCE, idx, NULL, volume, cb, userdata);
+}
+
+pa_operation *pa_context_set_source_volume_by_name(pa_context *c, const char *name, const pa_cvolume *volume,
+                                                   pa_context_success_cb_t cb, void *userdata) {
+    return volume_request(c, &server.sources, PA_SUBSCRIPTION_EVENT_SOURCE, PA_INVALID_INDEX, name, volume,
+                          cb, userdata);
+}
+
+static void run_set_mute(pa_operation *o, bool failed) {
+    mock_node *node = failed ? NULL : op_device(o);
+    if (node) {
+        if (node->mute != (o->flag != 0)) {
+            node->mute = o->flag != 0;
+            emit_event(o->facility | PA_SUBSCRIPTION_EVENT_CHANGE, node->index);
+        }
+    }
+    finish_success(o, node != NULL, failed ? PA_ERR_UNKNOWN : PA_ERR_NOENTITY);
+}
+
+static pa_operation *mute_request(pa_context *c, mock_table *table, pa_subscription_event_type_t facility,
+                                  uint32_t index, const char *name, int mute,
+                                  pa_context_success_cb_t cb, void *userdata) {
+    pa_operation *o = device_request(c, MOCK_OP_SET_MUTE, run_set_mute, table, facility, index, name, cb, userdata);
+    if (!o) {
+        return NULL;
+    }
+    o->flag = mute;
+    return op_submit(o);
+}
+
+pa_operation *pa_context_set_sink_mute_by_index(pa_context *c, uint32_t idx, int mute,
+                                                pa_context_success_cb_t cb, void *userdata) {
+    return mute_request(c, &server.sinks, PA_SUBSCRIPTION_EVENT_SINK, idx, NULL, mute, cb, userdata);
+}
+
+pa_operation *pa_context_set_sink_mute_by_name(pa_context *c, const char *name, int mute,
+                                               pa_context_success_cb_t cb, void *userdata) {
+    return mute_request(c, &server.sinks, PA_SUBSCRIPTION_EVENT_SINK, PA_INVALID_INDEX, name, mute, cb, userdata);
+}
+
+pa_operation *pa_context_set_source_mute_by_index(pa_context *c, uint32_t idx, int mute,
+                                                  pa_context_success_cb_t cb, void *userdata) {
+    return mute_request(c, &server.sources, PA_SUBSCRIPTION_EVENT_SOURCE, idx, NULL, mute, cb, userdata);
+}
+
+pa_operation *pa_context_set_source_mute_by_name(pa_context *c, const char *name, int mute,
+                                                 pa_context_success_cb_t cb, void *userdata) {
+    return mute_request(c, &server.sources, PA_SUBSCRIPTION_EVENT_SOURCE, PA_INVALID_INDEX, name, mute,
+                        cb, userdata);
+}
+
+static void run_suspend(pa_operation *o, bool failed) {
+    mock_node *node = failed ? NULL : op_device(o);
+    if (node) {
+        if (node->suspended != (o->flag != 0)) {
+            node->suspended = o->flag != 0;
+            emit_event(o->facility | PA_SUBSCRIPTION_EVENT_CHANGE, node->index);
+        }
+    }
+    finish_success(o, node != NULL, failed ? PA_ERR_UNKNOWN : PA_ERR_NOENTITY);
+}
+
+static pa_operation *suspend_request(pa_context *c, mock_table *table, pa_subscription_event_type_t facility,
+                                     uint32_t index, const char *name, int suspend,
+                                     pa_context_success_cb_t cb, void *userdata) {
+    pa_operation *o = device_request(c, MOCK_OP_SUSPEND, run_suspend, table, facility, index, name, cb, userdata);
+    if (!o) {
+        return NULL;
+    }
+    o->flag = suspend;
+    return op_submit(o);
+}
+
+pa_operation *pa_context_suspend_sink_by_index(pa_context *c, uint32_t idx, int suspend,
+                                               pa_context_success_cb_t cb, void *userdata) {
+    return suspend_request(c, &server.sinks, PA_SUBSCRIPTION_EVENT_SINK, idx, NULL, suspend, cb, userdata);
+}
+
+pa_operation *pa_context_suspend_sink_by_name(pa_context *c, const char *sink_name, int suspend,
+                                              pa_context_success_cb_t cb, void *userdata) {
+    return suspend_request(c, &server.sinks, PA_SUBSCRIPTION_EVENT_SINK, PA_INVALID_INDEX, sink_name, suspend,
+                           cb, userdata);
+}
+
+pa_operation *pa_context_suspend_source_by_index(pa_context *c, uint32_t idx, int suspend,
+                                                 pa_context_success_cb_t cb, void *userdata) {
+    return suspend_request(c, &server.sources, PA_SUBSCRIPTION_EVENT_SOURCE, idx, NULL, suspend, cb, userdata);
+}
+
+pa_operation *pa_context_suspend_source_by_name(pa_context *c, const char *source_name, int suspend,
+                                                pa_context_success_cb_t cb, void *userdata) {
+    return suspend_request(c, &server.sources, PA_SUBSCRIPTION_EVENT_SOURCE, PA_INVALID_INDEX, source_name,
+                           suspend, cb, userdata);
+}
+
+static void run_set_port(pa_operation *o, bool failed) {
+    mock_node *node = failed ? NULL : op_device(o);
+    bool sink = o->table == &server.sinks;
+    const char *const (*ports)[2] = sink ? mock_sink_ports : mock_source_ports;
+    bool has_ports = node && node->card != PA_INVALID_INDEX && (sink || node->peer == PA_INVALID_INDEX);
+
+    uint32_t port = 0;
+    while (has_ports && port < MOCK_PORT_COUNT && strcmp(ports[port][0], o->target_name) != 0) {
+        ++port;
+    }
+    if (!has_ports || port == MOCK_PORT_COUNT) {
+        finish_success(o, false, failed ? PA_ERR_UNKNOWN : PA_ERR_NOENTITY);
+        return;
+    }
+
+    if (node->port != port) {
+        node->port = port;
+        emit_event(o->facility | PA_SUBSCRIPTION_EVENT_CHANGE, node->index);
+    }
+    finish_success(o, true, PA_OK);
+}
+
+static pa_operation *port_request(pa_context *c, mock_table *table, pa_subscription_event_type_t facility,
+                                  uint32_t index, const char *name, const char *port,
+                                  pa_context_success_cb_t cb, void *userdata) {
+    pa_operation *o = device_request(c, MOCK_OP_SET_PORT, run_set_port, table, facility, index, name, cb, userdata);
+    if (!o) {
+        return NULL;
+    }
+    if (!(o->target_name = strdup(port ? port : ""))) {
+        pa_operation_unref(o);
+        pa_operation_unref(o);
+        return NULL;
+    }
+    return op_submit(o);
+}
+
+pa_operation *pa_context_set_sink_port_by_index(pa_context *c, uint32_t idx, const char *port,
+                                                pa_context_success_cb_t cb, void *userdata) {
+    return port_request(c, &server.sinks, PA_SUBSCRIPTION_EVENT_SINK, idx, NULL, port, cb, userdata);
+}
+
+pa_operation *pa_context_set_sink_port_by_name(pa_context *c, const char *name, const char *port,
+                                               pa_context_success_cb_t cb, void *userdata) {
+    return port_request(c, &server.sinks, PA_SUBSCRIPTION_EVENT_SINK, PA_INVALID_INDEX, name, port, cb, userdata);
+}
+
+pa_operation *pa_context_set_source_port_by_index(pa_context *c, uint32_t idx, const char *port,
+                                                  pa_context_success_cb_t cb, void *userdata) {
+    return port_request(c, &server.sources, PA_SUBSCRIPTION_EVENT_SOURCE, idx, NULL, port, cb, userdata);
+}
+
+pa_operation *pa_context_set_source_port_by_name(pa_context *c, const char *name, const char *port,
+                                                 pa_context_success_cb_t cb, void *userdata) {
+    return port_request(c, &server.sources, PA_SUBSCRIPTION_EVENT_SOURCE, PA_INVALID_INDEX, name, port,
+                        cb, userdata);
+}
+
+static void run_set_default(pa_operation *o, bool failed) {
+    mock_node *node = failed ? NULL : table_find_name(o->table, o->name);
+    if (node) {
+        if (o->table == &server.sinks) {
+            set_default_sink_locked(node->index);
+        } else {
+            set_default_source_locked(node->index);
+        }
+    }
+    finish_success(o, node != NULL, failed ? PA_ERR_UNKNOWN : PA_ERR_NOENTITY);
+}
+
+pa_operation *pa_context_set_default_sink(pa_context *c, const char *name, pa_context_success_cb_t cb,
+                                          void *userdata) {
+    pa_operation *o = device_request(c, MOCK_OP_SET_DEFAULT, run_set_default, &server.sinks,
+                                     PA_SUBSCRIPTION_EVENT_SERVER, PA_INVALID_INDEX, name ? name : "", cb, userdata);
+    return o ? op_submit(o) : NULL;
+}
+
+pa_operation *pa_context_set_default_source(pa_context *c, const char *name, pa_context_success_cb_t cb,
+                                            void *userdata) {
+    pa_operation *o = device_request(c, MOCK_OP_SET_DEFAULT, run_set_default, &server.sources,
+                                     PA_SUBSCRIPTION_EVENT_SERVER, PA_INVALID_INDEX, name ? name : "", cb, userdata);
+    return o ? op_submit(o) : NULL;
+}
+
+/**
+ * @brief Moves a stream. o->table holds the streams, the destination is looked up among the devices.
+ */
+static void run_move(pa_operation *o, bool failed) {
+    mock_table *devices = o->table == &server.sink_inputs ? &server.sinks : &server.sources;
+    mock_node *stream = failed ? NULL : table_find(o->table, o->index);
+    mock_node *device = NULL;
+    if (stream) {
+        device = o->target_name ? table_find_name(devices, o->target_name) : table_find(devices, o->target);
+    }
+
+    if (stream && device) {
+        if (stream->peer != device->index) {
+            stream->peer = device->index;
+            emit_event(o->facility | PA_SUBSCRIPTION_EVENT_CHANGE, stream->index);
+        }
+    }
+    finish_success(o, stream && device, failed ? PA_ERR_UNKNOWN : PA_ERR_NOENTITY);
+}
+
+static pa_operation *move_request(pa_context *c, mock_table *streams, pa_subscription_event_type_t facility,
+                                  uint32_t index, uint32_t target, const char *target_name,
+                                  pa_context_success_cb_t cb, void *userdata) {
+    pa_operation *o = op_new(c, MOCK_OP_MOVE, run_move, (void (*)(void)) cb, userdata);
+    if (!o) {
+        return NULL;
+    }
+    o->table = streams;
+    o->facility = facility;
+    o->index = index;
+    o->target = target;
+    if (target_name && !(o->target_name = strdup(target_name))) {
+        pa_operation_unref(o);
+        pa_operation_unref(o);
+        return NULL;
+    }
+    return op_submit(o);
+}
+
+pa_operation *pa_context_move_sink_input_by_index(pa_context *c, uint32_t idx, uint32_t sink_idx,
+                                                  pa_context_success_cb_t cb, void *userdata) {
+    return move_request(c, &server.sink_inputs, PA_SUBSCRIPTION_EVENT_SINK_INPUT, idx, sink_idx, NULL,
+                        cb, userdata);
+}
+
+pa_operation *pa_context_move_sink_input_by_name(pa_context *c, uint32_t idx, const char *sink_name,
+                                                 pa_context_success_cb_t cb, void *userdata) {
+    return move_request(c, &server.sink_inputs, PA_SUBSCRIPTION_EVENT_SINK_INPUT, idx, PA_INVALID_INDEX,
+                        sink_name ? sink_name : "", cb, userdata);
+}
+
+pa_operation *pa_context_move_source_output_by_index(pa_context *c, uint32_t idx, uint32_t source_idx,
+                                                     pa_context_success_cb_t cb, void *userdata) {
+    return move_request(c, &server.source_outputs, PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT, idx, source_idx, NULL,
+                        cb, userdata);
+}
+
+pa_operation *pa_context_move_source_output_by_name(pa_context *c, uint32_t idx, const char *source_name,
+                                                    pa_context_success_cb_t cb, void *userdata) {
+    return move_request(c, &server.source_outputs, PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT, idx, PA_INVALID_INDEX,
+                        source_name ? source_name : "", cb, userdata);
+}
+
+static void run_set_card_profile(pa_operation *o, bool failed) {
+    mock_card *card = NULL;
+    if (!failed) {
+        card = o->lookup == LOOKUP_NAME ? find_card_name(o->name) : find_card(o->index);
+    }
+
+    uint32_t profile = 0;
+    while (card && profile < card->profile_count && strcmp(card->profiles[profile], o->target_name) != 0) {
+        ++profile;
+    }
+    bool success = card && profile < card->profile_count;
+    if (success && card->active != profile) {
+        card->active = profile;
+        emit_event(PA_SUBSCRIPTION_EVENT_CARD | PA_SUBSCRIPTION_EVENT_CHANGE, card->index);
+    }
+    finish_success(o, success, failed ? PA_ERR_UNKNOWN : PA_ERR_NOENTITY);
+}
+
+static pa_operation *card_profile_request(pa_context *c, uint32_t index, const char *name, const char *profile,
+                                          pa_context_success_cb_t cb, void *userdata) {
+    pa_operation *o = op_new(c, MOCK_OP_CARD_PROFILE, run_set_card_profile, (void (*)(void)) cb, userdata);
+    if (!o) {
+        return NULL;
+    }
+    o->lookup = name ? LOOKUP_NAME : LOOKUP_INDEX;
+    o->index = index;
+    o->name = name ? strdup(name) : NULL;
+    o->target_name = strdup(profile ? profile : "");
+    if ((name && !o->name) || !o->target_name) {
+        pa_operation_unref(o);
+        pa_operation_unref(o);
+        return NULL;
+    }
+    return op_submit(o);
+}
+
+pa_operation *pa_context_set_card_profile_by_index(pa_context *c, uint32_t idx, const char *profile,
+                                                   pa_context_success_cb_t cb, void *userdata) {
+    return card_profile_request(c, idx, NULL, profile, cb, userdata);
+}
+
+pa_operation *pa_context_set_card_profile_by_name(pa_context *c, const char *name, const char *profile,
+                                                  pa_context_success_cb_t cb, void *userdata) {
+    return card_profile_request(c, PA_INVALID_INDEX, name ? name : "", profile, cb, userdata);
+}
+
+static void run_load_module(pa_operation *o, bool failed) {
+    uint32_t index = failed ? PA_INVALID_INDEX : load_module_locked(o->name, o->argument);
+    if (index == PA_INVALID_INDEX) {
+        o->context->error = failed ? PA_ERR_UNKNOWN : PA_ERR_MODINITFAILED;
+    }
+    if (o->cb) {
+        ((pa_context_index_cb_t) o->cb)(o->context, index, o->userdata);
+    }
+}
+
+pa_operation *pa_context_load_module(pa_context *c, const char *name, const char *argument,
+                                     pa_context_index_cb_t cb, void *userdata) {
+    if (!name) {
+        if (c) {
+            c->error = PA_ERR_INVALID;
+        }
+        return NULL;
+    }
+
+    pa_operation *o = op_new(c, MOCK_OP_MODULE, run_load_module, (void (*)(void)) cb, userdata);
+    if (!o) {
+        return NULL;
+    }
+    o->name = strdup(name);
+    o->argument = argument ? strdup(argument) : NULL;
+    if (!o->name || (argument && !o->argument)) {
+        pa_operation_unref(o);
+        pa_operation_unref(o);
+        return NULL;
+    }
+    return op_submit(o);
+}
+
+static void run_unload_module(pa_operation *o, bool failed) {
+    bool success = !failed && unload_module_locked(o->index);
+    finish_success(o, success, failed ? PA_ERR_UNKNOWN : PA_ERR_NOENTITY);
+}
+
+pa_operation *pa_context_unload_module(pa_context *c, uint32_t idx, pa_context_success_cb_t cb, void *userdata) {
+    pa_operation *o = op_new(c, MOCK_OP_MODULE, run_unload_module, (void (*)(void)) cb, userdata);
+    if (!o) {
+        return NULL;
+    }
+    o->index = idx;
+    return op_submit(o);
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Test API
+ * ---------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief Empties the server and restores the default settings.
+ *
+ * Connected contexts stay connected and see an empty server. No events are sent.
+ */
+void mock_reset(void) {
+    server_lock();
+    table_clear(&server.sinks);
+    table_clear(&server.sources);
+    table_clear(&server.sink_inputs);
+    table_clear(&server.source_outputs);
+
+    for (uint32_t i = 0; i < server.card_count; ++i) {
+        for (uint32_t j = 0; j < server.cards[i].profile_count; ++j) {
+            free(server.cards[i].profiles[j]);
+        }
+        free(server.cards[i].profiles);
+        free(server.cards[i].name);
+        pa_proplist_free(server.cards[i].proplist);
+    }
+    free(server.cards);
+    server.cards = NULL;
+    server.card_count = 0;
+    server.next_card = 0;
+
+    for (uint32_t i = 0; i < server.module_count; ++i) {
+        free(server.modules[i].name);
+        free(server.modules[i].argument);
+    }
+    free(server.modules);
+    server.modules = NULL;
+    server.module_count = 0;
+    server.next_module = 0;
+
+    server.default_sink = PA_INVALID_INDEX;
+    server.default_source = PA_INVALID_INDEX;
+    memset(server.latency, 0, sizeof(server.latency));
+    memset(server.failure_rate, 0, sizeof(server.failure_rate));
+    memset(server.fail_next, 0, sizeof(server.fail_next));
+    memset(server.op_count, 0, sizeof(server.op_count));
+    server.rng = 1;
+    server_unlock();
+}
+
+/**
+ * @brief Seeds the failure generator.
+ *
+ * @param seed The seed. 0 is replaced by 1.
+ */
+void mock_seed(uint32_t seed) {
+    server_lock();
+    server.rng = seed ? seed : 1;
+    server_unlock();
+}
+
+/**
+ * @brief Sets the delay between the creation of an operation and its completion.
+ *
+ * @param kind The kind of operation.
+ * @param usec The delay in microseconds.
+ */
+void mock_set_latency(mock_op_kind kind, uint32_t usec) {
+    if (kind >= MOCK_OP_KIND_COUNT) {
+        return;
+    }
+    server_lock();
+    server.latency[kind] = usec;
+    server_unlock();
+}
+
+/**
+ * @brief Sets the probability that an operation of a kind fails.
+ *
+ * @param kind The kind of operation.
+ * @param probability Between 0 (never) and 1 (always).
+ */
+void mock_set_failure_rate(mock_op_kind kind, double probability) {
+    if (kind >= MOCK_OP_KIND_COUNT) {
+        return;
+    }
+    server_lock();
+    server.failure_rate[kind] = probability;
+    server_unlock();
+}
+
+/**
+ * @brief Forces the next operations of a kind to fail, regardless of the failure rate.
+ *
+ * @param kind The kind of operation.
+ * @param count Number of operations to fail.
+ */
+void mock_fail_next(mock_op_kind kind, uint32_t count) {
+    if (kind >= MOCK_OP_KIND_COUNT) {
+        return;
+    }
+    server_lock();
+    server.fail_next[kind] = count;
+    server_unlock();
+}
+
+/**
+ * @brief Returns the number of operations of a kind received since the last reset.
+ */
+uint64_t mock_op_count(mock_op_kind kind) {
+    if (kind >= MOCK_OP_KIND_COUNT) {
+        return 0;
+    }
+    server_lock();
+    uint64_t count = server.op_count[kind];
+    server_unlock();
+    return count;
+}
+
+/**
+ * @brief Adds a card.
+ *
+ * @param name Name of the card.
+ * @param profiles Names of its profiles. The first one is active.
+ * @param profile_count Number of profiles.
+ * @return Index of the card, or PA_INVALID_INDEX on error.
+ */
+uint32_t mock_add_card(const char *name, const char *const *profiles, uint32_t profile_count) {
+    if (!name || (profile_count && !profiles)) {
+        return PA_INVALID_INDEX;
+    }
+
+    server_lock();
+    mock_card *cards = realloc(server.cards, (server.card_count + 1) * sizeof(mock_card));
+    if (!cards) {
+        server_unlock();
+        return PA_INVALID_INDEX;
+    }
+    server.cards = cards;
+
+    mock_card *card = &server.cards[server.card_count];
+    memset(card, 0, sizeof(mock_card));
+    card->name = strdup(name);
+    card->profiles = calloc(profile_count ? profile_count : 1, sizeof(char *));
+    card->proplist = pa_proplist_new();
+    bool ok = card->name && card->profiles && card->proplist;
+    for (uint32_t i = 0; ok && i < profile_count; ++i) {
+        ok = (card->profiles[i] = strdup(profiles[i])) != NULL;
+        card->profile_count = i + 1;
+    }
+    if (!ok) {
+        for (uint32_t i = 0; i < card->profile_count; ++i) {
+            free(card->profiles[i]);
+        }
+        free(card->profiles);
+        free(card->name);
+        if (card->proplist) {
+            pa_proplist_free(card->proplist);
+        }
+        server_unlock();
+        return PA_INVALID_INDEX;
+    }
+
+    card->index = server.next_card++;
+    pa_proplist_sets(card->proplist, "alsa.card_name", name);
+    ++server.card_count;
+
+    uint32_t index = card->index;
+    emit_event(PA_SUBSCRIPTION_EVENT_CARD | PA_SUBSCRIPTION_EVENT_NEW, index);
+    server_unlock();
+    return index;
+}
+
+/**
+ * @brief Adds a sink and its monitor source. The first sink becomes the default.
+ *
+ * @param name Name of the sink.
+ * @param description Description, or NULL to use the name.
+ * @param card Index of its card, or PA_INVALID_INDEX.
+ * @param channels Number of channels (2 if 0).
+ * @param rate Sample rate (44100 if 0).
+ * @return Index of the sink, or PA_INVALID_INDEX on error or if the name is taken.
+ */
+uint32_t mock_add_sink(const char *name, const char *description, uint32_t card, uint8_t channels, uint32_t rate) {
+    server_lock();
+    uint32_t index = add_sink_locked(name, description, card, channels, rate, PA_INVALID_INDEX);
+    server_unlock();
+    return index;
+}
+
+/**
+ * @brief Adds a source. The first source becomes the default.
+ *
+ * @param name Name of the source.
+ * @param description Description, or NULL to use the name.
+ * @param card Index of its card, or PA_INVALID_INDEX.
+ * @param channels Number of channels (2 if 0).
+ * @param rate Sample rate (44100 if 0).
+ * @return Index of the source, or PA_INVALID_INDEX on error or if the name is taken.
+ */
+uint32_t mock_add_source(const char *name, const char *description, uint32_t card, uint8_t channels, uint32_t rate) {
+    server_lock();
+    uint32_t index = add_source_locked(name, description, card, channels, rate, PA_INVALID_INDEX, PA_INVALID_INDEX);
+    server_unlock();
+    return index;
+}
+
+/**
+ * @brief Adds a playback stream.
+ *
+ * @param application Application name of the stream.
+ * @param media_role Value of media.role, or NULL.
+ * @param sink Index of the sink, or PA_INVALID_INDEX for the default sink.
+ * @param corked Whether the stream is paused.
+ * @return Index of the stream, or PA_INVALID_INDEX on error.
+ */
+uint32_t mock_add_sink_input(const char *application, const char *media_role, uint32_t sink, bool corked) {
+    server_lock();
+    uint32_t device = sink == PA_INVALID_INDEX ? server.default_sink : sink;
+    uint32_t index = PA_INVALID_INDEX;
+    if (table_find(&server.sinks, device)) {
+        index = add_stream_locked(&server.sink_inputs, PA_SUBSCRIPTION_EVENT_SINK_INPUT,
+                                  application, media_role, device, corked);
+    }
+    server_unlock();
+    return index;
+}
+
+/**
+ * @brief Adds a recording stream.
+ *
+ * @param application Application name of the stream.
+ * @param source Index of the source, or PA_INVALID_INDEX for the default source.
+ * @param corked Whether the stream is paused.
+ * @return Index of the stream, or PA_INVALID_INDEX on error.
+ */
+uint32_t mock_add_source_output(const char *application, uint32_t source, bool corked) {
+    server_lock();
+    uint32_t device = source == PA_INVALID_INDEX ? server.default_source : source;
+    uint32_t index = PA_INVALID_INDEX;
+    if (table_find(&server.sources, device)) {
+        index = add_stream_locked(&server.source_outputs, PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT,
+                                  application, NULL, device, corked);
+    }
+    server_unlock();
+    return index;
+}
+
+/**
+ * @brief Adds an analog card with a stereo output and a stereo input, the usual layout of a laptop.
+ */
+void mock_add_default_devices(void) {
+    static const char *const profiles[] = {"output:analog-stereo+input:analog-stereo", "output:analog-stereo", "off"};
+
+    uint32_t card = mock_add_card("alsa_card.mock", profiles, 3);
+    mock_add_sink("alsa_output.mock.analog-stereo", "Mock Analog Stereo", card, 2, 48000);
+    mock_add_source("alsa_input.mock.analog-stereo", "Mock Analog Stereo", card, 2, 48000);
+}
+
+/**
+ * @brief Removes a sink and its monitor, as when a device is unplugged.
+ *
+ * Its streams are moved to the default sink (a new one is chosen if it was the
+ * default), or removed if no sink is left.
+ *
+ * @return true if the sink existed.
+ */
+bool mock_remove_sink(uint32_t index) {
+    server_lock();
+    bool removed = remove_sink_locked(index);
+    server_unlock();
+    return removed;
+}
+
+/**
+ * @brief Removes a source. Its streams are moved to the default source, or removed.
+ *
+ * @return true if the source existed.
+ */
+bool mock_remove_source(uint32_t index) {
+    server_lock();
+    bool removed = remove_source_locked(index);
+    server_unlock();
+    return removed;
+}
+
+static bool remove_stream(mock_table *streams, pa_subscription_event_type_t facility, uint32_t index) {
+    server_lock();
+    bool found = table_find(streams, index) != NULL;
+    if (found) {
+        table_remove(streams, index);
+        emit_event(facility | PA_SUBSCRIPTION_EVENT_REMOVE, index);
+    }
+    server_unlock();
+    return found;
+}
+
+/**
+ * @brief Removes a playback stream.
+ *
+ * @return true if the stream existed.
+ */
+bool mock_remove_sink_input(uint32_t index) {
+    return remove_stream(&server.sink_inputs, PA_SUBSCRIPTION_EVENT_SINK_INPUT, index);
+}
+
+/**
+ * @brief Removes a recording stream.
+ *
+ * @return true if the stream existed.
+ */
+bool mock_remove_source_output(uint32_t index) {
+    return remove_stream(&server.source_outputs, PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT, index);
+}
+
+static uint32_t stream_device(mock_table *streams, uint32_t index) {
+    server_lock();
+    mock_node *stream = table_find(streams, index);
+    uint32_t device = stream ? stream->peer : PA_INVALID_INDEX;
+    server_unlock();
+    return device;
+}
+
+uint32_t mock_sink_input_sink(uint32_t index) {
+    return stream_device(&server.sink_inputs, index);
+}
+
+uint32_t mock_source_output_source(uint32_t index) {
+    return stream_device(&server.source_outputs, index);
+}
+
+uint32_t mock_default_sink(void) {
+    server_lock();
+    uint32_t index = server.default_sink;
+    server_unlock();
+    return index;
+}
+
+uint32_t mock_default_source(void) {
+    server_lock();
+    uint32_t index = server.default_source;
+    server_unlock();
+    return index;
+}
+
+const char *mock_active_port(bool sink, uint32_t index) {
+    server_lock();
+    mock_node *node = table_find(sink ? &server.sinks : &server.sources, index);
+    const char *port = NULL;
+    if (node && node->card != PA_INVALID_INDEX && (sink || node->peer == PA_INVALID_INDEX)) {
+        port = (sink ? mock_sink_ports : mock_source_ports)[node->port][0];
+    }
+    server_unlock();
+    return port;
+}
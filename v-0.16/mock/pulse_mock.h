@@ -0,0 +1,83 @@
+/**
+ * @file pulse_mock.h
+ * @brief In-process mock of the PulseAudio server, for benchmarks and stress runs.
+ *
+ * pulse_mock.c defines the pa_context_* and pa_operation_* functions used by the
+ * library. When it is linked into a program together with the library objects (see
+ * mock/Makefile), these definitions take precedence over the ones of libpulse, so
+ * easypulse_core.c and system_query.c talk to a simulated server instead of a
+ * daemon. Everything else (threaded mainloop, proplists, volumes, channel maps)
+ * still comes from the real libpulse, so callbacks are delivered exactly as usual:
+ * from the mainloop thread, with the mainloop lock held, after a configurable delay.
+ *
+ * The simulated server holds cards, sinks (each with its monitor source), sources,
+ * playback and recording streams and modules. module-null-sink, module-null-source,
+ * module-combine-sink and module-remap-sink create devices when loaded and remove
+ * them when unloaded. Devices on a card have two ports (speakers and headphones, or
+ * microphone and line in). Subscription events are generated for every change.
+ *
+ * Each operation kind can be given a latency and a failure rate (or a number of
+ * forced failures). Failures are drawn from a seeded generator, so a run with the
+ * same seed and the same calls is reproducible.
+ */
+
+#ifndef PULSE_MOCK_H
+#define PULSE_MOCK_H
+
+#include <pulse/pulseaudio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+//Kinds of operations that share a latency and a failure setting.
+typedef enum mock_op_kind {
+    MOCK_OP_CONNECT,        // Context connection.
+    MOCK_OP_INFO,           // Every get_*_info and server info request.
+    MOCK_OP_SET_VOLUME,     // Device volume changes.
+    MOCK_OP_SET_MUTE,       // Device mute changes.
+    MOCK_OP_SET_DEFAULT,    // Default sink / source changes.
+    MOCK_OP_MOVE,           // Stream moves.
+    MOCK_OP_MODULE,         // Module loads and unloads.
+    MOCK_OP_CARD_PROFILE,   // Card profile changes.
+    MOCK_OP_SUSPEND,        // Device suspend / resume.
+    MOCK_OP_SET_PORT,       // Device port changes.
+    MOCK_OP_SUBSCRIBE,      // Subscription mask changes.
+    MOCK_OP_KIND_COUNT
+} mock_op_kind;
+
+void mock_reset(void);                                               //Empties the server and restores the default settings.
+void mock_seed(uint32_t seed);                                       //Seeds the failure generator.
+
+void mock_set_latency(mock_op_kind kind, uint32_t usec);            //Delay before an operation of this kind completes.
+void mock_set_failure_rate(mock_op_kind kind, double probability);  //Probability that an operation of this kind fails.
+void mock_fail_next(mock_op_kind kind, uint32_t count);             //Forces the next operations of this kind to fail.
+uint64_t mock_op_count(mock_op_kind kind);                          //Operations of this kind received so far.
+
+uint32_t mock_add_card(const char *name,
+const char *const *profiles, uint32_t profile_count);               //Adds a card. The first profile is active.
+
+uint32_t mock_add_sink(const char *name, const char *description,
+uint32_t card, uint8_t channels, uint32_t rate);                    //Adds a sink and its monitor source.
+
+uint32_t mock_add_source(const char *name, const char *description,
+uint32_t card, uint8_t channels, uint32_t rate);                    //Adds a source.
+
+uint32_t mock_add_sink_input(const char *application,
+const char *media_role, uint32_t sink, bool corked);                //Adds a playback stream.
+
+uint32_t mock_add_source_output(const char *application,
+uint32_t source, bool corked);                                      //Adds a recording stream.
+
+void mock_add_default_devices(void);                                //Adds a card with a stereo sink and source.
+
+bool mock_remove_sink(uint32_t index);                              //Removes a sink; its streams go to the default sink.
+bool mock_remove_source(uint32_t index);                            //Removes a source; its streams go to the default source.
+bool mock_remove_sink_input(uint32_t index);                        //Removes a playback stream.
+bool mock_remove_source_output(uint32_t index);                     //Removes a recording stream.
+
+uint32_t mock_sink_input_sink(uint32_t index);                      //Sink of a playback stream (PA_INVALID_INDEX if none).
+uint32_t mock_source_output_source(uint32_t index);                 //Source of a recording stream (PA_INVALID_INDEX if none).
+uint32_t mock_default_sink(void);                                   //Index of the default sink (PA_INVALID_INDEX if none).
+uint32_t mock_default_source(void);                                 //Index of the default source (PA_INVALID_INDEX if none).
+const char *mock_active_port(bool sink, uint32_t index);             //Active port of a device on a card (NULL if none).
+
+#endif
@@ -0,0 +1,161 @@
+/**
+ * @file op_batch.c
+ * @brief Implementation of the pipelined operation batches.
+ */
+
+#include "op_batch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Initializes an empty batch.
+ *
+ * @param batch The batch to initialize.
+ * @param mainloop The threaded mainloop running the context the operations are sent to.
+ * @param kind Metric the operations of the batch are recorded under.
+ */
+void op_batch_init(op_batch *batch, pa_threaded_mainloop *mainloop, metric_id kind) {
+    memset(batch, 0, sizeof(op_batch));
+    batch->mainloop = mainloop;
+    batch->kind = kind;
+    batch->start_ns = metrics_op_begin();
+}
+
+/**
+ * @brief State callback of the operations of a batch: wakes op_batch_wait() when one
+ * ends, its completion callback may never run if it was cancelled.
+ *
+ * @param op The operation.
+ * @param userdata Pointer to the op_batch the operation belongs to.
+ */
+static void op_batch_state_cb(pa_operation *op, void *userdata) {
+    if (pa_operation_get_state(op) != PA_OPERATION_RUNNING) {
+        pa_threaded_mainloop_signal(((op_batch *) userdata)->mainloop, 0);
+    }
+}
+
+/**
+ * @brief Adds a started operation to the batch.
+ *
+ * The operation must have been started with a callback that ends up calling
+ * op_batch_complete() (such as op_batch_success_cb). The batch keeps the reference to
+ * the operation until op_batch_wait(), to notice if the context cancels it.
+ *
+ * @param batch The batch.
+ * @param op The operation returned by the pa_context_* call. NULL is recorded as a failure.
+ * @return true if the operation was started, false otherwise.
+ */
+bool op_batch_add(op_batch *batch, pa_operation *op) {
+    if (!op) {
+        batch->failed++;
+        metrics_op_end(batch->kind, batch->start_ns, false);
+        return false;
+    }
+
+    if (batch->op_count == batch->op_capacity) {
+        uint32_t capacity = batch->op_capacity ? batch->op_capacity * 2 : 16;
+        pa_operation **ops = realloc(batch->ops, capacity * sizeof(pa_operation *));
+        if (!ops) {
+            // An operation that cannot be tracked is not waited for
+            pa_operation_cancel(op);
+            pa_operation_unref(op);
+            batch->failed++;
+            metrics_op_end(batch->kind, batch->start_ns, false);
+            return false;
+        }
+        batch->ops = ops;
+        batch->op_capacity = capacity;
+    }
+
+    pa_operation_set_state_callback(op, op_batch_state_cb, batch);
+    batch->ops[batch->op_count++] = op;
+    batch->pending++;
+    batch->started++;
+    return true;
+}
+
+/**
+ * @brief Tells whether an operation of the batch is still running.
+ */
+static bool op_batch_running(const op_batch *batch) {
+    for (uint32_t i = 0; i < batch->op_count; ++i) {
+        if (pa_operation_get_state(batch->ops[i]) == PA_OPERATION_RUNNING) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Records the completion of an operation of the batch.
+ *
+ * To be called from the completion callbacks, in the mainloop thread.
+ *
+ * @param batch The batch.
+ * @param success Whether the operation succeeded.
+ */
+void op_batch_complete(op_batch *batch, bool success) {
+    metrics_op_end(batch->kind, batch->start_ns, success);
+
+    if (success) {
+        batch->succeeded++;
+    } else {
+        batch->failed++;
+    }
+
+    if (batch->pending > 0) {
+        batch->pending--;
+    }
+
+    if (batch->pending == 0) {
+        pa_threaded_mainloop_signal(batch->mainloop, 0);
+    }
+}
+
+/**
+ * @brief Completion callback for operations reporting a success flag.
+ *
+ * @param c The PulseAudio context.
+ * @param success Non-zero if the operation succeeded.
+ * @param userdata Pointer to the op_batch the operation belongs to.
+ */
+void op_batch_success_cb(pa_context *c, int success, void *userdata) {
+    (void) c;
+
+    op_batch_complete((op_batch *) userdata, success != 0);
+}
+
+/**
+ * @brief Waits until every operation of the batch has completed.
+ *
+ * Must be called with the mainloop locked, from outside the mainloop thread. The wait
+ * also ends when no operation is running any more (the context failed and cancelled
+ * them); the operations that did not complete are then counted as failures.
+ *
+ * @param batch The batch.
+ */
+void op_batch_wait(op_batch *batch) {
+    while (batch->pending > 0 && op_batch_running(batch)) {
+        metrics_lock_suspend();
+        pa_threaded_mainloop_wait(batch->mainloop);
+        metrics_lock_resume();
+    }
+
+    for (; batch->pending > 0; batch->pending--) {
+        batch->failed++;
+        metrics_op_end(batch->kind, batch->start_ns, false);
+    }
+
+    for (uint32_t i = 0; i < batch->op_count; ++i) {
+        pa_operation_set_state_callback(batch->ops[i], NULL, NULL);
+        pa_operation_unref(batch->ops[i]);
+    }
+    free(batch->ops);
+    batch->ops = NULL;
+    batch->op_count = batch->op_capacity = 0;
+
+    if (batch->started > 0) {
+        metrics_round_trip();
+    }
+}
@@ -0,0 +1,69 @@
+/**
+ * @file op_batch.h
+ * @brief Pipelined submission of PulseAudio operations.
+ *
+ * An op_batch tracks a group of operations that are all sent to the server before
+ * waiting for any of them. The server processes them in order, so a batch of N
+ * operations costs one round trip instead of N.
+ *
+ * Usage (from any thread but the mainloop thread):
+ * @code
+ * op_batch batch;
+ * op_batch_init(&batch, manager->mainloop, METRIC_OP_MOVE_SINK_INPUT);
+ * pa_threaded_mainloop_lock(manager->mainloop);
+ * for (...) {
+ *     op_batch_add(&batch, pa_context_move_sink_input_by_index(c, idx, sink, op_batch_success_cb, &batch));
+ * }
+ * op_batch_wait(&batch);
+ * pa_threaded_mainloop_unlock(manager->mainloop);
+ * @endcode
+ *
+ * The mainloop must stay locked from the first op_batch_add() to the end of
+ * op_batch_wait(), so that no completion can be processed before it is counted.
+ *
+ * The batch keeps a reference to each operation until op_batch_wait() returns. When
+ * the context fails or disconnects, libpulse cancels the operations in flight without
+ * calling their callbacks: the wait then ends once no operation is running, and the
+ * completions that never came count as failures.
+ *
+ * Each operation is recorded in the metrics under the kind of the batch, with the
+ * time from op_batch_init() to its completion, and the batch counts as one round trip.
+ */
+
+#ifndef OP_BATCH_H
+#define OP_BATCH_H
+
+#include "easypulse_metrics.h"
+#include <pulse/pulseaudio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct op_batch {
+    pa_threaded_mainloop *mainloop;   // Mainloop signalled by the completions.
+    uint32_t pending;                 // Operations still in flight.
+    uint32_t succeeded;               // Operations completed successfully.
+    uint32_t failed;                  // Operations that failed or could not be started.
+    uint32_t started;                 // Operations sent to the server.
+    pa_operation **ops;               // Operations sent and not yet waited for.
+    uint32_t op_count;
+    uint32_t op_capacity;
+    metric_id kind;                   // Metric the operations are recorded under.
+    uint64_t start_ns;                // Time the batch was started (0 when metrics are off).
+} op_batch;
+
+void op_batch_init(op_batch *batch, pa_threaded_mainloop *mainloop,
+metric_id kind);                                                            //Initializes an empty batch.
+bool op_batch_add(op_batch *batch, pa_operation *op);                       //Counts a started operation (NULL counts as a failure).
+void op_batch_complete(op_batch *batch, bool success);                      //Records the completion of an operation.
+void op_batch_success_cb(pa_context *c, int success, void *userdata);       //Completion callback for operations with a success flag.
+void op_batch_wait(op_batch *batch);                                        //Waits for every operation of the batch (mainloop locked).
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,277 @@
+/**
+ * @file peak_meter.c
+ * @brief Implementation of the peak meters.
+ *
+ * A meter is a recording stream of the manager context on the device (or on the
+ * monitor of an output) with PA_STREAM_PEAK_DETECT. It is opened by the first request
+ * for the device and stays open until the manager is cleaned up.
+ */
+
+#include "peak_meter.h"
+#include "easypulse_internal.h"
+#include "easypulse_log.h"
+#include "easypulse_metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Peak meter of a device, kept open once a peak has been requested
+struct manager_meter {
+    pulseaudio_manager *manager;
+    pa_stream *stream;          //Recording stream with PA_STREAM_PEAK_DETECT.
+    bool output;                //Whether the device is an output (the monitor is recorded).
+    uint32_t index;             //Index of the device.
+    float peak;                 //Last peak received, between 0 and 1.
+    bool has_peak;              //Whether a peak was received.
+    bool failed;                //The stream failed or was terminated.
+    bool timed_out;             //The wait for the first peak timed out.
+};
+
+/**
+ * @brief Read callback of a peak meter.
+ *
+ * With PA_STREAM_PEAK_DETECT, every sample read is the peak of a fragment of the
+ * monitored device, between 0 and 1. The last one is kept.
+ *
+ * @param s The meter stream.
+ * @param nbytes Number of bytes readable.
+ * @param userdata User-provided data, expected to be a pointer to the manager_meter.
+ */
+static void manager_meter_read_cb(pa_stream *s, size_t nbytes, void *userdata) {
+    (void) nbytes;
+
+    manager_meter *meter = (manager_meter *) userdata;
+    const void *data;
+    size_t length;
+
+    while (pa_stream_readable_size(s) > 0) {
+        if (pa_stream_peek(s, &data, &length) < 0 || length == 0) {
+            break;
+        }
+        // data is NULL for a hole in the stream, which must be dropped as well
+        if (data && length >= sizeof(float)) {
+            meter->peak = ((const float *) data)[length / sizeof(float) - 1];
+            meter->has_peak = true;
+        }
+        pa_stream_drop(s);
+    }
+
+    pa_threaded_mainloop_signal(meter->manager->mainloop, 0);
+}
+
+/**
+ * @brief State callback of a peak meter.
+ *
+ * @param s The meter stream.
+ * @param userdata User-provided data, expected to be a pointer to the manager_meter.
+ */
+static void manager_meter_state_cb(pa_stream *s, void *userdata) {
+    manager_meter *meter = (manager_meter *) userdata;
+
+    pa_stream_state_t state = pa_stream_get_state(s);
+    if (state == PA_STREAM_FAILED || state == PA_STREAM_TERMINATED) {
+        meter->failed = true;
+    }
+    pa_threaded_mainloop_signal(meter->manager->mainloop, 0);
+}
+
+/**
+ * @brief Ends the wait for the first peak of a meter.
+ *
+ * A suspended device produces no data, so its meter never reads anything.
+ */
+static void manager_meter_timeout_cb(pa_mainloop_api *api, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    (void) api;
+    (void) e;
+    (void) tv;
+
+    manager_meter *meter = (manager_meter *) userdata;
+    meter->timed_out = true;
+    pa_threaded_mainloop_signal(meter->manager->mainloop, 0);
+}
+
+/**
+ * @brief Disconnects a peak meter and frees it. Mainloop locked.
+ *
+ * @param meter The meter.
+ */
+static void manager_free_meter(manager_meter *meter) {
+    if (meter->stream) {
+        pa_stream_set_read_callback(meter->stream, NULL, NULL);
+        pa_stream_set_state_callback(meter->stream, NULL, NULL);
+        if (pa_stream_get_state(meter->stream) == PA_STREAM_READY ||
+            pa_stream_get_state(meter->stream) == PA_STREAM_CREATING) {
+            pa_stream_disconnect(meter->stream);
+        }
+        pa_stream_unref(meter->stream);
+    }
+    free(meter);
+}
+
+/**
+ * @brief Opens a peak meter on a device and waits for its first peak. Mainloop locked.
+ *
+ * The meter records from the device (or from the monitor of an output) with
+ * PA_STREAM_PEAK_DETECT, so the server sends MANAGER_METER_RATE peaks per second
+ * instead of the audio.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param output Whether the device is an output.
+ * @param device The device.
+ * @return The meter, added to manager->meters, or NULL on failure.
+ */
+static manager_meter *manager_open_meter(pulseaudio_manager *manager, bool output, const pulseaudio_device *device) {
+    manager_meter **meters = realloc(manager->meters, (manager->meter_count + 1) * sizeof(manager_meter *));
+    manager_meter *meter = calloc(1, sizeof(manager_meter));
+    if (meters) {
+        manager->meters = meters;
+    }
+    if (!meters || !meter) {
+        EASYPULSE_ERROR("Failed to allocate memory for the peak meter.");
+        free(meter);
+        return NULL;
+    }
+
+    meter->manager = manager;
+    meter->output = output;
+    meter->index = device->index;
+
+    pa_sample_spec spec = { PA_SAMPLE_FLOAT32NE, MANAGER_METER_RATE, 1 };
+    meter->stream = pa_stream_new(manager->context, "easypulse peak meter", &spec, NULL);
+    if (!meter->stream) {
+        EASYPULSE_ERROR("Failed to create the peak meter of %s.", device->code);
+        free(meter);
+        return NULL;
+    }
+    pa_stream_set_read_callback(meter->stream, manager_meter_read_cb, meter);
+    pa_stream_set_state_callback(meter->stream, manager_meter_state_cb, meter);
+
+    // One peak per fragment
+    pa_buffer_attr attr;
+    memset(&attr, 0xff, sizeof(attr));
+    attr.fragsize = sizeof(float);
+
+    char source[256];
+    snprintf(source, sizeof(source), output ? "%s.monitor" : "%s", device->code);
+
+    if (pa_stream_connect_record(meter->stream, source, &attr,
+                                 PA_STREAM_DONT_MOVE | PA_STREAM_PEAK_DETECT | PA_STREAM_ADJUST_LATENCY) < 0) {
+        EASYPULSE_ERROR("Failed to connect the peak meter of %s.", device->code);
+        manager_free_meter(meter);
+        return NULL;
+    }
+
+    pa_mainloop_api *api = pa_threaded_mainloop_get_api(manager->mainloop);
+    pa_time_event *timeout = pa_context_rttime_new(manager->context, pa_rtclock_now() + MANAGER_METER_TIMEOUT_USEC,
+                                                   manager_meter_timeout_cb, meter);
+    while (!meter->has_peak && !meter->failed && !meter->timed_out) {
+        manager_wait(manager);
+    }
+    if (timeout) {
+        api->time_free(timeout);
+    }
+
+    if (meter->failed) {
+        EASYPULSE_ERROR("The peak meter of %s failed.", device->code);
+        manager_free_meter(meter);
+        return NULL;
+    }
+
+    manager->meters[manager->meter_count++] = meter;
+    return meter;
+}
+
+/**
+ * @brief Closes the peak meters of the manager, when it is cleaned up.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ */
+void manager_close_meters(pulseaudio_manager *manager) {
+    if (!manager->meters) {
+        return;
+    }
+
+    manager_lock(manager);
+    for (uint32_t i = 0; i < manager->meter_count; ++i) {
+        manager_free_meter(manager->meters[i]);
+    }
+    free(manager->meters);
+    manager->meters = NULL;
+    manager->meter_count = 0;
+    manager_unlock(manager);
+}
+
+/**
+ * @brief Returns the current peak level of a device.
+ *
+ * The first call for a device opens a meter on it and waits for its first peak (up to
+ * MANAGER_METER_TIMEOUT_USEC); the meter then stays open, so the next calls return
+ * the last peak received without any round trip to the server.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param output Whether the device is an output.
+ * @param index The position of the device in manager->outputs or manager->inputs.
+ * @param peak Where to store the peak, between 0 and 1 (0 while the device is suspended).
+ * @return 0 on success, -1 on failure.
+ */
+static int manager_get_peak_impl(pulseaudio_manager *manager, bool output, uint32_t index, float *peak) {
+    if (!manager || !manager->context || !peak) {
+        EASYPULSE_ERROR("Invalid arguments provided.");
+        return -1;
+    }
+
+    if (index >= (output ? manager->output_count : manager->input_count)) {
+        EASYPULSE_ERROR("Device index out of range.");
+        return -1;
+    }
+
+    const pulseaudio_device *device = output ? &manager->outputs[index] : &manager->inputs[index];
+
+    manager_lock(manager);
+
+    manager_meter *meter = NULL;
+    for (uint32_t i = 0; i < manager->meter_count; ++i) {
+        if (manager->meters[i]->output == output && manager->meters[i]->index == device->index) {
+            meter = manager->meters[i];
+            break;
+        }
+    }
+
+    // A meter whose stream went away (device removed) is opened again
+    if (meter && meter->failed) {
+        for (uint32_t i = 0; i < manager->meter_count; ++i) {
+            if (manager->meters[i] == meter) {
+                manager->meters[i] = manager->meters[--manager->meter_count];
+                break;
+            }
+        }
+        manager_free_meter(meter);
+        meter = NULL;
+    }
+
+    if (!meter) {
+        meter = manager_open_meter(manager, output, device);
+    }
+
+    if (meter) {
+        *peak = meter->has_peak ? meter->peak : 0.0f;
+    }
+
+    manager_unlock(manager);
+    return meter ? 0 : -1;
+}
+
+int manager_get_output_peak(pulseaudio_manager *manager, uint32_t index, float *peak) {
+    metrics_call call = metrics_api_begin();
+    int result = manager_get_peak_impl(manager, true, index, peak);
+    metrics_api_end(METRIC_API_GET_PEAK, call, result == 0);
+    return result;
+}
+
+int manager_get_input_peak(pulseaudio_manager *manager, uint32_t index, float *peak) {
+    metrics_call call = metrics_api_begin();
+    int result = manager_get_peak_impl(manager, false, index, peak);
+    metrics_api_end(METRIC_API_GET_PEAK, call, result == 0);
+    return result;
+}
+
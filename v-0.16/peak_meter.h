@@ -0,0 +1,35 @@
+/**
+ * @file peak_meter.h
+ * @brief Peak levels of the devices of a manager.
+ *
+ * The first request for a device opens a meter on it and waits for its first peak;
+ * the meter then stays open, so the next requests return the last peak received
+ * without any round trip to the server. The server sends MANAGER_METER_RATE peaks per
+ * second to a meter instead of the audio. A suspended device sends nothing, its peak
+ * is 0.
+ */
+
+#ifndef PEAK_METER_H
+#define PEAK_METER_H
+
+#include "easypulse_core.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MANAGER_METER_RATE 25              // Peaks per second sent by the server to a peak meter.
+#define MANAGER_METER_TIMEOUT_USEC 250000  // Wait for the first peak of a new meter.
+
+int manager_get_output_peak(pulseaudio_manager *manager,
+uint32_t index, float *peak);                                      //Gets the current peak level (0 to 1) of an output device.
+
+int manager_get_input_peak(pulseaudio_manager *manager,
+uint32_t index, float *peak);                                      //Gets the current peak level (0 to 1) of an input device.
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,827 @@
+/**
+ * @file scene.c
+ * @brief Implementation of the mixer scenes.
+ *
+ * The live state is read with one batch of list requests (devices, cards, streams and
+ * server information) and kept in a scene_live. A capture serializes it into the file
+ * format; a restore compares it with the scene and sends the differences.
+ */
+
+#include "scene.h"
+#include "easypulse_internal.h"
+#include "easypulse_log.h"
+#include "easypulse_metrics.h"
+#include "op_batch.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SCENE_ALIGN(size) (((size) + 7) & ~(size_t) 7)
+
+struct mixer_scene {
+    const uint8_t *data;                // The scene in its file format.
+    size_t size;
+    bool mapped;                        // Mapped from a file (otherwise allocated).
+};
+
+//A device as read from the server.
+typedef struct scene_live_device {
+    uint32_t index;
+    uint64_t id;
+    bool output;
+    char *name;
+    pa_cvolume volume;
+    int mute;
+    char *port;                         // Active port (NULL if none).
+} scene_live_device;
+
+//A card as read from the server.
+typedef struct scene_live_card {
+    uint32_t index;
+    uint64_t id;
+    char *profile;                      // Active profile (NULL if none).
+} scene_live_card;
+
+//A stream as read from the server.
+typedef struct scene_live_stream {
+    uint32_t index;
+    uint64_t id;                        // 0 if it has no application name.
+    bool output;
+    uint32_t device;                    // Index of its sink or source.
+} scene_live_stream;
+
+//Live state of the mixer.
+typedef struct scene_live {
+    scene_live_device *devices;
+    uint32_t device_count;
+    uint32_t device_capacity;
+    scene_live_card *cards;
+    uint32_t card_count;
+    uint32_t card_capacity;
+    scene_live_stream *streams;
+    uint32_t stream_count;
+    uint32_t stream_capacity;
+    char *default_sink;
+    char *default_source;
+    bool out_of_memory;
+    op_batch *batch;
+} scene_live;
+
+//Positions of the tables of a scene.
+typedef struct scene_layout {
+    size_t devices;
+    size_t cards;
+    size_t streams;
+    size_t volumes;
+    size_t strings;
+    size_t size;
+} scene_layout;
+
+static scene_layout scene_layout_of(const scene_header *header) {
+    scene_layout layout;
+    layout.devices = SCENE_ALIGN(sizeof(scene_header));
+    layout.cards = layout.devices + SCENE_ALIGN((size_t) header->device_count * sizeof(scene_device));
+    layout.streams = layout.cards + SCENE_ALIGN((size_t) header->card_count * sizeof(scene_card));
+    layout.volumes = layout.streams + SCENE_ALIGN((size_t) header->stream_count * sizeof(scene_stream));
+    layout.strings = layout.volumes + SCENE_ALIGN((size_t) header->volume_count * sizeof(uint32_t));
+    layout.size = layout.strings + header->strings_size;
+    return layout;
+}
+
+/**
+ * @brief Appends a zeroed element to a growable array.
+ *
+ * @return The element, or NULL on allocation failure.
+ */
+static void *scene_append(void **array, uint32_t *count, uint32_t *capacity, size_t size) {
+    if (*count == *capacity) {
+        uint32_t larger = *capacity ? *capacity * 2 : 16;
+        void *grown = realloc(*array, larger * size);
+        if (!grown) {
+            return NULL;
+        }
+        *array = grown;
+        *capacity = larger;
+    }
+    void *element = (char *) *array + (size_t) (*count)++ * size;
+    memset(element, 0, size);
+    return element;
+}
+
+/**
+ * @brief Stable id of a stream: hash of its application name and media role.
+ *
+ * @return The id, 0 if the stream has no application name.
+ */
+static uint64_t scene_stream_id(const pa_proplist *proplist) {
+    const char *application = proplist ? pa_proplist_gets(proplist, PA_PROP_APPLICATION_NAME) : NULL;
+    if (!application) {
+        return 0;
+    }
+    const char *role = pa_proplist_gets(proplist, PA_PROP_MEDIA_ROLE);
+
+    char key[512];
+    snprintf(key, sizeof(key), "%s\n%s", application, role ? role : "");
+    return manager_device_stable_id(key);
+}
+
+static void scene_live_free(scene_live *live) {
+    for (uint32_t i = 0; i < live->device_count; ++i) {
+        free(live->devices[i].name);
+        free(live->devices[i].port);
+    }
+    for (uint32_t i = 0; i < live->card_count; ++i) {
+        free(live->cards[i].profile);
+    }
+    free(live->devices);
+    free(live->cards);
+    free(live->streams);
+    free(live->default_sink);
+    free(live->default_source);
+    memset(live, 0, sizeof(scene_live));
+}
+
+static void scene_add_device(scene_live *live, bool output, uint32_t index, const char *name,
+                             const pa_cvolume *volume, int mute, const char *port) {
+    scene_live_device *device = scene_append((void **) &live->devices, &live->device_count,
+                                             &live->device_capacity, sizeof(scene_live_device));
+    if (!device || !(device->name = strdup(name)) || (port && !(device->port = strdup(port)))) {
+        live->out_of_memory = true;
+        return;
+    }
+    device->index = index;
+    device->id = manager_device_stable_id(name);
+    device->output = output;
+    device->volume = *volume;
+    device->mute = mute;
+}
+
+static void scene_sink_cb(pa_context *c, const pa_sink_info *info, int eol, void *userdata) {
+    (void) c;
+    scene_live *live = (scene_live *) userdata;
+
+    if (eol != 0) {
+        op_batch_complete(live->batch, eol > 0);
+        return;
+    }
+    scene_add_device(live, true, info->index, info->name, &info->volume, info->mute,
+                     info->active_port ? info->active_port->name : NULL);
+}
+
+static void scene_source_cb(pa_context *c, const pa_source_info *info, int eol, void *userdata) {
+    (void) c;
+    scene_live *live = (scene_live *) userdata;
+
+    if (eol != 0) {
+        op_batch_complete(live->batch, eol > 0);
+        return;
+    }
+    scene_add_device(live, false, info->index, info->name, &info->volume, info->mute,
+                     info->active_port ? info->active_port->name : NULL);
+}
+
+static void scene_card_cb(pa_context *c, const pa_card_info *info, int eol, void *userdata) {
+    (void) c;
+    scene_live *live = (scene_live *) userdata;
+
+    if (eol != 0) {
+        op_batch_complete(live->batch, eol > 0);
+        return;
+    }
+    scene_live_card *card = scene_append((void **) &live->cards, &live->card_count, &live->card_capacity,
+                                         sizeof(scene_live_card));
+    if (!card || (info->active_profile && !(card->profile = strdup(info->active_profile->name)))) {
+        live->out_of_memory = true;
+        return;
+    }
+    card->index = info->index;
+    card->id = manager_device_stable_id(info->name);
+}
+
+static void scene_add_stream(scene_live *live, bool output, uint32_t index, uint32_t device,
+                             const pa_proplist *proplist) {
+    scene_live_stream *stream = scene_append((void **) &live->streams, &live->stream_count,
+                                             &live->stream_capacity, sizeof(scene_live_stream));
+    if (!stream) {
+        live->out_of_memory = true;
+        return;
+    }
+    stream->index = index;
+    stream->id = scene_stream_id(proplist);
+    stream->output = output;
+    stream->device = device;
+}
+
+static void scene_sink_input_cb(pa_context *c, const pa_sink_input_info *info, int eol, void *userdata) {
+    (void) c;
+    scene_live *live = (scene_live *) userdata;
+
+    if (eol != 0) {
+        op_batch_complete(live->batch, eol > 0);
+        return;
+    }
+    scene_add_stream(live, true, info->index, info->sink, info->proplist);
+}
+
+static void scene_source_output_cb(pa_context *c, const pa_source_output_info *info, int eol, void *userdata) {
+    (void) c;
+    scene_live *live = (scene_live *) userdata;
+
+    if (eol != 0) {
+        op_batch_complete(live->batch, eol > 0);
+        return;
+    }
+    scene_add_stream(live, false, info->index, info->source, info->proplist);
+}
+
+static void scene_server_cb(pa_context *c, const pa_server_info *info, void *userdata) {
+    (void) c;
+    scene_live *live = (scene_live *) userdata;
+
+    if (info) {
+        live->default_sink = info->default_sink_name ? strdup(info->default_sink_name) : NULL;
+        live->default_source = info->default_source_name ? strdup(info->default_source_name) : NULL;
+    }
+    op_batch_complete(live->batch, info != NULL);
+}
+
+/**
+ * @brief Reads the live state in one batch. Mainloop locked.
+ *
+ * @return true on success, false otherwise (the state is then freed).
+ */
+static bool scene_read_live(pulseaudio_manager *manager, scene_live *live) {
+    pa_context *c = manager->context;
+    op_batch batch;
+
+    memset(live, 0, sizeof(scene_live));
+    live->batch = &batch;
+    op_batch_init(&batch, manager->mainloop, METRIC_OP_BATCH);
+    op_batch_add(&batch, pa_context_get_sink_info_list(c, scene_sink_cb, live));
+    op_batch_add(&batch, pa_context_get_source_info_list(c, scene_source_cb, live));
+    op_batch_add(&batch, pa_context_get_card_info_list(c, scene_card_cb, live));
+    op_batch_add(&batch, pa_context_get_sink_input_info_list(c, scene_sink_input_cb, live));
+    op_batch_add(&batch, pa_context_get_source_output_info_list(c, scene_source_output_cb, live));
+    op_batch_add(&batch, pa_context_get_server_info(c, scene_server_cb, live));
+    op_batch_wait(&batch);
+    live->batch = NULL;
+
+    if (batch.failed > 0 || live->out_of_memory) {
+        EASYPULSE_ERROR("Failed to read the mixer state.");
+        scene_live_free(live);
+        return false;
+    }
+    return true;
+}
+
+static const scene_live_device *scene_find_live_device(const scene_live *live, bool output, uint64_t id) {
+    for (uint32_t i = 0; i < live->device_count; ++i) {
+        if (live->devices[i].output == output && live->devices[i].id == id) {
+            return &live->devices[i];
+        }
+    }
+    return NULL;
+}
+
+static const scene_live_device *scene_find_live_index(const scene_live *live, bool output, uint32_t index) {
+    for (uint32_t i = 0; i < live->device_count; ++i) {
+        if (live->devices[i].output == output && live->devices[i].index == index) {
+            return &live->devices[i];
+        }
+    }
+    return NULL;
+}
+
+static bool scene_check_manager(const pulseaudio_manager *manager) {
+    if (!manager || !manager->context) {
+        EASYPULSE_ERROR("Invalid PulseAudio manager or context.");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Appends a string to the strings of a scene being built.
+ *
+ * @return Its offset, or SCENE_NONE for NULL.
+ */
+static uint32_t scene_put_string(uint8_t *strings, uint32_t *used, const char *text) {
+    if (!text) {
+        return SCENE_NONE;
+    }
+    uint32_t offset = *used;
+    size_t length = strlen(text) + 1;
+    memcpy(strings + offset, text, length);
+    *used += (uint32_t) length;
+    return offset;
+}
+
+/**
+ * @brief Serializes a live state into a scene.
+ */
+static mixer_scene *scene_build(const scene_live *live) {
+    scene_header header = {
+        .magic = SCENE_MAGIC,
+        .version = SCENE_VERSION,
+        .header_size = sizeof(scene_header),
+        .device_count = live->device_count,
+        .card_count = live->card_count,
+        .default_output = live->default_sink ? manager_device_stable_id(live->default_sink) : 0,
+        .default_input = live->default_source ? manager_device_stable_id(live->default_source) : 0,
+    };
+
+    size_t strings_size = 0;
+    for (uint32_t i = 0; i < live->device_count; ++i) {
+        header.volume_count += live->devices[i].volume.channels;
+        strings_size += live->devices[i].port ? strlen(live->devices[i].port) + 1 : 0;
+    }
+    for (uint32_t i = 0; i < live->card_count; ++i) {
+        strings_size += live->cards[i].profile ? strlen(live->cards[i].profile) + 1 : 0;
+    }
+    for (uint32_t i = 0; i < live->stream_count; ++i) {
+        header.stream_count += live->streams[i].id != 0 &&
+                               scene_find_live_index(live, live->streams[i].output, live->streams[i].device);
+    }
+    header.strings_size = (uint32_t) strings_size;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    header.captured_usec = (uint64_t) now.tv_sec * 1000000ull + (uint64_t) now.tv_nsec / 1000;
+
+    scene_layout layout = scene_layout_of(&header);
+    header.size = (uint32_t) layout.size;
+
+    mixer_scene *scene = malloc(sizeof(mixer_scene));
+    uint8_t *data = calloc(1, layout.size);
+    if (!scene || !data) {
+        EASYPULSE_ERROR("Failed to allocate memory for the scene.");
+        free(scene);
+        free(data);
+        return NULL;
+    }
+
+    memcpy(data, &header, sizeof(scene_header));
+    scene_device *devices = (scene_device *) (data + layout.devices);
+    scene_card *cards = (scene_card *) (data + layout.cards);
+    scene_stream *streams = (scene_stream *) (data + layout.streams);
+    uint32_t *volumes = (uint32_t *) (data + layout.volumes);
+    uint8_t *strings = data + layout.strings;
+    uint32_t volume_count = 0;
+    uint32_t strings_used = 0;
+
+    for (uint32_t i = 0; i < live->device_count; ++i) {
+        const scene_live_device *device = &live->devices[i];
+        devices[i] = (scene_device) {
+            .id = device->id,
+            .volumes = volume_count,
+            .port = scene_put_string(strings, &strings_used, device->port),
+            .output = device->output,
+            .mute = device->mute != 0,
+            .channels = device->volume.channels,
+        };
+        for (uint8_t channel = 0; channel < device->volume.channels; ++channel) {
+            volumes[volume_count++] = device->volume.values[channel];
+        }
+    }
+    for (uint32_t i = 0; i < live->card_count; ++i) {
+        cards[i] = (scene_card) {
+            .id = live->cards[i].id,
+            .profile = scene_put_string(strings, &strings_used, live->cards[i].profile),
+        };
+    }
+    for (uint32_t i = 0, position = 0; i < live->stream_count; ++i) {
+        const scene_live_stream *stream = &live->streams[i];
+        const scene_live_device *device = scene_find_live_index(live, stream->output, stream->device);
+        if (stream->id != 0 && device) {
+            streams[position++] = (scene_stream) { .id = stream->id, .device = device->id, .output = stream->output };
+        }
+    }
+
+    scene->data = data;
+    scene->size = layout.size;
+    scene->mapped = false;
+    return scene;
+}
+
+static mixer_scene *scene_capture_impl(pulseaudio_manager *manager) {
+    if (!scene_check_manager(manager)) {
+        return NULL;
+    }
+    manager_lock(manager);
+
+    scene_live live;
+    bool read = scene_read_live(manager, &live);
+    manager_unlock(manager);
+    if (!read) {
+        return NULL;
+    }
+
+    mixer_scene *scene = scene_build(&live);
+    scene_live_free(&live);
+    return scene;
+}
+
+/**
+ * @brief Captures the live mixer state.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @return The scene, to be freed with scene_free(), or NULL on failure.
+ */
+mixer_scene *scene_capture(pulseaudio_manager *manager) {
+    metrics_call call = metrics_api_begin();
+    mixer_scene *scene = scene_capture_impl(manager);
+    metrics_api_end(METRIC_API_SCENE_CAPTURE, call, scene != NULL);
+    return scene;
+}
+
+/**
+ * @brief Writes a scene to a file, replacing it atomically.
+ *
+ * @param scene The scene.
+ * @param path Path of the file.
+ * @return true on success, false otherwise.
+ */
+bool scene_save(const mixer_scene *scene, const char *path) {
+    if (!scene || !path) {
+        return false;
+    }
+
+    // Written next to the file and renamed, so that a mapped scene never changes
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+
+    FILE *file = fopen(temporary, "wb");
+    if (!file) {
+        EASYPULSE_ERROR("Cannot create the scene file %s.", temporary);
+        return false;
+    }
+    bool written = fwrite(scene->data, 1, scene->size, file) == scene->size;
+    written = fclose(file) == 0 && written;
+    if (!written || rename(temporary, path) != 0) {
+        EASYPULSE_ERROR("Cannot write the scene file %s.", path);
+        unlink(temporary);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Checks that everything a scene refers to lies within it.
+ */
+static bool scene_valid(const uint8_t *data, size_t size) {
+    const scene_header *header = (const scene_header *) data;
+    if (size < sizeof(scene_header) || header->magic != SCENE_MAGIC || header->version != SCENE_VERSION ||
+        header->header_size != sizeof(scene_header) || header->size != size) {
+        return false;
+    }
+
+    scene_layout layout = scene_layout_of(header);
+    if (layout.size != size || (header->strings_size > 0 && data[size - 1] != '\0')) {
+        return false;
+    }
+
+    const scene_device *devices = (const scene_device *) (data + layout.devices);
+    for (uint32_t i = 0; i < header->device_count; ++i) {
+        if (devices[i].channels == 0 || devices[i].channels > PA_CHANNELS_MAX ||
+            (uint64_t) devices[i].volumes + devices[i].channels > header->volume_count ||
+            (devices[i].port != SCENE_NONE && devices[i].port >= header->strings_size)) {
+            return false;
+        }
+    }
+    const scene_card *cards = (const scene_card *) (data + layout.cards);
+    for (uint32_t i = 0; i < header->card_count; ++i) {
+        if (cards[i].profile != SCENE_NONE && cards[i].profile >= header->strings_size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Maps a scene file.
+ *
+ * @param path Path of the file.
+ * @return The scene, to be freed with scene_free(), or NULL if the file is missing or
+ *         is not a valid scene of this version.
+ */
+mixer_scene *scene_load(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        EASYPULSE_ERROR("Cannot open the scene file %s.", path);
+        return NULL;
+    }
+
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(scene_header) && st.st_size <= UINT32_MAX) {
+        data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        EASYPULSE_ERROR("Cannot map the scene file %s.", path);
+        return NULL;
+    }
+    if (!scene_valid(data, (size_t) st.st_size)) {
+        EASYPULSE_ERROR("The scene file %s is invalid or has another version.", path);
+        munmap(data, (size_t) st.st_size);
+        return NULL;
+    }
+
+    mixer_scene *scene = malloc(sizeof(mixer_scene));
+    if (!scene) {
+        EASYPULSE_ERROR("Failed to allocate memory for the scene.");
+        munmap(data, (size_t) st.st_size);
+        return NULL;
+    }
+    scene->data = data;
+    scene->size = (size_t) st.st_size;
+    scene->mapped = true;
+    return scene;
+}
+
+/**
+ * @brief Frees or unmaps a scene.
+ *
+ * @param scene The scene (NULL is ignored).
+ */
+void scene_free(mixer_scene *scene) {
+    if (!scene) {
+        return;
+    }
+    if (scene->mapped) {
+        munmap((void *) scene->data, scene->size);
+    } else {
+        free((void *) scene->data);
+    }
+    free(scene);
+}
+
+const scene_header *scene_get_header(const mixer_scene *scene) {
+    return (const scene_header *) scene->data;
+}
+
+const scene_device *scene_get_devices(const mixer_scene *scene) {
+    return (const scene_device *) (scene->data + scene_layout_of(scene_get_header(scene)).devices);
+}
+
+const scene_card *scene_get_cards(const mixer_scene *scene) {
+    return (const scene_card *) (scene->data + scene_layout_of(scene_get_header(scene)).cards);
+}
+
+const scene_stream *scene_get_streams(const mixer_scene *scene) {
+    return (const scene_stream *) (scene->data + scene_layout_of(scene_get_header(scene)).streams);
+}
+
+const uint32_t *scene_get_volumes(const mixer_scene *scene) {
+    return (const uint32_t *) (scene->data + scene_layout_of(scene_get_header(scene)).volumes);
+}
+
+const char *scene_get_string(const mixer_scene *scene, uint32_t offset) {
+    if (offset == SCENE_NONE) {
+        return NULL;
+    }
+    return (const char *) scene->data + scene_layout_of(scene_get_header(scene)).strings + offset;
+}
+
+/**
+ * @brief Sends the card profiles of a scene that differ from the live state. Mainloop locked.
+ *
+ * @return The number of operations sent.
+ */
+static uint32_t scene_send_profiles(pulseaudio_manager *manager, const mixer_scene *scene, const scene_live *live,
+                                    op_batch *batch, scene_restore_stats *stats) {
+    const scene_header *header = scene_get_header(scene);
+    const scene_card *cards = scene_get_cards(scene);
+    uint32_t sent = 0;
+
+    for (uint32_t i = 0; i < header->card_count; ++i) {
+        const char *profile = scene_get_string(scene, cards[i].profile);
+        const scene_live_card *card = NULL;
+        for (uint32_t j = 0; j < live->card_count && !card; ++j) {
+            card = live->cards[j].id == cards[i].id ? &live->cards[j] : NULL;
+        }
+
+        if (!card) {
+            stats->missing++;
+        } else if (profile && (!card->profile || strcmp(card->profile, profile) != 0)) {
+            op_batch_add(batch, pa_context_set_card_profile_by_index(manager->context, card->index, profile,
+                                                                     op_batch_success_cb, batch));
+            sent++;
+        }
+    }
+    return sent;
+}
+
+/**
+ * @brief Sends the device settings, defaults and stream moves of a scene that differ
+ * from the live state. Mainloop locked.
+ *
+ * @return The number of operations sent.
+ */
+static uint32_t scene_send_changes(pulseaudio_manager *manager, const mixer_scene *scene, const scene_live *live,
+                                   op_batch *batch, scene_restore_stats *stats) {
+    pa_context *c = manager->context;
+    const scene_header *header = scene_get_header(scene);
+    const scene_device *devices = scene_get_devices(scene);
+    const uint32_t *volumes = scene_get_volumes(scene);
+    uint32_t sent = 0;
+
+    for (uint32_t i = 0; i < header->device_count; ++i) {
+        const scene_device *saved = &devices[i];
+        const scene_live_device *device = scene_find_live_device(live, saved->output, saved->id);
+        if (!device) {
+            stats->missing++;
+            continue;
+        }
+
+        // The port first: the server may restore a volume saved for the new port
+        const char *port = scene_get_string(scene, saved->port);
+        if (port && (!device->port || strcmp(device->port, port) != 0)) {
+            op_batch_add(batch, saved->output
+                ? pa_context_set_sink_port_by_index(c, device->index, port, op_batch_success_cb, batch)
+                : pa_context_set_source_port_by_index(c, device->index, port, op_batch_success_cb, batch));
+            sent++;
+        }
+
+        pa_cvolume volume;
+        volume.channels = saved->channels;
+        for (uint8_t channel = 0; channel < saved->channels; ++channel) {
+            volume.values[channel] = volumes[saved->volumes + channel];
+        }
+        if (device->volume.channels == volume.channels && !pa_cvolume_equal(&device->volume, &volume) &&
+            pa_cvolume_valid(&volume)) {
+            op_batch_add(batch, saved->output
+                ? pa_context_set_sink_volume_by_index(c, device->index, &volume, op_batch_success_cb, batch)
+                : pa_context_set_source_volume_by_index(c, device->index, &volume, op_batch_success_cb, batch));
+            sent++;
+        }
+
+        if ((device->mute != 0) != (saved->mute != 0)) {
+            op_batch_add(batch, saved->output
+                ? pa_context_set_sink_mute_by_index(c, device->index, saved->mute, op_batch_success_cb, batch)
+                : pa_context_set_source_mute_by_index(c, device->index, saved->mute, op_batch_success_cb, batch));
+            sent++;
+        }
+    }
+
+    const uint64_t defaults[2] = { header->default_output, header->default_input };
+    const char *current[2] = { live->default_sink, live->default_source };
+    for (int output = 1; output >= 0; --output) {
+        uint64_t id = defaults[1 - output];
+        const scene_live_device *device = id ? scene_find_live_device(live, output, id) : NULL;
+        if (id && !device) {
+            stats->missing++;
+        } else if (device && (!current[1 - output] || strcmp(current[1 - output], device->name) != 0)) {
+            op_batch_add(batch, output ? pa_context_set_default_sink(c, device->name, op_batch_success_cb, batch)
+                                       : pa_context_set_default_source(c, device->name, op_batch_success_cb, batch));
+            sent++;
+        }
+    }
+
+    const scene_stream *streams = scene_get_streams(scene);
+    for (uint32_t i = 0; i < header->stream_count; ++i) {
+        const scene_live_device *target = scene_find_live_device(live, streams[i].output, streams[i].device);
+        bool found = false;
+
+        for (uint32_t j = 0; j < live->stream_count; ++j) {
+            const scene_live_stream *stream = &live->streams[j];
+            if (stream->output != streams[i].output || stream->id != streams[i].id) {
+                continue;
+            }
+            found = true;
+            if (target && stream->device != target->index) {
+                op_batch_add(batch, stream->output
+                    ? pa_context_move_sink_input_by_index(c, stream->index, target->index, op_batch_success_cb, batch)
+                    : pa_context_move_source_output_by_index(c, stream->index, target->index, op_batch_success_cb,
+                                                             batch));
+                sent++;
+            }
+        }
+        stats->missing += !found || !target;
+    }
+    return sent;
+}
+
+static int scene_restore_impl(pulseaudio_manager *manager, const mixer_scene *scene, scene_restore_stats *stats) {
+    if (!scene) {
+        EASYPULSE_ERROR("No scene to restore.");
+        return -1;
+    }
+    if (!scene_check_manager(manager)) {
+        return -1;
+    }
+    manager_lock(manager);
+
+    uint64_t start = metrics_now_ns();
+    scene_live live;
+    if (!scene_read_live(manager, &live)) {
+        manager_unlock(manager);
+        return -1;
+    }
+    stats->round_trips++;
+
+    // A new profile recreates the devices of the card, which are then read again
+    op_batch profiles;
+    op_batch_init(&profiles, manager->mainloop, METRIC_OP_BATCH);
+    uint32_t sent = scene_send_profiles(manager, scene, &live, &profiles, stats);
+    if (sent > 0) {
+        op_batch_wait(&profiles);
+        stats->round_trips++;
+        stats->failed += profiles.failed;
+
+        scene_live_free(&live);
+        if (!scene_read_live(manager, &live)) {
+            manager_unlock(manager);
+            stats->operations = sent;
+            return -1;
+        }
+        stats->round_trips++;
+    }
+
+    op_batch changes;
+    op_batch_init(&changes, manager->mainloop, METRIC_OP_BATCH);
+    uint32_t changed = scene_send_changes(manager, scene, &live, &changes, stats);
+    if (changed > 0) {
+        op_batch_wait(&changes);
+        stats->round_trips++;
+        stats->failed += changes.failed;
+    }
+    manager_unlock(manager);
+    scene_live_free(&live);
+
+    stats->operations = sent + changed;
+    stats->elapsed_ns = metrics_now_ns() - start;
+    return (int) stats->operations;
+}
+
+/**
+ * @brief Restores a scene: sends the operations changing the live state into it.
+ *
+ * @param manager Pointer to the pulseaudio_manager instance.
+ * @param scene The scene.
+ * @param stats Filled with the outcome, or NULL.
+ * @return The number of operations sent, or -1 if the live state could not be read.
+ */
+int scene_restore(pulseaudio_manager *manager, const mixer_scene *scene, scene_restore_stats *stats) {
+    scene_restore_stats ignored;
+    if (!stats) {
+        stats = &ignored;
+    }
+    memset(stats, 0, sizeof(scene_restore_stats));
+
+    metrics_call call = metrics_api_begin();
+    int result = scene_restore_impl(manager, scene, stats);
+    metrics_api_end(METRIC_API_SCENE_RESTORE, call, result >= 0 && stats->failed == 0);
+    return result;
+}
+
+/**
+ * @brief Saves the device and card settings of a scene into a preference store.
+ *
+ * The entries of the devices and cards of the scene are replaced; the other entries of
+ * the store, such as those of devices unplugged when the scene was captured, are kept.
+ * The default devices of the scene become the default ones of the store.
+ *
+ * @param scene The scene.
+ * @param prefs The store.
+ * @return true on success, false otherwise.
+ */
+bool scene_store_device_prefs(const mixer_scene *scene, device_prefs *prefs) {
+    if (!scene || !prefs) {
+        return false;
+    }
+
+    const scene_header *header = scene_get_header(scene);
+    const scene_device *devices = scene_get_devices(scene);
+    const scene_card *cards = scene_get_cards(scene);
+    const uint32_t *volumes = scene_get_volumes(scene);
+
+    for (uint32_t i = 0; i < header->device_count; ++i) {
+        const scene_device *device = &devices[i];
+        pa_cvolume volume;
+        volume.channels = device->channels;
+        for (uint8_t channel = 0; channel < device->channels; ++channel) {
+            volume.values[channel] = volumes[device->volumes + channel];
+        }
+
+        uint64_t default_id = device->output ? header->default_output : header->default_input;
+        if (!device_prefs_set_device(prefs, device->output, device->id, pa_cvolume_valid(&volume) ? &volume : NULL,
+                                     device->mute, scene_get_string(scene, device->port),
+                                     default_id != 0 && default_id == device->id)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->card_count; ++i) {
+        const char *profile = scene_get_string(scene, cards[i].profile);
+        if (profile && !device_prefs_set_card(prefs, cards[i].id, profile)) {
+            return false;
+        }
+    }
+    return true;
+}
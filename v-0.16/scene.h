@@ -0,0 +1,119 @@
+/**
+ * @file scene.h
+ * @brief Mixer scenes: the whole mixer state saved to a file and restored in one batch.
+ *
+ * A scene holds, for every device, the volume of each channel, the mute state and the
+ * active port, the active profile of every card, the default devices and the device
+ * every stream plays to or records from. Devices and cards are identified by their
+ * stable id (manager_device_stable_id() of their name) and streams by the stable id of
+ * their application name and media role, so a scene still applies after the devices
+ * were unplugged or the server restarted.
+ *
+ * Restoring a scene reads the live state in one batch, compares it with the scene and
+ * sends only the operations that change something, all in a second batch: switching
+ * between room presets takes two round trips whatever the number of devices (three
+ * when a card profile changes, since the devices of the card are then recreated and
+ * read again). Devices, cards and streams of the scene that are not present are left
+ * out. scene_store_device_prefs() keeps the device and card settings of a scene in a
+ * preference store instead (see device_prefs.h), which gives them back to each device
+ * when it reappears.
+ *
+ * A scene is kept in memory in its file format, so scene_save() writes it as is and
+ * scene_load() maps the file: header, devices, cards, streams, channel volumes and
+ * strings follow each other, each table aligned on 8 bytes, in the byte order of the
+ * machine (the magic number tells). Everything is checked against the size of the file
+ * when it is loaded.
+ */
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "easypulse_core.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SCENE_MAGIC 0x43535045u         // "EPSC" in little endian.
+#define SCENE_VERSION 1
+#define SCENE_NONE UINT32_MAX           // No string (offsets into the strings).
+
+//Start of a scene file.
+typedef struct scene_header {
+    uint32_t magic;                     // SCENE_MAGIC.
+    uint16_t version;                   // SCENE_VERSION.
+    uint16_t header_size;               // sizeof(scene_header).
+    uint32_t size;                      // Size of the whole scene.
+    uint32_t device_count;
+    uint32_t card_count;
+    uint32_t stream_count;
+    uint32_t volume_count;              // Channel volumes of all the devices.
+    uint32_t strings_size;              // Size of the strings, which end the scene.
+    uint64_t captured_usec;             // Wall clock time of the capture (µs since the epoch).
+    uint64_t default_output;            // Stable id of the default output (0 if none).
+    uint64_t default_input;             // Stable id of the default input (0 if none).
+} scene_header;
+
+//A device (sink or source) of a scene.
+typedef struct scene_device {
+    uint64_t id;                        // Stable id of the device.
+    uint32_t volumes;                   // Position of its first channel volume in the volumes.
+    uint32_t port;                      // Active port (offset in the strings, SCENE_NONE if none).
+    uint8_t output;                     // 1 for a sink, 0 for a source.
+    uint8_t mute;                       // 1 if muted.
+    uint8_t channels;                   // Number of channel volumes.
+    uint8_t reserved[5];
+} scene_device;
+
+//A card of a scene.
+typedef struct scene_card {
+    uint64_t id;                        // Stable id of the card.
+    uint32_t profile;                   // Active profile (offset in the strings, SCENE_NONE if none).
+    uint32_t reserved;
+} scene_card;
+
+//A stream of a scene.
+typedef struct scene_stream {
+    uint64_t id;                        // Stable id of the application name and media role.
+    uint64_t device;                    // Stable id of its device.
+    uint8_t output;                     // 1 for a playback stream, 0 for a recording stream.
+    uint8_t reserved[7];
+} scene_stream;
+
+//Outcome of scene_restore().
+typedef struct scene_restore_stats {
+    uint32_t operations;                // Operations sent (differences found).
+    uint32_t failed;                    // Operations that failed.
+    uint32_t missing;                   // Devices, cards and streams of the scene not found.
+    uint32_t round_trips;               // Batches waited for, reads included.
+    uint64_t elapsed_ns;                // Time the restore took.
+} scene_restore_stats;
+
+typedef struct mixer_scene mixer_scene;
+
+mixer_scene *scene_capture(pulseaudio_manager *manager);            //Captures the live mixer state. Returns NULL on failure.
+bool scene_save(const mixer_scene *scene, const char *path);        //Writes a scene to a file.
+mixer_scene *scene_load(const char *path);                          //Maps a scene file. Returns NULL if missing or invalid.
+void scene_free(mixer_scene *scene);                                //Frees or unmaps a scene.
+
+const scene_header *scene_get_header(const mixer_scene *scene);     //Header of a scene, with the counts.
+const scene_device *scene_get_devices(const mixer_scene *scene);    //Devices of a scene.
+const scene_card *scene_get_cards(const mixer_scene *scene);        //Cards of a scene.
+const scene_stream *scene_get_streams(const mixer_scene *scene);    //Streams of a scene.
+const uint32_t *scene_get_volumes(const mixer_scene *scene);        //Channel volumes (pa_volume_t) of the devices.
+const char *scene_get_string(const mixer_scene *scene,
+uint32_t offset);                                                   //String of a scene, NULL for SCENE_NONE.
+
+int scene_restore(pulseaudio_manager *manager, const mixer_scene *scene,
+scene_restore_stats *stats);                                        //Applies the differences. Returns the operations sent, or -1.
+
+bool scene_store_device_prefs(const mixer_scene *scene,
+device_prefs *prefs);                                               //Saves the device and card settings of a scene into a preference store.
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,226 @@
+/**
+ * @file shm_state.c
+ * @brief Implementation of the shared memory segment of the mixer state.
+ *
+ * The segment is created with shm_open() so that readers find it by name, with mode
+ * 0600: the device names and volumes are only visible to the user of the publisher. The state is copied with plain memcpy
+ * between the updates of the sequence; the fences make the copy visible before the
+ * sequence that announces it.
+ */
+
+#include "shm_state.h"
+#include "easypulse_log.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHM_STATE_READ_RETRIES 100000   // Reads attempted before giving up on a stuck update.
+
+struct shm_state_writer {
+    char *name;
+    shm_state_segment *segment;
+    uint64_t generation;
+};
+
+struct shm_state_reader {
+    const shm_state_segment *segment;
+};
+
+/**
+ * @brief Creates a segment, replacing any segment of the same name.
+ *
+ * @param name Name of the segment ("/name"), NULL for SHM_STATE_DEFAULT_NAME.
+ * @return The writer, or NULL on failure.
+ */
+shm_state_writer *shm_state_create(const char *name) {
+    if (!name) {
+        name = SHM_STATE_DEFAULT_NAME;
+    }
+
+    shm_state_writer *writer = calloc(1, sizeof(shm_state_writer));
+    if (!writer || !(writer->name = strdup(name))) {
+        EASYPULSE_ERROR("Failed to allocate memory for the state publisher.");
+        free(writer);
+        return NULL;
+    }
+
+    // A segment left by a publisher that crashed is replaced, its readers keep the old one
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 || ftruncate(fd, sizeof(shm_state_segment)) != 0) {
+        EASYPULSE_ERROR("Cannot create the shared memory segment %s.", name);
+        if (fd >= 0) {
+            close(fd);
+            shm_unlink(name);
+        }
+        free(writer->name);
+        free(writer);
+        return NULL;
+    }
+
+    writer->segment = mmap(NULL, sizeof(shm_state_segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (writer->segment == MAP_FAILED) {
+        EASYPULSE_ERROR("Cannot map the shared memory segment %s.", name);
+        shm_unlink(name);
+        free(writer->name);
+        free(writer);
+        return NULL;
+    }
+
+    // The file is zeroed by ftruncate(), so readers see no state until the first update
+    writer->segment->version = SHM_STATE_VERSION;
+    writer->segment->size = sizeof(shm_state_segment);
+    atomic_thread_fence(memory_order_release);
+    writer->segment->magic = SHM_STATE_MAGIC;
+
+    return writer;
+}
+
+/**
+ * @brief Publishes a new state.
+ *
+ * @param writer The writer.
+ * @param snapshot The state. Its generation and update time are set by this function.
+ */
+void shm_state_publish(shm_state_writer *writer, const shm_state_snapshot *snapshot) {
+    shm_state_segment *segment = writer->segment;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    uint32_t sequence = atomic_load_explicit(&segment->sequence, memory_order_relaxed);
+    atomic_store_explicit(&segment->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    memcpy(&segment->state, snapshot, sizeof(shm_state_snapshot));
+    segment->state.generation = ++writer->generation;
+    segment->state.updated_usec = (uint64_t) now.tv_sec * 1000000ull + (uint64_t) now.tv_nsec / 1000;
+
+    atomic_store_explicit(&segment->sequence, sequence + 2, memory_order_release);
+}
+
+/**
+ * @brief Marks the state offline, so that readers still mapping it know it is stale,
+ * and removes the segment.
+ *
+ * @param writer The writer (NULL is ignored).
+ */
+void shm_state_destroy(shm_state_writer *writer) {
+    if (!writer) {
+        return;
+    }
+
+    shm_state_segment *segment = writer->segment;
+    uint32_t sequence = atomic_load_explicit(&segment->sequence, memory_order_relaxed);
+    atomic_store_explicit(&segment->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    segment->state.online = 0;
+    atomic_store_explicit(&segment->sequence, sequence + 2, memory_order_release);
+
+    munmap(segment, sizeof(shm_state_segment));
+    shm_unlink(writer->name);
+    free(writer->name);
+    free(writer);
+}
+
+/**
+ * @brief Maps a segment read-only.
+ *
+ * @param name Name of the segment, NULL for SHM_STATE_DEFAULT_NAME.
+ * @return The reader, or NULL if there is no segment or it has another layout version.
+ */
+shm_state_reader *shm_state_open(const char *name) {
+    if (!name) {
+        name = SHM_STATE_DEFAULT_NAME;
+    }
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        EASYPULSE_ERROR("No published state named %s.", name);
+        return NULL;
+    }
+
+    struct stat st;
+    const shm_state_segment *segment = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(shm_state_segment)) {
+        segment = mmap(NULL, sizeof(shm_state_segment), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (segment == MAP_FAILED) {
+        EASYPULSE_ERROR("Cannot map the published state %s.", name);
+        return NULL;
+    }
+    if (segment->magic != SHM_STATE_MAGIC || segment->version != SHM_STATE_VERSION ||
+        segment->size != sizeof(shm_state_segment)) {
+        EASYPULSE_ERROR("The published state %s has an unknown layout.", name);
+        munmap((void *) segment, sizeof(shm_state_segment));
+        return NULL;
+    }
+
+    shm_state_reader *reader = malloc(sizeof(shm_state_reader));
+    if (!reader) {
+        EASYPULSE_ERROR("Failed to allocate memory for the state reader.");
+        munmap((void *) segment, sizeof(shm_state_segment));
+        return NULL;
+    }
+    reader->segment = segment;
+    return reader;
+}
+
+/**
+ * @brief Copies a consistent snapshot of the state.
+ *
+ * @param reader The reader.
+ * @param snapshot Where to copy the state.
+ * @return true on success, false if nothing was published yet or the publisher died
+ *         in the middle of an update.
+ */
+bool shm_state_read(const shm_state_reader *reader, shm_state_snapshot *snapshot) {
+    const shm_state_segment *segment = reader->segment;
+
+    for (int attempt = 0; attempt < SHM_STATE_READ_RETRIES; ++attempt) {
+        uint32_t before = atomic_load_explicit(&segment->sequence, memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+
+        memcpy(snapshot, (const void *) &segment->state, sizeof(shm_state_snapshot));
+        atomic_thread_fence(memory_order_acquire);
+
+        uint32_t after = atomic_load_explicit(&segment->sequence, memory_order_relaxed);
+        if (before == after) {
+            return snapshot->generation > 0;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Returns the current sequence of the segment.
+ *
+ * The sequence changes with every update: a reader polling the state can compare it
+ * with the previous value and skip the copy when nothing changed.
+ *
+ * @param reader The reader.
+ */
+uint32_t shm_state_sequence(const shm_state_reader *reader) {
+    return atomic_load_explicit(&reader->segment->sequence, memory_order_acquire);
+}
+
+/**
+ * @brief Unmaps the segment and frees the reader.
+ *
+ * @param reader The reader (NULL is ignored).
+ */
+void shm_state_close(shm_state_reader *reader) {
+    if (!reader) {
+        return;
+    }
+    munmap((void *) reader->segment, sizeof(shm_state_segment));
+    free(reader);
+}
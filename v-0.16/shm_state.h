@@ -0,0 +1,100 @@
+/**
+ * @file shm_state.h
+ * @brief Mixer state published in shared memory, for processes that only read it.
+ *
+ * A manager started with manager_start_publishing() keeps the state of the devices
+ * (volumes, mute states, default devices) in a POSIX shared memory segment, and
+ * updates it from the server events. Any number of processes (status bars, exporters,
+ * watchdogs) can then map the segment read-only with shm_state_open() and read
+ * snapshots with shm_state_read(): no server connection, no enumeration, and no
+ * system call after the mapping.
+ *
+ * The segment is a shm_state_segment. It is updated under a sequence lock: the
+ * publisher makes the sequence odd, copies the new state and makes it even again. A
+ * reader copies the state between two reads of the sequence and retries if they
+ * differ or are odd, so a snapshot is always consistent and the publisher never waits
+ * for readers.
+ *
+ * Names and descriptions longer than SHM_STATE_NAME_SIZE - 1 bytes are truncated, and
+ * devices past SHM_STATE_MAX_DEVICES are left out (the counts say how many there are).
+ */
+
+#ifndef SHM_STATE_H
+#define SHM_STATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+#include <atomic>
+#define SHM_STATE_ATOMIC(type) std::atomic<type>     // Same size and alignment as _Atomic in C.
+#else
+#include <stdatomic.h>
+#define SHM_STATE_ATOMIC(type) _Atomic type
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHM_STATE_MAGIC 0x53535045u      // "EPSS" in little endian.
+#define SHM_STATE_VERSION 1
+#define SHM_STATE_DEFAULT_NAME "/easypulse-state"
+#define SHM_STATE_MAX_DEVICES 32
+#define SHM_STATE_NAME_SIZE 128
+#define SHM_STATE_NONE UINT32_MAX        // No default device.
+
+//A device as published.
+typedef struct shm_state_device {
+    uint32_t index;                         // Index of the sink or source.
+    uint32_t channels;                      // Number of channels.
+    int32_t volume;                         // Average volume of the channels (in percentage).
+    uint8_t mute;                           // 1 if muted.
+    uint8_t reserved[3];
+    char code[SHM_STATE_NAME_SIZE];         // PulseAudio name of the device.
+    char name[SHM_STATE_NAME_SIZE];         // Description of the device.
+} shm_state_device;
+
+//State of the devices at one point in time.
+typedef struct shm_state_snapshot {
+    uint64_t generation;                    // Number of updates published so far.
+    uint64_t updated_usec;                  // Wall clock time of the update (µs since the epoch).
+    uint32_t online;                        // 1 while the publisher is running.
+    uint32_t output_count;                  // Number of outputs (may exceed SHM_STATE_MAX_DEVICES).
+    uint32_t input_count;                   // Number of inputs (may exceed SHM_STATE_MAX_DEVICES).
+    uint32_t default_output;                // Position of the default output in outputs, or SHM_STATE_NONE.
+    uint32_t default_input;                 // Position of the default input in inputs, or SHM_STATE_NONE.
+    uint32_t reserved;
+    shm_state_device outputs[SHM_STATE_MAX_DEVICES];
+    shm_state_device inputs[SHM_STATE_MAX_DEVICES];
+} shm_state_snapshot;
+
+//Layout of the shared memory segment.
+typedef struct shm_state_segment {
+    uint32_t magic;                         // SHM_STATE_MAGIC.
+    uint16_t version;                       // SHM_STATE_VERSION.
+    uint16_t reserved;
+    uint32_t size;                          // sizeof(shm_state_segment).
+    SHM_STATE_ATOMIC(uint32_t) sequence;    // Odd while an update is in progress.
+    shm_state_snapshot state;
+} shm_state_segment;
+
+typedef struct shm_state_writer shm_state_writer;
+typedef struct shm_state_reader shm_state_reader;
+
+shm_state_writer *shm_state_create(const char *name);                  //Creates (or replaces) a segment. Returns NULL on failure.
+void shm_state_publish(shm_state_writer *writer,
+const shm_state_snapshot *snapshot);                                    //Publishes a new state (generation and time are set).
+void shm_state_destroy(shm_state_writer *writer);                       //Marks the state offline and removes the segment.
+
+shm_state_reader *shm_state_open(const char *name);                     //Maps a segment read-only. Returns NULL on failure.
+bool shm_state_read(const shm_state_reader *reader,
+shm_state_snapshot *snapshot);                                          //Copies a consistent snapshot. Returns false if none was published.
+uint32_t shm_state_sequence(const shm_state_reader *reader);            //Current sequence, to check for changes cheaply.
+void shm_state_close(shm_state_reader *reader);                         //Unmaps the segment.
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
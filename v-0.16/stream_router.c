@@ -0,0 +1,311 @@
+/**
+ * @file stream_router.c
+ * @brief Implementation of the rule-based stream router.
+ *
+ * Rules are compiled once, when added, into a flat representation: every condition
+ * refers to a slot of a shared key table and keeps its pattern length. Matching a
+ * stream fetches each referenced key from the proplist at most once and compares
+ * values with memcmp, so no string is parsed while events are being processed.
+ */
+
+#define _GNU_SOURCE // For memmem().
+
+#include "stream_router.h"
+#include "easypulse_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Condition after compilation.
+typedef struct _compiled_condition {
+    uint8_t key_slot;          // Index of the proplist key in the router key table.
+    route_match_type type;     // Comparison to perform.
+    char *pattern;             // Owned copy of the pattern.
+    size_t pattern_len;        // Length of the pattern.
+} _compiled_condition;
+
+//Rule after compilation.
+typedef struct _compiled_rule {
+    int id;                                            // Id returned to the user.
+    uint32_t condition_count;                          // Number of conditions (all must match).
+    _compiled_condition conditions[ROUTER_MAX_CONDITIONS];
+    char *target_code;                                 // Code of the target device.
+} _compiled_rule;
+
+struct stream_router {
+    char *keys[ROUTER_MAX_KEYS];    // Deduplicated proplist keys used by the rules.
+    uint32_t key_count;             // Number of keys in use.
+    _compiled_rule *rules;          // Rules, in evaluation order.
+    uint32_t rule_count;            // Number of rules.
+    int next_id;                    // Id given to the next rule.
+};
+
+/**
+ * @brief Creates an empty stream router.
+ *
+ * @return A pointer to the new router, or NULL if memory allocation fails.
+ */
+stream_router *stream_router_create(void) {
+    stream_router *router = calloc(1, sizeof(stream_router));
+    if (!router) {
+        EASYPULSE_ERROR("Failed to allocate memory for stream router.");
+        return NULL;
+    }
+
+    router->next_id = 1;
+    return router;
+}
+
+/**
+ * @brief Frees the memory owned by a compiled rule.
+ *
+ * @param rule The rule whose fields are to be freed. The rule itself is not freed.
+ */
+static void free_rule(_compiled_rule *rule) {
+    for (uint32_t i = 0; i < rule->condition_count; ++i) {
+        free(rule->conditions[i].pattern);
+    }
+    free(rule->target_code);
+}
+
+/**
+ * @brief Removes all rules and keys from a router.
+ *
+ * @param router The router to clear. If NULL, the function does nothing.
+ */
+void stream_router_clear(stream_router *router) {
+    if (!router) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < router->rule_count; ++i) {
+        free_rule(&router->rules[i]);
+    }
+    free(router->rules);
+    router->rules = NULL;
+    router->rule_count = 0;
+
+    for (uint32_t i = 0; i < router->key_count; ++i) {
+        free(router->keys[i]);
+        router->keys[i] = NULL;
+    }
+    router->key_count = 0;
+}
+
+/**
+ * @brief Destroys a router and all its rules.
+ *
+ * @param router The router to destroy. If NULL, the function does nothing.
+ */
+void stream_router_destroy(stream_router *router) {
+    if (!router) {
+        return;
+    }
+
+    stream_router_clear(router);
+    free(router);
+}
+
+/**
+ * @brief Finds the slot of a proplist key in the key table, adding it if needed.
+ *
+ * @param router The router owning the key table.
+ * @param key The proplist key.
+ * @return The slot of the key, or -1 if the table is full or allocation fails.
+ */
+static int intern_key(stream_router *router, const char *key) {
+    for (uint32_t i = 0; i < router->key_count; ++i) {
+        if (strcmp(router->keys[i], key) == 0) {
+            return (int) i;
+        }
+    }
+
+    if (router->key_count >= ROUTER_MAX_KEYS) {
+        EASYPULSE_ERROR("[stream_router_add_rule()] Too many distinct proplist keys (max %d).", ROUTER_MAX_KEYS);
+        return -1;
+    }
+
+    router->keys[router->key_count] = strdup(key);
+    if (!router->keys[router->key_count]) {
+        return -1;
+    }
+
+    return (int) router->key_count++;
+}
+
+/**
+ * @brief Compiles a rule and appends it to the router.
+ *
+ * All conditions of a rule must match for the rule to apply. Rules are evaluated in
+ * the order they were added and the first matching rule wins.
+ *
+ * @param router The router to add the rule to.
+ * @param conditions Array of conditions of the rule.
+ * @param condition_count Number of conditions (1 to ROUTER_MAX_CONDITIONS).
+ * @param target_code Code (PulseAudio name) of the device matching streams are moved to.
+ * @return The id of the new rule, or -1 on error.
+ */
+int stream_router_add_rule(stream_router *router, const route_condition *conditions,
+uint32_t condition_count, const char *target_code) {
+    if (!router || !conditions || !target_code || condition_count == 0 ||
+        condition_count > ROUTER_MAX_CONDITIONS) {
+        EASYPULSE_ERROR("[stream_router_add_rule()] Invalid arguments provided.");
+        return -1;
+    }
+
+    _compiled_rule rule;
+    memset(&rule, 0, sizeof(rule));
+
+    for (uint32_t i = 0; i < condition_count; ++i) {
+        if (!conditions[i].key || (conditions[i].type != ROUTE_MATCH_PRESENT && !conditions[i].pattern)) {
+            EASYPULSE_ERROR("[stream_router_add_rule()] Condition %u is incomplete.", i);
+            free_rule(&rule);
+            return -1;
+        }
+
+        int slot = intern_key(router, conditions[i].key);
+        if (slot < 0) {
+            free_rule(&rule);
+            return -1;
+        }
+
+        _compiled_condition *compiled = &rule.conditions[i];
+        compiled->key_slot = (uint8_t) slot;
+        compiled->type = conditions[i].type;
+        compiled->pattern = strdup(conditions[i].pattern ? conditions[i].pattern : "");
+        if (!compiled->pattern) {
+            free_rule(&rule);
+            return -1;
+        }
+        compiled->pattern_len = strlen(compiled->pattern);
+        rule.condition_count = i + 1;
+    }
+
+    rule.target_code = strdup(target_code);
+    if (!rule.target_code) {
+        free_rule(&rule);
+        return -1;
+    }
+
+    _compiled_rule *rules = realloc(router->rules, (router->rule_count + 1) * sizeof(_compiled_rule));
+    if (!rules) {
+        EASYPULSE_ERROR("Failed to allocate memory for routing rule.");
+        free_rule(&rule);
+        return -1;
+    }
+
+    rule.id = router->next_id++;
+    router->rules = rules;
+    router->rules[router->rule_count++] = rule;
+
+    return rule.id;
+}
+
+/**
+ * @brief Removes a rule from the router.
+ *
+ * Keys used only by the removed rule stay in the key table until the router is cleared.
+ *
+ * @param router The router.
+ * @param rule_id The id returned by stream_router_add_rule.
+ * @return true if the rule was found and removed, false otherwise.
+ */
+bool stream_router_remove_rule(stream_router *router, int rule_id) {
+    if (!router) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < router->rule_count; ++i) {
+        if (router->rules[i].id == rule_id) {
+            free_rule(&router->rules[i]);
+            memmove(&router->rules[i], &router->rules[i + 1],
+                    (router->rule_count - i - 1) * sizeof(_compiled_rule));
+            router->rule_count--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Returns the number of rules loaded in the router.
+ */
+uint32_t stream_router_rule_count(const stream_router *router) {
+    return router ? router->rule_count : 0;
+}
+
+/**
+ * @brief Evaluates a single compiled condition against a value.
+ *
+ * @param cond The compiled condition.
+ * @param value The proplist value, or NULL if the key is not present.
+ * @param value_len Length of the value.
+ * @return true if the condition matches.
+ */
+static bool condition_matches(const _compiled_condition *cond, const char *value, size_t value_len) {
+    if (!value) {
+        return false;
+    }
+
+    switch (cond->type) {
+        case ROUTE_MATCH_PRESENT:
+            return true;
+        case ROUTE_MATCH_EXACT:
+            return value_len == cond->pattern_len && memcmp(value, cond->pattern, value_len) == 0;
+        case ROUTE_MATCH_PREFIX:
+            return value_len >= cond->pattern_len && memcmp(value, cond->pattern, cond->pattern_len) == 0;
+        case ROUTE_MATCH_SUFFIX:
+            return value_len >= cond->pattern_len &&
+                   memcmp(value + value_len - cond->pattern_len, cond->pattern, cond->pattern_len) == 0;
+        case ROUTE_MATCH_CONTAINS:
+            return memmem(value, value_len, cond->pattern, cond->pattern_len) != NULL;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Finds the first rule matching a stream proplist.
+ *
+ * Each key of the key table is looked up in the proplist at most once, and only if a
+ * rule being evaluated needs it.
+ *
+ * @param router The router.
+ * @param proplist The proplist of the stream.
+ * @return The target code of the first matching rule, or NULL if no rule matches.
+ *         The string is owned by the router.
+ */
+const char *stream_router_match(const stream_router *router, const pa_proplist *proplist) {
+    if (!router || !proplist || router->rule_count == 0) {
+        return NULL;
+    }
+
+    const char *values[ROUTER_MAX_KEYS];
+    size_t lengths[ROUTER_MAX_KEYS];
+    uint32_t fetched = 0; // Bitmask of keys already looked up.
+
+    for (uint32_t r = 0; r < router->rule_count; ++r) {
+        const _compiled_rule *rule = &router->rules[r];
+        bool matched = true;
+
+        for (uint32_t c = 0; c < rule->condition_count && matched; ++c) {
+            const _compiled_condition *cond = &rule->conditions[c];
+            uint32_t slot = cond->key_slot;
+
+            if (!(fetched & (1u << slot))) {
+                values[slot] = pa_proplist_gets(proplist, router->keys[slot]);
+                lengths[slot] = values[slot] ? strlen(values[slot]) : 0;
+                fetched |= 1u << slot;
+            }
+
+            matched = condition_matches(cond, values[slot], lengths[slot]);
+        }
+
+        if (matched) {
+            return rule->target_code;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,70 @@
+/**
+ * @file stream_router.h
+ * @brief Rule-based stream routing for the easypulse manager.
+ *
+ * A stream router holds an ordered list of routing rules. Each rule is a set of
+ * conditions on stream proplist values (application.name, media.role,
+ * application.process.binary...) and the code (PulseAudio name) of the device the
+ * matching streams must be sent to. The device code is used as the stable device
+ * identity, since sink indexes change every time a device reappears.
+ *
+ * Rules are compiled when they are added: proplist keys are deduplicated into a
+ * small key table and patterns are stored with their lengths, so matching a stream
+ * only performs one proplist lookup per distinct key and plain memory comparisons.
+ *
+ * The router itself does not talk to PulseAudio. The manager (easypulse_core.c)
+ * feeds it the proplist of every new stream reported by the subscription API and
+ * moves the stream when a rule matches.
+ */
+
+#ifndef STREAM_ROUTER_H
+#define STREAM_ROUTER_H
+
+#include <pulse/pulseaudio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ROUTER_MAX_KEYS 16       // Maximum number of distinct proplist keys used by all rules.
+#define ROUTER_MAX_CONDITIONS 8  // Maximum number of conditions in a single rule.
+
+//How the value of a proplist key is compared against the pattern of a condition.
+typedef enum route_match_type {
+    ROUTE_MATCH_EXACT,      // Value is equal to the pattern.
+    ROUTE_MATCH_PREFIX,     // Value starts with the pattern.
+    ROUTE_MATCH_SUFFIX,     // Value ends with the pattern.
+    ROUTE_MATCH_CONTAINS,   // Value contains the pattern.
+    ROUTE_MATCH_PRESENT     // Key is present, the pattern is ignored.
+} route_match_type;
+
+//A single condition of a routing rule, as given by the user.
+typedef struct route_condition {
+    const char *key;          // Proplist key (e.g. PA_PROP_APPLICATION_NAME).
+    route_match_type type;    // Comparison to perform.
+    const char *pattern;      // Pattern to compare the value against.
+} route_condition;
+
+typedef struct stream_router stream_router;
+
+stream_router *stream_router_create(void);                                 //Creates an empty router.
+void stream_router_destroy(stream_router *router);                          //Frees a router and all its rules.
+
+int stream_router_add_rule(stream_router *router,
+const route_condition *conditions, uint32_t condition_count,
+const char *target_code);                                                   //Compiles and appends a rule. Returns its id or -1.
+
+bool stream_router_remove_rule(stream_router *router, int rule_id);         //Removes a rule by id.
+void stream_router_clear(stream_router *router);                            //Removes all rules.
+uint32_t stream_router_rule_count(const stream_router *router);            //Number of rules currently loaded.
+
+const char *stream_router_match(const stream_router *router,
+const pa_proplist *proplist);                                               //Returns the target code of the first matching rule, or NULL.
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
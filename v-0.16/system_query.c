@@ -18,6 +18,9 @@
  */
 
 #include "system_query.h"
+#include "easypulse_metrics.h"
+#include "easypulse_trace.h"
+#include "easypulse_log.h"
 #include <pulse/mainloop-api.h>
 #include <pulse/mainloop.h>
 #include <pulse/operation.h>
@@ -94,7 +97,7 @@ typedef struct {
 
 static void pulse_cleanup(void);
 static bool is_pulse_initialized(void);
-static void get_output_device_count_cb(pa_context *c, const pa_card_info *i, int eol, void *userdata);
+static void get_output_device_count_cb(pa_context *c, const pa_sink_info *i, int eol, void *userdata);
 static void get_profile_count_cb(pa_context *c, const pa_card_info *i, int eol, void *userdata);
 
 // Utility function to print all properties in the proplist
@@ -120,9 +123,12 @@ void print_proplist(const pa_proplist *p) {
 static void iterate(pa_operation *op) {
     //fprintf(stderr, "[DEBUG] Entering %s\n", __FUNCTION__); // Debug statement for entry
 
+    uint64_t start = metrics_op_begin();
+
     //Leaves if operation is invalid.
     if (!op) {
-        fprintf(stderr, "[DEBUG] Operation is NULL\n"); // Debug statement for NULL operation
+        EASYPULSE_DEBUG("Operation is NULL");
+        metrics_op_end(METRIC_OP_QUERY, start, false);
         return;
     }
 
@@ -131,14 +137,20 @@ static void iterate(pa_operation *op) {
 
     // If we're not in the mainloop thread, lock it.
     if (!is_in_mainloop_thread) {
+        uint64_t lock_start = trace_begin();
+        uint64_t wait_start = metrics_lock_begin();
         pa_threaded_mainloop_lock(shared_data_1.mainloop);
+        metrics_lock_acquired(wait_start);
+        trace_end("query_mainloop_lock", "lock", lock_start);
         //fprintf(stderr, "[DEBUG] Mainloop locked\n"); // Debug statement for mainloop locked
     }
 
     //Wait for the operation to complete.
     //The signaling to continue is performed inside the callback operation (op).
     while (pa_operation_get_state(op) == PA_OPERATION_RUNNING) {
+        metrics_lock_suspend();
         pa_threaded_mainloop_wait(shared_data_1.mainloop);
+        metrics_lock_resume();
         //fprintf(stderr, "[DEBUG] Waiting in mainloop...\n"); // Debug message while waiting
     }
 
@@ -159,16 +171,22 @@ static void iterate(pa_operation *op) {
     }
     #endif
 
+    bool done = pa_operation_get_state(op) == PA_OPERATION_DONE;
+
     //Cleaning up.
     pa_operation_unref(op);
     //fprintf(stderr, "[DEBUG] Operation unreferenced and cleaned up\n"); // Debug statement for cleanup
 
     // If we locked the mainloop earlier, unlock it now.
     if (!is_in_mainloop_thread) {
+        metrics_lock_released();
         pa_threaded_mainloop_unlock(shared_data_1.mainloop);
         //fprintf(stderr, "[DEBUG] Mainloop unlocked\n"); // Debug statement for mainloop unlocked
     }
 
+    metrics_op_end(METRIC_OP_QUERY, start, done);
+    metrics_round_trip();
+
     //fprintf(stderr, "[DEBUG] Exiting %s\n", __FUNCTION__); // Debug statement for exit
 }
 
@@ -233,20 +251,20 @@ static bool is_pulse_initialized(void) {
 bool initialize_pulse() {
     shared_data_1.mainloop = pa_threaded_mainloop_new();
     if (!shared_data_1.mainloop) {
-        fprintf(stderr, "Failed to create mainloop.\n");
+        EASYPULSE_ERROR("Failed to create mainloop.");
         return false;
     }
 
     shared_data_1.mainloop_api = pa_threaded_mainloop_get_api(shared_data_1.mainloop);
     if (!shared_data_1.mainloop_api) {
-        fprintf(stderr, "Failed to get mainloop API.\n");
+        EASYPULSE_ERROR("Failed to get mainloop API.");
         pa_threaded_mainloop_free(shared_data_1.mainloop);
         return false;
     }
 
     shared_data_1.context = pa_context_new(shared_data_1.mainloop_api, "Easypulse query API");
     if (!shared_data_1.context) {
-        fprintf(stderr, "Failed to create context.\n");
+        EASYPULSE_ERROR("Failed to create context.");
         pa_threaded_mainloop_free(shared_data_1.mainloop);
         return false;
     }
@@ -327,7 +345,7 @@ static void get_profile_count_cb(pa_context *c, const pa_card_info *i, int eol,
 
     // Handle errors in retrieving profile count.
     if (eol < 0) {
-        fprintf(stderr, "Failed to get profile count.\n");
+        EASYPULSE_ERROR("Failed to get profile count.");
         pa_threaded_mainloop_signal(shared_data_1.mainloop, 0);
         return;
     }
@@ -362,7 +380,7 @@ uint32_t get_profile_count(uint32_t card_index) {
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized.
         if (!initialize_pulse()) {
-            fprintf(stderr, "get_profiles_count(): failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("get_profiles_count(): failed to initialize pulseaudio.");
             return UINT32_MAX;  // Return error if initialization fails.
         }
     }
@@ -398,7 +416,7 @@ static void get_available_output_devices_cb(pa_context *c, const pa_sink_info *i
 
     // Handle errors in retrieving sink information.
     if (eol < 0) {
-        fprintf(stderr, "Failed to get sink info.\n");
+        EASYPULSE_ERROR("Failed to get sink info.");
         pa_threaded_mainloop_signal(shared_data_1.mainloop, 0);
         return;
     }
@@ -413,7 +431,7 @@ static void get_available_output_devices_cb(pa_context *c, const pa_sink_info *i
     // Allocate memory for the pa_sink_info structure.
     shared_data_3.sinks[*count] = malloc(sizeof(pa_sink_info));
     if (shared_data_3.sinks[*count] == NULL) {
-        fprintf(stderr, "Failed to allocate memory for sink info.\n");
+        EASYPULSE_ERROR("Failed to allocate memory for sink info.");
         pa_threaded_mainloop_signal(shared_data_1.mainloop, 0);
         return;
     }
@@ -457,7 +475,7 @@ pa_sink_info **get_available_output_devices() {
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized
         if (!initialize_pulse()) {
-            fprintf(stderr, "get_available_output_devices(): failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("get_available_output_devices(): failed to initialize pulseaudio.");
             free(shared_data_3.sinks);
             shared_data_3.sinks = NULL;
             return NULL;
@@ -466,7 +484,7 @@ pa_sink_info **get_available_output_devices() {
 
     // Check for successful memory allocation
     if (!shared_data_3.sinks) {
-        fprintf(stderr, "Failed to allocate memory for sinks.\n");
+        EASYPULSE_ERROR("Failed to allocate memory for sinks.");
         return NULL;
     }
 
@@ -474,7 +492,7 @@ pa_sink_info **get_available_output_devices() {
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized
         if (!initialize_pulse()) {
-            fprintf(stderr, "get_available_output_devices(): failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("get_available_output_devices(): failed to initialize pulseaudio.");
             free(shared_data_3.sinks);
             shared_data_3.sinks = NULL;
             return NULL;
@@ -551,10 +569,10 @@ void delete_input_devices(pa_source_info **sources) {
 
 
 /**
- * @brief Callback function used to count the available audio devices (cards).
+ * @brief Callback function used to count the available output devices (sinks).
  *
- * This function is called for each audio device found by PulseAudio when querying
- * for the list of devices. The function increments the device_count for each device.
+ * This function is called for each sink found by PulseAudio when querying
+ * for the list of sinks. The function increments the device_count for each device.
  * When the list is exhausted or there's an error, it signals the mainloop to continue.
  *
  * @param c Pointer to the PulseAudio context.
@@ -562,7 +580,7 @@ void delete_input_devices(pa_source_info **sources) {
  * @param eol Indicates the end of the list or an error.
  * @param userdata Pointer to the data shared with the main function.
  */
-static void get_output_device_count_cb(pa_context *c, const pa_card_info *i, int eol, void *userdata) {
+static void get_output_device_count_cb(pa_context *c, const pa_sink_info *i, int eol, void *userdata) {
     (void) c;
     (void) i;
 
@@ -587,9 +605,11 @@ static void get_output_device_count_cb(pa_context *c, const pa_card_info *i, int
 
 
 /**
- * @brief Retrieve the count of audio devices in the system.
+ * @brief Retrieve the count of output devices in the system.
  *
- * This function queries PulseAudio to get a count of all available audio devices (cards).
+ * This function queries PulseAudio to get a count of all available output devices (sinks).
+ * Sinks are counted rather than cards, since virtual sinks (null, combined) have no card
+ * and get_available_output_devices() sizes its array with this count.
  * If PulseAudio is not initialized, the function attempts to initialize it. If the initialization
  * fails or there's an error in fetching the device count, it returns UINT32_MAX.
  *
@@ -603,23 +623,23 @@ uint32_t get_output_device_count(void) {
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized.
         if (!initialize_pulse()) {
-            fprintf(stderr, "get_device_count(): failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("get_device_count(): failed to initialize pulseaudio.");
             return UINT32_MAX;  // Return error if initialization fails.
         }
     }
 
     // Check if context is valid after initialization attempt.
     if (!shared_data_1.context) {
-        fprintf(stderr, "Context is NULL in get_device_count.\n");
+        EASYPULSE_ERROR("Context is NULL in get_device_count.");
         return UINT32_MAX;
     }
 
     //fprintf(stderr,"[get_device_count()] context is, %p\n",&shared_data_1.context);
     //fprintf(stderr,"[get_device_count()] mainloop is, %p\n",&shared_data_1.mainloop);
 
-    // Query PulseAudio for the list of audio devices (cards).
-    // The callback get_device_count_cb will increment the device_count for each device found.
-    count_op = pa_context_get_card_info_list(shared_data_1.context, get_output_device_count_cb, &device_count);
+    // Query PulseAudio for the list of output devices (sinks).
+    // The callback get_output_device_count_cb will increment the device_count for each sink found.
+    count_op = pa_context_get_sink_info_list(shared_data_1.context, get_output_device_count_cb, &device_count);
 
     // Wait for the PulseAudio operation to complete.
     iterate(count_op);
@@ -637,14 +657,14 @@ uint32_t get_output_device_count(void) {
  * @param alsa_name Name of the ALSA device.
  * @return Minimum number of channels supported by the device or -1 on error.
  */
-int get_min_input_channels(const char *alsa_id, const pa_source_info *source_info) {
+static int get_min_input_channels_impl(const char *alsa_id, const pa_source_info *source_info) {
     snd_pcm_t *handle;
     snd_pcm_hw_params_t *params;
     unsigned int min_channels = 0;
     int err;
 
     if ((!alsa_id) && (!source_info)) {
-        fprintf(stderr, "Invalid parameters provided.\n");
+        EASYPULSE_ERROR("Invalid parameters provided.");
         return -1;
     }
     //The input device was found, but there's no alsa information about it.
@@ -654,19 +674,19 @@ int get_min_input_channels(const char *alsa_id, const pa_source_info *source_inf
     }
 
     if ((err = snd_pcm_open(&handle, alsa_id, SND_PCM_STREAM_CAPTURE, SND_PCM_NONBLOCK)) < 0) {
-        fprintf(stderr, "Unable to open PCM device: %s, error: %s\n", alsa_id, snd_strerror(err));
+        EASYPULSE_ERROR("Unable to open PCM device: %s, error: %s", alsa_id, snd_strerror(err));
         return source_info->sample_spec.channels;  // Return channels from PulseAudio if ALSA fails
     }
 
     snd_pcm_hw_params_alloca(&params);
     if ((err = snd_pcm_hw_params_any(handle, params)) < 0) {
-        fprintf(stderr, "Cannot initialize hardware parameter structure: %s\n", snd_strerror(err));
+        EASYPULSE_ERROR("Cannot initialize hardware parameter structure: %s", snd_strerror(err));
         snd_pcm_close(handle);
         return source_info->sample_spec.channels;
     }
 
     if ((err = snd_pcm_hw_params_get_channels_min(params, &min_channels)) < 0) {
-        fprintf(stderr, "Error getting min channels for device: %s, error: %s\n", alsa_id, snd_strerror(err));
+        EASYPULSE_ERROR("Error getting min channels for device: %s, error: %s", alsa_id, snd_strerror(err));
         snd_pcm_close(handle);
         return source_info->sample_spec.channels;
     }
@@ -675,6 +695,13 @@ int get_min_input_channels(const char *alsa_id, const pa_source_info *source_inf
     return min_channels;
 }
 
+int get_min_input_channels(const char *alsa_id, const pa_source_info *source_info) {
+    uint64_t start = trace_begin();
+    int result = get_min_input_channels_impl(alsa_id, source_info);
+    trace_end("alsa:get_min_input_channels", "alsa", start);
+    return result;
+}
+
 
 /**
  * @brief Retrieves the maximum number of channels for the given ALSA device name.
@@ -688,14 +715,14 @@ int get_min_input_channels(const char *alsa_id, const pa_source_info *source_inf
  * @param source_info Information about the PulseAudio source.
  * @return Maximum number of channels supported by the device or -1 on error.
  */
-int get_max_input_channels(const char *alsa_id, const pa_source_info *source_info) {
+static int get_max_input_channels_impl(const char *alsa_id, const pa_source_info *source_info) {
     snd_pcm_t *handle;
     snd_pcm_hw_params_t *params;
     unsigned int max_channels = 0;
     int err;
 
     if ((!alsa_id) && (!source_info)) {
-        fprintf(stderr, "Invalid parameters provided.\n");
+        EASYPULSE_ERROR("Invalid parameters provided.");
         return -1;
     }
 
@@ -717,14 +744,14 @@ int get_max_input_channels(const char *alsa_id, const pa_source_info *source_inf
 
     // Fill it in with default values
     if ((err = snd_pcm_hw_params_any(handle, params)) < 0) {
-        fprintf(stderr, "Cannot initialize hardware parameter structure: %s\n", snd_strerror(err));
+        EASYPULSE_ERROR("Cannot initialize hardware parameter structure: %s", snd_strerror(err));
         snd_pcm_close(handle);
         return source_info->sample_spec.channels;
     }
 
     // Get the maximum number of channels
     if ((err = snd_pcm_hw_params_get_channels_max(params, &max_channels)) < 0) {
-        fprintf(stderr, "Error getting max channels for device: %s, error: %s\n", alsa_id, snd_strerror(err));
+        EASYPULSE_ERROR("Error getting max channels for device: %s, error: %s", alsa_id, snd_strerror(err));
         snd_pcm_close(handle);
         return source_info->sample_spec.channels;
     }
@@ -735,6 +762,13 @@ int get_max_input_channels(const char *alsa_id, const pa_source_info *source_inf
     return max_channels;
 }
 
+int get_max_input_channels(const char *alsa_id, const pa_source_info *source_info) {
+    uint64_t start = trace_begin();
+    int result = get_max_input_channels_impl(alsa_id, source_info);
+    trace_end("alsa:get_max_input_channels", "alsa", start);
+    return result;
+}
+
 /**
  * @brief Retrieves the maximum number of channels for the given ALSA device name.
  *
@@ -745,14 +779,14 @@ int get_max_input_channels(const char *alsa_id, const pa_source_info *source_inf
  * @param alsa_name Name of the ALSA device.
  * @return Maximum number of channels supported by the device or -1 on error.
  */
-int get_max_output_channels(const char *alsa_id, const pa_sink_info *sink_info) {
+static int get_max_output_channels_impl(const char *alsa_id, const pa_sink_info *sink_info) {
     snd_pcm_t *handle;
     snd_pcm_hw_params_t *params;
     unsigned int max_channels = 0;
     int err;
 
     if ((!alsa_id) && (!sink_info)) {
-        fprintf(stderr, "[get_max_output_channels()] Invalid parameters provided.\n");
+        EASYPULSE_ERROR("[get_max_output_channels()] Invalid parameters provided.");
         return -1;
     }
     //The input device was found, but there's no alsa information about it.
@@ -784,6 +818,13 @@ int get_max_output_channels(const char *alsa_id, const pa_sink_info *sink_info)
     return max_channels;
 }
 
+int get_max_output_channels(const char *alsa_id, const pa_sink_info *sink_info) {
+    uint64_t start = trace_begin();
+    int result = get_max_output_channels_impl(alsa_id, sink_info);
+    trace_end("alsa:get_max_output_channels", "alsa", start);
+    return result;
+}
+
 /**
  * @brief Retrieves the minimum number of channels for the given ALSA device id.
  *
@@ -794,7 +835,7 @@ int get_max_output_channels(const char *alsa_id, const pa_sink_info *sink_info)
  * @param alsa_name Name of the ALSA device.
  * @return Minimum number of channels supported by the device or -1 on error.
  */
-int get_min_output_channels(const char *alsa_id, const pa_sink_info *sink_info) {
+static int get_min_output_channels_impl(const char *alsa_id, const pa_sink_info *sink_info) {
     snd_pcm_t *handle;
     snd_pcm_hw_params_t *params;
     unsigned int min_channels = 0;
@@ -803,7 +844,7 @@ int get_min_output_channels(const char *alsa_id, const pa_sink_info *sink_info)
     //fprintf(stderr, "[DEBUG, get_min_output_channels()] sink_info->sample_spec.channels is %i\n", sink_info->sample_spec.channels);
 
     if ((!alsa_id) && (!sink_info)) {
-        fprintf(stderr, "Invalid parameters provided.\n");
+        EASYPULSE_ERROR("Invalid parameters provided.");
         return -1;
     }
     //The input device was found, but there's no alsa information about it.
@@ -834,6 +875,13 @@ int get_min_output_channels(const char *alsa_id, const pa_sink_info *sink_info)
     return min_channels;
 }
 
+int get_min_output_channels(const char *alsa_id, const pa_sink_info *sink_info) {
+    uint64_t start = trace_begin();
+    int result = get_min_output_channels_impl(alsa_id, sink_info);
+    trace_end("alsa:get_min_output_channels", "alsa", start);
+    return result;
+}
+
 /**
  * @brief Callback function for retrieving the ALSA card name of a PulseAudio source.
  *
@@ -883,14 +931,14 @@ static void get_alsa_input_name_cb(pa_context *c, const pa_source_info *i, int e
  */
 char* get_alsa_input_name(const char *source_name) {
     if (!source_name) {
-        fprintf(stderr, "[get_alsa_input_name()] Invalid source name.\n");
+        EASYPULSE_ERROR("[get_alsa_input_name()] Invalid source name.");
         return NULL;
     }
 
     shared_data_2.alsa_name = NULL; // Ensure alsa_name is initialized to NULL
 
     if (!is_pulse_initialized() && !initialize_pulse()) {
-        fprintf(stderr, "get_alsa_input_name(): PulseAudio initialization failed.\n");
+        EASYPULSE_ERROR("get_alsa_input_name(): PulseAudio initialization failed.");
         return NULL;
     }
 
@@ -930,7 +978,7 @@ static void get_alsa_output_name_cb(pa_context *c, const pa_sink_info *i, int eo
     if (alsa_name) {
         shared_data_2.alsa_name = strdup(alsa_name);
         if (!shared_data_2.alsa_name) {
-            fprintf(stderr, "Failed to allocate memory for ALSA name.\n");
+            EASYPULSE_ERROR("Failed to allocate memory for ALSA name.");
         }
         pa_threaded_mainloop_signal(shared_data_1.mainloop, 0);
     }
@@ -954,7 +1002,7 @@ char* get_alsa_output_name(const char *sink_name) {
     shared_data_2.alsa_name = NULL;  // Ensure alsa_name is initialized to NULL
 
     if (!is_pulse_initialized() && !initialize_pulse()) {
-        fprintf(stderr, "[get_alsa_output_name()] PulseAudio initialization failed.\n");
+        EASYPULSE_ERROR("[get_alsa_output_name()] PulseAudio initialization failed.");
         return NULL;
     }
 
@@ -1012,7 +1060,7 @@ static void get_alsa_input_id_cb(pa_context *c, const pa_source_info *i, int eol
         // Store the ALSA device string in shared data
         shared_data_2.alsa_id = strdup(alsa_device_string);
         if (!shared_data_2.alsa_id) {
-            fprintf(stderr, "Failed to allocate memory for ALSA device id.\n");
+            EASYPULSE_ERROR("Failed to allocate memory for ALSA device id.");
         }
     } else {
         // Log an error if ALSA properties are not found or are invalid
@@ -1043,7 +1091,7 @@ char* get_alsa_input_id(const char *source_name) {
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized
         if (!initialize_pulse()) {
-            fprintf(stderr, "[get_alsa_input_id()] PulseAudio initialization failed.\n");
+            EASYPULSE_ERROR("[get_alsa_input_id()] PulseAudio initialization failed.");
             return NULL;
         }
     }
@@ -1051,7 +1099,7 @@ char* get_alsa_input_id(const char *source_name) {
     // Duplicate the source name to ensure it remains valid throughout the operation
     char *source_name_copy = strdup(source_name);
     if (!source_name_copy) {
-        fprintf(stderr, "[get_alsa_input_id()] Failed to allocate memory for source name.\n");
+        EASYPULSE_ERROR("[get_alsa_input_id()] Failed to allocate memory for source name.");
         return NULL;
     }
 
@@ -1116,7 +1164,7 @@ static void get_alsa_output_id_cb(pa_context *c, const pa_sink_info *i, int eol,
         // Store the ALSA device string in shared data
         shared_data_2.alsa_id = strdup(alsa_device_string);
         if (!shared_data_2.alsa_id) {
-            fprintf(stderr, "Failed to allocate memory for ALSA device id.\n");
+            EASYPULSE_ERROR("Failed to allocate memory for ALSA device id.");
         }
     } else {
         shared_data_2.alsa_id = NULL;
@@ -1148,7 +1196,7 @@ char* get_alsa_output_id(const char *sink_name) {
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized
         if (!initialize_pulse()) {
-            fprintf(stderr, "[get_alsa_output_id()] PulseAudio initialization failed.\n");
+            EASYPULSE_ERROR("[get_alsa_output_id()] PulseAudio initialization failed.");
             return NULL;
         }
     }
@@ -1156,7 +1204,7 @@ char* get_alsa_output_id(const char *sink_name) {
     // Make a copy of the sink name to ensure it remains valid
     char *sink_name_copy = strdup(sink_name);
     if (!sink_name_copy) {
-        fprintf(stderr, "[get_alsa_output_id()] Failed to allocate memory for sink name.\n");
+        EASYPULSE_ERROR("[get_alsa_output_id()] Failed to allocate memory for sink name.");
         return NULL;
     }
 
@@ -1183,7 +1231,7 @@ char* get_alsa_output_id(const char *sink_name) {
  * @param source_info The PulseAudio source information structure.
  * @return The sample rate of the source in Hz on success, or -1 on error.
  */
-int get_input_sample_rate(const char *alsa_id, pa_source_info *source_info) {
+static int get_input_sample_rate_impl(const char *alsa_id, pa_source_info *source_info) {
     snd_pcm_t *handle;
     snd_pcm_hw_params_t *params;
     unsigned int sample_rate = 0; // Default to a known value
@@ -1208,7 +1256,7 @@ int get_input_sample_rate(const char *alsa_id, pa_source_info *source_info) {
     //fprintf(stderr, "[DEBUG, get_input_sample_rate()] Attempting to open ALSA device: '%s'\n", alsa_id);
 
     if ((err = snd_pcm_open(&handle, alsa_id, SND_PCM_STREAM_CAPTURE, SND_PCM_NONBLOCK)) < 0) {
-        fprintf(stderr, "Unable to open PCM device: '%s', error: %s\n", alsa_id, snd_strerror(err));
+        EASYPULSE_ERROR("Unable to open PCM device: '%s', error: %s", alsa_id, snd_strerror(err));
         return source_info->sample_spec.rate;
     }
 
@@ -1218,42 +1266,42 @@ int get_input_sample_rate(const char *alsa_id, pa_source_info *source_info) {
 
     // Initialize hardware parameters
     if ((err = snd_pcm_hw_params_any(handle, params)) < 0) {
-        fprintf(stderr, "Cannot initialize hardware parameter structure: %s\n", snd_strerror(err));
+        EASYPULSE_ERROR("Cannot initialize hardware parameter structure: %s", snd_strerror(err));
         snd_pcm_close(handle);
         return -1;
     }
 
     // Set the access type for the hardware parameters
     if ((err = snd_pcm_hw_params_set_access(handle, params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
-        fprintf(stderr, "Cannot set access type: %s\n", snd_strerror(err));
+        EASYPULSE_ERROR("Cannot set access type: %s", snd_strerror(err));
         snd_pcm_close(handle);
         return -1;
     }
 
     // Set the sample format for the hardware parameters
     if ((err = snd_pcm_hw_params_set_format(handle, params, SND_PCM_FORMAT_S16_LE)) < 0) {
-        fprintf(stderr, "Cannot set sample format: %s\n", snd_strerror(err));
+        EASYPULSE_ERROR("Cannot set sample format: %s", snd_strerror(err));
         snd_pcm_close(handle);
         return -1;
     }
 
     // Set the channel count for the hardware parameters
     if ((err = snd_pcm_hw_params_set_channels(handle, params, source_info->sample_spec.channels)) < 0) {
-        fprintf(stderr, "Cannot set channel count: %s\n", snd_strerror(err));
+        EASYPULSE_ERROR("Cannot set channel count: %s", snd_strerror(err));
         snd_pcm_close(handle);
         return -1;
     }
 
     // Apply the hardware parameters to the device
     if ((err = snd_pcm_hw_params(handle, params)) < 0) {
-        fprintf(stderr, "Cannot set hardware parameters: %s\n", snd_strerror(err));
+        EASYPULSE_ERROR("Cannot set hardware parameters: %s", snd_strerror(err));
         snd_pcm_close(handle);
         return -1;
     }
 
     // Now try to get the sample rate
     if ((err = snd_pcm_hw_params_get_rate(params, &sample_rate, 0)) < 0) {
-        fprintf(stderr, "Error getting sample rate for device: '%s', error: %s\n", alsa_id, snd_strerror(err));
+        EASYPULSE_ERROR("Error getting sample rate for device: '%s', error: %s", alsa_id, snd_strerror(err));
         snd_pcm_close(handle);
         return -1;
     }
@@ -1264,6 +1312,67 @@ int get_input_sample_rate(const char *alsa_id, pa_source_info *source_info) {
     return sample_rate; // Successfully obtained sample rate
 }
 
+int get_input_sample_rate(const char *alsa_id, pa_source_info *source_info) {
+    uint64_t start = trace_begin();
+    int result = get_input_sample_rate_impl(alsa_id, source_info);
+    trace_end("alsa:get_input_sample_rate", "alsa", start);
+    return result;
+}
+
+/**
+ * @brief Retrieves the period and buffer time ranges of an ALSA device.
+ *
+ * The device is opened without being configured, so the ranges are those of the
+ * hardware. It usually fails while PulseAudio holds the device (it is then busy).
+ *
+ * @param alsa_id The ALSA device identifier.
+ * @param stream SND_PCM_STREAM_PLAYBACK or SND_PCM_STREAM_CAPTURE.
+ * @param range Where to store the ranges (in microseconds).
+ * @return true if the ranges were read, false otherwise.
+ */
+static bool get_buffer_range_impl(const char *alsa_id, snd_pcm_stream_t stream, pcm_buffer_range *range) {
+    snd_pcm_t *handle;
+    snd_pcm_hw_params_t *params;
+    int dir = 0;
+    int err;
+
+    if (!alsa_id || !range) {
+        return false;
+    }
+
+    if ((err = snd_pcm_open(&handle, alsa_id, stream, SND_PCM_NONBLOCK)) < 0) {
+        return false;
+    }
+
+    snd_pcm_hw_params_alloca(&params);
+    if ((err = snd_pcm_hw_params_any(handle, params)) < 0 ||
+        (err = snd_pcm_hw_params_get_period_time_min(params, &range->min_period_usec, &dir)) < 0 ||
+        (err = snd_pcm_hw_params_get_period_time_max(params, &range->max_period_usec, &dir)) < 0 ||
+        (err = snd_pcm_hw_params_get_buffer_time_min(params, &range->min_buffer_usec, &dir)) < 0 ||
+        (err = snd_pcm_hw_params_get_buffer_time_max(params, &range->max_buffer_usec, &dir)) < 0) {
+        EASYPULSE_ERROR("Error getting the buffer ranges of device: '%s', error: %s", alsa_id, snd_strerror(err));
+        snd_pcm_close(handle);
+        return false;
+    }
+
+    snd_pcm_close(handle);
+    return true;
+}
+
+bool get_output_buffer_range(const char *alsa_id, pcm_buffer_range *range) {
+    uint64_t start = trace_begin();
+    bool result = get_buffer_range_impl(alsa_id, SND_PCM_STREAM_PLAYBACK, range);
+    trace_end("alsa:get_output_buffer_range", "alsa", start);
+    return result;
+}
+
+bool get_input_buffer_range(const char *alsa_id, pcm_buffer_range *range) {
+    uint64_t start = trace_begin();
+    bool result = get_buffer_range_impl(alsa_id, SND_PCM_STREAM_CAPTURE, range);
+    trace_end("alsa:get_input_buffer_range", "alsa", start);
+    return result;
+}
+
 
 /**
  * @brief Retrieves the sample rate of the specified PulseAudio sink by ALSA identifier.
@@ -1276,7 +1385,7 @@ int get_input_sample_rate(const char *alsa_id, pa_source_info *source_info) {
  * @param sink_info The PulseAudio sink information structure.
  * @return The sample rate of the sink in Hz on success, or -1 on error.
  */
-int get_output_sample_rate(const char *alsa_id, const pa_sink_info *sink_info) {
+static int get_output_sample_rate_impl(const char *alsa_id, const pa_sink_info *sink_info) {
     snd_pcm_t *handle;
     snd_pcm_hw_params_t *params;
     unsigned int sample_rate = 0; // Default to a known value
@@ -1297,49 +1406,49 @@ int get_output_sample_rate(const char *alsa_id, const pa_sink_info *sink_info) {
     //fprintf(stderr, "Attempting to open ALSA device: '%s'\n", alsa_id);
 
     if ((err = snd_pcm_open(&handle, alsa_id, SND_PCM_STREAM_PLAYBACK, 0)) < 0) {
-        fprintf(stderr, "Unable to open PCM device: '%s', error: %s\n", alsa_id, snd_strerror(err));
+        EASYPULSE_ERROR("Unable to open PCM device: '%s', error: %s", alsa_id, snd_strerror(err));
         return sink_info->sample_spec.rate;
     }
 
     //fprintf(stderr, "ALSA device: '%s' successfully opened.\n", alsa_id);
     snd_pcm_hw_params_alloca(&params);
     if ((err = snd_pcm_hw_params_any(handle, params)) < 0) {
-        fprintf(stderr, "Cannot initialize hardware parameter structure: %s\n", snd_strerror(err));
+        EASYPULSE_ERROR("Cannot initialize hardware parameter structure: %s", snd_strerror(err));
         snd_pcm_close(handle);
         return -1;
     }
 
     // Set the access type for the hardware parameters
     if ((err = snd_pcm_hw_params_set_access(handle, params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
-        fprintf(stderr, "Cannot set access type: %s\n", snd_strerror(err));
+        EASYPULSE_ERROR("Cannot set access type: %s", snd_strerror(err));
         snd_pcm_close(handle);
         return -1;
     }
 
     // Set the sample format for the hardware parameters
     if ((err = snd_pcm_hw_params_set_format(handle, params, SND_PCM_FORMAT_S16_LE)) < 0) {
-        fprintf(stderr, "Cannot set sample format: %s\n", snd_strerror(err));
+        EASYPULSE_ERROR("Cannot set sample format: %s", snd_strerror(err));
         snd_pcm_close(handle);
         return -1;
     }
 
     // Set the channel count for the hardware parameters
     if ((err = snd_pcm_hw_params_set_channels(handle, params, sink_info->sample_spec.channels)) < 0) {
-        fprintf(stderr, "Cannot set channel count: %s\n", snd_strerror(err));
+        EASYPULSE_ERROR("Cannot set channel count: %s", snd_strerror(err));
         snd_pcm_close(handle);
         return -1;
     }
 
     // Apply the hardware parameters to the device
     if ((err = snd_pcm_hw_params(handle, params)) < 0) {
-        fprintf(stderr, "Cannot set hardware parameters: %s\n", snd_strerror(err));
+        EASYPULSE_ERROR("Cannot set hardware parameters: %s", snd_strerror(err));
         snd_pcm_close(handle);
         return -1;
     }
 
     // Now try to get the sample rate
     if ((err = snd_pcm_hw_params_get_rate(params, &sample_rate, 0)) < 0) {
-        fprintf(stderr, "Error getting sample rate for device: '%s', error: %s\n", alsa_id, snd_strerror(err));
+        EASYPULSE_ERROR("Error getting sample rate for device: '%s', error: %s", alsa_id, snd_strerror(err));
         snd_pcm_close(handle);
         return -1;
     }
@@ -1349,6 +1458,13 @@ int get_output_sample_rate(const char *alsa_id, const pa_sink_info *sink_info) {
     return sample_rate; // Successfully obtained sample rate
 }
 
+int get_output_sample_rate(const char *alsa_id, const pa_sink_info *sink_info) {
+    uint64_t start = trace_begin();
+    int result = get_output_sample_rate_impl(alsa_id, sink_info);
+    trace_end("alsa:get_output_sample_rate", "alsa", start);
+    return result;
+}
+
 
 /**
  * @brief Callback function for retrieving source information to get ports.
@@ -1436,7 +1552,7 @@ pa_source_info_list* get_source_port_info() {
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized.
         if (!initialize_pulse()) {
-            fprintf(stderr, "[get_source_port_info()] Failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("[get_source_port_info()] Failed to initialize pulseaudio.");
             return NULL;  // Return error if initialization fails.
         }
     }
@@ -1482,7 +1598,7 @@ pa_volume_t get_channel_volume(const pa_sink_info *sink_info, unsigned int chann
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized.
         if (!initialize_pulse()) {
-            fprintf(stderr, "get_channel_volume(): failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("get_channel_volume(): failed to initialize pulseaudio.");
             return UINT32_MAX;  // Return error if initialization fails.
         }
     }
@@ -1525,7 +1641,7 @@ static void get_available_input_devices_cb(pa_context *c, const pa_source_info *
 
     // Error or end of list
     if (eol < 0) {
-        fprintf(stderr, "Error occurred while getting source info.\n");
+        EASYPULSE_ERROR("Error occurred while getting source info.");
         pa_threaded_mainloop_signal(shared_data_1.mainloop, 0);
         return;
     }
@@ -1540,7 +1656,7 @@ static void get_available_input_devices_cb(pa_context *c, const pa_source_info *
         size_t new_alloc = shared_data_sources.allocated + 8;
         void *temp = realloc(shared_data_sources.sources, new_alloc * sizeof(pa_source_info *));
         if (!temp) {
-            fprintf(stderr, "Out of memory when reallocating sources array.\n");
+            EASYPULSE_ERROR("Out of memory when reallocating sources array.");
             pa_threaded_mainloop_signal(shared_data_1.mainloop, 0);
             return;
         }
@@ -1550,7 +1666,7 @@ static void get_available_input_devices_cb(pa_context *c, const pa_source_info *
 
     shared_data_sources.sources[shared_data_sources.count] = malloc(sizeof(pa_source_info));
     if (!shared_data_sources.sources[shared_data_sources.count]) {
-        fprintf(stderr, "Out of memory when allocating source info.\n");
+        EASYPULSE_ERROR("Out of memory when allocating source info.");
         pa_threaded_mainloop_signal(shared_data_1.mainloop, 0);
         return;
     }
@@ -1560,13 +1676,13 @@ static void get_available_input_devices_cb(pa_context *c, const pa_source_info *
     if (i->name) {
         shared_data_sources.sources[shared_data_sources.count]->name = strdup(i->name);
         if (!shared_data_sources.sources[shared_data_sources.count]->name) {
-            fprintf(stderr, "Out of memory when duplicating source name.\n");
+            EASYPULSE_ERROR("Out of memory when duplicating source name.");
         }
     }
     if (i->description) {
         shared_data_sources.sources[shared_data_sources.count]->description = strdup(i->description);
         if (!shared_data_sources.sources[shared_data_sources.count]->description) {
-            fprintf(stderr, "Out of memory when duplicating source description.\n");
+            EASYPULSE_ERROR("Out of memory when duplicating source description.");
         }
     }
 
@@ -1594,7 +1710,7 @@ pa_source_info **get_available_input_devices() {
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized
         if (!initialize_pulse()) {
-            fprintf(stderr, "[get_available_input_devices()] Failed to initialize PulseAudio.\n");
+            EASYPULSE_ERROR("[get_available_input_devices()] Failed to initialize PulseAudio.");
             return NULL;
         }
     }
@@ -1610,7 +1726,7 @@ pa_source_info **get_available_input_devices() {
         // iterate handles locking, waiting, and cleanup
         iterate(op);
     } else {
-        fprintf(stderr, "Failed to create the operation to get source info.\n");
+        EASYPULSE_ERROR("Failed to create the operation to get source info.");
         return NULL;
     }
 
@@ -1619,7 +1735,7 @@ pa_source_info **get_available_input_devices() {
     if (shared_data_sources.sources) {
         shared_data_sources.sources[shared_data_sources.count] = NULL; // Set the sentinel value
     } else {
-        fprintf(stderr, "Out of memory while allocating sources array.\n");
+        EASYPULSE_ERROR("Out of memory while allocating sources array.");
     }
 
     return shared_data_sources.sources;
@@ -1676,14 +1792,14 @@ uint32_t get_input_device_count(void) {
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized
         if (!initialize_pulse()) {
-            fprintf(stderr, "[get_input_device_count()] Failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("[get_input_device_count()] Failed to initialize pulseaudio.");
             return UINT32_MAX; // Return error if initialization fails
         }
     }
 
     // Check if context is valid after initialization attempt
     if (!shared_data_1.context) {
-        fprintf(stderr, "Context is NULL in get_input_device_count.\n");
+        EASYPULSE_ERROR("Context is NULL in get_input_device_count.");
         return UINT32_MAX;
     }
 
@@ -1697,33 +1813,132 @@ uint32_t get_input_device_count(void) {
 }
 
 
+//Names of the channel positions, as pa_channel_position_to_pretty_string() returns them
+//untranslated, indexed by position.
+static const char *const channel_position_names[PA_CHANNEL_POSITION_MAX] = {
+    [PA_CHANNEL_POSITION_MONO] = "Mono",
+    [PA_CHANNEL_POSITION_FRONT_LEFT] = "Front Left",
+    [PA_CHANNEL_POSITION_FRONT_RIGHT] = "Front Right",
+    [PA_CHANNEL_POSITION_FRONT_CENTER] = "Front Center",
+    [PA_CHANNEL_POSITION_REAR_CENTER] = "Rear Center",
+    [PA_CHANNEL_POSITION_REAR_LEFT] = "Rear Left",
+    [PA_CHANNEL_POSITION_REAR_RIGHT] = "Rear Right",
+    [PA_CHANNEL_POSITION_LFE] = "Subwoofer",
+    [PA_CHANNEL_POSITION_FRONT_LEFT_OF_CENTER] = "Front Left-of-center",
+    [PA_CHANNEL_POSITION_FRONT_RIGHT_OF_CENTER] = "Front Right-of-center",
+    [PA_CHANNEL_POSITION_SIDE_LEFT] = "Side Left",
+    [PA_CHANNEL_POSITION_SIDE_RIGHT] = "Side Right",
+    [PA_CHANNEL_POSITION_AUX0] = "Auxiliary 0",
+    [PA_CHANNEL_POSITION_AUX1] = "Auxiliary 1",
+    [PA_CHANNEL_POSITION_AUX2] = "Auxiliary 2",
+    [PA_CHANNEL_POSITION_AUX3] = "Auxiliary 3",
+    [PA_CHANNEL_POSITION_AUX4] = "Auxiliary 4",
+    [PA_CHANNEL_POSITION_AUX5] = "Auxiliary 5",
+    [PA_CHANNEL_POSITION_AUX6] = "Auxiliary 6",
+    [PA_CHANNEL_POSITION_AUX7] = "Auxiliary 7",
+    [PA_CHANNEL_POSITION_AUX8] = "Auxiliary 8",
+    [PA_CHANNEL_POSITION_AUX9] = "Auxiliary 9",
+    [PA_CHANNEL_POSITION_AUX10] = "Auxiliary 10",
+    [PA_CHANNEL_POSITION_AUX11] = "Auxiliary 11",
+    [PA_CHANNEL_POSITION_AUX12] = "Auxiliary 12",
+    [PA_CHANNEL_POSITION_AUX13] = "Auxiliary 13",
+    [PA_CHANNEL_POSITION_AUX14] = "Auxiliary 14",
+    [PA_CHANNEL_POSITION_AUX15] = "Auxiliary 15",
+    [PA_CHANNEL_POSITION_AUX16] = "Auxiliary 16",
+    [PA_CHANNEL_POSITION_AUX17] = "Auxiliary 17",
+    [PA_CHANNEL_POSITION_AUX18] = "Auxiliary 18",
+    [PA_CHANNEL_POSITION_AUX19] = "Auxiliary 19",
+    [PA_CHANNEL_POSITION_AUX20] = "Auxiliary 20",
+    [PA_CHANNEL_POSITION_AUX21] = "Auxiliary 21",
+    [PA_CHANNEL_POSITION_AUX22] = "Auxiliary 22",
+    [PA_CHANNEL_POSITION_AUX23] = "Auxiliary 23",
+    [PA_CHANNEL_POSITION_AUX24] = "Auxiliary 24",
+    [PA_CHANNEL_POSITION_AUX25] = "Auxiliary 25",
+    [PA_CHANNEL_POSITION_AUX26] = "Auxiliary 26",
+    [PA_CHANNEL_POSITION_AUX27] = "Auxiliary 27",
+    [PA_CHANNEL_POSITION_AUX28] = "Auxiliary 28",
+    [PA_CHANNEL_POSITION_AUX29] = "Auxiliary 29",
+    [PA_CHANNEL_POSITION_AUX30] = "Auxiliary 30",
+    [PA_CHANNEL_POSITION_AUX31] = "Auxiliary 31",
+    [PA_CHANNEL_POSITION_TOP_CENTER] = "Top Center",
+    [PA_CHANNEL_POSITION_TOP_FRONT_LEFT] = "Top Front Left",
+    [PA_CHANNEL_POSITION_TOP_FRONT_RIGHT] = "Top Front Right",
+    [PA_CHANNEL_POSITION_TOP_FRONT_CENTER] = "Top Front Center",
+    [PA_CHANNEL_POSITION_TOP_REAR_LEFT] = "Top Rear Left",
+    [PA_CHANNEL_POSITION_TOP_REAR_RIGHT] = "Top Rear Right",
+    [PA_CHANNEL_POSITION_TOP_REAR_CENTER] = "Top Rear Center",
+};
+
+/**
+ * @brief Get the name of a channel position.
+ *
+ * The name is a static string: it must not be freed, and stays valid for the lifetime
+ * of the program.
+ *
+ * @param position The channel position.
+ * @return The name of the position, or NULL if the position is invalid.
+ */
+const char *channel_position_name(pa_channel_position_t position) {
+    if (position < 0 || position >= PA_CHANNEL_POSITION_MAX) {
+        return NULL;
+    }
+    return channel_position_names[position];
+}
+
+/**
+ * @brief Fill channel names from a channel map.
+ *
+ * Entry i of names is set to the name of channel i of the map. Entries past the channels
+ * of the map (a device may report more channels than its map has) are set to NULL. No
+ * memory is allocated and no server is queried.
+ *
+ * @param map The channel map (of a sink, source or stream).
+ * @param names The array to fill, of count entries.
+ * @param count Number of entries to fill.
+ * @return The number of names set.
+ */
+int channel_names_from_map(const pa_channel_map *map, const char **names, int count) {
+    int known = 0;
+
+    if (!names || count <= 0) {
+        return 0;
+    }
+    if (map) {
+        known = map->channels < count ? map->channels : count;
+    }
+    for (int i = 0; i < count; ++i) {
+        names[i] = i < known ? channel_position_name(map->map[i]) : NULL;
+    }
+    return known;
+}
+
 /**
  * @brief Get the channel names for a specific sink identified by its name.
  *
- * This function retrieves the channel names for a given sink using its unique name.
- * It allocates an array of strings where each entry corresponds to a channel name
- * of the sink. The caller is responsible for freeing the memory allocated for the
- * array of channel names and the strings themselves.
+ * This function retrieves the sink by its unique name and returns the names of its
+ * channels. The names are static strings (see channel_position_name()), so the caller
+ * frees the array only. A manager already has them in pulseaudio_device::channel_names,
+ * without this query.
  *
- * @param sink_name The name of the sink whose channel names are to be retrieved.
+ * @param pulse_id The name of the sink whose channel names are to be retrieved.
  * @param num_channels Number of channels of the sink.
- * @return A pointer to an array of strings containing the channel names, or NULL if
- *         the sink is not found or in case of an error.
+ * @return An array of num_channels names, or NULL if the sink is not found or in case
+ *         of an error.
  */
-char** get_output_channel_names(const char *pulse_id, int num_channels) {
+const char** get_output_channel_names(const char *pulse_id, int num_channels) {
 
     // Check if PulseAudio is initialized.
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized.
         if (!initialize_pulse()) {
-            fprintf(stderr, "[get_output_channel_names()] Failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("[get_output_channel_names()] Failed to initialize pulseaudio.");
             return NULL;  // Return error if initialization fails.
         }
     }
 
     // Validate input parameters
-    if (!pulse_id) {
-        return NULL; // Return NULL if the sink name is not provided
+    if (!pulse_id || num_channels <= 0) {
+        return NULL;
     }
 
     // Retrieve the sink information for the specified sink name
@@ -1734,65 +1949,43 @@ char** get_output_channel_names(const char *pulse_id, int num_channels) {
         return NULL; // Return NULL if the sink is not found or in case of an error
     }
 
-    char **channel_names = calloc(num_channels, sizeof(char*));
-
-    if (!channel_names) {
-        free((char *)device_info->description); // Free the description if allocated
-        free(device_info); // Free the device_info structure
-        return NULL; // Return NULL if memory allocation fails
+    const char **channel_names = calloc(num_channels, sizeof(char*));
+    if (channel_names) {
+        channel_names_from_map(&device_info->channel_map, channel_names, num_channels);
     }
 
-    // Copy the channel names into the array
-    for (int i = 0; i < num_channels; ++i) {
-        channel_names[i] = strdup(pa_channel_position_to_pretty_string(device_info->channel_map.map[i]));
-        if (!channel_names[i]) {
-            // Handle allocation failure for a channel name
-            // Free all previously allocated names and the array itself
-            while (i--) free(channel_names[i]);
-            free(channel_names);
-            free((char *)device_info->description); // Free the description if allocated
-            free(device_info); // Free the device_info structure
-            return NULL; // Return NULL if memory allocation fails
-        }
-    }
-
-    // Free the sink_info structure and its description field
-    if (device_info->description) {
-        free((char *)device_info->description); // Corrected free statement
-    }
+    free((char *)device_info->description);
     free(device_info);
-
-    // Return the array of channel names
     return channel_names;
 }
 
 /**
  * @brief Get the channel names for a specific source identified by its name.
  *
- * This function retrieves the channel names for a given source using its unique name.
- * It allocates an array of strings where each entry corresponds to a channel name
- * of the source. The caller is responsible for freeing the memory allocated for the
- * array of channel names and the strings themselves.
+ * This function retrieves the source by its unique name and returns the names of its
+ * channels. The names are static strings (see channel_position_name()), so the caller
+ * frees the array only. A manager already has them in pulseaudio_device::channel_names,
+ * without this query.
  *
- * @param source_name The name of the source whose channel names are to be retrieved.
+ * @param pulse_code The name of the source whose channel names are to be retrieved.
  * @param num_channels Number of channels of the source.
- * @return A pointer to an array of strings containing the channel names, or NULL if
- *         the source is not found or in case of an error.
+ * @return An array of num_channels names, or NULL if the source is not found or in case
+ *         of an error.
  */
-char** get_input_channel_names(const char *pulse_code, int num_channels) {
+const char** get_input_channel_names(const char *pulse_code, int num_channels) {
 
     // Check if PulseAudio is initialized.
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized.
         if (!initialize_pulse()) {
-            fprintf(stderr, "[get_input_channel_names()] Failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("[get_input_channel_names()] Failed to initialize pulseaudio.");
             return NULL;  // Return error if initialization fails.
         }
     }
 
     // Validate input parameters
-    if (!pulse_code) {
-        return NULL; // Return NULL if the source name is not provided
+    if (!pulse_code || num_channels <= 0) {
+        return NULL;
     }
 
     // Retrieve the source information for the specified source name
@@ -1803,33 +1996,13 @@ char** get_input_channel_names(const char *pulse_code, int num_channels) {
         return NULL; // Return NULL if the source is not found or in case of an error
     }
 
-    char **channel_names = calloc(num_channels, sizeof(char*));
-    if (!channel_names) {
-        free((char *)device_info->description); // Free the description if allocated
-        free(device_info); // Free the device_info structure
-        return NULL; // Return NULL if memory allocation fails
+    const char **channel_names = calloc(num_channels, sizeof(char*));
+    if (channel_names) {
+        channel_names_from_map(&device_info->channel_map, channel_names, num_channels);
     }
 
-    // Copy the channel names into the array
-    for (int i = 0; i < num_channels; ++i) {
-        channel_names[i] = strdup(pa_channel_position_to_pretty_string(device_info->channel_map.map[i]));
-        if (!channel_names[i]) {
-            // Handle allocation failure for a channel name
-            while (i--) free(channel_names[i]); // Free all previously allocated names
-            free(channel_names); // Free the array itself
-            free((char *)device_info->description); // Free the description if allocated
-            free(device_info); // Free the device_info structure
-            return NULL; // Return NULL if memory allocation fails
-        }
-    }
-
-    // Free the source_info structure and its description field
-    if (device_info->description) {
-        free((char *)device_info->description);
-    }
+    free((char *)device_info->description);
     free(device_info);
-
-    // Return the array of channel names
     return channel_names;
 }
 
@@ -1850,7 +2023,7 @@ pa_source_info *get_input_device_by_name(const char *source_name) {
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized.
         if (!initialize_pulse()) {
-            fprintf(stderr, "[get_input_device_by_name()] Failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("[get_input_device_by_name()] Failed to initialize pulseaudio.");
             return NULL;  // Return error if initialization fails.
         }
     }
@@ -1932,7 +2105,7 @@ pa_sink_info *get_output_device_by_name(const char *sink_name) {
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized.
         if (!initialize_pulse()) {
-            fprintf(stderr, "[get_output_device_by_name()] Failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("[get_output_device_by_name()] Failed to initialize pulseaudio.");
             return NULL;  // Return error if initialization fails.
         }
     }
@@ -2033,20 +2206,20 @@ pa_sink_info* get_output_device_by_index(uint32_t index) {
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized.
         if (!initialize_pulse()) {
-            fprintf(stderr, "[get_output_device_by_index] Failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("[get_output_device_by_index] Failed to initialize pulseaudio.");
             return NULL;  // Return error if initialization fails.
         }
     }
 
     if (!shared_data_1.context || !shared_data_1.mainloop) {
-        fprintf(stderr, "Invalid shared data context or mainloop.\n");
+        EASYPULSE_ERROR("Invalid shared data context or mainloop.");
         return NULL;
     }
 
     // Allocate memory for sink_info
     pa_sink_info *sink_info = malloc(sizeof(pa_sink_info));
     if (!sink_info) {
-        fprintf(stderr, "Memory allocation for sink_info failed.\n");
+        EASYPULSE_ERROR("Memory allocation for sink_info failed.");
         return NULL;
     }
 
@@ -2129,20 +2302,20 @@ pa_source_info* get_input_device_by_index(uint32_t index) {
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized.
         if (!initialize_pulse()) {
-            fprintf(stderr, "[get_input_device_by_index()] Failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("[get_input_device_by_index()] Failed to initialize pulseaudio.");
             return NULL;  // Return error if initialization fails.
         }
     }
 
     if (!shared_data_1.context || !shared_data_1.mainloop) {
-        fprintf(stderr, "Invalid shared data context or mainloop.\n");
+        EASYPULSE_ERROR("Invalid shared data context or mainloop.");
         return NULL;
     }
 
     // Allocate memory for source_info
     pa_source_info *source_info = malloc(sizeof(pa_source_info));
     if (!source_info) {
-        fprintf(stderr, "Memory allocation for source_info failed.\n");
+        EASYPULSE_ERROR("Memory allocation for source_info failed.");
         return NULL;
     }
 
@@ -2176,7 +2349,7 @@ static void get_default_output_cb(pa_context *c, const pa_server_info *i, void *
 
     // Always signal the mainloop to unblock the iterate function, even if i is NULL
     if (!i) {
-        fprintf(stderr, "Failed to get default sink information.\n");
+        EASYPULSE_ERROR("Failed to get default sink information.");
     } else if (i->default_sink_name) {
         // Duplicate the name string to our output variable
         *default_sink_name = strdup(i->default_sink_name);
@@ -2194,8 +2367,7 @@ static void get_default_output_cb(pa_context *c, const pa_server_info *i, void *
  * Then, it queries the PulseAudio server for the default output device and waits for
  * the operation to complete.
  *
- * @param mainloop A pointer to the mainloop structure.
- * @param context A pointer to the PulseAudio context.
+ * @param context Ignored; the query goes through the context of this module.
  * @return A dynamically allocated string containing the default sink name, or NULL on error.
  *         The caller is responsible for freeing this string.
  */
@@ -2206,22 +2378,24 @@ char* get_default_output(pa_context *context) {
     // Check if PulseAudio is initialized, and if not, initialize it
     if (!is_pulse_initialized()) {
         if (!initialize_pulse()) {
-            fprintf(stderr, "Failed to initialize PulseAudio.\n");
+            EASYPULSE_ERROR("Failed to initialize PulseAudio.");
             return NULL;
         }
     }
 
     char *default_sink_name = NULL;
 
-    // Start the operation to get the default sink
-    pa_operation *op = pa_context_get_server_info(context, get_default_output_cb, &default_sink_name);
+    // The server info is the same from every context, and iterate() waits on the mainloop of
+    // this module: the request must go through its own context for the wait to see it complete.
+    (void) context;
+    pa_operation *op = pa_context_get_server_info(shared_data_1.context, get_default_output_cb, &default_sink_name);
 
     if (op) {
         // Wait for the operation to complete using the iterate function
         iterate(op); // This function should handle the waiting and signaling
         // pa_operation_unref(op); is called inside iterate, no need to call here
     } else {
-        fprintf(stderr, "Failed to create the operation to get server info.\n");
+        EASYPULSE_ERROR("Failed to create the operation to get server info.");
     }
 
     return default_sink_name; // Caller must free this string
@@ -2241,7 +2415,7 @@ static void get_default_input_cb(pa_context *c, const pa_server_info *i, void *u
     //fprintf(stderr, "[DEBUG, get_default_input_cb()] callback reached.\n");
 
     if (!i) {
-        fprintf(stderr, "Failed to get default source information.\n");
+        EASYPULSE_ERROR("Failed to get default source information.");
         pa_threaded_mainloop_signal(shared_data_1.mainloop, 0);
         return;
     }
@@ -2249,8 +2423,10 @@ static void get_default_input_cb(pa_context *c, const pa_server_info *i, void *u
     if (i->default_source_name) {
         // Duplicate the name string to our output variable
         *default_source_name = strdup(i->default_source_name);
-        pa_threaded_mainloop_signal(shared_data_1.mainloop, 0); // Signal to stop the loop
     }
+
+    // Signal the mainloop to unblock the iterate function, regardless of the outcome
+    pa_threaded_mainloop_signal(shared_data_1.mainloop, 0);
 }
 
 
@@ -2275,14 +2451,15 @@ char* get_default_input(pa_context *context) {
 
     // Check if PulseAudio is initialized, and if not, initialize it
     if (!is_pulse_initialized() && !initialize_pulse()) {
-        fprintf(stderr, "[get_default_onput()] Failed to initialize PulseAudio.\n");
+        EASYPULSE_ERROR("[get_default_onput()] Failed to initialize PulseAudio.");
         return NULL;
     }
 
     char *default_source_name = NULL;
 
-    // Start the operation to get the default source
-    pa_operation *op = pa_context_get_server_info(context, get_default_input_cb, &default_source_name);
+    // Same as get_default_output(): the request goes through the context of this module
+    (void) context;
+    pa_operation *op = pa_context_get_server_info(shared_data_1.context, get_default_input_cb, &default_source_name);
     iterate(op);
 
     return default_source_name; // Caller must free this string
@@ -2305,7 +2482,7 @@ void get_profiles_cb(pa_context *c, const pa_card_info *i, int eol, void *userda
     (void) userdata;
 
     if (eol < 0) {
-        fprintf(stderr, "Failed to fetch profiles.\n");
+        EASYPULSE_ERROR("Failed to fetch profiles.");
         pa_threaded_mainloop_signal(shared_data_1.mainloop, 0);
         return;
     }
@@ -2348,7 +2525,7 @@ pa_card_profile_info *get_profiles(pa_context *pa_ctx, uint32_t card_index) {
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized.
         if (!initialize_pulse()) {
-            fprintf(stderr, "[get_profiles()] Failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("[get_profiles()] Failed to initialize pulseaudio.");
             return NULL;  // Return error if initialization fails.
         }
     }
@@ -2402,7 +2579,7 @@ static void get_muted_output_status_cb(pa_context *c, const pa_sink_info *i, int
     // If eol is negative, an error occurred
     if (eol < 0) {
         int err = pa_context_errno(c); // Retrieve the error number from the context
-        fprintf(stderr, "[ERROR, get_muted_output_status_cb]: Error occurred during iteration - %s\n", pa_strerror(err));
+        EASYPULSE_ERROR("[ERROR, get_muted_output_status_cb]: Error occurred during iteration - %s", pa_strerror(err));
         pa_threaded_mainloop_signal(shared_data_1.mainloop, 0);
         return;
     }
@@ -2447,13 +2624,13 @@ int get_muted_output_status(const char *sink_name) {
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized.
         if (!initialize_pulse()) {
-            fprintf(stderr, "[get_muted_output_status()] Failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("[get_muted_output_status()] Failed to initialize pulseaudio.");
             return UINT32_MAX;  // Return error if initialization fails.
         }
     }
 
     if (!shared_data_1.mainloop || !shared_data_1.context || !sink_name) {
-        fprintf(stderr, "Invalid arguments provided.\n");
+        EASYPULSE_ERROR("Invalid arguments provided.");
         return -1;
     }
 
@@ -2498,7 +2675,7 @@ static void get_muted_input_status_cb(pa_context *c, const pa_source_info *i, in
     // If eol is negative, an error occurred
     if (eol < 0) {
         int err = pa_context_errno(c); // Retrieve the error number from the context
-        fprintf(stderr, "[ERROR, get_muted_input_status_cb]: Error occurred during iteration - %s\n", pa_strerror(err));
+        EASYPULSE_ERROR("[ERROR, get_muted_input_status_cb]: Error occurred during iteration - %s", pa_strerror(err));
         pa_threaded_mainloop_signal(shared_data_1.mainloop, 0);
         return;
     }
@@ -2533,7 +2710,7 @@ int get_muted_input_status(const char *source_name) {
     //fprintf(stderr,"[DEBUG, get_muted_input_status()] source_name is %s\n", source_name);
 
     if (!shared_data_1.mainloop || !shared_data_1.context || !source_name) {
-        fprintf(stderr, "Invalid arguments provided.\n");
+        EASYPULSE_ERROR("Invalid arguments provided.");
         return -1;
     }
 
@@ -2567,7 +2744,7 @@ static void get_output_device_index_by_code_cb(pa_context *c, const pa_sink_info
     uint32_t *index_ptr = (uint32_t *) userdata;
 
     if (eol < 0) {
-        fprintf(stderr, "Error occurred in sink_info_cb.\n");
+        EASYPULSE_ERROR("Error occurred in sink_info_cb.");
         return;
     }
 
@@ -2595,7 +2772,7 @@ static void get_input_device_index_by_code_cb(pa_context *c, const pa_source_inf
     uint32_t *index_ptr = (uint32_t *) userdata;
 
     if (eol < 0) {
-        fprintf(stderr, "Error occurred in source_info_cb.\n");
+        EASYPULSE_ERROR("Error occurred in source_info_cb.");
         return;
     }
 
@@ -2613,7 +2790,7 @@ static void get_input_device_index_by_code_cb(pa_context *c, const pa_source_inf
  * process the source information once it's received. It waits for the completion of the operation
  * and returns the index of the source.
  *
- * @param context Pointer to the initialized PulseAudio context.
+ * @param context Must not be NULL; the query goes through the context of this module.
  * @param device_code The pulseaudio code of the source whose index is to be retrieved.
  * @return The index of the input device if found, or UINT32_MAX if not found or in case of error.
  */
@@ -2626,17 +2803,18 @@ uint32_t get_input_device_index_by_code(pa_context *context, const char *device_
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized.
         if (!initialize_pulse()) {
-            fprintf(stderr, "[get_input_device_index_by_code()] Failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("[get_input_device_index_by_code()] Failed to initialize pulseaudio.");
             return UINT32_MAX;  // Return error if initialization fails.
         }
     }
 
     if (!context || !device_code) {
-        fprintf(stderr, "Invalid arguments.\n");
+        EASYPULSE_ERROR("Invalid arguments.");
         return UINT32_MAX;
     }
 
-    pa_operation *op = pa_context_get_source_info_by_name(context, device_code, get_input_device_index_by_code_cb, &index);
+    // iterate() waits on the mainloop of this module: the request goes through its own context.
+    pa_operation *op = pa_context_get_source_info_by_name(shared_data_1.context, device_code, get_input_device_index_by_code_cb, &index);
     iterate(op);
 
     return index;
@@ -2650,7 +2828,7 @@ uint32_t get_input_device_index_by_code(pa_context *context, const char *device_
  * process the sink information once it's received. It waits for the completion of the operation
  * and returns the index of the sink.
  *
- * @param context Pointer to the initialized PulseAudio context.
+ * @param context Must not be NULL; the query goes through the context of this module.
  * @param device_code The pulseaudio code of the sink whose index is to be retrieved.
  * @return The index of the output device if found, or UINT32_MAX if not found or in case of error.
  */
@@ -2663,17 +2841,18 @@ uint32_t get_output_device_index_by_code(pa_context *context, const char *device
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized.
         if (!initialize_pulse()) {
-            fprintf(stderr, "get_output_device_index_by_code()] Failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("get_output_device_index_by_code()] Failed to initialize pulseaudio.");
             return UINT32_MAX;  // Return error if initialization fails.
         }
     }
 
     if (!context || !device_code) {
-        fprintf(stderr, "Invalid arguments.\n");
+        EASYPULSE_ERROR("Invalid arguments.");
         return UINT32_MAX;
     }
 
-    pa_operation *op = pa_context_get_sink_info_by_name(context, device_code, get_output_device_index_by_code_cb, &index);
+    // iterate() waits on the mainloop of this module: the request goes through its own context.
+    pa_operation *op = pa_context_get_sink_info_by_name(shared_data_1.context, device_code, get_output_device_index_by_code_cb, &index);
     iterate(op);
 
     return index;
@@ -2731,7 +2910,7 @@ char* get_output_name_by_code(pa_context *pa_ctx, const char *code) {
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized.
         if (!initialize_pulse()) {
-            fprintf(stderr, "[get_output_name_by_code()] Failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("[get_output_name_by_code()] Failed to initialize pulseaudio.");
             return NULL;  // Return error if initialization fails.
         }
     }
@@ -2806,7 +2985,7 @@ char* get_input_name_by_code(pa_context *pa_ctx, const char *code) {
     if (!is_pulse_initialized()) {
         // Attempt to initialize PulseAudio if it's not already initialized.
         if (!initialize_pulse()) {
-            fprintf(stderr, "[get_input_name_by_code] Failed to initialize pulseaudio.\n");
+            EASYPULSE_ERROR("[get_input_name_by_code] Failed to initialize pulseaudio.");
             return NULL;  // Return error if initialization fails.
         }
     }
@@ -2955,7 +3134,7 @@ bool get_output_channel_mute_state(pa_context *context, pa_threaded_mainloop *ma
 uint32_t sink_index, uint32_t channel_index) {
 
     if (!context || !mainloop) {
-        fprintf(stderr, "Invalid PulseAudio context or mainloop.\n");
+        EASYPULSE_ERROR("Invalid PulseAudio context or mainloop.");
         return false;
     }
 
@@ -3023,7 +3202,7 @@ static void get_input_channel_mute_state_cb(pa_context *c, const pa_source_info
 bool get_input_channel_mute_state(pa_context *context, pa_threaded_mainloop *mainloop,
 uint32_t source_index, uint32_t channel_index) {
     if (!context || !mainloop) {
-        fprintf(stderr, "Invalid PulseAudio context or mainloop.\n");
+        EASYPULSE_ERROR("Invalid PulseAudio context or mainloop.");
         return false;
     }
 
@@ -3138,7 +3317,7 @@ static void get_output_streams_cb(pa_context *c, const pa_sink_input_info *i, in
     // Resize the inputs array to accommodate one more output_stream_info
     input_list->inputs = realloc(input_list->inputs, (input_list->num_inputs + 1) * sizeof(output_stream_info));
     if (input_list->inputs == NULL) {
-        fprintf(stderr, "Failed to allocate memory for sink input list\n");
+        EASYPULSE_ERROR("Failed to allocate memory for sink input list");
         return;
     }
 
@@ -3167,13 +3346,13 @@ static void get_output_streams_cb(pa_context *c, const pa_sink_input_info *i, in
     // Copy name
     new_input->name = strdup(i->name);
     if (new_input->name == NULL) {
-        fprintf(stderr, "Failed to allocate memory for sink input name\n");
+        EASYPULSE_ERROR("Failed to allocate memory for sink input name");
     }
 
     // Copy driver
     new_input->driver = strdup(i->driver);
     if (new_input->driver == NULL) {
-        fprintf(stderr, "Failed to allocate memory for sink input driver\n");
+        EASYPULSE_ERROR("Failed to allocate memory for sink input driver");
     }
 
     input_list->num_inputs++;
@@ -3202,7 +3381,7 @@ static void get_output_streams_cb(pa_context *c, const pa_sink_input_info *i, in
 output_stream_list *get_output_streams(pa_context *context) {
     output_stream_list *input_list = malloc(sizeof(output_stream_list));
     if (!input_list) {
-        fprintf(stderr, "Failed to allocate memory for output_stream_list\n");
+        EASYPULSE_ERROR("Failed to allocate memory for output_stream_list");
         return NULL;
     }
 
@@ -3212,7 +3391,7 @@ output_stream_list *get_output_streams(pa_context *context) {
     // Initiate the operation to get the list of sink inputs
     pa_operation *op = pa_context_get_sink_input_info_list(context, get_output_streams_cb, input_list);
     if (!op) {
-        fprintf(stderr, "Failed to start operation to get sink input list\n");
+        EASYPULSE_ERROR("Failed to start operation to get sink input list");
         free(input_list);
         return NULL;
     }
@@ -3249,7 +3428,7 @@ static void get_input_streams_cb(pa_context *c, const pa_source_output_info *o,
     // Resize the outputs array to accommodate one more input_stream_info
     input_list->outputs = realloc(input_list->outputs, (input_list->num_inputs + 1) * sizeof(input_stream_info));
     if (input_list->outputs == NULL) {
-        fprintf(stderr, "Failed to allocate memory for source output list\n");
+        EASYPULSE_ERROR("Failed to allocate memory for source output list");
         return;
     }
 
@@ -3281,13 +3460,13 @@ static void get_input_streams_cb(pa_context *c, const pa_source_output_info *o,
     // Copy name
     new_info->name = strdup(o->name);
     if (new_info->name == NULL) {
-        fprintf(stderr, "Failed to allocate memory for source output name\n");
+        EASYPULSE_ERROR("Failed to allocate memory for source output name");
     }
 
     // Copy driver
     new_info->driver = strdup(o->driver);
     if (new_info->driver == NULL) {
-        fprintf(stderr, "Failed to allocate memory for source output driver\n");
+        EASYPULSE_ERROR("Failed to allocate memory for source output driver");
     }
 
     // Increment the inputs counter
@@ -3308,7 +3487,7 @@ static void get_input_streams_cb(pa_context *c, const pa_source_output_info *o,
 input_stream_list *get_input_streams(pa_context *context) {
     input_stream_list *input_list = malloc(sizeof(input_stream_list));
     if (!input_list) {
-        fprintf(stderr, "Failed to allocate memory for input_stream_list\n");
+        EASYPULSE_ERROR("Failed to allocate memory for input_stream_list");
         return NULL;
     }
 
@@ -3318,7 +3497,7 @@ input_stream_list *get_input_streams(pa_context *context) {
     // Initiate the operation to get the list of source outputs
     pa_operation *op = pa_context_get_source_output_info_list(context, get_input_streams_cb, input_list);
     if (!op) {
-        fprintf(stderr, "Failed to start operation to get source output list\n");
+        EASYPULSE_ERROR("Failed to start operation to get source output list");
         free(input_list);
         return NULL;
     }
@@ -3345,10 +3524,8 @@ input_stream_list *get_input_streams(pa_context *context) {
 static void get_active_profile_cb(pa_context *c, const pa_card_info *i, int eol, void *userdata) {
     (void) c;
 
-    fprintf(stderr, "[DEBUG, card_info_cb()], reached function\n");
-
     card_profile_info *info = (card_profile_info *)userdata;
-    printf("[DEBUG] i is: %p\n", i);
+    EASYPULSE_DEBUG("i is: %p", (const void *) i);
 
     if (eol > 0 || !i) {
         pa_threaded_mainloop_signal(shared_data_1.mainloop, 0);
@@ -3366,7 +3543,7 @@ static void get_active_profile_cb(pa_context *c, const pa_card_info *i, int eol,
         }
     }
 
-    fprintf(stderr, "[DEBUG, card_info_cb()] card_info_cb is %s\n", i->active_profile->description);
+    EASYPULSE_DEBUG("Active profile is %s", i->active_profile ? i->active_profile->description : "(none)");
 }
 
 /**
@@ -3386,7 +3563,7 @@ pa_card_profile_info *get_active_profile(pa_context *context, char *card_name) {
     static card_profile_info info;
 
     if (!context) {
-        fprintf(stderr, "Invalid arguments.\n");
+        EASYPULSE_ERROR("Invalid arguments.");
         return NULL;
     }
 
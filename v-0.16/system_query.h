@@ -26,6 +26,10 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 //Structures to get source port information (e.g, line in, microphone...)
 //Used by get_source_port_info, get_active_port, and get_source_ports.
 typedef struct pa_port_info {
@@ -78,6 +82,14 @@ typedef struct input_stream_list {
     uint32_t num_inputs;
 } input_stream_list;
 
+//Period and buffer time ranges of a device, from get_output_buffer_range() and
+//get_input_buffer_range() or from the buffering properties of a sink or source (0 if unknown).
+typedef struct pcm_buffer_range {
+    unsigned int min_period_usec;
+    unsigned int max_period_usec;
+    unsigned int min_buffer_usec;
+    unsigned int max_buffer_usec;
+} pcm_buffer_range;
 
 void print_proplist(const pa_proplist *p);                                 // Utility function to print all properties in the proplist
 uint32_t get_output_device_count(void);                                    //Gets the number of output devices in the system.
@@ -95,10 +107,13 @@ pa_source_info* get_input_device_by_index(uint32_t index);                 //Get
 pa_source_info_list* get_source_port_info();                               //Returns which ports in the source are available (mic, line in...).
 
 
-char** get_input_channel_names(const char *pulse_id,
-int num_channels);                                                         //Returns the channel names of an input device.
-char** get_output_channel_names(const char *pulse_id,
-int num_channels);                                                         //Returns the channel names of an output device.
+const char* channel_position_name(pa_channel_position_t position);       //Static name of a channel position, or NULL if invalid.
+int channel_names_from_map(const pa_channel_map *map,
+const char **names, int count);                                            //Fills names from a channel map, without allocating.
+const char** get_input_channel_names(const char *pulse_id,
+int num_channels);                                                         //Returns the channel names of an input device (free the array only).
+const char** get_output_channel_names(const char *pulse_id,
+int num_channels);                                                         //Returns the channel names of an output device (free the array only).
 
 int get_min_input_channels(const char *alsa_id,
 const pa_source_info *source_info);                                        //Gets the minimum output channels an ALSA card supports.
@@ -122,6 +137,12 @@ const pa_sink_info *sink_info);                                            //Get
 int get_input_sample_rate(const char *alsa_id,
 pa_source_info *source_info);                                              //Gets the sample rate of a pulseaudio source (input device).
 
+bool get_output_buffer_range(const char *alsa_id,
+pcm_buffer_range *range);                                                  //Gets the period and buffer time ranges of an ALSA playback device.
+
+bool get_input_buffer_range(const char *alsa_id,
+pcm_buffer_range *range);                                                  //Gets the period and buffer time ranges of an ALSA capture device.
+
 pa_source_info *get_input_device_by_name(const char *pulse_code);          //Gets alsa name of a pulseaudio source (input device) by its name.
 pa_sink_info *get_output_device_by_name(const char *pulse_code);           //Gets alsa name of a pulseaudio sink (output device) by its name.
 
@@ -173,4 +194,8 @@ input_stream_list *get_input_streams(pa_context *context);                 //Get
 pa_card_profile_info *get_active_profile(pa_context *context,
 char *output_name);                                                        //Gets the active profile of a card.
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,95 @@
+/**
+ * @file easypulse_batch.c
+ * @brief Runs a script of mixer operations (see batch_script.h) over one connection.
+ *
+ * Provisioning a machine used to mean running one small program per operation, each
+ * connecting to the server and enumerating the devices again. This tool connects
+ * once and sends the whole script as one pipelined batch, then prints the outcome of
+ * every line.
+ *
+ * Usage: easypulse_batch [-l] [-q] [script]
+ *
+ *   -l  Lists the devices with their stable ids and exits.
+ *   -q  Prints only the lines that failed.
+ *
+ * The script is read from the standard input when no file is given. Exits with 1 if
+ * an operation failed, 2 if the script could not run.
+ */
+
+#include "../batch_script.h"
+#include "../easypulse_core.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static void list_devices(const char *kind, const pulseaudio_device *devices, uint32_t count, const char *active) {
+    for (uint32_t i = 0; i < count; ++i) {
+        bool is_default = active && devices[i].code && strcmp(active, devices[i].code) == 0;
+        printf("%c %-6s %3u " MANAGER_STABLE_ID_FORMAT " %s \"%s\"\n", is_default ? '*' : ' ', kind,
+               devices[i].index, manager_device_stable_id(devices[i].code), devices[i].code,
+               devices[i].name ? devices[i].name : "");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bool list = false;
+    bool quiet = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "lq")) != -1) {
+        switch (opt) {
+            case 'l':
+                list = true;
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-l] [-q] [script]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    FILE *file = stdin;
+    if (!list && optind < argc && !(file = fopen(argv[optind], "r"))) {
+        perror(argv[optind]);
+        return 2;
+    }
+
+    pulseaudio_manager *manager = manager_create();
+    if (!manager) {
+        fprintf(stderr, "Failed to initialize PulseAudio manager\n");
+        return 2;
+    }
+
+    if (list) {
+        list_devices("output", manager->outputs, manager->output_count, manager->active_output_device);
+        list_devices("input", manager->inputs, manager->input_count, manager->active_input_device);
+        manager_cleanup(manager);
+        return 0;
+    }
+
+    script_report *report = script_run_file(manager, file);
+    if (file != stdin) {
+        fclose(file);
+    }
+    if (!report) {
+        manager_cleanup(manager);
+        return 2;
+    }
+
+    for (uint32_t i = 0; i < report->count; ++i) {
+        const script_result *result = &report->results[i];
+        if (!result->success) {
+            printf("line %u: ERR %s\n", result->line, result->message);
+        } else if (!quiet) {
+            printf("line %u: OK\n", result->line);
+        }
+    }
+    printf("%u operations, %u failed\n", report->count, report->failed);
+
+    int status = report->failed > 0 ? 1 : 0;
+    script_report_free(report);
+    manager_cleanup(manager);
+    return status;
+}